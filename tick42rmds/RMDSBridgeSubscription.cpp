@@ -31,6 +31,8 @@
 #include "UPASubscription.h"
 #include "msg.h"
 #include "utils/t42log.h"
+#include "utils/time.h"
+#include "StatisticsLogger.h"
 
 RMDSBridgeSubscription::RMDSBridgeSubscription(void)
 {
@@ -96,6 +98,12 @@ typedef struct
     mamaMsg msg;
     mamaSubscription subscription;
     UPASubscription_ptr_t upaSubscription;
+
+    // the conflation state of the queue the message is on, if the subscription conflates
+    UPASubscription::AsyncQueueState_ptr_t queueState;
+
+    // when the message was queued, for the queue residency statistics. 0 if they are not being collected
+    RsslUInt64 enqueueTime;
 } queueCallbackData;
 
 void MAMACALLTYPE
@@ -103,24 +111,42 @@ queueCallback(mamaQueue queue, void* closure)
 {
     queueCallbackData* data = (queueCallbackData*) closure;
 
+    if (data->enqueueTime != 0)
+    {
+        StatisticsLogger::GetStatisticsLogger()->RecordQueueResidency(utils::time::GetMicroCount() - data->enqueueTime);
+    }
+
     /* Process the message as normal */
     mamaMsgImpl_setQueue(data->msg, queue);
     mama_status status = mamaSubscription_processMsg(data->subscription,
                                                      data->msg);
 
+    if (data->queueState)
+    {
+        data->upaSubscription->AsyncMessageDispatched(data->queueState);
+    }
+
+    // the message is shared by all the queues the update was fanned out to. The last one to dispatch it gives it back
+    // to the subscription's message pool
     msgBridge bridgeMessage;
     mamaMsgImpl_getBridgeMsg(data->msg, &bridgeMessage);
-    tick42rmdsBridgeMamaMsgImpl_decreaseReferences(bridgeMessage);
 
     size_t references = 0;
-    tick42rmdsBridgeMamaMsgImpl_getReferences(bridgeMessage, references);
-    if (references <= 0)
+    tick42rmdsBridgeMamaMsgImpl_decreaseReferences(bridgeMessage, references);
+    if (references == 0)
     {
         bool detached = false;
         tick42rmdsBridgeMamaMsgImpl_isDetached(bridgeMessage, detached);
         if (!detached)
         {
-            mamaMsg_destroy(data->msg);
+            if (data->upaSubscription)
+            {
+                data->upaSubscription->ReleaseAsyncMessage(data->msg);
+            }
+            else
+            {
+                mamaMsg_destroy(data->msg);
+            }
         }
     }
 
@@ -169,8 +195,28 @@ void RMDSBridgeSubscription::OnMessage(mamaMsg msg, mamaMsgType msgType, bool as
             data->msg = msg;
             data->subscription = subscription_;
             data->upaSubscription = UpaSubscription_;
+            data->enqueueTime = StatisticsLogger::GetStatisticsLogger()->Enabled() ? utils::time::GetMicroCount() : 0;
+            if (UpaSubscription_)
+            {
+                data->queueState = UpaSubscription_->AsyncMessageQueued(queue_);
+            }
+
+            // the queue holds a reference to the shared message until it has been dispatched
+            msgBridge bridgeMessage;
+            mamaMsgImpl_getBridgeMsg(msg, &bridgeMessage);
+            tick42rmdsBridgeMamaMsgImpl_increaseReferences(bridgeMessage);
 
             status = mamaQueue_enqueueEvent(queue_, queueCallback, data);
+            if (MAMA_STATUS_OK != status)
+            {
+                // the sender still holds its own reference so this cant be the last one
+                tick42rmdsBridgeMamaMsgImpl_decreaseReferences(bridgeMessage);
+                if (data->queueState)
+                {
+                    UpaSubscription_->AsyncMessageDispatched(data->queueState);
+                }
+                delete data;
+            }
         }
         else
         {
@@ -29,6 +29,10 @@
 
 #include <utils/t42log.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
 #ifdef ENABLE_TICK42_ENHANCED
 // Additional functionality provided by the enhanced bridge is available as part of a a support package
 // please contact support@tick42.com
@@ -41,7 +45,8 @@ RMDSSource::RMDSSource(const std::string& serviceName, const RsslUInt64 serviceI
     serviceName_(serviceName),
     serviceId_(serviceId),
     consumer_(consumer),
-    pausedUpdates_(false)
+    pausedUpdates_(false),
+    viewBuilt_(false)
 {
     // sort out the default domain for this service
     std::string configDomain = consumer_->GetOwner()->Config()->getServicePropertyString(serviceName,"domain","any");
@@ -74,6 +79,12 @@ RMDSSource::RMDSSource(const std::string& serviceName, const RsslUInt64 serviceI
         sourceDomain_ =  UPASubscription::SubscriptionTypeUnknown;
         t42log_info("%s %s", serviceName.c_str(), "(none)");
     }
+
+    // views can be set for the transport and overridden for each source, and configuring the fields implies a view
+    const TransportConfig_ptr_t& config = consumer_->GetOwner()->Config();
+    viewFieldsConfig_ = config->getServicePropertyString(serviceName, "view-fields", "");
+    bool viewRequests = config->getBool("view-requests", Default_viewRequests) || !viewFieldsConfig_.empty();
+    viewRequests_ = config->getServicePropertyBool(serviceName, "view-requests", viewRequests);
 }
 
 RMDSSource::~RMDSSource()
@@ -100,7 +111,12 @@ bool RMDSSource::AddSubscription(const UPASubscription_ptr_t& sub)
 
     if (sub != 0)
     {
-        subscriptions_[sub->Symbol()] = sub;
+        UPASubscription_ptr_t& entry = subscriptions_[sub->Symbol()];
+        if (entry != 0 && entry != sub)
+        {
+            RemoveFromGroup(entry.get());
+        }
+        entry = sub;
         return true;
     }
     return false;
@@ -132,6 +148,7 @@ bool RMDSSource::RemoveSubscription(const std::string& symbol)
     {
         //printf("remove RMDSBridgeSubscription from source %s, 0x%x\n", symbol.c_str(), it->second.get());
         itSubscription->second->Close();
+        RemoveFromGroup(itSubscription->second.get());
         subscriptions_.erase(itSubscription);
 
         return true;
@@ -141,8 +158,11 @@ bool RMDSSource::RemoveSubscription(const std::string& symbol)
     return false;
 }
 
-bool RMDSSource::SetStale()
+bool RMDSSource::SetStale(const UPAConsumer * consumer)
 {
+    DropTransitions(consumer);
+    DropItemGroups(consumer);
+
     // set all the subscriptions stale
     T42Lock lock(&subscriptionMapLock_);
 
@@ -151,7 +171,10 @@ bool RMDSSource::SetStale()
     while(itSubscription != subscriptions_.end())
     {
         const UPASubscription_ptr_t& subscription = itSubscription->second;
-        subscription->SetStale(NULL);
+        if (consumer == 0 || subscription->Consumer().get() == consumer)
+        {
+            subscription->SetStale(NULL);
+        }
         ++itSubscription;
     }
 
@@ -160,6 +183,8 @@ bool RMDSSource::SetStale()
 
 bool RMDSSource::SetLive()
 {
+    DropTransitions(0);
+
     // set all the subscriptions live
     T42Lock lock(&subscriptionMapLock_);
 
@@ -180,10 +205,25 @@ void RMDSSource::SetState(ServiceState newState)
 
     state_ = newState;
 
+    if (oldState == newState.state)
+    {
+        return;
+    }
+
+    std::vector<UPASubscription_ptr_t> items;
+    {
+        T42Lock lock(&subscriptionMapLock_);
+        items.reserve(subscriptions_.size());
+        for (SubscriptionMap_t::const_iterator it = subscriptions_.begin(); it != subscriptions_.end(); ++it)
+        {
+            items.push_back(it->second);
+        }
+    }
+
     if (oldState && !newState.state)
     // was up and now down
     {
-        SetStale();
+        QueueTransition(TransitionStale, items, "", true);
     }
 
     // cant rely on the TREP to always send image / live status when the source recovers. non-interactive sources may not
@@ -192,14 +232,16 @@ void RMDSSource::SetState(ServiceState newState)
     if (!oldState && newState.state)
     // was down and now up
     {
-        SetLive();
+        QueueTransition(TransitionLive, items, "", true);
     }
     // other combinations oldstate=Up + newstate = up, oldstate =down + newstate = down and oldstate=down and new state = up can be ignored
     // the last of these - service recovery should result in new image and status from rmds
 }
 
-bool RMDSSource::ReSubscribe()
+bool RMDSSource::ReSubscribe(const UPAConsumer * consumer)
 {
+    DropTransitions(consumer);
+
     // set all the subscriptions stale
     T42Lock lock(&subscriptionMapLock_);
 
@@ -208,9 +250,525 @@ bool RMDSSource::ReSubscribe()
     while(itSubscription != subscriptions_.end())
     {
         const UPASubscription_ptr_t& subscription = itSubscription->second;
-        subscription->ReSubscribe();
+        if (consumer == 0 || subscription->Consumer().get() == consumer)
+        {
+            subscription->ReSubscribe();
+        }
         ++itSubscription;
     }
     return true;
 }
 
+void RMDSSource::TakeForResubscribe(const UPAConsumer * consumer, std::vector<UPASubscription_ptr_t>& items)
+{
+    DropTransitions(consumer);
+
+    T42Lock lock(&subscriptionMapLock_);
+    for (SubscriptionMap_t::const_iterator it = subscriptions_.begin(); it != subscriptions_.end(); ++it)
+    {
+        if (consumer == 0 || it->second->Consumer().get() == consumer)
+        {
+            items.push_back(it->second);
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// queued state transitions
+void RMDSSource::QueueTransition(TransitionAction action, std::vector<UPASubscription_ptr_t>& items, const std::string& text,
+    bool wholeSource)
+{
+    // split the items by the consumer they are on
+    std::vector<UPAConsumer_ptr_t> consumers;
+    std::vector<std::vector<UPASubscription_ptr_t> > consumerItems;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        const UPAConsumer_ptr_t& consumer = items[i]->Consumer();
+        size_t index = std::find(consumers.begin(), consumers.end(), consumer) - consumers.begin();
+        if (index == consumers.size())
+        {
+            consumers.push_back(consumer);
+            consumerItems.push_back(std::vector<UPASubscription_ptr_t>());
+        }
+        consumerItems[index].push_back(items[i]);
+    }
+    items.clear();
+
+    {
+        T42Lock lock(&transitionLock_);
+        if (wholeSource)
+        {
+            transitions_.clear();
+        }
+
+        for (size_t i = 0; i < consumers.size(); ++i)
+        {
+            TransitionQueue_t& queue = transitions_[consumers[i].get()];
+            queue.push_back(Transition());
+            Transition& transition = queue.back();
+            transition.action_ = action;
+            transition.text_ = text;
+            transition.items_.swap(consumerItems[i]);
+            transition.next_ = 0;
+        }
+    }
+
+    // the consumers may be blocked waiting for their channels
+    for (size_t i = 0; i < consumers.size(); ++i)
+    {
+        if (consumers[i])
+        {
+            consumers[i]->Wakeup();
+        }
+    }
+}
+
+void RMDSSource::DropTransitions(const UPAConsumer * consumer)
+{
+    T42Lock lock(&transitionLock_);
+    if (consumer == 0)
+    {
+        transitions_.clear();
+        return;
+    }
+
+    transitions_.erase(consumer);
+}
+
+bool RMDSSource::TransitionsPending(const UPAConsumer * consumer) const
+{
+    T42Lock lock(&transitionLock_);
+    ShardTransitions_t::const_iterator it = transitions_.find(consumer);
+    return it != transitions_.end() && !it->second.empty();
+}
+
+size_t RMDSSource::ProcessTransitions(const UPAConsumer * consumer, size_t maxItems)
+{
+    // take the slice off the queue, then apply it without the lock as the subscriptions call out to the listeners
+    std::vector<Transition> slice;
+    size_t count = 0;
+    {
+        T42Lock lock(&transitionLock_);
+        ShardTransitions_t::iterator itQueue = transitions_.find(consumer);
+        if (itQueue == transitions_.end())
+        {
+            return 0;
+        }
+
+        TransitionQueue_t& transitions = itQueue->second;
+        while (!transitions.empty() && count < maxItems)
+        {
+            Transition& transition = transitions.front();
+            size_t n = (std::min)(maxItems - count, transition.items_.size() - transition.next_);
+
+            slice.push_back(Transition());
+            Transition& part = slice.back();
+            part.action_ = transition.action_;
+            part.text_ = transition.text_;
+            part.items_.assign(transition.items_.begin() + transition.next_, transition.items_.begin() + transition.next_ + n);
+            part.next_ = 0;
+
+            transition.next_ += n;
+            count += n;
+            if (transition.next_ == transition.items_.size())
+            {
+                transitions.pop_front();
+            }
+        }
+
+        if (transitions.empty())
+        {
+            transitions_.erase(itQueue);
+        }
+    }
+
+    for (size_t i = 0; i < slice.size(); ++i)
+    {
+        const Transition& part = slice[i];
+        const char * text = part.text_.empty() ? NULL : part.text_.c_str();
+        for (size_t j = 0; j < part.items_.size(); ++j)
+        {
+            const UPASubscription_ptr_t& subscription = part.items_[j];
+            switch (part.action_)
+            {
+            case TransitionStale:
+                subscription->SetStale(text);
+                break;
+
+            case TransitionLive:
+                subscription->SetLive();
+                break;
+
+            case TransitionRecover:
+                if (subscription->SetStale(text))
+                {
+                    subscription->ReSubscribe();
+                }
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// item groups
+void RMDSSource::SetItemGroup(const UPASubscription_ptr_t& sub, const RsslBuffer& groupId)
+{
+    const UPAConsumer * consumer = sub->Consumer().get();
+
+    T42Lock lock(&groupLock_);
+
+    ItemGroupIndex_t::iterator it = itemGroupIndex_.find(sub.get());
+    if (it != itemGroupIndex_.end())
+    {
+        const ItemGroupKey_t& current = it->second;
+        if (current.first == consumer && current.second.length() == groupId.length
+            && memcmp(current.second.data(), groupId.data, groupId.length) == 0)
+        {
+            // the usual case, the item is still in the same group
+            return;
+        }
+
+        EraseGroupMember(current, sub.get());
+    }
+
+    std::string group(groupId.data, groupId.length);
+    itemGroups_[consumer][group][sub.get()] = sub;
+    itemGroupIndex_[sub.get()] = ItemGroupKey_t(consumer, group);
+}
+
+void RMDSSource::RemoveFromGroup(UPASubscription * sub)
+{
+    T42Lock lock(&groupLock_);
+
+    ItemGroupIndex_t::iterator it = itemGroupIndex_.find(sub);
+    if (it == itemGroupIndex_.end())
+    {
+        return;
+    }
+
+    EraseGroupMember(it->second, sub);
+    itemGroupIndex_.erase(it);
+}
+
+void RMDSSource::DropItemGroups(const UPAConsumer * consumer)
+{
+    T42Lock lock(&groupLock_);
+    if (consumer == 0)
+    {
+        itemGroups_.clear();
+        itemGroupIndex_.clear();
+        return;
+    }
+
+    itemGroups_.erase(consumer);
+
+    ItemGroupIndex_t::iterator it = itemGroupIndex_.begin();
+    while (it != itemGroupIndex_.end())
+    {
+        if (it->second.first == consumer)
+        {
+            it = itemGroupIndex_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// called with the group lock held
+void RMDSSource::EraseGroupMember(const ItemGroupKey_t& key, UPASubscription * sub)
+{
+    ShardItemGroups_t::iterator itShard = itemGroups_.find(key.first);
+    if (itShard == itemGroups_.end())
+    {
+        return;
+    }
+
+    ItemGroups_t::iterator itGroup = itShard->second.find(key.second);
+    if (itGroup != itShard->second.end())
+    {
+        itGroup->second.erase(sub);
+        if (itGroup->second.empty())
+        {
+            itShard->second.erase(itGroup);
+        }
+    }
+}
+
+void RMDSSource::UpdateItemGroups(const UPAConsumer * consumer, const RsslServiceGroupInfo* groups, RsslUInt32 count)
+{
+    for (RsslUInt32 i = 0; i < count; ++i)
+    {
+        const RsslServiceGroupInfo& info = groups[i];
+        if (info.GroupLength == 0)
+        {
+            continue;
+        }
+
+        std::string group((const char *)info.Group, info.GroupLength);
+
+        // the status applies to the group as it was, before any merge
+        if (info.HasStatus)
+        {
+            SetGroupState(consumer, group, info.Status);
+        }
+
+        if (info.MergedToGroupLength > 0)
+        {
+            MergeGroup(consumer, group, std::string((const char *)info.MergedToGroup, info.MergedToGroupLength));
+        }
+    }
+}
+
+void RMDSSource::MergeGroup(const UPAConsumer * consumer, const std::string& group, const std::string& mergedTo)
+{
+    T42Lock lock(&groupLock_);
+
+    ShardItemGroups_t::iterator itShard = itemGroups_.find(consumer);
+    if (itShard == itemGroups_.end() || group == mergedTo)
+    {
+        return;
+    }
+
+    ItemGroups_t& groups = itShard->second;
+    ItemGroups_t::iterator it = groups.find(group);
+    if (it == groups.end())
+    {
+        return;
+    }
+
+    GroupMembers_t members;
+    members.swap(it->second);
+    groups.erase(it);
+
+    GroupMembers_t& target = groups[mergedTo];
+    for (GroupMembers_t::iterator itMember = members.begin(); itMember != members.end(); ++itMember)
+    {
+        target[itMember->first] = itMember->second;
+        itemGroupIndex_[itMember->first] = ItemGroupKey_t(consumer, mergedTo);
+    }
+
+    t42log_info("Source %s merged an item group of %u items into another of %u items\n", serviceName_.c_str(),
+        (unsigned int)members.size(), (unsigned int)target.size());
+}
+
+void RMDSSource::SetGroupState(const UPAConsumer * consumer, const std::string& group, const RsslState& state)
+{
+    TransitionAction action;
+    if (state.streamState == RSSL_STREAM_CLOSED_RECOVER)
+    {
+        action = TransitionRecover;
+    }
+    else if (state.streamState == RSSL_STREAM_CLOSED || state.dataState == RSSL_DATA_SUSPECT)
+    {
+        action = TransitionStale;
+    }
+    else if (state.dataState == RSSL_DATA_OK)
+    {
+        action = TransitionLive;
+    }
+    else
+    {
+        return;
+    }
+
+    std::vector<UPASubscription_ptr_t> items;
+    {
+        T42Lock lock(&groupLock_);
+        ShardItemGroups_t::const_iterator itShard = itemGroups_.find(consumer);
+        if (itShard == itemGroups_.end())
+        {
+            return;
+        }
+
+        ItemGroups_t::const_iterator it = itShard->second.find(group);
+        if (it == itShard->second.end())
+        {
+            return;
+        }
+
+        items.reserve(it->second.size());
+        for (GroupMembers_t::const_iterator itMember = it->second.begin(); itMember != it->second.end(); ++itMember)
+        {
+            items.push_back(itMember->second);
+        }
+    }
+
+    std::string text;
+    if (state.text.data != 0)
+    {
+        text.assign(state.text.data, state.text.length);
+    }
+
+    t42log_info("Source %s item group status %s/%s applies to %u items\n", serviceName_.c_str(),
+        rsslStreamStateToString(state.streamState), rsslDataStateToString(state.dataState), (unsigned int)items.size());
+
+    QueueTransition(action, items, text, false);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RDM views
+bool RMDSSource::HasView()
+{
+    if (!viewRequests_)
+    {
+        return false;
+    }
+
+    T42Lock lock(&viewLock_);
+    if (!viewBuilt_ || viewFieldMap_ != consumer_->GetOwner()->FieldMap())
+    {
+        BuildView();
+    }
+
+    return !viewFields_.empty();
+}
+
+RsslUInt32 RMDSSource::ViewBytes()
+{
+    T42Lock lock(&viewLock_);
+
+    // the element names and headers, then two bytes a fid
+    return 32 + (RsslUInt32)viewFields_.size() * 2;
+}
+
+RsslRet RMDSSource::EncodeView(RsslEncodeIterator* iter)
+{
+    T42Lock lock(&viewLock_);
+
+    RsslRet ret = 0;
+    RsslElementEntry element = RSSL_INIT_ELEMENT_ENTRY;
+    RsslUInt viewType = RDM_VIEW_TYPE_FIELD_ID_LIST;
+    element.name = RSSL_ENAME_VIEW_TYPE;
+    element.dataType = RSSL_DT_UINT;
+    if ((ret = rsslEncodeElementEntry(iter, &element, &viewType)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeElementEntry() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    rsslClearElementEntry(&element);
+    element.name = RSSL_ENAME_VIEW_DATA;
+    element.dataType = RSSL_DT_ARRAY;
+    if ((ret = rsslEncodeElementEntryInit(iter, &element, 0)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeElementEntryInit() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    RsslArray viewData = RSSL_INIT_ARRAY;
+    viewData.primitiveType = RSSL_DT_INT;
+    viewData.itemLength = 2;
+    if ((ret = rsslEncodeArrayInit(iter, &viewData)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeArrayInit() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    for (size_t i = 0; i < viewFields_.size(); ++i)
+    {
+        RsslInt fid = viewFields_[i];
+        if ((ret = rsslEncodeArrayEntry(iter, 0, &fid)) < RSSL_RET_SUCCESS)
+        {
+            t42log_error("rsslEncodeArrayEntry() failed with return code: %d\n", ret);
+            return ret;
+        }
+    }
+
+    if ((ret = rsslEncodeArrayComplete(iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeArrayComplete() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    if ((ret = rsslEncodeElementEntryComplete(iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeElementEntryComplete() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+// called with the view lock held
+void RMDSSource::BuildView()
+{
+    viewBuilt_ = true;
+    viewFieldMap_ = consumer_->GetOwner()->FieldMap();
+    viewFields_.clear();
+
+    if (viewFieldsConfig_.empty())
+    {
+        if (viewFieldMap_ == 0 || !viewFieldMap_->GetTranslatedFids(viewFields_))
+        {
+            t42log_warn("Source %s passes on non-translated fields, so items are requested without a view\n", serviceName_.c_str());
+        }
+        else
+        {
+            t42log_info("Source %s requests a view of the %u fields in the field map\n", serviceName_.c_str(), (unsigned int)viewFields_.size());
+        }
+        return;
+    }
+
+    // the configured list is separated by commas or spaces, and each is either a fid or an rmds field name
+    const RsslDataDictionary * dictionary = 0;
+    UPADictionaryWrapper_ptr_t dictionaryWrapper = consumer_->RsslDictionary();
+    if (dictionaryWrapper != 0)
+    {
+        dictionary = &dictionaryWrapper->GetRawDictionary();
+    }
+
+    std::string::size_type pos = 0;
+    while (pos < viewFieldsConfig_.length())
+    {
+        std::string::size_type end = viewFieldsConfig_.find_first_of(", ", pos);
+        if (end == std::string::npos)
+        {
+            end = viewFieldsConfig_.length();
+        }
+
+        std::string field = viewFieldsConfig_.substr(pos, end - pos);
+        pos = end + 1;
+        if (field.empty())
+        {
+            continue;
+        }
+
+        char * parseEnd = 0;
+        long fid = strtol(field.c_str(), &parseEnd, 10);
+        if (*parseEnd == '\0')
+        {
+            viewFields_.push_back((RsslFieldId)fid);
+            continue;
+        }
+
+        bool found = false;
+        if (dictionary != 0 && dictionary->entriesArray != 0)
+        {
+            for (int i = dictionary->minFid; i <= dictionary->maxFid && !found; ++i)
+            {
+                const RsslDictionaryEntry * entry = dictionary->entriesArray[i];
+                if (entry != 0 && entry->acronym.length == field.length()
+                    && memcmp(entry->acronym.data, field.c_str(), field.length()) == 0)
+                {
+                    viewFields_.push_back((RsslFieldId)i);
+                    found = true;
+                }
+            }
+        }
+
+        if (!found)
+        {
+            t42log_warn("Source %s view field %s is not in the dictionary\n", serviceName_.c_str(), field.c_str());
+        }
+    }
+
+    std::sort(viewFields_.begin(), viewFields_.end());
+    viewFields_.erase(std::unique(viewFields_.begin(), viewFields_.end()), viewFields_.end());
+    t42log_info("Source %s requests a view of %u configured fields\n", serviceName_.c_str(), (unsigned int)viewFields_.size());
+}
@@ -28,8 +28,11 @@
 
 #include "UPASubscription.h"
 #include "RMDSBridgeSubscription.h"
+#include "SourceDirectoryTypes.h"
 #include <utils/thread/lock.h>
 
+#include <deque>
+
 struct ServiceState
 {
     bool state;
@@ -83,12 +86,32 @@ public:
 
     bool FindSubscription(const std::string & symbol, UPASubscription_ptr_t & sub);
 
-    // manage the state
+    // manage the state. The stale / live transitions that follow a change to the source state are applied a slice at a
+    // time by ProcessTransitions, so a large source doesnt hold up the consumer thread
     void SetState(ServiceState state);
 
-    bool SetStale();
+    // a null consumer applies to all the subscriptions, otherwise just to those on that consumer
+    bool SetStale(const UPAConsumer * consumer = 0);
     bool SetLive();
-    bool ReSubscribe();
+    bool ReSubscribe(const UPAConsumer * consumer = 0);
+
+    // takes the subscriptions that ReSubscribe would reopen, so that RMDSSources can reopen those on all the sources
+    // in order of their activity
+    void TakeForResubscribe(const UPAConsumer * consumer, std::vector<UPASubscription_ptr_t>& items);
+
+    // apply up to maxItems of the queued state transitions for the items on the consumer, returning the number applied.
+    // Each consumer applies its own, on its own thread, as the items decode into the consumer's shared message
+    size_t ProcessTransitions(const UPAConsumer * consumer, size_t maxItems);
+    bool TransitionsPending(const UPAConsumer * consumer) const;
+
+    // Item groups
+    //
+    // Each streaming item is indexed by the group id of its last refresh, so the group status and merges in the source
+    // directory only touch the items in the group rather than every item on the source. The ADS assigns the group ids
+    // for each connection, so the groups are kept for each consumer shard, and each shard's source directory only
+    // applies to the items on that shard
+    void SetItemGroup(const UPASubscription_ptr_t& sub, const RsslBuffer& groupId);
+    void UpdateItemGroups(const UPAConsumer * consumer, const RsslServiceGroupInfo* groups, RsslUInt32 count);
 
     // pause / resume updates
     bool IsPausedUpdates() const
@@ -108,6 +131,20 @@ public:
     // This is either set by config or implied by the symbol name
     UPASubscription::UPASubscriptionType SourceDomain() const { return sourceDomain_; }
 
+    // RDM views
+    //
+    // With view-requests set, or a view-fields list configured for the source, items are requested with a view so the
+    // provider only sends the fields that get passed on. The view is the view-fields list (rmds field names or fids)
+    // if there is one, otherwise every fid in the field map. There is no field map view when it passes on
+    // non-translated fields, as then every field is wanted
+    bool HasView();
+
+    // encoded size of the view, to allow for when sizing batch requests
+    RsslUInt32 ViewBytes();
+
+    // encode the :ViewType and :ViewData entries into the request's element list
+    RsslRet EncodeView(RsslEncodeIterator* iter);
+
 
 private:
     RsslUInt64 serviceId_;
@@ -131,6 +168,63 @@ private:
 
     UPASubscription::UPASubscriptionType sourceDomain_;
 
+    // the items in each group on each consumer shard, and the shard and group each item is in
+    typedef utils::collection::unordered_map<UPASubscription *, UPASubscription_ptr_t> GroupMembers_t;
+    typedef utils::collection::unordered_map<std::string, GroupMembers_t> ItemGroups_t;
+    typedef utils::collection::unordered_map<const UPAConsumer *, ItemGroups_t> ShardItemGroups_t;
+    typedef std::pair<const UPAConsumer *, std::string> ItemGroupKey_t;
+    typedef utils::collection::unordered_map<UPASubscription *, ItemGroupKey_t> ItemGroupIndex_t;
+    ShardItemGroups_t itemGroups_;
+    ItemGroupIndex_t itemGroupIndex_;
+    mutable utils::thread::lock_t groupLock_;
+
+    void RemoveFromGroup(UPASubscription * sub);
+
+    // the group ids dont outlive the consumer's channel. The items join their groups again from their next refreshes
+    void DropItemGroups(const UPAConsumer * consumer);
+    void EraseGroupMember(const ItemGroupKey_t& key, UPASubscription * sub);
+    void MergeGroup(const UPAConsumer * consumer, const std::string& group, const std::string& mergedTo);
+    void SetGroupState(const UPAConsumer * consumer, const std::string& group, const RsslState& state);
+
+    // queued stale / live transitions
+    enum TransitionAction
+    {
+        TransitionStale = 0,
+        TransitionLive,
+        TransitionRecover   // stale, then re-request the item
+    };
+
+    struct Transition
+    {
+        TransitionAction action_;
+        std::string text_;
+        std::vector<UPASubscription_ptr_t> items_;
+        size_t next_;
+    };
+
+    // queued for each consumer
+    typedef std::deque<Transition> TransitionQueue_t;
+    typedef utils::collection::unordered_map<const UPAConsumer *, TransitionQueue_t> ShardTransitions_t;
+    ShardTransitions_t transitions_;
+    mutable utils::thread::lock_t transitionLock_;
+
+    // a transition for the whole source replaces any that are queued. The items are split by consumer, and each
+    // consumer that is given some is woken to apply them
+    void QueueTransition(TransitionAction action, std::vector<UPASubscription_ptr_t>& items, const std::string& text,
+        bool wholeSource);
+
+    // the synchronous state changes drop the queued transitions for the consumer's items
+    void DropTransitions(const UPAConsumer * consumer);
+
+    bool viewRequests_;
+    std::string viewFieldsConfig_;
+    std::vector<RsslFieldId> viewFields_;
+
+    // the field map the view was built from, as the view follows the subscriber's field map
+    UpaMamaFieldMap_ptr_t viewFieldMap_;
+    bool viewBuilt_;
+    mutable utils::thread::lock_t viewLock_;
+    void BuildView();
 
 };
 
@@ -33,6 +33,8 @@
 
 #include <utils/t42log.h>
 
+#include <algorithm>
+
 using namespace utils::thread;
 
 //////////////////////////////////////////////////////////////////////////
@@ -134,13 +136,13 @@ void RMDSSources::Shutdown()
 #endif // ENABLE_TICK42_ENHANCED
 }
 
-bool RMDSSources::SetAllStale()
+bool RMDSSources::SetAllStale(const UPAConsumer * consumer)
 {
     services_t::const_iterator itSources = servicesMap_.begin();
 
     while(itSources != servicesMap_.end())
     {
-        itSources->second->SetStale();
+        itSources->second->SetStale(consumer);
         ++itSources;
     }
 
@@ -148,16 +150,57 @@ bool RMDSSources::SetAllStale()
 
 }
 
-bool RMDSSources::ResubscribeAll()
+bool RMDSSources::ProcessTransitions(const UPAConsumer * consumer, size_t maxItems)
+{
+    bool pending = false;
+    services_t::const_iterator itSources = servicesMap_.begin();
+
+    while(itSources != servicesMap_.end())
+    {
+        if (maxItems > 0)
+        {
+            maxItems -= itSources->second->ProcessTransitions(consumer, maxItems);
+        }
+        pending = pending || itSources->second->TransitionsPending(consumer);
+        ++itSources;
+    }
+
+    return pending;
+}
+
+namespace
+{
+    bool MoreRecentlyActive(const UPASubscription_ptr_t& lhs, const UPASubscription_ptr_t& rhs)
+    {
+        return lhs->LastActivity() > rhs->LastActivity();
+    }
+}
+
+bool RMDSSources::ResubscribeAll(const UPAConsumer * consumer)
 {
+    // the open window lets the re-requests out a few at a time, so send the items that were ticking most recently
+    // first and the ones that havent ticked at all last. Those are the ones the applications are most likely to be
+    // waiting on
+    std::vector<UPASubscription_ptr_t> items;
     services_t::const_iterator itSources = servicesMap_.begin();
 
     while(itSources != servicesMap_.end())
     {
-        itSources->second->ReSubscribe();
+        itSources->second->TakeForResubscribe(consumer, items);
         ++itSources;
     }
 
+    std::stable_sort(items.begin(), items.end(), MoreRecentlyActive);
+
+    for (std::vector<UPASubscription_ptr_t>::const_iterator it = items.begin(); it != items.end(); ++it)
+    {
+        // skip any closed since we took them
+        if ((*it)->GetSubscriptionState() != UPASubscription::SubscriptionStateInactive)
+        {
+            (*it)->ReSubscribe();
+        }
+    }
+
     return true;
 }
 
@@ -54,9 +54,13 @@ public:
     bool Find(RsslUInt64 keyId, RMDSSource_ptr_t &value) const;
     bool Find(const std::string& keyName, RMDSSource_ptr_t &value) const;
 
-    // manage state
-    bool SetAllStale();
-    bool ResubscribeAll();
+    // manage state. If a consumer is given then only the subscriptions on that consumer are affected
+    bool SetAllStale(const UPAConsumer * consumer = 0);
+    bool ResubscribeAll(const UPAConsumer * consumer = 0);
+
+    // apply up to maxItems of the sources' queued state transitions for the items on the consumer, returning true if
+    // there are more to do
+    bool ProcessTransitions(const UPAConsumer * consumer, size_t maxItems);
 
     // We need to stop updates being sent while closing down
     void PauseUpdates();
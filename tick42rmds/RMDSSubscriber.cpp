@@ -38,15 +38,13 @@
 #include <utils/t42log.h>
 #include <utils/threadMonitor.h>
 
-extern "C"
-{
-   fd_set wrtfds;
-}
-
 RMDSSubscriber::RMDSSubscriber(const UPATransportNotifier &notify)
    : notify_(notify)
-   , hConsumerThread_(0)
-
+   , numConsumers_(1)
+   , decodePlanGeneration_(0)
+   , stateSliceSize_(Default_stateSliceSize)
+   , fastReconnect_(Default_fastReconnect)
+   , fastRecovering_(false)
 {
    sources_ = boost::make_shared<RMDSSources>();
 
@@ -73,17 +71,45 @@ bool RMDSSubscriber::Initialize( mamaBridge bridgeImpl, mamaTransport transport,
 
    t42log_debug( "RMDSSubscriber::Initialize(): Entering.");
 
-   // create a queue
-   if (MAMA_STATUS_OK !=
-      (status =  mamaQueue_create (&upaRequestQueue_, bridgeImpl)))
+   int consumers = config_->getInt("consumers", Default_consumers);
+   numConsumers_ = (consumers > 1) ? (size_t)consumers : 1;
+
+   // create a queue for each consumer
+   for (size_t shard = 0; shard < numConsumers_; ++shard)
    {
-      mama_log (MAMA_LOG_LEVEL_ERROR,
-                "RMDSSubscriber::Initialize:"
-                "Failed to create upa command queue.");
-      return false;
+      mamaQueue queue;
+      if (MAMA_STATUS_OK !=
+         (status =  mamaQueue_create (&queue, bridgeImpl)))
+      {
+         mama_log (MAMA_LOG_LEVEL_ERROR,
+                   "RMDSSubscriber::Initialize:"
+                   "Failed to create upa command queue.");
+         return false;
+      }
+
+      if (shard == 0)
+      {
+         mamaQueue_setQueueName(queue, "UPA_SUBSCRIBER_QUEUE");
+      }
+      else
+      {
+         char queueName[64];
+         snprintf(queueName, sizeof(queueName), "UPA_SUBSCRIBER_QUEUE_%u", (unsigned int)shard);
+         mamaQueue_setQueueName(queue, queueName);
+      }
+
+      requestQueues_.push_back(queue);
    }
 
-   mamaQueue_setQueueName(upaRequestQueue_, "UPA_SUBSCRIBER_QUEUE");
+   upaRequestQueue_ = requestQueues_[0];
+
+   int poolSize = config_->getInt("async-message-pool", Default_asyncMessagePool);
+   messagePool_ = boost::make_shared<UPAMessagePool>(bridgeImpl, (poolSize > 0) ? (size_t)poolSize : 0);
+
+   int sliceSize = config_->getInt("state-slice-size", Default_stateSliceSize);
+   stateSliceSize_ = (sliceSize > 0) ? (size_t)sliceSize : 1;
+
+   fastReconnect_ = config_->getBool("fast-reconnect", Default_fastReconnect);
 
    return true;
 }
@@ -93,8 +119,8 @@ void *RMDSSubscriber::threadFunc(void *state)
    // The thread monitor outputs debug when the thread starts and stops
    utils::os::ThreadMonitor mon("RMDSSubscriber-UPAConsumer");
 
-   RMDSSubscriber *pOwner = (RMDSSubscriber *) state;
-   pOwner->Consumer()->Run();
+   UPAConsumer *pConsumer = (UPAConsumer *) state;
+   pConsumer->Run();
    return 0;
 }
 
@@ -119,14 +145,40 @@ bool RMDSSubscriber::Start(const char* interfaceName, RsslConnectionTypes connTy
    {
       consumer_->AddListener(this);
       sources_->Initialise(consumer_);
+      consumers_.push_back(consumer_);
+
+      // the secondary shards are only worth having if we actually connect
+      size_t numConsumers = consumer_->RequiresConnection() ? numConsumers_ : 1;
+      for (size_t shard = 1; shard < numConsumers; ++shard)
+      {
+         UPAConsumer_ptr_t consumer(new UPAConsumer(this, shard));
+         RMDSConsumerShard_ptr_t listener = boost::make_shared<RMDSConsumerShard>(this, consumer.get());
+         consumer->AddListener(listener.get());
+         consumer->AddLoginListener(listener.get());
+         consumer->SourceDirectory()->AddListener(listener.get());
+
+         consumers_.push_back(consumer);
+         shardListeners_.push_back(listener);
+      }
+      numConsumers_ = numConsumers;
+
+      // and fire up the threads
+      bool result = true;
+      for (size_t shard = 0; result && shard < consumers_.size(); ++shard)
+      {
+         wthread_t hConsumerThread = 0;
+         result = (0 == wthread_create(&hConsumerThread, 0, threadFunc, consumers_[shard].get()));
+         if (result)
+         {
+            consumerThreads_.push_back(hConsumerThread);
+         }
+         t42log_info("RMDSSubscriber start Consumer thread %p for shard %u", hConsumerThread, (unsigned int)shard);
+      }
 
-      // and fire up the thread
-      bool result = (0 == wthread_create(&hConsumerThread_, 0, threadFunc, this));
       if (result)
       {
          subscriberState_ = connecting;
       }
-      t42log_info("RMDSSubscriber start Consumer thread %p", hConsumerThread_);
       return result;
    }
    else
@@ -140,8 +192,11 @@ bool RMDSSubscriber::Start(const char* interfaceName, RsslConnectionTypes connTy
 
 bool RMDSSubscriber::Stop()
 {
-   // Stop the consumer thread
-   consumer_->Stop();
+   // Stop the consumer threads
+   for (size_t shard = 0; shard < consumers_.size(); ++shard)
+   {
+      consumers_[shard]->Stop();
+   }
 
    if (sources_)
    {
@@ -154,16 +209,123 @@ bool RMDSSubscriber::Stop()
 
 bool RMDSSubscriber::Done()
 {
-    t42log_info("RMDSSubscriber stop Consumer thread %p", hConsumerThread_);
-    if (0 != hConsumerThread_)
+    for (size_t shard = 0; shard < consumerThreads_.size(); ++shard)
     {
-       consumer_->JoinThread(hConsumerThread_);
-       hConsumerThread_ = 0;
+       t42log_info("RMDSSubscriber stop Consumer thread %p", consumerThreads_[shard]);
+       consumers_[shard]->JoinThread(consumerThreads_[shard]);
     }
+    consumerThreads_.clear();
 
     return true;
 }
 
+const UPAConsumer_ptr_t& RMDSSubscriber::ConsumerFor(const std::string& source, const std::string& symbol) const
+{
+    if (consumers_.size() <= 1)
+    {
+        return consumer_;
+    }
+
+    // FNV-1a over source and symbol. This has to be stable for the life of the transport, so that
+    // a resubscribe lands on the connection that holds the stream
+    uint32_t hash = 2166136261U;
+    for (std::string::const_iterator it = source.begin(); it != source.end(); ++it)
+    {
+        hash = (hash ^ (unsigned char)*it) * 16777619U;
+    }
+    hash = (hash ^ '.') * 16777619U;
+    for (std::string::const_iterator it = symbol.begin(); it != symbol.end(); ++it)
+    {
+        hash = (hash ^ (unsigned char)*it) * 16777619U;
+    }
+
+    return consumers_[hash % consumers_.size()];
+}
+
+void RMDSSubscriber::ShardDisconnected(const UPAConsumer * consumer)
+{
+    t42log_warn("Consumer shard %u on transport %s disconnected\n", (unsigned int)consumer->Shard(), transport_name_.c_str());
+    sources_->SetAllStale(consumer);
+}
+
+void RMDSSubscriber::ShardRecovered(const UPAConsumer * consumer)
+{
+    t42log_info("Consumer shard %u on transport %s recovered\n", (unsigned int)consumer->Shard(), transport_name_.c_str());
+    sources_->ResubscribeAll(consumer);
+}
+
+void RMDSSubscriber::ShardItemGroups(const UPAConsumer * consumer, RsslSourceDirectoryResponseInfo * pResponseInfo)
+{
+    // the primary's source directory creates the sources, so until it has there are no items to apply the groups to
+    RMDSSource_ptr_t source;
+    if (pResponseInfo->ServiceGroupCount > 0 && sources_->Find(pResponseInfo->ServiceId, source))
+    {
+        source->UpdateItemGroups(consumer, pResponseInfo->ServiceGroupInfo, pResponseInfo->ServiceGroupCount);
+    }
+}
+
+RMDSConsumerShard::RMDSConsumerShard(RMDSSubscriber * owner, UPAConsumer * consumer)
+    : owner_(owner)
+    , consumer_(consumer)
+    , connected_(false)
+    , recovering_(false)
+{ }
+
+void RMDSConsumerShard::ConnectionNotification(bool connected, const char* extraInfo)
+{
+    t42log_debug("Consumer shard %u connected = %s", (unsigned int)consumer_->Shard(), connected ? "true" : "false");
+
+    bool wasConnected = connected_;
+    connected_ = connected;
+
+    if (connected_)
+    {
+        // the request queue is held until we are logged in, so the login has to go straight out
+        if (!consumer_->SendLogin())
+        {
+            t42log_error("Consumer shard %u failed to send login request\n", (unsigned int)consumer_->Shard());
+        }
+    }
+    else if (wasConnected)
+    {
+        recovering_ = true;
+        owner_->ShardDisconnected(consumer_);
+    }
+}
+
+void RMDSConsumerShard::LoginResponse(UPALogin::RsslLoginResponseInfo * pResponseInfo, bool loginSucceeded, const char* extraInfo)
+{
+    if (!connected_ || !loginSucceeded)
+    {
+        t42log_warn("Consumer shard %u login failed: %s\n", (unsigned int)consumer_->Shard(), extraInfo);
+        return;
+    }
+
+    t42log_debug("Consumer shard %u: %s", (unsigned int)consumer_->Shard(), extraInfo);
+
+    // now the item requests can go out, and the source directory for the item groups on this connection
+    consumer_->EnableRequests(true);
+    consumer_->RequestSourceDirectory(consumer_->RequestQueue());
+
+    if (recovering_)
+    {
+        recovering_ = false;
+        consumer_->RecoveryStage("logged in");
+        owner_->ShardRecovered(consumer_);
+        consumer_->ItemsResubscribed();
+    }
+}
+
+void RMDSConsumerShard::SourceDirectoryUpdate(RsslSourceDirectoryResponseInfo * pResponseInfo, bool isRefresh)
+{
+    // the service state comes from the primary, the shard's own directory only matters for its item groups
+    owner_->ShardItemGroups(consumer_, pResponseInfo);
+}
+
+void RMDSConsumerShard::SourceDirectoryRefreshComplete(bool succeeded)
+{
+}
+
 const char * RMDSSubscriber::InterfaceName() const
 {
     if (interfaceName_.size() > 0)
@@ -208,6 +370,22 @@ void RMDSSubscriber::LoginResponse(UPALogin::RsslLoginResponseInfo * pResponseIn
       subscriberState_ = requestingSourceDirectory;
 
       consumer_->RequestSourceDirectory(upaRequestQueue_);
+
+      // a fast reconnect doesnt wait for the source directory and dictionary to resubscribe
+      UPADictionary * dictionary = GetUpaDictionary();
+      if (recovering_ && fastReconnect_ && dictionary && dictionary->IsComplete())
+      {
+         consumer_->RecoveryStage("logged in");
+         if (dictionary->FieldsDownloaded())
+         {
+            consumer_->RequestDictionaryVersionCheck(upaRequestQueue_);
+         }
+
+         recovering_ = false;
+         fastRecovering_ = true;
+         sources_->ResubscribeAll(consumer_.get());
+         consumer_->ItemsResubscribed();
+      }
    }
    else
    {
@@ -243,8 +421,10 @@ void RMDSSubscriber::ConnectionNotification(bool connected, const char* extraInf
       {
          subscriberState_ = connecting;
          recovering_ = true;
+         fastRecovering_ = false;
          notify_.onConnectionDisconnect("disconnected from RMDS");
-         sources_->SetAllStale();
+         // the items on the other shards are unaffected by the primary connection going down
+         sources_->SetAllStale(consumer_.get());
       }
       else
       {
@@ -256,6 +436,16 @@ void RMDSSubscriber::ConnectionNotification(bool connected, const char* extraInf
 
 void RMDSSubscriber::SourceDirectoryUpdate( RsslSourceDirectoryResponseInfo * pResponseInfo, bool isRefresh )
 {
+   // an update may just carry item group changes, which only affect the items in those groups
+   if (!pResponseInfo->HasStateInfo)
+   {
+      RMDSSource_ptr_t source;
+      if (sources_->Find(pResponseInfo->ServiceId, source))
+      {
+         source->UpdateItemGroups(consumer_.get(), pResponseInfo->ServiceGroupInfo, pResponseInfo->ServiceGroupCount);
+      }
+      return;
+   }
 
    const char* state = (int)pResponseInfo->ServiceStateInfo.ServiceState == 0 ? "DOWN" : "UP";
    const char* acceptingRequests = (int)pResponseInfo->ServiceStateInfo.AcceptingRequests == 0 ? "FALSE" : "TRUE";
@@ -266,11 +456,13 @@ void RMDSSubscriber::SourceDirectoryUpdate( RsslSourceDirectoryResponseInfo * pR
                 pResponseInfo->ServiceGeneralInfo.ServiceName, sid, state, acceptingRequests);
 
     // The update to the source will propagate any state changes through to all the subscriptions active on the source
-    sources_->UpdateOrCreate(pResponseInfo->ServiceId,
+    RMDSSource_ptr_t source = sources_->UpdateOrCreate(pResponseInfo->ServiceId,
                              pResponseInfo->ServiceGeneralInfo.ServiceName,
                              ServiceState(pResponseInfo->ServiceStateInfo.ServiceState != 0,
                                           pResponseInfo->ServiceStateInfo.AcceptingRequests != 0));
 
+    source->UpdateItemGroups(consumer_.get(), pResponseInfo->ServiceGroupInfo, pResponseInfo->ServiceGroupCount);
+
 }
 
 
@@ -280,7 +472,15 @@ void RMDSSubscriber::SourceDirectoryRefreshComplete(bool succeeded)
 
    // this is where we make the dictionary request
 
-   if (succeeded)
+   if (succeeded && fastRecovering_)
+   {
+      // the items were re-requested at login and the dictionary is kept, so this completes the reconnection
+      fastRecovering_ = false;
+      consumer_->RecoveryStage("source directory");
+      SetLive();
+      notify_.onConnectionReconnect("connection recovered");
+   }
+   else if (succeeded)
    {
       subscriberState_ = requestingDictionary;
       consumer_->RequestDictionary(upaRequestQueue_);
@@ -335,6 +535,17 @@ bool RMDSSubscriber::UpdateUpaMamaFieldMap()
       if (underlayingRsslDictionary)
       {
          result = UpaMamaFieldMap_->SetUPADictionaryHandler(underlayingRsslDictionary);
+         if (result)
+         {
+            // resolve the dictionary and field map lookups for every fid now rather than for each field we decode
+            RsslUInt32 generation = decodePlanGeneration_.load(utils::thread::memory_order_relaxed) + 1;
+            UPAFieldDecodePlan_ptr_t plan = boost::make_shared<UPAFieldDecodePlan>(underlayingRsslDictionary, UpaMamaFieldMap_, generation);
+            {
+               utils::thread::T42Lock l(&decodePlanLock_);
+               decodePlan_ = plan;
+            }
+            decodePlanGeneration_.store(generation, utils::thread::memory_order_release);
+         }
       }
    }
 
@@ -357,8 +568,13 @@ void RMDSSubscriber::DictionaryUpdate(bool dictionaryComplete)
 
    if (dictionaryComplete)
    {
-      // now have a complete rmds dictionary so can build the field map
-      UpdateUpaMamaFieldMap();
+      // now have a complete rmds dictionary so can build the field map. A recovery keeps the dictionary it had, so
+      // there is nothing to rebuild
+      bool reused = recovering_ && DecodePlan();
+      if (!reused)
+      {
+         UpdateUpaMamaFieldMap();
+      }
 
       t42log_debug("update mama field map on transport %s, sentDictionary = %d, dictionaryReply = 0x%x\n", transport_name_.c_str(), sentDictionary_, dictionaryReply_.get());
       if (!sentDictionary_ && dictionaryReply_)
@@ -367,7 +583,7 @@ void RMDSSubscriber::DictionaryUpdate(bool dictionaryComplete)
          t42log_debug("Sent dictionary on transport %s\n", transport_name_.c_str());
          sentDictionary_ = true;
       }
-      else
+      else if (!reused)
       {
           // we need to combine the dictionaries anyway
           UpaMamaFieldMap_->GetCombinedMamaDictionary();
@@ -378,7 +594,9 @@ void RMDSSubscriber::DictionaryUpdate(bool dictionaryComplete)
       if (recovering_)
       {
          recovering_ = false;
-         sources_->ResubscribeAll();
+         consumer_->RecoveryStage("dictionary");
+         sources_->ResubscribeAll(consumer_.get());
+         consumer_->ItemsResubscribed();
          notify_.onConnectionReconnect("connection recovered");
       }
       else
@@ -393,6 +611,17 @@ void RMDSSubscriber::DictionaryUpdate(bool dictionaryComplete)
    }
 }
 
+void RMDSSubscriber::DictionaryVersionChecked(bool sameVersion)
+{
+   consumer_->RecoveryStage(sameVersion ? "dictionary version unchanged" : "dictionary version changed");
+
+   // the decoders on every shard hold the loaded dictionary, so it cant be swapped under them
+   if (!sameVersion)
+   {
+      t42log_warn("Transport %s keeps decoding with the dictionary it loaded first, restart to load the new version\n", transport_name_.c_str());
+   }
+}
+
 bool RMDSSubscriber::AddSubscription( subscriptionBridge* subscriber, const char* source, const char* symbol, mamaTransport transport, mamaQueue queue, mamaMsgCallbacks callback, mamaSubscription subscription, void* closure )
 {
    bool logrmdsvalues = config_->getBool("logrmdsvalues");
@@ -437,6 +666,12 @@ bool RMDSSubscriber::AddSubscription( subscriptionBridge* subscriber, const char
        pendingSubscriptions_.push_back(sub);
    }
 
+   // the consumer thread picks up the pending list next time round its loop
+   if (consumer_)
+   {
+       consumer_->Wakeup();
+   }
+
    return true;
 }
 
@@ -447,6 +682,11 @@ void RMDSSubscriber::SetLive()
 }
 
 
+bool RMDSSubscriber::ProcessSourceTransitions(const UPAConsumer * consumer)
+{
+   return sources_->ProcessTransitions(consumer, stateSliceSize_);
+}
+
 void RMDSSubscriber::ProcessPendingSubcriptions()
 {
     if(subscriberState_ != live)
@@ -563,8 +803,8 @@ bool RMDSSubscriber::AddSubscriptionToSource( RMDSBridgeSubscription_ptr_t sub )
       upaSub->Source(src);
       upaSub->AddListener(sub);
 
-      // and open it
-      upaSub->Open(consumer_);
+      // and open it on the shard that owns the item
+      upaSub->Open(ConsumerFor(sub->SourceName(), sub->Symbol()));
    }
 
    return true;
@@ -724,6 +964,11 @@ void RMDSSubscriber::SendSnapshotRequest(const SnapshotReply_ptr_t& snapReply )
         utils::thread::T42Lock l(&pendingListLock_);
         pendingSnapshots_.push_back(snap);
     }
+
+    if (consumer_)
+    {
+        consumer_->Wakeup();
+    }
 }
 
 bool RMDSSubscriber::AddSnaphotToSource( RMDSBridgeSnapshot_ptr_t snap )
@@ -747,7 +992,15 @@ bool RMDSSubscriber::AddSnaphotToSource( RMDSBridgeSnapshot_ptr_t snap )
 
     upaSnap->SetDomain(src->SourceDomain());
     upaSnap->Source(src);
-    upaSnap->Snapshot(consumer_, snap);
+
+    // if we are already streaming the item and caching its image then the snapshot can be served from that
+    UPASubscription_ptr_t upaSub;
+    if (src->FindSubscription(snap->Symbol(), upaSub) && upaSub->CachesImage())
+    {
+        upaSnap->ImageSource(upaSub);
+    }
+
+    upaSnap->Snapshot(ConsumerFor(snap->SourceName(), snap->Symbol()), snap);
 
     return true;
 }
@@ -39,6 +39,8 @@
 #include "UPATransportNotifier.h"
 
 #include "UPAMamaFieldMap.h"
+#include "UPAFieldDecodePlan.h"
+#include "UPAMessagePool.h"
 
 #include "RMDSSources.h"
 #include "DictionaryReply.h"
@@ -52,6 +54,29 @@
 
 class UPALogin;
 class UPABridgePoster;
+class RMDSSubscriber;
+
+// Tracks the connection and login of a secondary consumer shard. The primary consumer reports to the RMDSSubscriber
+// itself, the secondaries only need to log in, to stale and recover their own items, and to follow the item groups
+// in their own source directory
+
+class RMDSConsumerShard : public LoginResponseListener, public ConnectionListener, public SourceDirectoryResponseListener
+{
+public:
+    RMDSConsumerShard(RMDSSubscriber * owner, UPAConsumer * consumer);
+
+    virtual void LoginResponse(UPALogin::RsslLoginResponseInfo * pResponseInfo, bool loginSucceeded, const char* extraInfo);
+    virtual void ConnectionNotification(bool connected, const char* extraInfo);
+    virtual void SourceDirectoryUpdate(RsslSourceDirectoryResponseInfo * pResponseInfo, bool isRefresh);
+    virtual void SourceDirectoryRefreshComplete(bool succeeded);
+
+private:
+    RMDSSubscriber * owner_;
+    UPAConsumer * consumer_;
+    bool connected_;
+    bool recovering_;
+};
+typedef boost::shared_ptr<RMDSConsumerShard> RMDSConsumerShard_ptr_t;
 
 
 // Implements the mama subscriber
@@ -76,13 +101,25 @@ public:
     const UPAConsumer_ptr_t& Consumer() const { return consumer_; }
     void Consumer(const UPAConsumer_ptr_t& val) { consumer_ = val; }
 
+    // The items are spread over the consumer shards by a hash of source and symbol so that the same item always
+    // lands on the same connection
+    const UPAConsumer_ptr_t& ConsumerFor(const std::string& source, const std::string& symbol) const;
+    size_t NumConsumers() const { return numConsumers_; }
+
+    // called from a secondary shard's thread as its connection goes down and once it has logged in again
+    void ShardDisconnected(const UPAConsumer * consumer);
+    void ShardRecovered(const UPAConsumer * consumer);
+
+    // and with the item group changes in its source directory
+    void ShardItemGroups(const UPAConsumer * consumer, RsslSourceDirectoryResponseInfo * pResponseInfo);
+
     // subscription & snapshots
     virtual bool AddSubscription(subscriptionBridge* subscriber, const char* source, const char* symbol, mamaTransport transport, mamaQueue queue, mamaMsgCallbacks callback, mamaSubscription subscription, void* closure);
     bool RemoveSubscription(RMDSBridgeSubscription* pSubscription);
     void SendSnapshotRequest(const SnapshotReply_ptr_t& snap);
     bool FindSubscription(const std::string& source, const std::string& symbol, UPASubscription_ptr_t& sub);
 
-    mamaQueue GetRequestQueue() const {return upaRequestQueue_;}
+    mamaQueue GetRequestQueue(size_t shard = 0) const {return requestQueues_[shard];}
 
     // dictionary reply
     void SetDictionaryReply(const DictionaryReply_ptr_t& dictionaryReply);
@@ -121,6 +158,7 @@ public:
     virtual void SourceDirectoryUpdate(RsslSourceDirectoryResponseInfo * pResponseInfo, bool isRefresh);
     virtual void SourceDirectoryRefreshComplete(bool succeeded);
     virtual void DictionaryUpdate(bool dictionaryComplete);
+    virtual void DictionaryVersionChecked(bool sameVersion);
 
     //Dictionaries related (RMDS and UPA to MAMA)
     const UPADictionary* GetUpaDictionary() const {return consumer_ ? (consumer_->UpaDictionary()) : NULL;}
@@ -134,6 +172,25 @@ public:
 
     bool CreateUpaMamaFieldMap();
 
+    // the decode plan for the current dictionary and field map - empty until the dictionary is complete
+    UPAFieldDecodePlan_ptr_t DecodePlan() const
+    {
+        utils::thread::T42Lock l(&decodePlanLock_);
+        return decodePlan_;
+    }
+
+    // changes each time the plan is rebuilt, so the decoders can pick up the new one without taking the lock
+    RsslUInt32 DecodePlanGeneration() const
+    {
+        return decodePlanGeneration_.load(utils::thread::memory_order_acquire);
+    }
+
+    // the free list of messages that async delivery fans updates out in
+    const UPAMessagePool_ptr_t& MessagePool() const
+    {
+        return messagePool_;
+    }
+
     // get the new item subscription for the specified source - used by interactive publishing
     bool GetNewItemSubscription(const std::string& sourceName, mamaSubscription* sub);
 
@@ -150,6 +207,10 @@ public:
    // deal with any pending subscriptions
    void ProcessPendingSubcriptions();
 
+   // apply the next slice of the sources' queued stale / live transitions for the items on the consumer, returning true
+   // if there are more to do. Called from each consumer's own thread
+   bool ProcessSourceTransitions(const UPAConsumer * consumer);
+
     mamaBridge Bridge() const;
 
 protected:
@@ -174,14 +235,30 @@ private:
     bool recovering_;
     bool connected_;
 
-    // upa consumer thread
-    wthread_t hConsumerThread_;
+    // Fast reconnect
+    //
+    // Normally the primary recovers in sequence - login, source directory, dictionary - and only then resubscribes its
+    // items. With fast-reconnect set, the dictionary from the first connection is kept, so the source directory
+    // request, a check of the dictionary version and the item re-requests all go out as soon as the login succeeds.
+    // The items are requested with the service ids from the last connection, which dont change while the provider
+    // keeps the service
+    bool fastReconnect_;
+    bool fastRecovering_;
+
+    // upa consumer threads, one per shard. Shard 0 is consumer_
+    size_t numConsumers_;
+    std::vector<UPAConsumer_ptr_t> consumers_;
+    std::vector<RMDSConsumerShard_ptr_t> shardListeners_;
+    std::vector<wthread_t> consumerThreads_;
 
     mutable utils::thread::lock_t pendingListLock_;
 
+    // the primary's request queue, also at the front of requestQueues_
     mamaQueue upaRequestQueue_;
+    std::vector<mamaQueue> requestQueues_;
 
     boost::shared_ptr<RMDSSources> sources_;
+    size_t stateSliceSize_;
 
     //map for "special" subscribers for publisher new item requests
     typedef utils::collection::unordered_map<std::string, mamaSubscription> PublisherRequestSubMap_t;
@@ -191,6 +268,12 @@ private:
 
     UpaMamaFieldMap_ptr_t UpaMamaFieldMap_;
 
+    UPAFieldDecodePlan_ptr_t decodePlan_;
+    utils::thread::atomic<RsslUInt32> decodePlanGeneration_;
+    mutable utils::thread::lock_t decodePlanLock_;
+
+    UPAMessagePool_ptr_t messagePool_;
+
     // list of pending subscritpions / snapshots.  If requests are made before connection completes
     // they are added to the pending list and actioned when the connection state changes
     typedef std::list<RMDSBridgeSubscription_ptr_t> SubscriptionList_t;
@@ -36,6 +36,7 @@ const size_t MaxCapabilities = 10;
 const size_t MaxQOS = 5;
 const size_t MaxDictionaries = 5;
 const size_t MaxGroupInfoLength = 256;
+const size_t MaxGroups = 16;
 const size_t MaxDataInfoLength = 1024;
 const size_t MaxLinks = 5;
 const size_t MaxSourceDirInfoStrLength = 256;
@@ -65,11 +66,14 @@ typedef struct
     RsslState    Status;
 } RsslServiceStateInfo;
 
-// service group information 
+// service group information, there is one of these for each group filter entry
 typedef struct
 {
     RsslUInt8    Group[MaxGroupInfoLength];
+    RsslUInt32    GroupLength;
     RsslUInt8    MergedToGroup[MaxGroupInfoLength];
+    RsslUInt32    MergedToGroupLength;
+    RsslBool    HasStatus;
     RsslState    Status;
 } RsslServiceGroupInfo;
 
@@ -106,8 +110,10 @@ typedef struct
     RsslInt32 StreamId;
     RsslUInt64 ServiceId;
     RsslServiceGeneralInfo ServiceGeneralInfo;
+    RsslBool HasStateInfo;
     RsslServiceStateInfo ServiceStateInfo;
-    RsslServiceGroupInfo ServiceGroupInfo;
+    RsslUInt32 ServiceGroupCount;
+    RsslServiceGroupInfo ServiceGroupInfo[MaxGroups];
     RsslServiceLoadInfo ServiceLoadInfo;
     RsslServiceDataInfo ServiceDataInfo;
     RsslServiceLinkInfo ServiceLinkInfo[MaxLinks];
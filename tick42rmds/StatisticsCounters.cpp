@@ -0,0 +1,139 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "stdafx.h"
+#include "StatisticsCounters.h"
+
+#if defined(WIN32)
+#define STATISTICS_THREAD_LOCAL __declspec(thread)
+#else
+#define STATISTICS_THREAD_LOCAL __thread
+#endif
+
+static utils::thread::atomic<size_t> nextThreadShard(0);
+
+// one more than the shard, so that zero means the thread doesnt have one yet
+static STATISTICS_THREAD_LOCAL size_t threadShard = 0;
+
+size_t StatisticsThreadShard()
+{
+    if (threadShard == 0)
+    {
+        threadShard = (nextThreadShard.fetch_add(1, utils::thread::memory_order_relaxed) % StatisticsShards) + 1;
+    }
+    return threadShard - 1;
+}
+
+StatisticsHistogram::StatisticsHistogram()
+{
+    for (size_t shard = 0; shard < StatisticsShards; ++shard)
+    {
+        for (size_t i = 0; i < Buckets; ++i)
+        {
+            shards_[shard].counts_[i].store(0, utils::thread::memory_order_relaxed);
+        }
+    }
+}
+
+void StatisticsHistogram::Snapshot(Counts_t& counts) const
+{
+    counts.assign(Buckets, 0);
+    for (size_t shard = 0; shard < StatisticsShards; ++shard)
+    {
+        for (size_t i = 0; i < Buckets; ++i)
+        {
+            counts[i] += shards_[shard].counts_[i].load(utils::thread::memory_order_relaxed);
+        }
+    }
+}
+
+RsslUInt64 StatisticsHistogram::Percentile(const Counts_t& counts, double percentile)
+{
+    RsslUInt64 total = 0;
+    for (Counts_t::const_iterator it = counts.begin(); it != counts.end(); ++it)
+    {
+        total += *it;
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    // the rank of the value we want, counting from 1
+    RsslUInt64 rank = (RsslUInt64)((percentile / 100.0) * (double)total + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    RsslUInt64 seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            return BucketHighestValue(i);
+        }
+    }
+
+    return BucketHighestValue(counts.size() - 1);
+}
+
+// Values below SubBuckets each have a bucket of their own. Above that, a value whose top bit is bit m goes in the
+// group for m, and the SubBucketBits bits below the top bit pick the bucket within the group
+size_t StatisticsHistogram::BucketIndex(RsslUInt64 value)
+{
+    if (value < SubBuckets)
+    {
+        return (size_t)value;
+    }
+
+    size_t magnitude = 0;
+    RsslUInt64 v = value;
+    for (size_t shift = 32; shift > 0; shift >>= 1)
+    {
+        if (v >> shift)
+        {
+            v >>= shift;
+            magnitude += shift;
+        }
+    }
+
+    size_t index = ((magnitude - SubBucketBits + 1) << SubBucketBits) + (size_t)((value >> (magnitude - SubBucketBits)) & (SubBuckets - 1));
+    return (index < Buckets) ? index : Buckets - 1;
+}
+
+RsslUInt64 StatisticsHistogram::BucketHighestValue(size_t index)
+{
+    if (index < SubBuckets)
+    {
+        return (RsslUInt64)index;
+    }
+
+    size_t magnitude = (index >> SubBucketBits) + SubBucketBits - 1;
+    RsslUInt64 subBucket = index & (SubBuckets - 1);
+    RsslUInt64 lowest = (SubBuckets + subBucket) << (magnitude - SubBucketBits);
+    return lowest + ((RsslUInt64)1 << (magnitude - SubBucketBits)) - 1;
+}
@@ -0,0 +1,123 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __STATISTICSCOUNTERS_H__
+#define __STATISTICSCOUNTERS_H__
+
+#include <utils/namespacedefines.h>
+
+// The statistics are updated on the consumer and queue threads and read by the logger thread. Rather than have the
+// updating threads contend for one shared counter, each thread updates a shard of its own and the logger thread adds
+// the shards up when it takes a sample. Each shard is padded out to a cache line so the threads dont share lines.
+
+static const size_t StatisticsShards = 16;
+static const size_t StatisticsCacheLine = 64;
+
+// a small number for the calling thread, assigned the first time the thread asks for it
+size_t StatisticsThreadShard();
+
+class StatisticsCounter
+{
+public:
+    StatisticsCounter()
+    {
+        for (size_t i = 0; i < StatisticsShards; ++i)
+        {
+            shards_[i].value_.store(0, utils::thread::memory_order_relaxed);
+        }
+    }
+
+    void Add(RsslUInt64 value = 1)
+    {
+        shards_[StatisticsThreadShard()].value_.fetch_add(value, utils::thread::memory_order_relaxed);
+    }
+
+    RsslUInt64 Read() const
+    {
+        RsslUInt64 total = 0;
+        for (size_t i = 0; i < StatisticsShards; ++i)
+        {
+            total += shards_[i].value_.load(utils::thread::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct Shard
+    {
+        utils::thread::atomic<RsslUInt64> value_;
+        char pad_[StatisticsCacheLine - sizeof(utils::thread::atomic<RsslUInt64>)];
+    };
+
+    Shard shards_[StatisticsShards];
+
+    StatisticsCounter(const StatisticsCounter&);
+    StatisticsCounter& operator=(const StatisticsCounter&);
+};
+
+// A latency histogram along the lines of HdrHistogram. Values are bucketed by their power of two and each power of two
+// is split into a fixed number of linear sub buckets, so the error in a reported percentile is at most 1 / SubBuckets
+// of the value whatever its magnitude. The values are in microseconds; anything beyond the top bucket is counted there.
+class StatisticsHistogram
+{
+public:
+    static const size_t SubBucketBits = 3;
+    static const size_t SubBuckets = 1 << SubBucketBits;
+    static const size_t Magnitudes = 36;
+    static const size_t Buckets = Magnitudes * SubBuckets;
+
+    typedef std::vector<RsslUInt64> Counts_t;
+
+    StatisticsHistogram();
+
+    void Record(RsslUInt64 value)
+    {
+        shards_[StatisticsThreadShard()].counts_[BucketIndex(value)].fetch_add(1, utils::thread::memory_order_relaxed);
+    }
+
+    // add up the shards. The counts are cumulative, the caller subtracts the previous snapshot to get an interval
+    void Snapshot(Counts_t& counts) const;
+
+    // the highest value that falls in the same bucket as the given percentile (0 - 100) of the counts, or 0 if there
+    // are no counts
+    static RsslUInt64 Percentile(const Counts_t& counts, double percentile);
+
+    static size_t BucketIndex(RsslUInt64 value);
+    static RsslUInt64 BucketHighestValue(size_t index);
+
+private:
+    struct Shard
+    {
+        utils::thread::atomic<RsslUInt64> counts_[Buckets];
+        char pad_[StatisticsCacheLine];
+    };
+
+    Shard shards_[StatisticsShards];
+
+    StatisticsHistogram(const StatisticsHistogram&);
+    StatisticsHistogram& operator=(const StatisticsHistogram&);
+};
+
+#endif //__STATISTICSCOUNTERS_H__
@@ -43,23 +43,20 @@ static StatisticsLogger_ptr_t gLogger;
 StatisticsLogger::StatisticsLogger()
 {
     lastMessageCount_ = 0;
-    incomingMessageCount_ = 0;
     lastSubscriptions_ = 0;
     lastSubscriptionsSucceeded_ = 0;
     lastSubscriptionsFailed_ = 0;
-    totalSubscriptions_ = 0;
-    totalSubscriptionsFailed_ = 0;
-    totalSubscriptionsSucceeded_ = 0;
+    enabled_ = false;
     maxAgeDays_ = 5;
-    maxAgeDays_ = 5;
-    requestQueueLength_ = 0;
-    pendingOpens_ = 0;
-    openItems_ = 0;
-    pendingCloses_ = 0;
+    requestQueueLength_.store(0);
+    pendingOpens_.store(0);
+    openItems_.store(0);
+    pendingCloses_.store(0);
     loggerThread_ = 0;
     runThread_ = false;
     lastSampleTime_ = 0;
-    queueEventsCount_ = 0;
+    queueEventsCount_.store(0);
+    lastRecoveryTime_.store(0);
 }
 
 const StatisticsLogger_ptr_t& StatisticsLogger::GetStatisticsLogger()
@@ -278,6 +275,27 @@ void StatisticsLogger::deleteOldFiles()
       }
 }
 
+void StatisticsLogger::FormatPercentiles(const StatisticsHistogram& histogram, StatisticsHistogram::Counts_t& last, char* buffer, size_t size)
+{
+    StatisticsHistogram::Counts_t current;
+    histogram.Snapshot(current);
+
+    StatisticsHistogram::Counts_t interval(current);
+    if (last.size() == interval.size())
+    {
+        for (size_t i = 0; i < interval.size(); ++i)
+        {
+            interval[i] -= last[i];
+        }
+    }
+    last.swap(current);
+
+    snprintf(buffer, size, "%llu,%llu,%llu"
+        , (unsigned long long)StatisticsHistogram::Percentile(interval, 50.0)
+        , (unsigned long long)StatisticsHistogram::Percentile(interval, 99.0)
+        , (unsigned long long)StatisticsHistogram::Percentile(interval, 99.9));
+}
+
 void StatisticsLogger::Run()
 {
    // Delete stats files that are old
@@ -335,7 +353,11 @@ void StatisticsLogger::Run()
       {
          sprintf(buffer,"Time,Updates (Total),Updates (Last),Update Rate"
             ",Subscriptions (Total),Subscriptions (Successful)"
-            ",Subscriptions (Failed),Request Queue Length,Pending Opens,Open Items,Events In Queues");
+            ",Subscriptions (Failed),Request Queue Length,Pending Opens,Open Items,Events In Queues"
+            ",Decode p50 (us),Decode p99 (us),Decode p99.9 (us)"
+            ",Fanout p50 (us),Fanout p99 (us),Fanout p99.9 (us)"
+            ",Queue p50 (us),Queue p99 (us),Queue p99.9 (us)"
+            ",Last Recovery (ms)");
          logFile << buffer << endl;
       }
 
@@ -347,19 +369,26 @@ void StatisticsLogger::Run()
         // Now format the stats into a string and write to the file
         RsslUInt64 ticks = utils::time::GetMilliCount();
         RsslUInt64 interval = ticks - lastSampleTime_;
-        RsslUInt64 intervalMessages = incomingMessageCount_ - lastMessageCount_;
+        RsslUInt64 incomingMessageCount = incomingMessageCount_.Read();
+        RsslUInt64 intervalMessages = incomingMessageCount - lastMessageCount_;
         double updateRate = ((double)intervalMessages * 1000) / interval;
 
-        snprintf(buffer, BUFFERSIZE, "%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d", strDate.c_str()
-         , (int)incomingMessageCount_, (int)intervalMessages, int(updateRate + 1)
-         , (int)totalSubscriptions_, (int)totalSubscriptionsSucceeded_
-         , (int)totalSubscriptionsFailed_, (int)requestQueueLength_
-         , (int)pendingOpens_, (int)openItems_, (int)queueEventsCount_ );
+        char decodeBuffer[64], fanoutBuffer[64], queueBuffer[64];
+        FormatPercentiles(decodeTime_, lastDecodeTime_, decodeBuffer, sizeof(decodeBuffer));
+        FormatPercentiles(fanoutTime_, lastFanoutTime_, fanoutBuffer, sizeof(fanoutBuffer));
+        FormatPercentiles(queueResidency_, lastQueueResidency_, queueBuffer, sizeof(queueBuffer));
+
+        snprintf(buffer, BUFFERSIZE, "%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%s,%s,%s,%d", strDate.c_str()
+         , (int)incomingMessageCount, (int)intervalMessages, int(updateRate + 1)
+         , (int)totalSubscriptions_.Read(), (int)totalSubscriptionsSucceeded_.Read()
+         , (int)totalSubscriptionsFailed_.Read(), (int)GetRequestQueueLength()
+         , (int)pendingOpens_.load(), (int)openItems_.load(), (int)GetQueueEventsCount()
+         , decodeBuffer, fanoutBuffer, queueBuffer, (int)lastRecoveryTime_.load());
 
         logFile << buffer << endl;
         logFile.close();
 
-        lastMessageCount_ = incomingMessageCount_;
+        lastMessageCount_ = incomingMessageCount;
         lastSampleTime_ = ticks;
     }
 
@@ -25,6 +25,7 @@
 #pragma once
 
 #include "utils/thread/lock.h"
+#include "StatisticsCounters.h"
 
 class StatisticsLogger;
 typedef boost::shared_ptr<StatisticsLogger> StatisticsLogger_ptr_t;
@@ -47,59 +48,91 @@ public:
     void Run();
 
     // stats interface
+    // These are called on the consumer and queue threads. The counters and histograms are sharded per thread and the
+    // gauges are single atomic values, so none of them take a lock
+    bool Enabled() const
+    {
+        return enabled_;
+    }
+
     void IncSubscribed()
     {
-        ++totalSubscriptions_;
+        totalSubscriptions_.Add();
     }
 
     void IncSubscriptionsSucceeded()
     {
-        ++totalSubscriptionsSucceeded_;
+        totalSubscriptionsSucceeded_.Add();
     }
 
     void IncSubscriptionsFailed()
     {
-        ++totalSubscriptionsFailed_;
+        totalSubscriptionsFailed_.Add();
     }
 
     void IncIncomingMessageCount()
     {
-        ++incomingMessageCount_;
+        incomingMessageCount_.Add();
     }
 
     void SetPendingOpens(int value)
     {
-        pendingOpens_ = value;
+        pendingOpens_.store(value, utils::thread::memory_order_relaxed);
     }
 
     void SetOpenItems(int value)
     {
-        openItems_ = value;
+        openItems_.store(value, utils::thread::memory_order_relaxed);
     }
 
     void SetPendingCloses(int value)
     {
-        pendingCloses_ = value;
+        pendingCloses_.store(value, utils::thread::memory_order_relaxed);
     }
 
     void SetRequestQueueLength(int value)
     {
-        requestQueueLength_ = value;
+        requestQueueLength_.store(value, utils::thread::memory_order_relaxed);
     }
 
     RsslUInt64 GetRequestQueueLength()
     {
-        return requestQueueLength_;
+        return requestQueueLength_.load(utils::thread::memory_order_relaxed);
     }
 
     void SetQueueEventsCount(size_t count)
     {
-        queueEventsCount_ = count;
+        queueEventsCount_.store(count, utils::thread::memory_order_relaxed);
     }
 
     RsslUInt64 GetQueueEventsCount()
     {
-        return queueEventsCount_;
+        return queueEventsCount_.load(utils::thread::memory_order_relaxed);
+    }
+
+    // how long the last connection recovery took to get all its items back, in milliseconds
+    void SetLastRecoveryTime(RsslUInt64 millis)
+    {
+        lastRecoveryTime_.store(millis, utils::thread::memory_order_relaxed);
+    }
+
+    // latencies, in microseconds
+    // from the consumer reading an item message to the decoded message being ready to send to the listeners
+    void RecordDecodeTime(RsslUInt64 micros)
+    {
+        decodeTime_.Record(micros);
+    }
+
+    // sending the decoded message to all the listeners on the stream
+    void RecordFanoutTime(RsslUInt64 micros)
+    {
+        fanoutTime_.Record(micros);
+    }
+
+    // an async message waiting on a listener's mama queue
+    void RecordQueueResidency(RsslUInt64 micros)
+    {
+        queueResidency_.Record(micros);
     }
 
    static void PauseUpdates();
@@ -134,16 +167,29 @@ private:
     RsslUInt64 lastSubscriptionsFailed_;
 
     // some basic stats
-    RsslUInt64 incomingMessageCount_;
-    RsslUInt64 totalSubscriptions_;
-    RsslUInt64 totalSubscriptionsSucceeded_;
-    RsslUInt64 totalSubscriptionsFailed_;
-
-    RsslUInt64 requestQueueLength_;
-    RsslUInt64 pendingOpens_;
-    RsslUInt64 openItems_;
-    RsslUInt64 pendingCloses_;
-
-    RsslUInt64 queueEventsCount_;
+    StatisticsCounter incomingMessageCount_;
+    StatisticsCounter totalSubscriptions_;
+    StatisticsCounter totalSubscriptionsSucceeded_;
+    StatisticsCounter totalSubscriptionsFailed_;
+
+    utils::thread::atomic<RsslUInt64> requestQueueLength_;
+    utils::thread::atomic<RsslUInt64> pendingOpens_;
+    utils::thread::atomic<RsslUInt64> openItems_;
+    utils::thread::atomic<RsslUInt64> pendingCloses_;
+
+    utils::thread::atomic<RsslUInt64> queueEventsCount_;
+    utils::thread::atomic<RsslUInt64> lastRecoveryTime_;
+
+    StatisticsHistogram decodeTime_;
+    StatisticsHistogram fanoutTime_;
+    StatisticsHistogram queueResidency_;
+
+    // the histograms at the last sample, so each line reports the latencies over its own interval
+    StatisticsHistogram::Counts_t lastDecodeTime_;
+    StatisticsHistogram::Counts_t lastFanoutTime_;
+    StatisticsHistogram::Counts_t lastQueueResidency_;
+
+    // write the p50, p99 and p99.9 latencies over the interval since the last sample
+    static void FormatPercentiles(const StatisticsHistogram& histogram, StatisticsHistogram::Counts_t& last, char* buffer, size_t size);
 };
 
@@ -0,0 +1,356 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "stdafx.h"
+#include "UPABatchRequests.h"
+#include "UPAConsumer.h"
+#include "UPASubscription.h"
+#include "RMDSSource.h"
+#include <utils/t42log.h>
+
+// room for the request header, the key and the :ItemList element around the names, and for the length each name is
+// encoded with
+static const RsslUInt32 RequestOverhead = 64;
+static const RsslUInt32 ItemOverhead = 3;
+
+UPABatchRequests::UPABatchRequests()
+    : consumer_(0)
+    , enabled_(false)
+    , maxItems_(0)
+    , maxBytes_(0)
+    , collecting_(false)
+{
+}
+
+void UPABatchRequests::Configure(UPAConsumer * consumer, bool enabled, size_t maxItems, RsslUInt32 maxBytes)
+{
+    consumer_ = consumer;
+    maxItems_ = maxItems;
+    maxBytes_ = maxBytes;
+
+    // a batch has to hold at least a couple of items to be worth it
+    enabled_ = enabled && maxItems_ > 1 && maxBytes_ > RequestOverhead;
+}
+
+void UPABatchRequests::Begin(bool providerSupportsBatch)
+{
+    collecting_ = enabled_ && providerSupportsBatch;
+}
+
+bool UPABatchRequests::Add(const UPASubscription_ptr_t& sub, bool isSnapshot)
+{
+    if (!collecting_ || sub->DomainType() == 0 || sub->Source() == 0)
+    {
+        return false;
+    }
+
+    if (queued_.find(sub.get()) != queued_.end())
+    {
+        return true;
+    }
+
+    // the source's view goes in every batch request on it
+    RsslUInt32 requestBytes = RequestOverhead;
+    if (consumer_->ViewsSupported() && sub->Source()->HasView())
+    {
+        requestBytes += sub->Source()->ViewBytes();
+    }
+
+    RsslUInt32 itemBytes = (RsslUInt32)sub->Symbol().length() + ItemOverhead;
+    if (requestBytes + itemBytes > maxBytes_)
+    {
+        return false;
+    }
+
+    BatchKey key;
+    key.serviceId_ = (RsslUInt16) sub->Source()->ServiceId();
+    key.domainType_ = sub->DomainType();
+    key.streaming_ = !isSnapshot;
+
+    Batch & batch = batches_[key];
+    if (requestBytes + batch.bytes_ + itemBytes > maxBytes_)
+    {
+        // the message is full
+        SendBatch(key, batch);
+    }
+
+    batch.items_.push_back(sub);
+    batch.bytes_ += itemBytes;
+    queued_.insert(sub.get());
+
+    // count it against the open window while it waits, so PumpQueueEvents doesnt dispatch any more than it would have
+    // sent on its own
+    consumer_->StreamManager().addPendingItem(sub.get());
+
+    if (batch.items_.size() >= maxItems_)
+    {
+        SendBatch(key, batch);
+    }
+
+    return true;
+}
+
+void UPABatchRequests::Send()
+{
+    for (Batches_t::iterator it = batches_.begin(); it != batches_.end(); ++it)
+    {
+        SendBatch(it->first, it->second);
+    }
+
+    collecting_ = false;
+}
+
+void UPABatchRequests::Clear()
+{
+    UPAStreamManager &mgr = consumer_->StreamManager();
+    for (Batches_t::iterator it = batches_.begin(); it != batches_.end(); ++it)
+    {
+        const std::vector<UPASubscription_ptr_t>& items = it->second.items_;
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            mgr.removePendingItem(items[i].get());
+        }
+    }
+
+    batches_.clear();
+    queued_.clear();
+    collecting_ = false;
+}
+
+void UPABatchRequests::SendBatch(const BatchKey& key, Batch& batch)
+{
+    UPAStreamManager &mgr = consumer_->StreamManager();
+
+    // drop anything that has been closed since it was added
+    std::vector<UPASubscription_ptr_t> items;
+    items.reserve(batch.items_.size());
+    for (size_t i = 0; i < batch.items_.size(); ++i)
+    {
+        const UPASubscription_ptr_t& sub = batch.items_[i];
+        queued_.erase(sub.get());
+        if (sub->GetSubscriptionState() == UPASubscription::SubscriptionStateSubscribing)
+        {
+            items.push_back(sub);
+        }
+        else
+        {
+            mgr.removePendingItem(sub.get());
+        }
+    }
+
+    batch.items_.clear();
+    batch.bytes_ = 0;
+
+    if (items.empty())
+    {
+        return;
+    }
+
+    // the subscriptions may have to send their own requests, which mustnt come back here
+    bool collecting = collecting_;
+    collecting_ = false;
+
+    if (items.size() == 1 || !SendBatchRequest(key, items))
+    {
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            items[i]->SendOpenRequest(!key.streaming_);
+        }
+    }
+
+    collecting_ = collecting;
+}
+
+bool UPABatchRequests::SendBatchRequest(const BatchKey& key, const std::vector<UPASubscription_ptr_t>& items)
+{
+    RsslChannel * chnl = consumer_->RsslConsumerChannel();
+    if (chnl == 0)
+    {
+        return false;
+    }
+
+    RsslError error;
+    RsslBuffer * msgBuf = rsslGetBuffer(chnl, maxBytes_, RSSL_FALSE, &error);
+    if (msgBuf == 0)
+    {
+        return false;
+    }
+
+    // one stream for the batch request and then one for each item
+    UPAStreamManager &mgr = consumer_->StreamManager();
+    RsslUInt32 count = (RsslUInt32)items.size();
+    RsslUInt32 batchStreamId = mgr.ReserveStreamRange(count + 1);
+    if (batchStreamId == 0)
+    {
+        rsslReleaseBuffer(msgBuf, &error);
+        return false;
+    }
+
+    if (EncodeBatchRequest(chnl, msgBuf, batchStreamId, key, items) != RSSL_RET_SUCCESS)
+    {
+        rsslReleaseBuffer(msgBuf, &error);
+        mgr.ReturnStreamRange(batchStreamId, count + 1);
+        t42log_warn("Failed to encode batch request, sending %u item requests instead\n", count);
+        return false;
+    }
+
+    // the provider opens the items on the streams after the batch stream, in the order of the list
+    for (RsslUInt32 i = 0; i < count; ++i)
+    {
+        items[i]->OpenInBatch(batchStreamId + 1 + i);
+    }
+
+    t42log_debug("Send batch request for %u items on stream %u\n", count, batchStreamId);
+
+    if (SendUPAMessage(chnl, msgBuf) != RSSL_RET_SUCCESS)
+    {
+        for (RsslUInt32 i = 0; i < count; ++i)
+        {
+            mgr.removePendingItem(items[i].get());
+            consumer_->StatsSubscriptionsFailed();
+        }
+    }
+
+    return true;
+}
+
+RsslRet UPABatchRequests::EncodeBatchRequest(RsslChannel* chnl, RsslBuffer* msgBuf, RsslUInt32 streamId, const BatchKey& key,
+    const std::vector<UPASubscription_ptr_t>& items)
+{
+    RsslRet ret = 0;
+    RsslRequestMsg msg = RSSL_INIT_REQUEST_MSG;
+    RsslEncodeIterator encodeIter;
+
+    rsslClearEncodeIterator(&encodeIter);
+
+    msg.msgBase.msgClass = RSSL_MC_REQUEST;
+    msg.msgBase.streamId = streamId;
+    msg.msgBase.domainType = key.domainType_;
+    msg.msgBase.containerType = RSSL_DT_ELEMENT_LIST;
+    msg.flags = RSSL_RQMF_HAS_BATCH | RSSL_RQMF_HAS_PRIORITY;
+    if (key.streaming_)
+    {
+        msg.flags |= RSSL_RQMF_STREAMING;
+    }
+
+    msg.priorityClass = 1;
+    msg.priorityCount = 1;
+
+    // the names go in the payload, so the key just carries the service
+    msg.msgBase.msgKey.flags = RSSL_MKF_HAS_NAME_TYPE | RSSL_MKF_HAS_SERVICE_ID;
+    msg.msgBase.msgKey.nameType = RDM_INSTRUMENT_NAME_TYPE_RIC;
+    msg.msgBase.msgKey.serviceId = key.serviceId_;
+
+    // the items in a batch all come from the same source, so share its view
+    const RMDSSource_ptr_t& source = items[0]->Source();
+    bool view = consumer_->ViewsSupported() && source->HasView();
+    if (view)
+    {
+        msg.flags |= RSSL_RQMF_HAS_VIEW;
+    }
+
+    if ((ret = rsslSetEncodeIteratorBuffer(&encodeIter, msgBuf)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslSetEncodeIteratorBuffer() failed with return code: %d\n", ret);
+        return ret;
+    }
+    rsslSetEncodeIteratorRWFVersion(&encodeIter, chnl->majorVersion, chnl->minorVersion);
+    if ((ret = rsslEncodeMsgInit(&encodeIter, (RsslMsg*)&msg, 0)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeMsgInit() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    RsslElementList elementList = RSSL_INIT_ELEMENT_LIST;
+    elementList.flags = RSSL_ELF_HAS_STANDARD_DATA;
+    if ((ret = rsslEncodeElementListInit(&encodeIter, &elementList, 0, 0)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeElementListInit() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    RsslElementEntry element = RSSL_INIT_ELEMENT_ENTRY;
+    element.name = RSSL_ENAME_BATCH_ITEM_LIST;
+    element.dataType = RSSL_DT_ARRAY;
+    if ((ret = rsslEncodeElementEntryInit(&encodeIter, &element, 0)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeElementEntryInit() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    RsslArray itemList = RSSL_INIT_ARRAY;
+    itemList.primitiveType = RSSL_DT_ASCII_STRING;
+    itemList.itemLength = 0;
+    if ((ret = rsslEncodeArrayInit(&encodeIter, &itemList)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeArrayInit() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        const std::string& symbol = items[i]->Symbol();
+        RsslBuffer name;
+        name.data = const_cast<char *>(symbol.c_str());
+        name.length = (RsslUInt32)symbol.length();
+        if ((ret = rsslEncodeArrayEntry(&encodeIter, 0, &name)) < RSSL_RET_SUCCESS)
+        {
+            t42log_error("rsslEncodeArrayEntry() failed with return code: %d\n", ret);
+            return ret;
+        }
+    }
+
+    if ((ret = rsslEncodeArrayComplete(&encodeIter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeArrayComplete() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    if ((ret = rsslEncodeElementEntryComplete(&encodeIter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeElementEntryComplete() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    if (view && (ret = source->EncodeView(&encodeIter)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    if ((ret = rsslEncodeElementListComplete(&encodeIter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeElementListComplete() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    if ((ret = rsslEncodeMsgComplete(&encodeIter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        t42log_error("rsslEncodeMsgComplete() failed with return code: %d\n", ret);
+        return ret;
+    }
+
+    msgBuf->length = rsslGetEncodedBufferLength(&encodeIter);
+
+    return RSSL_RET_SUCCESS;
+}
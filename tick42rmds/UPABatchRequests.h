@@ -0,0 +1,120 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __UPABATCHREQUESTS_H__
+#define __UPABATCHREQUESTS_H__
+
+#include "rmdsBridgeTypes.h"
+
+class UPAConsumer;
+
+// Coalesces the item opens that the consumer dispatches from its request queue into RDM batch requests.
+//
+// While PumpQueueEvents works through the queue, the opens for items that havent got a stream on the current channel
+// are collected by service, domain and whether they are snapshots, rather than being sent one by one. Each batch goes
+// as a single request carrying the item names in an :ItemList, on the first of a range of consecutive stream ids
+// reserved from the stream manager. The provider opens the items on the stream ids that follow, in the order of the
+// list, and closes the batch stream.
+//
+// A batch is sent when it reaches maxItems or fills a message, and the rest are sent when PumpQueueEvents has finished
+// dispatching. A batch of one, or one that cant be encoded, is sent as ordinary item requests. Batching is only used
+// when the provider advertises SupportBatchRequests in its login refresh.
+
+class UPABatchRequests
+{
+public:
+    UPABatchRequests();
+
+    // maxItems bounds the items in one request, and maxBytes the size of the message
+    void Configure(UPAConsumer * consumer, bool enabled, size_t maxItems, RsslUInt32 maxBytes);
+
+    bool Enabled() const
+    {
+        return enabled_;
+    }
+
+    // consumer thread - collect the opens dispatched from now on, if the provider supports batch requests
+    void Begin(bool providerSupportsBatch);
+
+    // add the open to its batch. Returns false if we arent collecting, in which case the subscription sends its own
+    // request. Returns true without adding it again if it is already waiting in a batch
+    bool Add(const UPASubscription_ptr_t& sub, bool isSnapshot);
+
+    // stop collecting and send what has been collected
+    void Send();
+
+    // stop collecting and drop what has been collected
+    void Clear();
+
+private:
+    struct BatchKey
+    {
+        RsslUInt16 serviceId_;
+        RsslUInt8 domainType_;
+        bool streaming_;
+
+        bool operator<(const BatchKey& rhs) const
+        {
+            if (serviceId_ != rhs.serviceId_)
+            {
+                return serviceId_ < rhs.serviceId_;
+            }
+            if (domainType_ != rhs.domainType_)
+            {
+                return domainType_ < rhs.domainType_;
+            }
+            return streaming_ < rhs.streaming_;
+        }
+    };
+
+    struct Batch
+    {
+        Batch() : bytes_(0) {}
+
+        std::vector<UPASubscription_ptr_t> items_;
+        RsslUInt32 bytes_;
+    };
+
+    typedef std::map<BatchKey, Batch> Batches_t;
+
+    void SendBatch(const BatchKey& key, Batch& batch);
+    bool SendBatchRequest(const BatchKey& key, const std::vector<UPASubscription_ptr_t>& items);
+    RsslRet EncodeBatchRequest(RsslChannel* chnl, RsslBuffer* msgBuf, RsslUInt32 streamId, const BatchKey& key,
+        const std::vector<UPASubscription_ptr_t>& items);
+
+    UPAConsumer * consumer_;
+    bool enabled_;
+    size_t maxItems_;
+    RsslUInt32 maxBytes_;
+
+    bool collecting_;
+    Batches_t batches_;
+
+    // the subscriptions waiting in the batches, so that a second request for one of them before its batch goes, such
+    // as a recap, doesnt put it in twice
+    std::set<UPASubscription *> queued_;
+};
+
+#endif //__UPABATCHREQUESTS_H__
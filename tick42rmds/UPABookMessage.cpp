@@ -89,465 +89,624 @@ static mamaPricePrecision RsslHintToMamaPrecisionTo( RsslRealHints p, uint16_t f
    }
 }
 
-UPABookByOrderMessage::UPABookByOrderMessage(void)
+namespace
 {
+    // price hints below EXPONENT0 are negative powers of 10, so trailing zeros in the value can be moved into the hint
+    RsslReal CanonicalPrice(RsslReal price)
+    {
+        if (price.value == 0)
+        {
+            price.hint = RSSL_RH_EXPONENT0;
+        }
+        else
+        {
+            while (price.hint < RSSL_RH_EXPONENT0 && (price.value % 10) == 0)
+            {
+                price.value /= 10;
+                ++price.hint;
+            }
+        }
+        return price;
+    }
 
-}
+    inline bool SamePrice(const RsslReal& lhs, const RsslReal& rhs)
+    {
+        return (lhs.value == rhs.value) && (lhs.hint == rhs.hint);
+    }
 
+    double PriceSortKey(const RsslReal& price)
+    {
+        RsslDouble value = 0;
+        rsslRealToDouble(&value, const_cast<RsslReal *>(&price));
+        return value;
+    }
 
-UPABookByOrderMessage::~UPABookByOrderMessage(void)
-{
+    // bids are sorted high to low, asks low to high
+    inline bool Better(char sideCode, double lhs, double rhs)
+    {
+        return (sideCode == 'B') ? (lhs > rhs) : (lhs < rhs);
+    }
 }
 
-bool UPABookByOrderMessage::AddEntry(const UPABookEntry_ptr_t& entry )
+void UPABookOrderId::Assign(const char * data, size_t length)
 {
+    length_ = length;
+    if (length <= InlineLength)
+    {
+        memcpy(inline_, data, length);
+        inline_[length] = '\0';
+    }
+    else
+    {
+        spill_.assign(data, length);
+    }
 
-    // look up the level on the key (price)
-    // add a new one if needed
-    // and insert the entry
+    // FNV-1a
+    size_t hash = 2166136261U;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619U;
+    }
+    hash_ = hash;
+}
 
-    t42log_debug("adding entry price %llu, order id %s\n", entry->Price().value, entry->Orderid().c_str());
-    RsslInt    key = entry->Price().value;
+UPALevel::UPALevel(RsslReal price, double sortKey, RsslUInt64 time, char sideCode)
+   : price_(price), sortKey_(sortKey), time_(time), actionCode_('A'), sideCode_(sideCode), numOrders_(0), dirty_(false)
+{
+}
 
-    UPALevel_ptr_t level;
+UPABookByOrderMessage::UPABookByOrderMessage(void)
+    : orderIndexMask_(0), numOrders_(0), price_(NULL), dateTime_(NULL)
+{
 
+}
 
-    // look up the entry in the ordermap
 
-    OrderMap_t::iterator it = orderMap_.find(entry->Orderid());
+UPABookByOrderMessage::~UPABookByOrderMessage(void)
+{
+    for (size_t index = 0; index < levelMsgs_.size(); index++)
+    {
+        mamaMsg_destroy(levelMsgs_[index]);
+    }
 
-    if (it == orderMap_.end() )
+    for (size_t index = 0; index < entryMsgs_.size(); index++)
     {
-        // add to the map
-        orderMap_[entry->Orderid()] = entry;
+        mamaMsg_destroy(entryMsgs_[index]);
     }
 
-    if (entry->SideCode()== 'A')
+    if (price_ != NULL)
     {
-        // its ASK
-        LevelMap_t::iterator it = levelMapAsk_.find(key);
+        mamaPrice_destroy(price_);
+    }
 
-        if (it == levelMapAsk_.end())
-        {
-            // don't have a level for this key
-            level = UPALevel_ptr_t(new UPALevel(entry->Price(), entry->Time(), 'A', entry->Size(), fieldmap_));
-            //level->setFids(fids_);
-            levelMapAsk_[key] = level;
-        }
-        else
-        {
-            level = it->second;
-        }
+    if (dateTime_ != NULL)
+    {
+        mamaDateTime_destroy(dateTime_);
     }
-    else if (entry->SideCode()== 'B')
+}
+
+UPABookByOrderMessage::Order* UPABookByOrderMessage::FindOrder(const UPABookOrderId& orderId)
+{
+    if (numOrders_ == 0)
     {
-        // its BID
-        LevelMap_t::iterator it = levelMapBid_.find(key);
+        return 0;
+    }
 
-        if (it == levelMapBid_.end())
+    size_t pos = orderId.Hash() & orderIndexMask_;
+    for (;;)
+    {
+        uint32_t entry = orderIndex_[pos];
+        if (entry == 0)
         {
-            // don't have a level for this key
-            level = UPALevel_ptr_t(new UPALevel(entry->Price(), entry->Time(), 'B', entry->Size(),fieldmap_));
-            levelMapBid_[key] = level;
+            return 0;
         }
-        else
+
+        if (orders_[entry - 1].orderId_ == orderId)
         {
-            level = it->second;
+            return &orders_[entry - 1];
         }
+
+        pos = (pos + 1) & orderIndexMask_;
     }
-    else
+}
+
+UPABookByOrderMessage::Order& UPABookByOrderMessage::InsertOrder(const UPABookOrderId& orderId)
+{
+    // keep the index at most half full
+    if ((numOrders_ + 1) * 2 > orderIndex_.size())
     {
-        // todo access the symbol name and other data and insert into wwarning message
-        t42log_warn("Unexpected level side code, ignoring update");
-        return false;
+        GrowOrderIndex();
     }
 
-
-    if (level.get() != 0)
+    uint32_t slot;
+    if (!freeOrders_.empty())
     {
-        level->AddEntry(entry);
+        slot = freeOrders_.back();
+        freeOrders_.pop_back();
     }
     else
     {
-        t42log_warn("null level");
+        slot = (uint32_t)orders_.size();
+        orders_.push_back(Order());
     }
 
-    return true;
+    Order& order = orders_[slot];
+    order.orderId_ = orderId;
+
+    size_t pos = orderId.Hash() & orderIndexMask_;
+    while (orderIndex_[pos] != 0)
+    {
+        pos = (pos + 1) & orderIndexMask_;
+    }
+    orderIndex_[pos] = slot + 1;
+    ++numOrders_;
 
+    return order;
 }
 
-bool UPABookByOrderMessage::UpdateEntry(const UPABookEntry_ptr_t& entry )
+void UPABookByOrderMessage::EraseOrder(const UPABookOrderId& orderId)
 {
-    t42log_debug("updating entry price %llu, order id %s\n", entry->Price().value, entry->Orderid().c_str());
-
-
-    // look up the order id
-    OrderMap_t::iterator it = orderMap_.find(entry->Orderid());
-    if (it == orderMap_.end() )
+    size_t pos = orderId.Hash() & orderIndexMask_;
+    for (;;)
     {
-        // should be an update to an existing order
-        // so log a warning
-        // todo add symbol name to log message
-        t42log_warn("received update order for non existent order id %s - ignored", entry->Orderid().c_str());
-        return false;
-    }
+        uint32_t entry = orderIndex_[pos];
+        if (entry == 0)
+        {
+            return;
+        }
 
-    UPABookEntry_ptr_t existingEntry = it->second;
+        if (orders_[entry - 1].orderId_ == orderId)
+        {
+            freeOrders_.push_back(entry - 1);
+            break;
+        }
 
-    // now we need to check if either the price or the size has changed
+        pos = (pos + 1) & orderIndexMask_;
+    }
 
-    // if its the price we need to remove from the existing level and add to a new one. If its the size then we just need to update in the existing level.
-    // If we process the price change first then  that will handle an update that is both price and size
+    // close the gap by shifting back the entries that probed past it, so every lookup still finds its order without
+    // needing tombstones
+    size_t hole = pos;
+    size_t next = (hole + 1) & orderIndexMask_;
+    while (orderIndex_[next] != 0)
+    {
+        size_t home = orders_[orderIndex_[next] - 1].orderId_.Hash() & orderIndexMask_;
+        if (((next - home) & orderIndexMask_) >= ((next - hole) & orderIndexMask_))
+        {
+            orderIndex_[hole] = orderIndex_[next];
+            hole = next;
+        }
+        next = (next + 1) & orderIndexMask_;
+    }
+    orderIndex_[hole] = 0;
+    --numOrders_;
+}
 
+void UPABookByOrderMessage::GrowOrderIndex()
+{
+    size_t size = orderIndex_.empty() ? 256 : orderIndex_.size() * 2;
+    orderIndex_.assign(size, 0);
+    orderIndexMask_ = size - 1;
 
-    if (existingEntry->Price().value != entry->Price().value)
+    // re-index the orders in use, the free slots are skipped
+    std::vector<bool> free(orders_.size(), false);
+    for (size_t i = 0; i < freeOrders_.size(); ++i)
     {
+        free[freeOrders_[i]] = true;
+    }
 
-        RsslInt    key = existingEntry->Price().value;
-        UPALevel_ptr_t oldLevel;
+    for (size_t i = 0; i < orders_.size(); ++i)
+    {
+        if (free[i])
+        {
+            continue;
+        }
 
-        if (existingEntry->SideCode()== 'A')
+        size_t pos = orders_[i].orderId_.Hash() & orderIndexMask_;
+        while (orderIndex_[pos] != 0)
         {
-            // its ASK
-            LevelMap_t::iterator it = levelMapAsk_.find(key);
+            pos = (pos + 1) & orderIndexMask_;
+        }
+        orderIndex_[pos] = (uint32_t)(i + 1);
+    }
+}
 
-            if (it == levelMapAsk_.end())
-            {
-                // dont have a level for this key
-                t42log_warn("received update order for order at non-existent level id %s - ignored", entry->Orderid().c_str());
-                return false;
-            }
+UPABookByOrderMessage::Levels_t* UPABookByOrderMessage::Side(char sideCode)
+{
+    if (sideCode == 'B')
+    {
+        return &bids_;
+    }
+    if (sideCode == 'A')
+    {
+        return &asks_;
+    }
+    return 0;
+}
 
-            // need to set the side code because an rssl entry update may not contain it
-            entry->SideCode('A');
+const UPABookByOrderMessage::Levels_t* UPABookByOrderMessage::Side(char sideCode) const
+{
+    return const_cast<UPABookByOrderMessage *>(this)->Side(sideCode);
+}
 
-            oldLevel = it->second;
-        }
-        else if (existingEntry->SideCode()== 'B')
-        {
-            // its BID
-            LevelMap_t::iterator it = levelMapBid_.find(key);
+size_t UPABookByOrderMessage::NumLevels(char sideCode) const
+{
+    const Levels_t* levels = Side(sideCode);
+    return (levels != 0) ? levels->size() : 0;
+}
 
-            if (it == levelMapBid_.end())
-            {
-                // dont have a level for this key
-                t42log_warn("received update order for order at non-existent level id %s - ignored", entry->Orderid().c_str());
-                return false;
-            }
+const UPALevel* UPABookByOrderMessage::Level(char sideCode, size_t depth) const
+{
+    const Levels_t* levels = Side(sideCode);
+    return (levels != 0 && depth < levels->size()) ? &(*levels)[depth] : 0;
+}
 
-            // need to set the side code because an rssl entry update may not contain it
-            entry->SideCode('B');
-            oldLevel = it->second;
+size_t UPABookByOrderMessage::FindLevel(const Levels_t& levels, char sideCode, const RsslReal& price, double sortKey, bool& found) const
+{
+    // first level that isnt better than the price
+    size_t low = 0;
+    size_t high = levels.size();
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (Better(sideCode, levels[mid].SortKey(), sortKey))
+        {
+            low = mid + 1;
         }
         else
         {
-            // todo access the symbol name and other data and insert into wwarning message
-            t42log_warn("Unexpected level side code, ignoring update");
-            return false;
+            high = mid;
         }
+    }
 
-        // Now we have the level (and side) of the existing entry for this order id
-        // so add a delete entry for the order
-        existingEntry->ActionCode('D');
-        oldLevel->AddEntry(existingEntry);
-
-        // now we need to add the updated entry at a new level
-
-        entry->ActionCode('A');
-        AddEntry(entry);
+    found = (low < levels.size()) && SamePrice(levels[low].Price(), price);
+    return low;
+}
 
+UPALevel* UPABookByOrderMessage::GetLevel(char sideCode, RsslReal price, RsslUInt64 time, bool create)
+{
+    Levels_t* levels = Side(sideCode);
+    if (levels == 0)
+    {
+        // todo access the symbol name and other data and insert into wwarning message
+        t42log_warn("Unexpected level side code, ignoring update");
+        return 0;
+    }
 
-        // then replace the entry in the orderid map.
+    price = CanonicalPrice(price);
+    double sortKey = PriceSortKey(price);
 
-        orderMap_[entry->Orderid()] = entry;
-    }
-    else
+    bool found = false;
+    size_t pos = FindLevel(*levels, sideCode, price, sortKey, found);
+    if (found)
     {
-        // no change to the level
+        return &(*levels)[pos];
+    }
 
-        RsslInt    key = existingEntry->Price().value;
+    if (!create)
+    {
+        return 0;
+    }
 
-        if (existingEntry->SideCode()== 'A')
-        {
-            // its ASK
-            LevelMap_t::iterator it = levelMapAsk_.find(key);
+    levels->insert(levels->begin() + pos, UPALevel(price, sortKey, time, sideCode));
+    return &(*levels)[pos];
+}
 
-            if (it == levelMapAsk_.end())
-            {
-                // dont have a level for this key
-                t42log_warn("received update order for order at non-existent level id %s - ignored", entry->Orderid().c_str());
-                return false;
-            }
+void UPABookByOrderMessage::AddDelta(UPALevel& level, const UPABookOrderId& orderId, char actionCode, RsslInt size)
+{
+    if (!level.dirty_)
+    {
+        level.dirty_ = true;
+        DirtyLevel dirty = { level.SideCode(), level.Price() };
+        dirtyLevels_.push_back(dirty);
+    }
 
-            // need to set the side code because an rssl entry update may not contain it
-            entry->SideCode('A');
+    level.deltas_.push_back(UPABookDelta());
+    UPABookDelta& delta = level.deltas_.back();
+    delta.orderId_ = orderId;
+    delta.actionCode_ = actionCode;
+    delta.size_ = size;
+}
 
-            // and add the update entry tpo the level
-            it->second->AddEntry(entry);
-        }
-        else if (existingEntry->SideCode()== 'B')
-        {
-            // its BID
-            LevelMap_t::iterator it = levelMapBid_.find(key);
+bool UPABookByOrderMessage::AddEntry(const UPABookEntry& entry )
+{
 
-            if (it == levelMapBid_.end())
-            {
-                // dont have a level for this key
-                t42log_warn("received update order for order at non-existent level id %s - ignored", entry->Orderid().c_str());
-                return false;
-            }
+    // look up the level on the key (price)
+    // add a new one if needed
+    // and insert the entry
 
-            // need to set the side code because an rssl entry update may not contain it
-            entry->SideCode('B');
+    t42log_debug("adding entry price %llu, order id %s\n", entry.Price().value, entry.Orderid().c_str());
 
-            // and add the update entry tpo the level
-            it->second->AddEntry(entry);
-        }
-        else
-        {
-            // todo access the symbol name and other data and insert into wwarning message
-            t42log_warn("Unexpected level side code, ignoring update");
-            return false;
-        }
+    char sideCode = entry.SideCode();
+    if (sideCode != 'A' && sideCode != 'B')
+    {
+        // todo access the symbol name and other data and insert into wwarning message
+        t42log_warn("Unexpected level side code, ignoring update");
+        return false;
+    }
 
+    orderId_.Assign(entry.Orderid().data(), entry.Orderid().size());
 
+    Order* order = FindOrder(orderId_);
+    if (order != 0 && (order->sideCode_ != sideCode || !SamePrice(CanonicalPrice(order->price_), CanonicalPrice(entry.Price()))))
+    {
+        // an add for an order we already hold at another price, so move it
+        RemoveEntry(entry);
+        order = 0;
+    }
 
+    UPALevel* level = GetLevel(sideCode, entry.Price(), entry.Time(), true);
+    if (level == 0)
+    {
+        return false;
     }
 
-    return true;
+    if (order == 0)
+    {
+        order = &InsertOrder(orderId_);
+        order->price_ = entry.Price();
+        order->sideCode_ = sideCode;
+        ++level->numOrders_;
+    }
 
-}
+    order->size_ = entry.Size();
+    order->time_ = entry.Time();
 
+    AddDelta(*level, orderId_, 'A', entry.Size());
 
+    return true;
 
+}
 
-bool UPABookByOrderMessage::RemoveEntry(const UPABookEntry_ptr_t& entry )
+bool UPABookByOrderMessage::UpdateEntry(const UPABookEntry& entry )
 {
-
+    t42log_debug("updating entry price %llu, order id %s\n", entry.Price().value, entry.Orderid().c_str());
 
     // look up the order id
-    OrderMap_t::iterator it = orderMap_.find(entry->Orderid());
-    if (it == orderMap_.end() )
+    orderId_.Assign(entry.Orderid().data(), entry.Orderid().size());
+    Order* order = FindOrder(orderId_);
+    if (order == 0)
     {
         // should be an update to an existing order
         // so log a warning
         // todo add symbol name to log message
-        t42log_warn("received delete order for non existent order id %s - ignored", entry->Orderid().c_str());
+        t42log_warn("received update order for non existent order id %s - ignored", entry.Orderid().c_str());
         return false;
     }
 
-    UPABookEntry_ptr_t existingEntry = it->second;
-
-    // have to get the order level key from the existing entry as the new 'delete' entry doesnt have a price in it, just the order id
-    RsslInt    key = existingEntry->Price().value;
+    // an rssl entry update may not contain the side code, so the order keeps the side it was added with
+    char sideCode = order->sideCode_;
+    UPALevel* level = GetLevel(sideCode, order->price_, 0, false);
+    if (level == 0)
+    {
+        // dont have a level for this key
+        t42log_warn("received update order for order at non-existent level id %s - ignored", entry.Orderid().c_str());
+        return false;
+    }
 
-    // remove from the order map
-    orderMap_.erase(it);
+    // now we need to check if either the price or the size has changed
 
+    // if its the price we need to remove from the existing level and add to a new one. If its the size then we just
+    // need to update in the existing level. If we process the price change first then that will handle an update that
+    // is both price and size
+    if (order->price_.value != entry.Price().value)
+    {
+        // delete the order from its level, as it stood
+        AddDelta(*level, orderId_, 'D', order->size_);
+        --level->numOrders_;
+
+        // and add the updated order at its new level. Adding a level can move the others so find it now
+        UPALevel* newLevel = GetLevel(sideCode, entry.Price(), entry.Time(), true);
+        ++newLevel->numOrders_;
+        AddDelta(*newLevel, orderId_, 'A', entry.Size());
+
+        // the pool doesnt move when levels are added, but look the order up again rather than rely on it
+        order = FindOrder(orderId_);
+        order->price_ = entry.Price();
+    }
+    else
+    {
+        // no change to the level
+        AddDelta(*level, orderId_, 'U', entry.Size());
+    }
 
-    // now find the level for this order
-    UPALevel_ptr_t level;
+    order->size_ = entry.Size();
+    order->time_ = entry.Time();
 
-    if (existingEntry->SideCode()== 'A')
-    {
-        // its ASK
-        LevelMap_t::iterator it = levelMapAsk_.find(key);
+    return true;
 
-        if (it == levelMapAsk_.end())
-        {
-            // dont have a level for this key
-            t42log_warn("received update order for order at non-existent level id %s - ignored", entry->Orderid().c_str());
-            return false;
-        }
+}
 
-        // need to set the side code because an rssl entry update may not contain it
-        entry->SideCode('A');
 
-        level = it->second;
-    }
-    else if (existingEntry->SideCode()== 'B')
-    {
-        // its BID
-        LevelMap_t::iterator it = levelMapBid_.find(key);
 
-        if (it == levelMapBid_.end())
-        {
-            // dont have a level for this key
-            t42log_warn("received update order for order at non-existent level id %s - ignored", entry->Orderid().c_str());
-            return false;
-        }
 
-        // need to set the side code because an rssl entry update may not contain it
-        entry->SideCode('B');
-        level = it->second;
-    }
-    else
+bool UPABookByOrderMessage::RemoveEntry(const UPABookEntry& entry )
+{
+    // look up the order id
+    orderId_.Assign(entry.Orderid().data(), entry.Orderid().size());
+    Order* order = FindOrder(orderId_);
+    if (order == 0)
     {
-        // todo access the symbol name and other data and insert into wwarning message
-        t42log_warn("Unexpected level side code, ignoring update");
+        // should be an update to an existing order
+        // so log a warning
+        // todo add symbol name to log message
+        t42log_warn("received delete order for non existent order id %s - ignored", entry.Orderid().c_str());
         return false;
     }
 
-    // set the action to delete
-    existingEntry->ActionCode('D');
+    // have to get the order level key from the existing entry as the new 'delete' entry doesnt have a price in it, just the order id
+    UPALevel* level = GetLevel(order->sideCode_, order->price_, 0, false);
+    RsslInt size = order->size_;
 
-    level->AddEntry(existingEntry);
+    // remove from the order pool
+    EraseOrder(orderId_);
 
+    if (level == 0)
+    {
+        // dont have a level for this key
+        t42log_warn("received update order for order at non-existent level id %s - ignored", entry.Orderid().c_str());
+        return false;
+    }
 
+    --level->numOrders_;
+    AddDelta(*level, orderId_, 'D', size);
 
     return true;
 
 }
 
-bool UPABookByOrderMessage::BuildMamdaMessage( mamaMsg msg )
+void UPABookByOrderMessage::ReserveMessages(std::vector<mamaMsg>& msgs, size_t count)
 {
-    // need to accumulate the number of levels in the message as we go as there will be multiple keys for the same level value
-    int numLevels = 0;
-    const BookFields &bookFields = UpaMamaCommonFields::BookFields();
-
-    // grow the levelMsgs vector if we need to
-    // just work on the sum of the bid and ask levels
-    numLevelMsgs_ = (RsslUInt16)(levelMapBid_.size() + levelMapAsk_.size());
-
-    if (numLevelMsgs_ > levelMsgs_.size())
+    // the messages are reused from update to update, we just create more when an update needs them
+    size_t originalSize = msgs.size();
+    if (count > originalSize)
     {
-        size_t originalSize = levelMsgs_.size();
-        levelMsgs_.resize(numLevelMsgs_);
-        // create a new mamaMsg for each of the new elements
-        for(size_t index = originalSize; index < numLevelMsgs_; index++)
+        msgs.resize(count);
+        for (size_t index = originalSize; index < count; index++)
         {
             mamaMsg newMsg;
             mamaMsg_createForPayload(&newMsg, MAMA_PAYLOAD_TICK42RMDS);
-            levelMsgs_[index] = newMsg;
+            msgs[index] = newMsg;
         }
     }
+}
 
-    // walk the map and process each book level
-    // do the ask side
-    LevelMap_t::iterator it = levelMapAsk_.begin();
-
-    while(it != levelMapAsk_.end())
-    {
-        UPALevel_ptr_t level = it->second;
-
-        // Mamda wants to identify the level with a mamaPrice
-        RsslReal levelPrice = level->Price();
-        RsslDouble dblVal;
-        rsslRealToDouble(&dblVal, &levelPrice);
-
-        mamaPrice p;
-        mamaPrice_create(&p);
-        mamaPrice_setValue(p, dblVal);
-        mamaPricePrecision prec = RsslHintToMamaPrecisionTo((RsslRealHints) levelPrice.hint, 653);
-        mamaPrice_setPrecision(p, prec);
-
-        mamaMsg levelMsg = levelMsgs_[numLevels];
-
-        //t42log_debug("created message for level   at 0x%08x", (void*)levelMsg);
-
-        // 654|wPlSide
-        mamaMsg_addChar(levelMsg, bookFields.wPlSide.mama_field_name.c_str(), bookFields.wPlSide.mama_fid, 'A');
-
-        // 653|wPlPrice
-        mamaMsg_addPrice(levelMsg, bookFields.wPlPrice.mama_field_name.c_str(), bookFields.wPlPrice.mama_fid, p); //p is copied and should be destroyed later on!
-        mamaPrice_destroy(p);
+void UPABookByOrderMessage::AddLevelToMsg(const UPALevel& level, mamaMsg levelMsg, size_t& entryMsg, mama_u64_t midnight)
+{
+    const BookFields &bookFields = UpaMamaCommonFields::BookFields();
 
-        // 658|wPlTime
-        mamaDateTime dt =  makeDateTime((mama_u64_t)level->Time());
-        mamaMsg_addDateTime(levelMsg, bookFields.wPlTime.mama_field_name.c_str(), bookFields.wPlTime.mama_fid, dt);
-        mamaDateTime_destroy(dt);
+    // Mamda wants to identify the level with a mamaPrice
+    RsslReal levelPrice = level.Price();
+    mamaPrice_setValue(price_, level.SortKey());
+    mamaPricePrecision prec = RsslHintToMamaPrecisionTo((RsslRealHints) levelPrice.hint, 653);
+    mamaPrice_setPrecision(price_, prec);
 
-        if (level->NumOrders() == 0)
-        {
-            // level is empty so set a delete message and remove the level
-            // 652|wPlAction
-            mamaMsg_addChar(levelMsg, bookFields.wPlAction.mama_field_name.c_str(), bookFields.wPlAction.mama_fid, 'D');
+    // 654|wPlSide
+    mamaMsg_addChar(levelMsg, bookFields.wPlSide.mama_field_name.c_str(), bookFields.wPlSide.mama_fid, level.SideCode());
 
-            // 657|wPlNumEntries
-            mamaMsg_addI32(levelMsg, bookFields.wPlNumEntries.mama_field_name.c_str(), bookFields.wPlNumEntries.mama_fid, 0);
-            mamaMsg_addI32(levelMsg, bookFields.wPlNumAttach.mama_field_name.c_str(), bookFields.wPlNumAttach.mama_fid, 0);
+    // 653|wPlPrice
+    mamaMsg_addPrice(levelMsg, bookFields.wPlPrice.mama_field_name.c_str(), bookFields.wPlPrice.mama_fid, price_); // the price is copied
 
-            level->ClearMessageVector(levelMsg);
-            ++it;
-        }
-        else
-        {
-            // add the entries for this level
-            mamaMsg_addChar(levelMsg, bookFields.wPlAction.mama_field_name.c_str(), bookFields.wPlAction.mama_fid,  level->ActionCode());
+    // 658|wPlTime
+    mamaDateTime_setEpochTimeMicroseconds(dateTime_, midnight + (mama_u64_t)level.Time() * 1000);
+    mamaMsg_addDateTime(levelMsg, bookFields.wPlTime.mama_field_name.c_str(), bookFields.wPlTime.mama_fid, dateTime_);
 
-            int numEntries = level->AddEntriesToMsg(levelMsg);
-            // for some reason mamda reads this as f32
-            mamaMsg_addI32(levelMsg, bookFields.wPlNumEntries.mama_field_name.c_str(), bookFields.wPlNumEntries.mama_fid, numEntries);
+    if (level.NumOrders() == 0)
+    {
+        // level is empty so set a delete message and remove the level
+        // 652|wPlAction
+        mamaMsg_addChar(levelMsg, bookFields.wPlAction.mama_field_name.c_str(), bookFields.wPlAction.mama_fid, 'D');
 
-            ++it;
-        }
+        // 657|wPlNumEntries
+        mamaMsg_addI32(levelMsg, bookFields.wPlNumEntries.mama_field_name.c_str(), bookFields.wPlNumEntries.mama_fid, 0);
+        mamaMsg_addI32(levelMsg, bookFields.wPlNumAttach.mama_field_name.c_str(), bookFields.wPlNumAttach.mama_fid, 0);
 
-        levelMsgs_[numLevels] = levelMsg;
-        ++numLevels;
+        // just add an empty message vector
+        mamaMsg_addVectorMsg(levelMsg, bookFields.wPlEntries.mama_field_name.c_str(), bookFields.wPlEntries.mama_fid, entryMsgs_.data(), 0);
+        return;
     }
 
-    // then the bid side
-
-    it = levelMapBid_.begin();
+    // add the entries for this level
+    mamaMsg_addChar(levelMsg, bookFields.wPlAction.mama_field_name.c_str(), bookFields.wPlAction.mama_fid,  level.ActionCode());
 
-    while(it != levelMapBid_.end())
+    // each level gets its own run of the entry messages
+    const std::vector<UPABookDelta>& deltas = level.Deltas();
+    size_t firstEntryMsg = entryMsg;
+    for (std::vector<UPABookDelta>::const_iterator it = deltas.begin(); it != deltas.end(); ++it)
     {
-        UPALevel_ptr_t level = it->second;
-
-        // Mamda wants to identify the level with a mamaPrice
-        RsslReal levelPrice = level->Price();
-        RsslDouble dblVal;
-        rsslRealToDouble(&dblVal, &levelPrice);
+        mamaMsg msg = entryMsgs_[entryMsg++];
 
-        mamaPrice p;
-        mamaPrice_create(&p);
-        mamaPrice_setValue(p, dblVal);
-        mamaPricePrecision prec = RsslHintToMamaPrecisionTo((RsslRealHints) levelPrice.hint, 653);
-        mamaPrice_setPrecision(p, prec);
+        // 681|wEntryId
+        // 683|wEntryAction
+        // 682|wEntrySize
+        mamaMsg_addString(msg, bookFields.wEntryId.mama_field_name.c_str(), bookFields.wEntryId.mama_fid, it->orderId_.c_str());
+        mamaMsg_addChar(msg, bookFields.wEntryAction.mama_field_name.c_str(), bookFields.wEntryAction.mama_fid, it->actionCode_);
+        mamaMsg_addI64(msg, bookFields.wEntrySize.mama_field_name.c_str(), bookFields.wEntrySize.mama_fid, (mama_u64_t)it->size_);
 
-        mamaMsg levelMsg = levelMsgs_[numLevels];
+        // todo add entry time and status
+    }
 
-        //t42log_debug("created message for level   at 0x%08x", (void*)levelMsg);
+    int numEntries = (int)deltas.size();
 
-        // 654|wPlSide
-        mamaMsg_addChar(levelMsg, bookFields.wPlSide.mama_field_name.c_str(), bookFields.wPlSide.mama_fid, 'B');
-        // 653|wPlPrice
-        mamaMsg_addPrice(levelMsg, bookFields.wPlPrice.mama_field_name.c_str(), bookFields.wPlPrice.mama_fid, p);
-        mamaPrice_destroy(p);
+    // 700|wPlEntries
+    mamaMsg_addVectorMsg(levelMsg, bookFields.wPlEntries.mama_field_name.c_str(), bookFields.wPlEntries.mama_fid, entryMsgs_.data() + firstEntryMsg, numEntries);
+    // 659|wPlNumAttach|18
+    mamaMsg_addI32(levelMsg, bookFields.wPlNumAttach.mama_field_name.c_str(), bookFields.wPlNumAttach.mama_fid, numEntries);
 
-        mamaDateTime dt =  makeDateTime((mama_u64_t)level->Time());
-        mamaMsg_addDateTime(levelMsg, bookFields.wPlTime.mama_field_name.c_str(), bookFields.wPlTime.mama_fid, dt);
-        mamaDateTime_destroy(dt);
+    // for some reason mamda reads this as f32
+    mamaMsg_addI32(levelMsg, bookFields.wPlNumEntries.mama_field_name.c_str(), bookFields.wPlNumEntries.mama_fid, numEntries);
+}
 
-        if (level->NumOrders() == 0)
-        {
-            // level is empty so set a delete message and remove the level
-            // 652|wPlAction
-            mamaMsg_addChar(levelMsg, bookFields.wPlAction.mama_field_name.c_str(), bookFields.wPlAction.mama_fid, 'D');
+bool UPABookByOrderMessage::BuildMamdaMessage( mamaMsg msg, bool fullBook )
+{
+    const BookFields &bookFields = UpaMamaCommonFields::BookFields();
 
-            // 657|wPlNumEntries
-            mamaMsg_addI32(levelMsg, bookFields.wPlNumEntries.mama_field_name.c_str(), bookFields.wPlNumEntries.mama_fid, 0);
-            mamaMsg_addI32(levelMsg, bookFields.wPlNumAttach.mama_field_name.c_str(), bookFields.wPlNumAttach.mama_fid, 0);
+    if (price_ == NULL)
+    {
+        mamaPrice_create(&price_);
+        mamaDateTime_create(&dateTime_);
+    }
 
-            ++it;
+    // the level times are relative to midnight, which only needs working out once for the message
+    mama_u64_t midnight = 0;
+    mamaDateTime_setToMidnightToday(dateTime_, NULL);
+    mamaDateTime_getEpochTimeMicroseconds(dateTime_, &midnight);
 
-            level->ClearMessageVector(levelMsg);
+    // gather the levels to render, asks first then bids
+    std::vector<const UPALevel*>& levels = renderLevels_;
+    levels.clear();
+    size_t numEntries = 0;
+    if (fullBook)
+    {
+        for (Levels_t::const_iterator it = asks_.begin(); it != asks_.end(); ++it)
+        {
+            levels.push_back(&*it);
         }
-        else
+        for (Levels_t::const_iterator it = bids_.begin(); it != bids_.end(); ++it)
         {
-            // add the entries for this level
-            mamaMsg_addChar(levelMsg, bookFields.wPlAction.mama_field_name.c_str(), bookFields.wPlAction.mama_fid,  level->ActionCode());
-
-            int numEntries = level->AddEntriesToMsg(levelMsg);
-            // for some reason mamda reads this as float32
-            mamaMsg_addI32(levelMsg, bookFields.wPlNumEntries.mama_field_name.c_str(), bookFields.wPlNumEntries.mama_fid, numEntries);
+            levels.push_back(&*it);
+        }
+    }
+    else
+    {
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            char sideCode = (pass == 0) ? 'A' : 'B';
+            for (std::vector<DirtyLevel>::const_iterator it = dirtyLevels_.begin(); it != dirtyLevels_.end(); ++it)
+            {
+                if (it->sideCode_ != sideCode)
+                {
+                    continue;
+                }
+
+                bool found = false;
+                const Levels_t& side = *Side(sideCode);
+                size_t pos = FindLevel(side, sideCode, it->price_, PriceSortKey(it->price_), found);
+                if (found)
+                {
+                    levels.push_back(&side[pos]);
+                }
+            }
+        }
+    }
 
-            ++it;
+    for (std::vector<const UPALevel*>::const_iterator it = levels.begin(); it != levels.end(); ++it)
+    {
+        if ((*it)->NumOrders() != 0)
+        {
+            numEntries += (*it)->Deltas().size();
         }
+    }
 
-        // just let the vector grow on demand - we can preallocate if this has a big impact on performance
+    // grow the message vectors if we need to
+    ReserveMessages(levelMsgs_, levels.size());
+    ReserveMessages(entryMsgs_, numEntries);
 
-        levelMsgs_[numLevels] = levelMsg;
+    size_t entryMsg = 0;
+    int numLevels = 0;
+    for (std::vector<const UPALevel*>::const_iterator it = levels.begin(); it != levels.end(); ++it)
+    {
+        AddLevelToMsg(**it, levelMsgs_[numLevels], entryMsg, midnight);
         ++numLevels;
     }
 
@@ -561,70 +720,53 @@ bool UPABookByOrderMessage::BuildMamdaMessage( mamaMsg msg )
     return true;
 }
 
-bool UPABookByOrderMessage::StartUpdate()
+bool UPABookByOrderMessage::ResetDirtyLevels()
 {
-    // clear down all the deltas in each level
-
-    LevelMap_t::iterator it = levelMapBid_.begin();
-    while(it != levelMapBid_.end())
-    {
-        it->second->ClearDeltas();
-        ++it;
-    }
-
-    it = levelMapAsk_.begin();
-    while(it != levelMapAsk_.end())
-    {
-        it->second->ClearDeltas();
-        ++it;
-    }
-
-    return true;
-}
-
-bool UPABookByOrderMessage::EndUpdate(mamaMsg msg)
-{
-    // clean out any empty levels
-
-    LevelMap_t::iterator it = levelMapBid_.begin();
-    while(it != levelMapBid_.end())
+    bool removed = false;
+    for (std::vector<DirtyLevel>::const_iterator it = dirtyLevels_.begin(); it != dirtyLevels_.end(); ++it)
     {
+        Levels_t& side = *Side(it->sideCode_);
+        bool found = false;
+        size_t pos = FindLevel(side, it->sideCode_, it->price_, PriceSortKey(it->price_), found);
+        if (!found)
+        {
+            continue;
+        }
 
-        if (it->second->NumOrders()== 0)
+        UPALevel& level = side[pos];
+        if (level.NumOrders() == 0)
         {
-            it->second->ClearMessageVector(msg);
-            LevelMap_t::iterator eraseIt = it;
-            ++it;
-            levelMapBid_.erase(eraseIt);
+            side.erase(side.begin() + pos);
+            removed = true;
         }
         else
         {
-            ++it;
+            level.deltas_.clear();
+            level.dirty_ = false;
         }
-
     }
 
+    dirtyLevels_.clear();
+    return removed;
+}
 
-    it = levelMapAsk_.begin();
-    while(it != levelMapAsk_.end())
-    {
-        LevelMap_t::iterator eraseIt = it;
+bool UPABookByOrderMessage::StartUpdate()
+{
+    // clear down the deltas of the last update, if it didnt get as far as EndUpdate
+    ResetDirtyLevels();
 
-        if (it->second->NumOrders()== 0)
-        {
-            it->second->ClearMessageVector(msg);
-            LevelMap_t::iterator eraseIt = it;
-            ++it;
-            levelMapAsk_.erase(eraseIt);
-        }
-        else
-        {
-            ++it;
-        }
+    return true;
+}
 
+bool UPABookByOrderMessage::EndUpdate(mamaMsg msg)
+{
+    // clean out any empty levels
+    if (ResetDirtyLevels())
+    {
+        const BookFields &bookFields = UpaMamaCommonFields::BookFields();
+        mamaMsg_addVectorMsg(msg, bookFields.wPlEntries.mama_field_name.c_str(), bookFields.wPlEntries.mama_fid, entryMsgs_.data(), 0);
     }
 
-
     return true;
 }
 
@@ -647,6 +789,23 @@ UPABookEntry::UPABookEntry(void)
 }
 
 
+void UPABookEntry::Clear()
+{
+    actionCode_ = 'Z';
+    sideCode_ = 'Z';
+    orderid_.clear();
+    orderTone_.clear();
+    mmid_.clear();
+    size_ = 0;
+    numOrders_ = 0;
+    price_.value = 0;
+    price_.hint = RSSL_RH_EXPONENT0;
+    time_ = 0;
+    rsslClearState(&status_);
+    haveOrderTone_ = false;
+    haveMmid_ = false;
+}
+
 char UPABookEntry::ActionCode() const
 {
     return actionCode_;
@@ -779,122 +938,6 @@ bool UPABookEntry::HasSide()
     return sideCode_ != 'Z';
 }
 
-void UPALevel::AddEntry(const UPABookEntry_ptr_t& entry)
-{
-    if (entry->ActionCode()== 'D')
-    {
-        // if itd a delete then erase the order from this level
-        orders_.erase(entry->Orderid());
-    }
-    else if (entry->ActionCode()== 'A')
-    {
-        // if its an add then add it
-        orders_.insert(OrderIDSet_t::value_type(entry->Orderid()));
-    }
-    // and if its an update then it should already be there
-
-    entryListDelta_.emplace_back(entry);
-}
-
-void UPALevel::ClearDeltas()
-{
-    // just clear down the list of deltas
-    entryListDelta_.erase(entryListDelta_.begin(), entryListDelta_.end());
-}
-
-int UPALevel::AddEntriesToMsg( mamaMsg & msg )
-{
-    int numMsgs = 0;
-    const BookFields &bookFields = UpaMamaCommonFields::BookFields();
-
-    // grow the vector if we need to
-    size_t originalSize = entryMsgs_.size();
-    size_t numEntryMsgs = entryListDelta_.size();
-    if (entryListDelta_.size() > entryMsgs_.size())
-    {
-        entryMsgs_.resize(numEntryMsgs);
-
-        for(size_t index = originalSize; index < numEntryMsgs; index++)
-        {
-            mamaMsg newMsg;
-            mamaMsg_createForPayload(&newMsg, MAMA_PAYLOAD_TICK42RMDS);
-            entryMsgs_[index] = newMsg;
-        }
-    }
-
-    while(entryListDelta_.size() > 0)
-    {
-        // get the next entry
-        UPABookEntry_ptr_t entry = entryListDelta_.front();
-        entryListDelta_.pop_front();
-
-        // create a msg for it
-        mamaMsg entryMsg;
-        entryMsg = entryMsgs_[numMsgs];
-        //t42log_debug("created message for level delta  at 0x%08x", (void*)entryMsg);
-
-        entryMsgs_[numMsgs] = entryMsg;
-
-        // and populate the message
-        // 683|wEntryAction
-        // 681|wEntryId
-        // 682|wEntrySize
-        // 685|wEntryTime
-        // 686|wEntryStatus
-
-        mamaMsg_addString(entryMsg, bookFields.wEntryId.mama_field_name.c_str(), bookFields.wEntryId.mama_fid, entry->Orderid().c_str());
-        mamaMsg_addChar(entryMsg, bookFields.wEntryAction.mama_field_name.c_str(), bookFields.wEntryAction.mama_fid, entry->ActionCode());
-        mamaMsg_addI64(entryMsg, bookFields.wEntrySize.mama_field_name.c_str(), bookFields.wEntrySize.mama_fid, (mama_u64_t)entry->Size());
-
-        // todo add entry time and status
-        ++numMsgs;
-    }
-
-    // 700|wPlEntries
-    mamaMsg_addVectorMsg(msg, bookFields.wPlEntries.mama_field_name.c_str(), bookFields.wPlEntries.mama_fid, entryMsgs_.data(), numMsgs );
-    // 659|wPlNumAttach|18
-    mamaMsg_addI32(msg,bookFields.wPlNumAttach.mama_field_name.c_str(), bookFields.wPlNumAttach.mama_fid, numMsgs);
-
-    return numMsgs;
-
-}
-
-
-UPALevel::~UPALevel()
-{
-    entryListDelta_.erase(entryListDelta_.begin(), entryListDelta_.end());
-
-    orders_.erase(orders_.begin(), orders_.end());
-
-    for(size_t index = 0; index < entryMsgs_.size(); index++)
-    {
-        mamaMsg_destroy(entryMsgs_[index]);
-    }
-}
-
-UPALevel::UPALevel(RsslReal price, RsslUInt64 time, char sideCode, RsslInt size, const UpaMamaFieldMap_ptr_t& fieldmap)
-   : price_(price), time_(time), dirty_(true), sideCode_(sideCode), fieldmap_(fieldmap)
-   , actionCode_('A'), size_(size) // initialise the action code in the constructor to Add
-{
-    // create an initial set of 10 messages - this will grow if we need to
-    entryMsgs_.resize(10);
-    for(size_t index = 0; index < entryMsgs_.size(); index++)
-    {
-        mamaMsg newMsg;
-      mamaMsg_createForPayload(&newMsg, MAMA_PAYLOAD_TICK42RMDS);
-        entryMsgs_[index] = newMsg;
-    }
-}
-
-void UPALevel::ClearMessageVector(mamaMsg msg)
-{
-    // just add an empty  message vector
-    const BookFields &bookFields = UpaMamaCommonFields::BookFields();
-    mamaMsg_addVectorMsg(msg, bookFields.wPlEntries.mama_field_name.c_str(), bookFields.wPlEntries.mama_fid, entryMsgs_.data(), 0 );
-}
-
-
-
 ////////////////////////////////////////////////////////////////
 //
 // Book by price
@@ -43,6 +43,9 @@ class UPABookEntry
 public:
     UPABookEntry();
 
+    // reset the entry for reuse, keeping the storage of its strings
+    void Clear();
+
     // accessors
     char ActionCode() const;
     void ActionCode(char val);
@@ -124,82 +127,82 @@ private:
 typedef boost::shared_ptr<PricePoint> PricePoint_ptr_t;
 
 typedef utils::collection::unordered_map<std::string, PricePoint_ptr_t> PricePointMap_t;
-typedef utils::collection::unordered_set<std::string> OrderIDSet_t;
-
-class UPALevel
+// an order id. Ids are held inline up to InlineLength bytes, which covers the ids the venues use, so keeping them
+// in the book doesnt allocate. Longer ids spill into a string
+class UPABookOrderId
 {
 public:
-    UPALevel(RsslReal price, RsslUInt64 time, char sideCode, RsslInt size, const UpaMamaFieldMap_ptr_t& fieldmap);
-
-    ~UPALevel();
-
-    void AddEntry(const UPABookEntry_ptr_t& entry);
-
-    void ClearDeltas();
+    static const size_t InlineLength = 32;
 
-    char ActionCode() const
-    {
-        return actionCode_;
-    }
+    UPABookOrderId() : length_(0), hash_(0) { inline_[0] = '\0'; }
 
-    void ActionCode(char val)
-    {
-        actionCode_ = val;
-    }
+    void Assign(const char * data, size_t length);
 
-    char SideCode() const
-    {
-        return sideCode_;
-    }
+    const char * c_str() const { return (length_ <= InlineLength) ? inline_ : spill_.c_str(); }
+    size_t Length() const { return length_; }
+    size_t Hash() const { return hash_; }
 
-    void SideCode(char val)
+    bool operator==(const UPABookOrderId& rhs) const
     {
-        sideCode_ = val;
+        return (hash_ == rhs.hash_) && (length_ == rhs.length_) && (memcmp(c_str(), rhs.c_str(), length_) == 0);
     }
 
-    bool Dirty() const { return dirty_; }
-    void Dirty(bool val) { dirty_ = val; }
+private:
+    size_t length_;
+    size_t hash_;
+    char inline_[InlineLength + 1];
+    std::string spill_;
+};
 
-    int NumOrders() const
-    {
-        return (int)orders_.size();
-    }
+// a change to an order, reported in the wPlEntries of its level
+struct UPABookDelta
+{
+    UPABookOrderId orderId_;
+    char actionCode_;    // 683|wEntryAction
+    RsslInt size_;        // 682|wEntrySize
+};
 
-   RsslUInt64 Time() const { return time_; }
+// A price level. The levels of each side are kept in a vector sorted best price first, so the top of the book is at
+// the front and a level is found by binary search
+class UPALevel
+{
+public:
+    UPALevel(RsslReal price, double sortKey, RsslUInt64 time, char sideCode);
 
     RsslReal Price() const { return price_; }
-    void Price(RsslReal val) { price_ = val; }
+    double SortKey() const { return sortKey_; }
+    RsslUInt64 Time() const { return time_; }
+    char SideCode() const { return sideCode_; }
+    char ActionCode() const { return actionCode_; }
 
-    int AddEntriesToMsg(mamaMsg & msg);
+    int NumOrders() const { return numOrders_; }
 
-    void ClearMessageVector(mamaMsg msg);
+    // the changes to the level in the current update
+    const std::vector<UPABookDelta>& Deltas() const { return deltas_; }
+    bool Dirty() const { return dirty_; }
 
 private:
-    RsslUInt64 time_;
-    RsslReal price_;
-    RsslInt size_;
+    friend class UPABookByOrderMessage;
 
-    // this is the set of deltas on the level
-    EntryList_t entryListDelta_;
+    RsslReal price_;    // 653|wPlPrice, with the trailing zeros taken out of the mantissa so each price has one form
+    double sortKey_;
+    RsslUInt64 time_;
 
     char actionCode_;    // 652|wPlAction
     char sideCode_;        // 654|wPlSide
 
-    bool dirty_;
-
-    // need to maintains a set of current order ids in this level so that we can tell when the level is emprt and can be removed
-    OrderIDSet_t orders_;
-
-    std::vector<mamaMsg> entryMsgs_;
+    // the number of orders at this price, the level is removed when this reaches 0
+    int numOrders_;
 
-    UpaMamaFieldMap_ptr_t fieldmap_;
+    bool dirty_;
+    std::vector<UPABookDelta> deltas_;
 };
 
-typedef boost::shared_ptr<UPALevel> UPALevel_ptr_t;
-
-typedef utils::collection::unordered_map<RsslInt, UPALevel_ptr_t> LevelMap_t;
 // accumulate the entries keyed on price in here and render a mama message from it
-
+//
+// The book holds its orders by value in a pool, indexed by order id in an open addressed table, so in the steady
+// state adding and removing orders doesnt allocate. Each update records the levels it touches and only those levels
+// are rendered, apart from refreshes which render the whole book.
 
 // todo rename to UPABookByOrderMessage
 class UPABookByOrderMessage
@@ -213,26 +216,82 @@ public:
     bool EndUpdate(mamaMsg msg);
 
     // add an entry from the rssl message
-    bool AddEntry(const UPABookEntry_ptr_t& entry);
+    bool AddEntry(const UPABookEntry& entry);
 
     // update an entry fromn the rssl message
-    bool UpdateEntry(const UPABookEntry_ptr_t& entry);
+    bool UpdateEntry(const UPABookEntry& entry);
 
-    bool RemoveEntry(const UPABookEntry_ptr_t& entry );
+    bool RemoveEntry(const UPABookEntry& entry);
 
-    // build the mamda message
-    bool BuildMamdaMessage(mamaMsg msg);
+    // build the mamda message, with every level for an image or just the levels changed by this update
+    bool BuildMamdaMessage(mamaMsg msg, bool fullBook);
+
+    // depth of book - the levels of a side, best price first
+    size_t NumLevels(char sideCode) const;
+    const UPALevel* Level(char sideCode, size_t depth) const;
 
 private:
-    typedef utils::collection::unordered_map<std::string, UPABookEntry_ptr_t> OrderMap_t;
-    OrderMap_t orderMap_;
+    struct Order
+    {
+        UPABookOrderId orderId_;
+        RsslReal price_;
+        char sideCode_;
+        RsslInt size_;
+        RsslUInt64 time_;
+    };
+
+    // the order pool, and the free slots in it
+    std::vector<Order> orders_;
+    std::vector<uint32_t> freeOrders_;
+
+    // power of 2 sized, each entry is the position of an order in orders_ plus 1, or 0 if the entry is empty
+    std::vector<uint32_t> orderIndex_;
+    size_t orderIndexMask_;
+    size_t numOrders_;
+
+    Order* FindOrder(const UPABookOrderId& orderId);
+    Order& InsertOrder(const UPABookOrderId& orderId);
+    void EraseOrder(const UPABookOrderId& orderId);
+    void GrowOrderIndex();
+
+    // the sides, best price first
+    typedef std::vector<UPALevel> Levels_t;
+    Levels_t bids_;
+    Levels_t asks_;
+
+    Levels_t* Side(char sideCode);
+    const Levels_t* Side(char sideCode) const;
+
+    // the level at a price, or the position a new level for the price would go
+    size_t FindLevel(const Levels_t& levels, char sideCode, const RsslReal& price, double sortKey, bool& found) const;
+    UPALevel* GetLevel(char sideCode, RsslReal price, RsslUInt64 time, bool create);
+
+    void AddDelta(UPALevel& level, const UPABookOrderId& orderId, char actionCode, RsslInt size);
+
+    // the levels changed by the current update, by side and price
+    struct DirtyLevel
+    {
+        char sideCode_;
+        RsslReal price_;
+    };
+    std::vector<DirtyLevel> dirtyLevels_;
+
+    // clear the deltas of the levels changed by the last update and take out the ones left empty
+    bool ResetDirtyLevels();
 
+    // scratch id for lookups
+    UPABookOrderId orderId_;
+
+    std::vector<const UPALevel*> renderLevels_;
     std::vector<mamaMsg> levelMsgs_;
+    std::vector<mamaMsg> entryMsgs_;
 
-    uint16_t numLevelMsgs_;
+    void ReserveMessages(std::vector<mamaMsg>& msgs, size_t count);
+    void AddLevelToMsg(const UPALevel& level, mamaMsg levelMsg, size_t& entryMsg, mama_u64_t midnight);
 
-    LevelMap_t levelMapBid_;
-    LevelMap_t levelMapAsk_;
+    // reused for each level
+    mamaPrice price_;
+    mamaDateTime dateTime_;
 
     UpaMamaFieldMap_ptr_t fieldmap_;
 
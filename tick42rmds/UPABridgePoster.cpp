@@ -275,7 +275,7 @@ bool UPABridgePoster::RequestPostMessage(mamaQueue requestQueue, PostMessageRequ
 
 bool UPABridgePoster::DoPostMessage(mamaMsg msg, const PublisherPostMessageReply_ptr_t& reply)
 {
-   RsslChannel *chnl = subscriber_->Consumer()->RsslConsumerChannel();
+   RsslChannel *chnl = PostConsumer()->RsslConsumerChannel();
    RsslError err;
    RsslRet ret = RSSL_RET_FAILURE;
 
@@ -366,7 +366,13 @@ bool UPABridgePoster::BuildPostMessage(RsslChannel * chnl, RsslBuffer* rsslMessa
 
    // postid
 
-   RsslUInt32 postId = subscriber_->Consumer()->PostManager().AddPost(sharedPtr_, reply);
+   RsslUInt32 postId = PostConsumer()->PostManager().AddPost(sharedPtr_, reply);
+   if (postId == UPAPostManager::NoPostId)
+   {
+      // too many posts are waiting for their acks to track this one, so nak it now rather than send it
+      ReportPost(postId, RSSL_NAKC_NO_RESOURCES, "Too many posts in flight", reply.get());
+      return false;
+   }
    rsslMsg.postId = postId;
 
    if (UseSeqNum())
@@ -447,7 +453,7 @@ bool UPABridgePoster::BuildPostMessage(RsslChannel * chnl, RsslBuffer* rsslMessa
 
    {
        utils::thread::T42Lock lock(&inFlightListLock_);
-       inFlightPosts_.emplace_back(postId);
+       inFlightPosts_.insert(postId);
    }
    return true;
 }
@@ -539,10 +545,20 @@ bool UPABridgePoster::EncodeMessageData(RsslChannel * chnl, RsslBuffer* rsslMess
    return encoder.encode(msg, chnl, rsslMsg, rsslMessageBuffer);
 }
 
+const UPAConsumer_ptr_t& UPABridgePoster::PostConsumer() const
+{
+   if (postOnStream_ && onStreamSubscription_->Consumer())
+   {
+      return onStreamSubscription_->Consumer();
+   }
+
+   return subscriber_->Consumer();
+}
+
 void UPABridgePoster::PrintMsg(RsslBuffer* buffer)
 {
     RsslRet ret = 0;
-    RsslChannel *chnl = subscriber_->Consumer()->RsslConsumerChannel();
+    RsslChannel *chnl = PostConsumer()->RsslConsumerChannel();
     RsslDecodeIterator dIter;
     RsslMsg msg = RSSL_INIT_MSG;
     RsslFieldList fList = RSSL_INIT_FIELD_LIST;
@@ -564,50 +580,16 @@ void UPABridgePoster::PrintMsg(RsslBuffer* buffer)
 
 RsslRet UPABridgePoster::ProcessAck(RsslMsg* msg, RsslDecodeIterator* dIter,  PublisherPostMessageReply * reply)
 {
-    bool nak = false;
     std::string nakText;
     RsslUInt8 nakCode = RSSL_NAKC_NONE;
 
-    // make sure the message is still in the inflight list
-    RsslUInt32 id = msg->ackMsg.ackId;
-    bool found = false;
-
-    // we are assuming that the message responses arrive more or less in the order the messages are sent, so we would expect the id to be near
-    // the front of the list - but nevertheless we cant assume it will be at the front.
-    {
-        utils::thread::T42Lock lock(&inFlightListLock_);
-        PostIDList_t::iterator it = inFlightPosts_.begin();
-        while (it != inFlightPosts_.end())
-        {
-            // we've found the id in the inflight list, so erase it and continue
-            if(*it == id)
-            {
-                found= true;
-                inFlightPosts_.erase(it);
-                break;
-            }
-            ++it;
-        }
-    }
-
-    if(!found)
-    {
-        // list is empty, the publisher has gone away
-        return RSSL_RET_SUCCESS;
-    }
-
-    const CommonFields& commonFields = UpaMamaCommonFields::CommonFields();
-
     // see if we have a nak code and extract it
     if (  rsslAckMsgCheckHasNakCode(&msg->ackMsg))
     {
         // have a NAK code
-
         nakCode = msg->ackMsg.nakCode;
         if (nakCode != RSSL_NAKC_NONE)
         {
-            nak = true;
-            // this is a nak so log as warning
             if (rsslAckMsgCheckHasText(&msg->ackMsg))
             {
                 nakText = std::string(msg->ackMsg.text.data, msg->ackMsg.text.length);
@@ -615,6 +597,35 @@ RsslRet UPABridgePoster::ProcessAck(RsslMsg* msg, RsslDecodeIterator* dIter,  Pu
         }
     }
 
+    return CompletePost(msg->ackMsg.ackId, nakCode, nakText, reply);
+}
+
+RsslRet UPABridgePoster::ProcessPostTimeout(RsslUInt32 postId, PublisherPostMessageReply * reply)
+{
+    // treat it as though the ADS had told us it got no response
+    return CompletePost(postId, RSSL_NAKC_NO_RESPONSE, "No acknowledgement received for post", reply);
+}
+
+RsslRet UPABridgePoster::CompletePost(RsslUInt32 id, RsslUInt8 nakCode, const std::string& nakText, PublisherPostMessageReply * reply)
+{
+    // make sure the message is still in the inflight set
+    {
+        utils::thread::T42Lock lock(&inFlightListLock_);
+        if (inFlightPosts_.erase(id) == 0)
+        {
+            // the publisher has gone away
+            return RSSL_RET_SUCCESS;
+        }
+    }
+
+    ReportPost(id, nakCode, nakText, reply);
+    return RSSL_RET_SUCCESS;
+}
+
+void UPABridgePoster::ReportPost(RsslUInt32 id, RsslUInt8 nakCode, const std::string& nakText, PublisherPostMessageReply * reply)
+{
+    const CommonFields& commonFields = UpaMamaCommonFields::CommonFields();
+
     if (reply != 0 && reply->Inbox() != 0 && sendAckMessages_)
     {
         // build a message for the inbox
@@ -636,42 +647,24 @@ RsslRet UPABridgePoster::ProcessAck(RsslMsg* msg, RsslDecodeIterator* dIter,  Pu
 
         mamaMsg_destroy(msg);
     }
-    if (rsslAckMsgCheckHasNakCode(&msg->ackMsg))
-    {
-    // have a NAK code
-    if (msg->ackMsg.nakCode != RSSL_NAKC_NONE)
+
+    if (nakCode != RSSL_NAKC_NONE)
     {
-        nak = true;
         // this is a nak so log as warning
-        std::string nakText;
-
-        if (rsslAckMsgCheckHasText(&msg->ackMsg))
-        {
-            nakText = std::string( msg->ackMsg.text.data, msg->ackMsg.text.length);
-        }
-
-        mama_status status = MAMA_STATUS_OK;
-        if (nakCode != RSSL_NAKC_NONE)
-        {
-            status = RsslNakCode2MamaStatus(nakCode);
-        }
+        mama_status status = RsslNakCode2MamaStatus(nakCode);
 
         if (useCallbacks_)
         {
             raiseOnError(status, nakText.c_str());
         }
 
-        t42log_warn("Received NAK for postid %d for %s : %s - NAK code is %d (%s)\n", msg->ackMsg.ackId, sourceName_.c_str(), symbol_.c_str(), msg->ackMsg.nakCode, nakText.c_str());
-        }
+        t42log_warn("Received NAK for postid %d for %s : %s - NAK code is %d (%s)\n", id, sourceName_.c_str(), symbol_.c_str(), nakCode, nakText.c_str());
     }
-
-    if ( ! nak)
+    else
     {
         // was an ACK
-        t42log_debug("Received ACK for postid %d for %s : %s \n", msg->ackMsg.ackId, sourceName_.c_str(), symbol_.c_str());
+        t42log_debug("Received ACK for postid %d for %s : %s \n", id, sourceName_.c_str(), symbol_.c_str());
     }
-
-    return RSSL_RET_SUCCESS;
 }
 
 mamaMsgStatus UPABridgePoster::RsslNakCode2MamaMsgStatus(RsslUInt8 nakCode)
@@ -918,7 +911,7 @@ RsslRet UPABridgePoster::PostStatusMessage(RsslChannel *chnl, mamaMsgStatus msgS
    // postid
 
    PublisherPostMessageReply_ptr_t reply;
-   RsslUInt32 postId = subscriber_->Consumer()->PostManager().AddPost(sharedPtr_, reply);
+   RsslUInt32 postId = PostConsumer()->PostManager().AddPost(sharedPtr_, reply);
    rsslPostMsg.postId = postId;
 
    // get the seqnum from mamamsg
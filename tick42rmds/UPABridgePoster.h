@@ -27,6 +27,7 @@
 #define __UPABRIDGEPOSTER_H__
 
 #include <list>
+#include <utils/namespacedefines.h>
 #include "RMDSSubscriber.h"
 #include "transportconfig.h"
 #include "UPAMamaFieldMap.h"
@@ -205,6 +206,9 @@ public:
 
     RsslRet ProcessAck(RsslMsg* msg, RsslDecodeIterator* dIter, PublisherPostMessageReply* reply);
 
+    // the post manager gave up waiting for the ack, report it as a nak
+    RsslRet ProcessPostTimeout(RsslUInt32 postId, PublisherPostMessageReply* reply);
+
 protected:
    RsslRet PostStatusMessage(RsslChannel *chnl, mamaMsgStatus msgStatus, mamaMsg msg);
    RsslRet EncodeStatusMessage(RsslEncodeIterator &itEncode, mamaMsgStatus msgStatus, mamaMsg msg);
@@ -219,6 +223,9 @@ private:
     virtual bool Initialise(const UPABridgePoster_ptr_t& poster, const TransportConfig_t& config);
     void PrintMsg(RsslBuffer* buffer);
 
+    // on-stream posts have to go on the connection that carries the stream, off-stream posts use the primary
+    const UPAConsumer_ptr_t& PostConsumer() const;
+
     RMDSSubscriber_ptr_t subscriber_;
 
    // Should we add
@@ -269,8 +276,12 @@ private:
 
     mutable utils::thread::lock_t inFlightListLock_;
 
-    typedef std::list<RsslUInt32> PostIDList_t;
-    PostIDList_t inFlightPosts_;
+    typedef utils::collection::unordered_set<RsslUInt32> PostIDSet_t;
+    PostIDSet_t inFlightPosts_;
+
+    // report the outcome of a post to the publisher
+    RsslRet CompletePost(RsslUInt32 id, RsslUInt8 nakCode, const std::string& nakText, PublisherPostMessageReply* reply);
+    void ReportPost(RsslUInt32 id, RsslUInt8 nakCode, const std::string& nakText, PublisherPostMessageReply* reply);
 
     bool useCallbacks_;
     bool sendAckMessages_;
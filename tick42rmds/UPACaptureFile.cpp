@@ -0,0 +1,517 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "stdafx.h"
+#include "UPACaptureFile.h"
+#include "tick42rmdsbridgefunctions.h"
+
+#include <algorithm>
+
+#include <utils/namespacedefines.h>
+#include <utils/t42log.h>
+#include <utils/time.h>
+
+#if defined(WIN32)
+#define REPLAY_THREAD_LOCAL __declspec(thread)
+#else
+#define REPLAY_THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+    REPLAY_THREAD_LOCAL RsslUInt64 threadAllocations = 0;
+    utils::thread::atomic<bool> countingAllocations(false);
+
+    const char CaptureMagic[8] = { 'T', '4', '2', 'R', 'W', 'F', '0', '1' };
+    const size_t RecordHeaderSize = 5;
+
+    // an rwf message header starts with its 2 byte length, the message class and the domain type, then the stream id
+    const size_t StreamIdOffset = 4;
+
+    void PutUInt32(char* p, RsslUInt32 value)
+    {
+        p[0] = (char)(value >> 24);
+        p[1] = (char)(value >> 16);
+        p[2] = (char)(value >> 8);
+        p[3] = (char)value;
+    }
+
+    RsslUInt32 GetUInt32(const char* p)
+    {
+        const unsigned char* u = (const unsigned char*)p;
+        return ((RsslUInt32)u[0] << 24) | ((RsslUInt32)u[1] << 16) | ((RsslUInt32)u[2] << 8) | (RsslUInt32)u[3];
+    }
+}
+
+UPACaptureWriter::UPACaptureWriter()
+    : file_(0)
+{
+}
+
+UPACaptureWriter::~UPACaptureWriter()
+{
+    Close();
+}
+
+bool UPACaptureWriter::Open(const std::string& path)
+{
+    Close();
+
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == 0)
+    {
+        t42log_error("Unable to open capture file %s\n", path.c_str());
+        return false;
+    }
+
+    path_ = path;
+    fwrite(CaptureMagic, 1, sizeof(CaptureMagic), file_);
+    t42log_info("Capturing rwf messages to %s\n", path_.c_str());
+    return true;
+}
+
+void UPACaptureWriter::Close()
+{
+    if (file_ != 0)
+    {
+        fclose(file_);
+        file_ = 0;
+        t42log_info("Closed capture file %s\n", path_.c_str());
+    }
+}
+
+void UPACaptureWriter::WriteSession(RsslUInt8 majorVersion, RsslUInt8 minorVersion)
+{
+    char version[2] = { (char)majorVersion, (char)minorVersion };
+    WriteRecord(UPACaptureReplay::RecordSession, version, sizeof(version));
+    fflush(file_);
+}
+
+void UPACaptureWriter::WriteMessage(const RsslBuffer* buffer)
+{
+    WriteRecord(UPACaptureReplay::RecordMessage, buffer->data, buffer->length);
+}
+
+void UPACaptureWriter::WriteItemOpen(RsslUInt32 streamId, RsslUInt8 domainType, const std::string& source, const std::string& symbol)
+{
+    std::string payload(5, '\0');
+    PutUInt32(&payload[0], streamId);
+    payload[4] = (char)domainType;
+    payload.append(source.c_str(), source.length() + 1);
+    payload.append(symbol.c_str(), symbol.length() + 1);
+    WriteRecord(UPACaptureReplay::RecordItemOpen, payload.data(), (RsslUInt32)payload.length());
+}
+
+void UPACaptureWriter::WriteRecord(char type, const char* data, RsslUInt32 length)
+{
+    if (file_ == 0)
+    {
+        return;
+    }
+
+    char header[RecordHeaderSize];
+    header[0] = type;
+    PutUInt32(&header[1], length);
+    if (fwrite(header, 1, sizeof(header), file_) != sizeof(header) || fwrite(data, 1, length, file_) != length)
+    {
+        t42log_error("Failed writing to capture file %s, capture stopped\n", path_.c_str());
+        Close();
+    }
+}
+
+
+UPACaptureReplay::UPACaptureReplay()
+    : lastOpenTime_(0)
+    , skipped_(0)
+{
+    for (size_t index = 0; index < NumStats; ++index)
+    {
+        stats_[index].messages_ = 0;
+        stats_[index].fields_ = 0;
+        stats_[index].elapsed_ = 0;
+        stats_[index].allocations_ = 0;
+    }
+}
+
+bool UPACaptureReplay::Load(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == 0)
+    {
+        t42log_error("Unable to open capture file %s\n", path.c_str());
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data_.resize((size > 0) ? (size_t)size : 0);
+    size_t read = data_.empty() ? 0 : fread(&data_[0], 1, data_.size(), file);
+    fclose(file);
+
+    if (read != data_.size() || data_.size() < sizeof(CaptureMagic) || memcmp(&data_[0], CaptureMagic, sizeof(CaptureMagic)) != 0)
+    {
+        t42log_error("%s is not a capture file\n", path.c_str());
+        return false;
+    }
+
+    // the records point into data_ so it mustnt be resized from here on
+    RsslUInt8 majorVersion = RSSL_RWF_MAJOR_VERSION;
+    RsslUInt8 minorVersion = RSSL_RWF_MINOR_VERSION;
+    size_t domainCounts[NumStats] = { 0 };
+    size_t badMessages = 0;
+
+    size_t pos = sizeof(CaptureMagic);
+    while (pos + RecordHeaderSize <= data_.size())
+    {
+        char type = data_[pos];
+        RsslUInt32 length = GetUInt32(&data_[pos + 1]);
+        pos += RecordHeaderSize;
+        if (length > data_.size() - pos)
+        {
+            t42log_warn("Capture file %s is truncated\n", path.c_str());
+            break;
+        }
+
+        char* payload = &data_[pos];
+        pos += length;
+
+        Record record;
+        memset(&record, 0, sizeof(record));
+        record.type_ = type;
+
+        switch (type)
+        {
+        case RecordSession:
+            if (length < 2)
+            {
+                continue;
+            }
+            majorVersion = record.majorVersion_ = (RsslUInt8)payload[0];
+            minorVersion = record.minorVersion_ = (RsslUInt8)payload[1];
+            break;
+
+        case RecordMessage:
+            {
+                record.buffer_.data = payload;
+                record.buffer_.length = length;
+
+                RsslDecodeIterator dIter;
+                RsslMsg msg = RSSL_INIT_MSG;
+                rsslClearDecodeIterator(&dIter);
+                rsslSetDecodeIteratorRWFVersion(&dIter, majorVersion, minorVersion);
+                if (length < StreamIdOffset + 4 || rsslSetDecodeIteratorBuffer(&dIter, &record.buffer_) != RSSL_RET_SUCCESS
+                    || rsslDecodeMsg(&dIter, &msg) != RSSL_RET_SUCCESS
+                    || (RsslInt32)GetUInt32(payload + StreamIdOffset) != msg.msgBase.streamId)
+                {
+                    ++badMessages;
+                    continue;
+                }
+
+                record.domainType_ = msg.msgBase.domainType;
+                record.streamId_ = (RsslUInt32)msg.msgBase.streamId;
+                record.numFields_ = CountFields(&dIter, msg.msgBase.containerType);
+
+                switch (record.domainType_)
+                {
+                case RSSL_DMT_MARKET_PRICE: ++domainCounts[StatsMarketPrice]; break;
+                case RSSL_DMT_MARKET_BY_ORDER: ++domainCounts[StatsMarketByOrder]; break;
+                case RSSL_DMT_MARKET_BY_PRICE: ++domainCounts[StatsMarketByPrice]; break;
+                default: ++domainCounts[StatsOther]; break;
+                }
+            }
+            break;
+
+        case RecordItemOpen:
+            {
+                const char* end = payload + length;
+                const char* source = payload + 5;
+                const char* sourceEnd = (length > 5) ? (const char*)memchr(source, '\0', end - source) : 0;
+                const char* symbolEnd = sourceEnd ? (const char*)memchr(sourceEnd + 1, '\0', end - sourceEnd - 1) : 0;
+                if (symbolEnd == 0)
+                {
+                    continue;
+                }
+
+                record.streamId_ = GetUInt32(payload);
+                record.domainType_ = (RsslUInt8)payload[4];
+                record.key_ = KeyIndex(record.domainType_, source, sourceEnd + 1);
+            }
+            break;
+
+        default:
+            // not a record we know about
+            continue;
+        }
+
+        records_.push_back(record);
+    }
+
+    if (badMessages > 0)
+    {
+        t42log_warn("Skipped %u messages in capture file %s that could not be decoded\n", (unsigned int)badMessages, path.c_str());
+    }
+
+    // so the timings dont allocate as they are collected
+    for (size_t index = 0; index < NumStats; ++index)
+    {
+        stats_[index].latencies_.reserve(domainCounts[index]);
+    }
+
+    t42log_info("Loaded %u records for %u items from capture file %s\n", (unsigned int)records_.size(), (unsigned int)keys_.size(), path.c_str());
+    return true;
+}
+
+RsslUInt32 UPACaptureReplay::CountFields(RsslDecodeIterator* dIter, RsslUInt8 containerType)
+{
+    RsslUInt32 numFields = 0;
+    RsslRet ret;
+
+    switch (containerType)
+    {
+    case RSSL_DT_FIELD_LIST:
+        {
+            RsslFieldList fieldList;
+            RsslFieldEntry fieldEntry;
+            if (rsslDecodeFieldList(dIter, &fieldList, 0) < RSSL_RET_SUCCESS)
+            {
+                break;
+            }
+
+            // just step over the entries without decoding them
+            while ((ret = rsslDecodeFieldEntry(dIter, &fieldEntry)) != RSSL_RET_END_OF_CONTAINER && ret >= RSSL_RET_SUCCESS)
+            {
+                ++numFields;
+            }
+        }
+        break;
+
+    case RSSL_DT_MAP:
+        {
+            // the order and price books - count the fields in each entry
+            RsslMap map;
+            RsslMapEntry mapEntry;
+            if (rsslDecodeMap(dIter, &map) < RSSL_RET_SUCCESS || map.containerType != RSSL_DT_FIELD_LIST)
+            {
+                break;
+            }
+
+            while ((ret = rsslDecodeMapEntry(dIter, &mapEntry, 0)) != RSSL_RET_END_OF_CONTAINER && ret >= RSSL_RET_SUCCESS)
+            {
+                if (mapEntry.action != RSSL_MPEA_DELETE_ENTRY)
+                {
+                    numFields += CountFields(dIter, RSSL_DT_FIELD_LIST);
+                }
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return numFields;
+}
+
+size_t UPACaptureReplay::KeyIndex(RsslUInt8 domainType, const std::string& source, const std::string& symbol)
+{
+    std::string key(1, (char)domainType);
+    key.append(source.c_str(), source.length() + 1);
+    key.append(symbol);
+
+    std::map<std::string, size_t>::iterator it = keys_.find(key);
+    if (it != keys_.end())
+    {
+        return it->second;
+    }
+
+    size_t index = liveStreams_.size();
+    keys_[key] = index;
+    liveStreams_.push_back(0);
+    return index;
+}
+
+void UPACaptureReplay::BeginSession()
+{
+    recordedStreams_.clear();
+    streamCache_.clear();
+}
+
+void UPACaptureReplay::RecordedOpen(const Record& record)
+{
+    recordedStreams_[record.streamId_] = record.key_;
+    if (record.streamId_ < streamCache_.size())
+    {
+        streamCache_[record.streamId_] = 0;
+    }
+}
+
+void UPACaptureReplay::ItemOpened(RsslUInt32 streamId, RsslUInt8 domainType, const std::string& source, const std::string& symbol)
+{
+    size_t key = KeyIndex(domainType, source, symbol);
+    if (liveStreams_[key] != 0)
+    {
+        // opened again on a new stream
+        liveKeys_.erase(liveStreams_[key]);
+        streamCache_.clear();
+    }
+
+    liveStreams_[key] = streamId;
+    liveKeys_[streamId] = key;
+    lastOpenTime_ = utils::time::GetMicroCount();
+}
+
+void UPACaptureReplay::ItemClosed(RsslUInt32 streamId)
+{
+    std::map<RsslUInt32, size_t>::iterator it = liveKeys_.find(streamId);
+    if (it != liveKeys_.end())
+    {
+        liveStreams_[it->second] = 0;
+        liveKeys_.erase(it);
+        streamCache_.clear();
+    }
+}
+
+RsslUInt32 UPACaptureReplay::LiveStream(RsslUInt32 recordedStreamId)
+{
+    if (recordedStreamId < streamCache_.size() && streamCache_[recordedStreamId] != 0)
+    {
+        return streamCache_[recordedStreamId];
+    }
+
+    std::map<RsslUInt32, size_t>::const_iterator it = recordedStreams_.find(recordedStreamId);
+    if (it == recordedStreams_.end())
+    {
+        return 0;
+    }
+
+    RsslUInt32 streamId = liveStreams_[it->second];
+    if (streamId != 0)
+    {
+        if (recordedStreamId >= streamCache_.size())
+        {
+            streamCache_.resize(recordedStreamId + 1, 0);
+        }
+        streamCache_[recordedStreamId] = streamId;
+    }
+    return streamId;
+}
+
+void UPACaptureReplay::SetStreamId(RsslBuffer* buffer, RsslUInt32 streamId)
+{
+    PutUInt32(buffer->data + StreamIdOffset, streamId);
+}
+
+void UPACaptureReplay::BeginPass()
+{
+    for (size_t index = 0; index < NumStats; ++index)
+    {
+        stats_[index].messages_ = 0;
+        stats_[index].fields_ = 0;
+        stats_[index].elapsed_ = 0;
+        stats_[index].allocations_ = 0;
+        stats_[index].latencies_.clear();
+    }
+    skipped_ = 0;
+}
+
+void UPACaptureReplay::Sample(RsslUInt8 domainType, RsslUInt32 numFields, RsslUInt64 elapsed, RsslUInt64 allocations)
+{
+    DomainStats* stats;
+    switch (domainType)
+    {
+    case RSSL_DMT_MARKET_PRICE: stats = &stats_[StatsMarketPrice]; break;
+    case RSSL_DMT_MARKET_BY_ORDER: stats = &stats_[StatsMarketByOrder]; break;
+    case RSSL_DMT_MARKET_BY_PRICE: stats = &stats_[StatsMarketByPrice]; break;
+    default: stats = &stats_[StatsOther]; break;
+    }
+
+    ++stats->messages_;
+    stats->fields_ += numFields;
+    stats->elapsed_ += elapsed;
+    stats->allocations_ += allocations;
+    stats->latencies_.push_back((elapsed > 0xffffffff) ? 0xffffffff : (RsslUInt32)elapsed);
+}
+
+void UPACaptureReplay::EndPass(int pass, RsslUInt64 elapsed)
+{
+    static const char* domainNames[NumStats] = { "MARKET_PRICE", "MARKET_BY_ORDER", "MARKET_BY_PRICE", "OTHER" };
+
+    RsslUInt64 messages = 0;
+    for (size_t index = 0; index < NumStats; ++index)
+    {
+        messages += stats_[index].messages_;
+    }
+
+    double seconds = (double)elapsed / 1e9;
+    t42log_info("Replay pass %d - %llu messages in %.3f seconds, %.0f msgs/sec, %llu skipped\n", pass,
+        (unsigned long long)messages, seconds, (seconds > 0) ? (double)messages / seconds : 0.0, (unsigned long long)skipped_);
+
+    for (size_t index = 0; index < NumStats; ++index)
+    {
+        DomainStats& stats = stats_[index];
+        if (stats.messages_ == 0)
+        {
+            continue;
+        }
+
+        std::vector<RsslUInt32>& latencies = stats.latencies_;
+        std::sort(latencies.begin(), latencies.end());
+        size_t last = latencies.size() - 1;
+
+        char allocations[64] = "";
+        if (CountingAllocations())
+        {
+            snprintf(allocations, sizeof(allocations), ", %.2f allocs/msg", (double)stats.allocations_ / (double)stats.messages_);
+        }
+
+        t42log_info("  %-16s %llu msgs, %llu fields, %.0f ns/msg, %.1f ns/field%s, latency ns p50=%u p90=%u p99=%u p99.9=%u max=%u\n",
+            domainNames[index], (unsigned long long)stats.messages_, (unsigned long long)stats.fields_,
+            (double)stats.elapsed_ / (double)stats.messages_,
+            (stats.fields_ > 0) ? (double)stats.elapsed_ / (double)stats.fields_ : 0.0, allocations,
+            latencies[std::min(last, latencies.size() / 2)], latencies[std::min(last, latencies.size() * 9 / 10)],
+            latencies[std::min(last, latencies.size() * 99 / 100)], latencies[std::min(last, latencies.size() * 999 / 1000)],
+            latencies[last]);
+    }
+}
+
+RsslUInt64 UPACaptureReplay::ThreadAllocations()
+{
+    return threadAllocations;
+}
+
+bool UPACaptureReplay::CountingAllocations()
+{
+    return countingAllocations.load(utils::thread::memory_order_relaxed);
+}
+
+void tick42rmds_countAllocation()
+{
+    ++threadAllocations;
+    if (!countingAllocations.load(utils::thread::memory_order_relaxed))
+    {
+        countingAllocations.store(true, utils::thread::memory_order_relaxed);
+    }
+}
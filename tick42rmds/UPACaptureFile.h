@@ -0,0 +1,181 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __UPACAPTUREFILE_H__
+#define __UPACAPTUREFILE_H__
+
+// Capture and replay of the rwf a consumer reads from its channel
+//
+// A capture file records the messages a consumer reads, exactly as rsslRead returned them, along with the item opens
+// the consumer made, so that a session can be fed back through UPAConsumer::ProcessResponse without an ADS and the
+// decode path from rwf to mama measured offline.
+//
+// The file starts with a magic number and then holds records made up of a type byte, a 4 byte big endian length and
+// the payload:
+//   session   - the rwf major and minor version, written each time the channel becomes active
+//   message   - one rwf message
+//   item open - the stream id (4 bytes big endian) and domain type, then the source and symbol, each nul terminated
+
+class UPACaptureWriter
+{
+public:
+    UPACaptureWriter();
+    ~UPACaptureWriter();
+
+    bool Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const
+    {
+        return file_ != 0;
+    }
+
+    void WriteSession(RsslUInt8 majorVersion, RsslUInt8 minorVersion);
+    void WriteMessage(const RsslBuffer* buffer);
+    void WriteItemOpen(RsslUInt32 streamId, RsslUInt8 domainType, const std::string& source, const std::string& symbol);
+
+private:
+    void WriteRecord(char type, const char* data, RsslUInt32 length);
+
+    FILE* file_;
+    std::string path_;
+};
+
+// The replay side loads the whole capture into memory, so that the file io isnt part of what is measured, and the
+// consumer then steps through the records.
+//
+// The recorded streams are matched to the streams the replaying consumer opens by domain, source and symbol, and each
+// message is rewritten with the live stream id before it is processed. Messages on streams that have not been opened
+// are skipped.
+//
+// The timings of the messages that are processed are collected by domain, and a report of the throughput, the cost
+// per field and the latency percentiles is logged at the end of each pass through the file. When the program counts
+// allocations through tick42rmds_countAllocation, as the replay benchmark in test does, the report also gives the
+// allocations per message made on the consumer thread
+
+class UPACaptureReplay
+{
+public:
+    enum RecordType
+    {
+        RecordSession = 'S',
+        RecordMessage = 'M',
+        RecordItemOpen = 'O'
+    };
+
+    struct Record
+    {
+        char type_;
+        RsslUInt8 domainType_;
+        RsslUInt32 streamId_;        // as recorded
+        RsslUInt32 numFields_;       // the field entries in a message, counted when it is loaded
+        RsslUInt8 majorVersion_;     // session
+        RsslUInt8 minorVersion_;
+        size_t key_;                 // item open - the item it opened
+        RsslBuffer buffer_;          // message - points into the loaded file
+    };
+
+    UPACaptureReplay();
+
+    bool Load(const std::string& path);
+
+    size_t NumRecords() const
+    {
+        return records_.size();
+    }
+
+    Record& GetRecord(size_t index)
+    {
+        return records_[index];
+    }
+
+    // the recorded streams start afresh with each session
+    void BeginSession();
+    void RecordedOpen(const Record& record);
+
+    // the replaying consumer opened or closed a stream
+    void ItemOpened(RsslUInt32 streamId, RsslUInt8 domainType, const std::string& source, const std::string& symbol);
+    void ItemClosed(RsslUInt32 streamId);
+
+    // when the last item was opened, so the replay can tell when the subscriptions have stopped coming
+    RsslUInt64 LastOpenTime() const
+    {
+        return lastOpenTime_;
+    }
+
+    // the live stream a recorded stream is replayed on, 0 if it hasnt been opened
+    RsslUInt32 LiveStream(RsslUInt32 recordedStreamId);
+
+    // put the live stream id into the message header
+    static void SetStreamId(RsslBuffer* buffer, RsslUInt32 streamId);
+
+    // statistics
+    void BeginPass();
+    void Sample(RsslUInt8 domainType, RsslUInt32 numFields, RsslUInt64 elapsed, RsslUInt64 allocations);
+    void Skipped()
+    {
+        ++skipped_;
+    }
+    void EndPass(int pass, RsslUInt64 elapsed);
+
+    // the allocations counted on the calling thread, and whether anything is counting them
+    static RsslUInt64 ThreadAllocations();
+    static bool CountingAllocations();
+
+private:
+    static RsslUInt32 CountFields(RsslDecodeIterator* dIter, RsslUInt8 containerType);
+    size_t KeyIndex(RsslUInt8 domainType, const std::string& source, const std::string& symbol);
+
+    std::vector<char> data_;
+    std::vector<Record> records_;
+
+    // the items, keyed on domain, source and symbol
+    std::map<std::string, size_t> keys_;
+
+    // recorded stream id -> item, and item -> live stream id
+    std::map<RsslUInt32, size_t> recordedStreams_;
+    std::vector<RsslUInt32> liveStreams_;
+    std::map<RsslUInt32, size_t> liveKeys_;
+
+    // recorded stream id -> live stream id, resolved from the above as the streams are used
+    std::vector<RsslUInt32> streamCache_;
+
+    RsslUInt64 lastOpenTime_;
+
+    struct DomainStats
+    {
+        RsslUInt64 messages_;
+        RsslUInt64 fields_;
+        RsslUInt64 elapsed_;
+        RsslUInt64 allocations_;
+        std::vector<RsslUInt32> latencies_;
+    };
+
+    enum { StatsMarketPrice = 0, StatsMarketByOrder, StatsMarketByPrice, StatsOther, NumStats };
+    DomainStats stats_[NumStats];
+    RsslUInt64 skipped_;
+};
+
+#endif //__UPACAPTUREFILE_H__
@@ -32,6 +32,8 @@
 #include "UPAConsumer.h"
 #include "transportconfig.h"
 
+#include <algorithm>
+
 #include <utils/HiResTime.h>
 #include <utils/t42log.h>
 #include <utils/os.h>
@@ -39,12 +41,31 @@
 
 const int32_t StatsSampleInterval = 10000;
 
-UPAConsumer::UPAConsumer(RMDSSubscriber* pOwner)
+// when replaying, the request queue is dispatched between batches of this many records
+const size_t ReplayBatchSize = 64;
+
+UPAConsumer::UPAConsumer(RMDSSubscriber* pOwner, size_t shard)
     : shouldRecoverConnection_(RSSL_TRUE)
     , rsslConsumerChannel_(NULL)
     , receivedServerMsg_ (RSSL_FALSE)
     , connectionConfig_(pOwner->Config()->getString("hosts"), pOwner->Config()->getString("retrysched", Default_retrysched))
     , requiresConnection_(true)
+    , blockingWait_(false)
+    , readPending_(false)
+    , requestBacklog_(false)
+    , nextConflationDeadline_(0)
+    , channelGeneration_(0)
+    , shard_(shard)
+    , requestsEnabled_(shard == 0)
+    , messageStartTime_(0)
+    , messageSequence_(0)
+    , recoveryStart_(0)
+    , recoveryResubscribed_(false)
+    , capture_(0)
+    , replay_(0)
+    , replayPasses_(Default_replayPasses)
+    , replaySettle_(0)
+    , replayStart_(0)
 {
     isInLoginSuspectState_ = RSSL_FALSE;
     owner_ = pOwner;
@@ -70,7 +91,7 @@ UPAConsumer::UPAConsumer(RMDSSubscriber* pOwner)
     }
 
     connType_ = pOwner->ConnType();
-    requestQueue_ = pOwner->GetRequestQueue();
+    requestQueue_ = pOwner->GetRequestQueue(shard);
 
     TransportConfig_t config(pOwner->GetTransportName());
 
@@ -84,17 +105,108 @@ UPAConsumer::UPAConsumer(RMDSSubscriber* pOwner)
     t42log_info("Consumer thread request throttle parameters - maxdisp=%d, maxPending=%d, waitTimeForSelect=%d\n",
                 maxDispatchesPerCycle_, maxPendingOpens_, waitTimeForSelect_);
 
+    // the adaptive throttle starts the open window at minPending and then sizes it from the ADS response times, up to
+    // maxPending - or maxPendingLimit, when that is set, to let it grow further. Otherwise the window is fixed at
+    // maxPending
+    bool adaptiveThrottle = config.getBool("adaptive-throttle", Default_adaptiveThrottle);
+    int minPendingOpens = config.getInt("minPending", Default_minPending);
+    int maxPendingLimit = config.getInt("maxPendingLimit", Default_maxPendingLimit);
+    size_t maximumWindow = (maxPendingLimit > 0) ? (size_t)maxPendingLimit : maxPendingOpens_;
+    size_t minimumWindow = (minPendingOpens > 0) ? (size_t)minPendingOpens : 1;
+    if (minimumWindow > maximumWindow)
+    {
+        minimumWindow = maximumWindow;
+    }
+    streamManager_.ConfigureOpenThrottle(adaptiveThrottle, adaptiveThrottle ? minimumWindow : maxPendingOpens_,
+        minimumWindow, maximumWindow);
+    if (adaptiveThrottle)
+    {
+        t42log_info("Consumer thread adaptive request throttle - minPending=%d, maximum window=%d\n", (int)minimumWindow, (int)maximumWindow);
+    }
+
+    // write batching holds the flushes of the messages written through a pass of the message loop, up to a byte and
+    // latency (microseconds) budget
+    bool writeBatching = config.getBool("write-batching", Default_writeBatching);
+    int writeBatchBytes = config.getInt("write-batch-bytes", Default_writeBatchBytes);
+    int writeBatchDelay = config.getInt("write-batch-delay", Default_writeBatchDelay);
+    writeBatch_.Configure(writeBatching, (writeBatchBytes > 0) ? (RsslUInt32)writeBatchBytes : 0,
+        (writeBatchDelay > 0) ? (RsslUInt32)writeBatchDelay : 0);
+    if (writeBatching)
+    {
+        t42log_info("Consumer thread write batching - write-batch-bytes=%d, write-batch-delay=%d\n", writeBatchBytes, writeBatchDelay);
+    }
+
+    // the table of posts waiting for their acks, and how long (milliseconds) to wait for an ack. 0 waits forever
+    int postTableSize = config.getInt("post-table-size", Default_postTableSize);
+    int postTimeout = config.getInt("post-timeout", Default_postTimeout);
+    postManager_.Configure((postTableSize > 0) ? (size_t)postTableSize : UPAPostManager::DefaultCapacity,
+        (postTimeout > 0) ? (RsslUInt32)postTimeout : 0);
+
     maxMessageSize_ = config.getUint16("maxmsgsize", Default_maxMessageSize);
 
+    // batch requests carry up to batch-size item names, as many as fit in a message
+    bool batchRequests = config.getBool("batch-requests", Default_batchRequests);
+    int batchSize = config.getInt("batch-size", Default_batchSize);
+    batchRequests_.Configure(this, batchRequests, (batchSize > 0) ? (size_t)batchSize : 0, maxMessageSize_);
+    if (batchRequests_.Enabled())
+    {
+        t42log_info("Consumer thread batch requests - batch-size=%d\n", batchSize);
+    }
+
+    // The primary can replay a capture file in place of connecting, in which case it doesnt need any hosts. There is no
+    // ADS to protect so the opens arent throttled. replay-settle (milliseconds) is how long the replay waits for the
+    // items in the capture to be subscribed to
+    replayFile_ = config.getString("replay-file");
+    if (!replayFile_.empty() && IsPrimary())
+    {
+        replay_ = new UPACaptureReplay();
+        replayPasses_ = config.getInt("replay-passes", Default_replayPasses);
+        int replaySettle = config.getInt("replay-settle", Default_replaySettle);
+        replaySettle_ = (replaySettle > 0) ? (RsslUInt64)replaySettle * 1000 : 0;
+
+        shouldRecoverConnection_ = RSSL_FALSE;
+        requiresConnection_ = false;
+        size_t unlimited = std::numeric_limits<size_t>::max();
+        streamManager_.ConfigureOpenThrottle(false, unlimited, unlimited, unlimited);
+        t42log_info("Transport %s will replay %s rather than connect\n", pOwner->GetTransportName().c_str(), replayFile_.c_str());
+    }
+    else
+    {
+        // each shard captures to its own file
+        std::string captureFile = config.getString("capture-file");
+        if (!captureFile.empty())
+        {
+            if (!IsPrimary())
+            {
+                captureFile += "." + boost::lexical_cast<std::string>(shard_);
+            }
+
+            capture_ = new UPACaptureWriter();
+            if (!capture_->Open(captureFile))
+            {
+                delete capture_;
+                capture_ = 0;
+            }
+        }
+    }
+
     bool configDisableDataConversion = config.getBool("disabledataconversion",false);
 
     // initialise the source directory and dictionary management components
-    login_->AddListener(pOwner);
     login_->DisableDataConversion(configDisableDataConversion);
     sourceDirectory_ = new UPASourceDirectory(config.getUint16("maxmsgsize", Default_maxMessageSize));
-    sourceDirectory_->AddListener(pOwner);
-    upaDictionary_ = boost::make_shared<UPADictionary>(pOwner->GetTransportName());
-    upaDictionary_->AddListener(pOwner);
+    if (IsPrimary())
+    {
+        login_->AddListener(pOwner);
+        sourceDirectory_->AddListener(pOwner);
+        upaDictionary_ = boost::make_shared<UPADictionary>(pOwner->GetTransportName());
+        upaDictionary_->AddListener(pOwner);
+    }
+    else
+    {
+        // the secondary shards decode with the dictionary the primary downloads
+        upaDictionary_ = pOwner->Consumer()->SharedUpaDictionary();
+    }
 
 
     // init statistics
@@ -109,13 +221,35 @@ UPAConsumer::UPAConsumer(RMDSSubscriber* pOwner)
     mamaMsg_createForPayloadBridge(&msg_, payloadBridge);
     mamaMsgImpl_setBridgeImpl(msg_, pOwner->Bridge());
 
+    // If the request queue can wake the consumer thread then it can block until there is something to do, otherwise
+    // it has to poll the request queue every waitTimeForSelect microseconds
+    if (poller_.Initialize() && poller_.CanWakeup())
+    {
+        if (mamaQueue_setEnqueueCallback(requestQueue_, UPAEventPoller::EnqueueCb, &poller_) == MAMA_STATUS_OK)
+        {
+            blockingWait_ = true;
+        }
+        else
+        {
+            t42log_warn("Unable to set enqueue callback on request queue for transport %s, falling back to polling\n", pOwner->GetTransportName().c_str());
+        }
+    }
+    t42log_info("Consumer thread %u %s for channel events\n", (unsigned int)shard_, blockingWait_ ? "blocks" : "polls");
+
     runThread_ = true;
 }
 
 UPAConsumer::~UPAConsumer(void)
 {
+    if (blockingWait_)
+    {
+        mamaQueue_removeEnqueueCallback(requestQueue_);
+    }
+
     delete login_;
     delete sourceDirectory_;
+    delete capture_;
+    delete replay_;
 
     if (msg_)
     {
@@ -126,27 +260,25 @@ UPAConsumer::~UPAConsumer(void)
 void UPAConsumer::Run()
 {
    RsslError error;
-   struct timeval time_interval;
    RsslRet    retval = 0;
 
-   fd_set useRead;
-   fd_set useExcept;
-   fd_set useWrt;
-
    // get hold of the statistics logger
    statsLogger_ = StatisticsLogger::GetStatisticsLogger();
 
+   if (replay_)
+   {
+      RunReplay();
+      t42log_info("Exit UPAConsumer thread");
+      return;
+   }
+
    // todo might want to make these configurable
 #ifdef _WIN32
    int rcvBfrSize = 65535;
    int sendBfrSize = 65535;
 #endif
 
-   int selRet;
-
-   FD_ZERO(&readfds_);
-   FD_ZERO(&exceptfds_);
-   FD_ZERO(&wrtfds_);
+   int selRet = 0;
 
    // The outer thread loop attempts to make / remake a connection to the rssl server
    //
@@ -158,64 +290,47 @@ void UPAConsumer::Run()
       {
          login_->UPAChannel(0);
          sourceDirectory_->UPAChannel(0);
-         upaDictionary_->UPAChannel(0);
+         if (IsPrimary())
+         {
+            upaDictionary_->UPAChannel(0);
+         }
          // connect to server
          t42log_info("Attempting to connect to server %s:%s...\n", connectionConfig_.Host().c_str(), connectionConfig_.Port().c_str());
 
+         // ConnectToRsslServer registers the channel with the poller
          if ((rsslConsumerChannel_ = ConnectToRsslServer(connectionConfig_.Host(), connectionConfig_.Port(), interfaceName_, connType_, &error)) == NULL)
          {
             t42log_error("Unable to connect to RSSL server: <%s>\n",error.text);
          }
-         else
-         {
-            if (rsslConsumerChannel_)
-            {
-               // connected - set up socket fds
-               RsslSocket s = rsslConsumerChannel_->socketId;
-               FD_SET(rsslConsumerChannel_->socketId, &readfds_);
-               FD_SET(rsslConsumerChannel_->socketId, &wrtfds_);
-               FD_SET(rsslConsumerChannel_->socketId, &exceptfds_);
-            }
-         }
 
          if (rsslConsumerChannel_ != NULL && rsslConsumerChannel_->state == RSSL_CH_STATE_ACTIVE)
             shouldRecoverConnection_ = RSSL_FALSE;
 
+         /* Set a timeout value if the provider accepts the connection, but does not initialize it */
+         int32_t initStart = utils::time::GetMilliCount();
+         const long initTimeout = 60000;
+
          //Wait for channel to become active.
          while (rsslConsumerChannel_ != NULL && rsslConsumerChannel_->state != RSSL_CH_STATE_ACTIVE && runThread_)
          {
-            useRead = readfds_;
-            useWrt = wrtfds_;
-            useExcept = exceptfds_;
-
-            /* Set a timeout value if the provider accepts the connection, but does not initialize it */
-            time_interval.tv_sec = 60;
-            time_interval.tv_usec = 0;
-
-            selRet = select(FD_SETSIZE, &useRead, &useWrt, &useExcept, &time_interval);
+            // the poller may also be woken by requests being queued, so wait for what is left of the timeout
+            long remaining = initTimeout - utils::time::GetMilliSpan(initStart);
+            selRet = (remaining > 0) ? poller_.Wait(remaining) : 0;
 
             // select has timed out, close the channel and attempt to reconnect
             if (selRet == 0)
             {
                t42log_warn("Channel initialization has timed out, attempting to reconnect...\n");
-
-               if (rsslConsumerChannel_)
-               {
-                  FD_CLR(rsslConsumerChannel_->socketId, &readfds_);
-                  FD_CLR(rsslConsumerChannel_->socketId, &exceptfds_);
-                  if (FD_ISSET(rsslConsumerChannel_->socketId, &wrtfds_))
-                     FD_CLR(rsslConsumerChannel_->socketId, &wrtfds_);
-               }
                RecoverConnection();
             }
             else
                // Received a response from the provider.
-               if (rsslConsumerChannel_ && selRet > 0 && (FD_ISSET(rsslConsumerChannel_->socketId, &useRead) || FD_ISSET(rsslConsumerChannel_->socketId, &useWrt) || FD_ISSET(rsslConsumerChannel_->socketId, &useExcept)))
+               if (rsslConsumerChannel_ && selRet > 0 && (poller_.Readable() || poller_.Writable()))
                {
                   if (rsslConsumerChannel_->state == RSSL_CH_STATE_INITIALIZING)
                   {
                      RsslInProgInfo inProg = RSSL_INIT_IN_PROG_INFO;
-                     FD_CLR(rsslConsumerChannel_->socketId,&wrtfds_);
+                     poller_.WantWrite(false);
                      if ((retval = rsslInitChannel(rsslConsumerChannel_, &inProg, &error)) < RSSL_RET_SUCCESS)
                      {
                         // channel init failed, try again
@@ -233,11 +348,8 @@ void UPAConsumer::Run()
                            {
                               t42log_info("Channel In Progress - New FD: %d  Old FD: %d\n",rsslConsumerChannel_->socketId, inProg.oldSocket );
 
-                              FD_CLR(inProg.oldSocket,&readfds_);
-                              FD_CLR(inProg.oldSocket,&exceptfds_);
-                              FD_SET(rsslConsumerChannel_->socketId,&readfds_);
-                              FD_SET(rsslConsumerChannel_->socketId,&exceptfds_);
-                              FD_SET(rsslConsumerChannel_->socketId,&wrtfds_);
+                              poller_.WantWrite(true);
+                              poller_.ChangeChannel(inProg.oldSocket, rsslConsumerChannel_->socketId);
                            }
                            else
                            {
@@ -262,9 +374,23 @@ void UPAConsumer::Run()
                               }
 
 
+                              if (capture_)
+                              {
+                                 capture_->WriteSession(rsslConsumerChannel_->majorVersion, rsslConsumerChannel_->minorVersion);
+                              }
+
+                              RecoveryStage("channel active");
+
+                              // the streams requested on the last channel are gone
+                              ++channelGeneration_;
+                              streamManager_.ReleaseBatchStreams();
+
                               login_->UPAChannel(rsslConsumerChannel_);
                               sourceDirectory_->UPAChannel(rsslConsumerChannel_);
-                              upaDictionary_->UPAChannel(rsslConsumerChannel_);
+                              if (IsPrimary())
+                              {
+                                 upaDictionary_->UPAChannel(rsslConsumerChannel_);
+                              }
                               mama_log (MAMA_LOG_LEVEL_FINEST, "Provider returned \"Connection Successful\"");
                               NotifyListeners(true, "Provider returned \"Connection Successful\"");
 
@@ -286,7 +412,7 @@ void UPAConsumer::Run()
                   }
                }
                else
-                  if (selRet < 0)
+                  if (selRet < 0 && errno != EINTR)
                   {
                      t42log_error("Select error.\n");
                      runThread_ = false;
@@ -318,10 +444,16 @@ void UPAConsumer::Run()
 
       /* Initialize ping handler */
       if (rsslConsumerChannel_)
+      {
          InitPingHandler(rsslConsumerChannel_);
 
-      int64_t queueCount = 0;
+         // the channel is active, from here on we only get told about new data so we must drain it on every read
+         poller_.EdgeTriggered(true);
+         readPending_ = true;
+      }
+
       /* this is the message processing loop */
+      writeBatch_.Hold();
       while (runThread_)
       {
 
@@ -331,18 +463,27 @@ void UPAConsumer::Run()
             break;
          }
 
+         bool readable = false;
+         bool writable = false;
          if ((rsslConsumerChannel_ != NULL) && (rsslConsumerChannel_->socketId != -1))
          {
-             // if we have a connection
-             useRead = readfds_;
-             useExcept = exceptfds_;
-             useWrt = wrtfds_;
-             time_interval.tv_sec = 0;
-             time_interval.tv_usec = waitTimeForSelect_;
-
-             // look at the socket state
-
-             selRet = select(FD_SETSIZE, &useRead, &useWrt, &useExcept, &time_interval);
+             // send what the queue events and the last read wrote, then hold the flushes again for this pass
+             FlushWrites(rsslConsumerChannel_);
+
+             if (readPending_)
+             {
+                 // there is still data to read so dont wait
+                 selRet = 1;
+                 readable = true;
+             }
+             else
+             {
+                 // wait until the channel has something for us, a request is queued or it is time to ping
+                 selRet = poller_.Wait(WaitTimeout());
+                 readable = poller_.Readable();
+                 writable = poller_.Writable();
+             }
+             writeBatch_.Hold();
          }
          else
          {
@@ -355,6 +496,7 @@ void UPAConsumer::Run()
 #endif
              // If waiting to recover connection then fall through and recover
               if (!shouldRecoverConnection_) continue;
+              selRet = 0;
          }
 
 
@@ -380,8 +522,7 @@ void UPAConsumer::Run()
          {
             if ((rsslConsumerChannel_ != NULL) && (rsslConsumerChannel_->socketId != -1))
             {
-               if ((FD_ISSET(rsslConsumerChannel_->socketId, &useRead)) ||
-                  (FD_ISSET(rsslConsumerChannel_->socketId, &useExcept)))
+               if (readable)
                {
                    // This will empty the read buffer and dispatch incoming events
                   if (ReadFromChannel(rsslConsumerChannel_) != RSSL_RET_SUCCESS)
@@ -401,7 +542,7 @@ void UPAConsumer::Run()
 
                // If there's anything to be written flush the write socket
                if (rsslConsumerChannel_ != NULL &&
-                  FD_ISSET(rsslConsumerChannel_->socketId, &useWrt) &&
+                  writable && poller_.WantsWrite() &&
                   rsslConsumerChannel_->state == RSSL_CH_STATE_ACTIVE)
                {
                   if ((retval = rsslFlush(rsslConsumerChannel_, &error)) < RSSL_RET_SUCCESS)
@@ -410,8 +551,8 @@ void UPAConsumer::Run()
                   }
                   else if (retval == RSSL_RET_SUCCESS)
                   {
-                     // and clear the fd
-                     FD_CLR(rsslConsumerChannel_->socketId, &wrtfds_);
+                     // and stop waiting for the channel to become writable
+                     poller_.WantWrite(false);
                   }
                }
             }
@@ -430,6 +571,9 @@ void UPAConsumer::Run()
          {
             ProcessPings(rsslConsumerChannel_);
          }
+
+         // and give up on any posts that have waited too long for their acks
+         postManager_.ExpirePosts();
       }
    }
 
@@ -439,6 +583,26 @@ void UPAConsumer::Run()
    t42log_info("Exit UPAConsumer thread");
 }
 
+void UPAConsumer::FlushWrites(RsslChannel* chnl)
+{
+   RsslError error;
+   RsslRet retval;
+
+   if (chnl->state == RSSL_CH_STATE_ACTIVE)
+   {
+      if ((retval = writeBatch_.Flush(chnl, &error)) < RSSL_RET_SUCCESS)
+      {
+         t42log_error("rsslFlush() failed with return code %d - <%s>\n", retval, error.text);
+      }
+   }
+
+   // rssl couldnt write everything, so flush again when the channel is writable
+   if (writeBatch_.TakeWantWrite())
+   {
+      poller_.WantWrite(true);
+   }
+}
+
 RsslChannel* UPAConsumer::ConnectToRsslServer(const std::string &hostname, const std::string &port, char* interfaceName, RsslConnectionTypes connType, RsslError* error)
 {
    RsslChannel* chnl;
@@ -461,17 +625,15 @@ RsslChannel* UPAConsumer::ConnectToRsslServer(const std::string &hostname, const
    connectOpts.minorVersion = RSSL_RWF_MINOR_VERSION;
    connectOpts.protocolType = RSSL_RWF_PROTOCOL_TYPE;
 
+   // SendUPAMessage finds the write batch through the channel
+   connectOpts.userSpecPtr = &writeBatch_;
+
    if ( (chnl = rsslConnect(&connectOpts,error)) != 0)
    {
-      FD_SET(chnl->socketId,&readfds_);
-      FD_SET(chnl->socketId,&exceptfds_);
+      // a non blocking connect completes when the socket becomes writable
+      poller_.SetChannel(chnl->socketId, !connectOpts.blocking);
 
       t42log_info("Channel IPC descriptor = %d\n", chnl->socketId);
-      if (!connectOpts.blocking)
-      {
-         if (!FD_ISSET(chnl->socketId,&wrtfds_))
-            FD_SET(chnl->socketId,&wrtfds_);
-      }
    }
 
    return chnl;
@@ -484,6 +646,14 @@ void UPAConsumer::RecoverConnection()
 
    // notify listeners that we are not connected
    mama_log (MAMA_LOG_LEVEL_FINE, "Recovering Connection");
+
+   // time from the first loss of a channel we had, not from a failed reconnection attempt
+   if (recoveryStart_ == 0 && channelGeneration_ > 0)
+   {
+      recoveryStart_ = utils::time::GetMicroCount();
+   }
+   recoveryResubscribed_ = false;
+
    NotifyListeners(false, "Recovering Connection");
 
    // reset the channel
@@ -494,6 +664,13 @@ void UPAConsumer::RecoverConnection()
    }
    // and flag a reconnect
    shouldRecoverConnection_ = RSSL_TRUE;
+   readPending_ = false;
+
+   // a secondary shard holds its requests until it has logged in again
+   if (!IsPrimary())
+   {
+      requestsEnabled_ = false;
+   }
 
 }
 
@@ -508,13 +685,8 @@ void UPAConsumer::RemoveChannel(RsslChannel* chnl)
    RsslError error = { 0, 0, 0, { '\0' } };
    RsslRet ret;
 
-   // tidy up the fds and close the channel
-   FD_CLR(chnl->socketId, &readfds_);
-   FD_CLR(chnl->socketId, &exceptfds_);
-   if (FD_ISSET(chnl->socketId, &wrtfds_))
-   {
-      FD_CLR(chnl->socketId, &wrtfds_);
-   }
+   // tidy up the poller and close the channel
+   poller_.ClearChannel();
 
    if ((ret = rsslCloseChannel(chnl, &error)) < RSSL_RET_SUCCESS)
    {
@@ -525,13 +697,68 @@ void UPAConsumer::RemoveChannel(RsslChannel* chnl)
 // Stop the UPAConsumer thread, which will also shut down RSSL
 void UPAConsumer::Stop()
 {
-   if (0 != statsLogger_)
+   // the statistics logger is shared by all the shards
+   if (IsPrimary() && 0 != statsLogger_)
    {
       statsLogger_->Stop();
    }
 
    t42log_info("Stopping UPAConsumer thread");
    runThread_ = false;
+   poller_.Wakeup();
+}
+
+void UPAConsumer::Wakeup()
+{
+   poller_.Wakeup();
+}
+
+long UPAConsumer::WaitTimeout() const
+{
+   long timeout = 0;
+   if (!blockingWait_)
+   {
+      // nothing will wake us so poll (waitTimeForSelect is in microseconds)
+      timeout = (long)((waitTimeForSelect_ + 999) / 1000);
+   }
+   else
+   {
+      if (requestBacklog_)
+      {
+         // PumpQueueEvents has more to do
+         return 0;
+      }
+
+      // otherwise block until the next ping is due
+      time_t currentTime = 0;
+      time(&currentTime);
+
+      time_t nextPingTime = (std::min)(nextSendPingTime_, nextReceivePingTime_);
+      if (nextPingTime <= currentTime)
+      {
+         return 0;
+      }
+
+      timeout = (long)(nextPingTime - currentTime) * 1000;
+   }
+
+   // or until a conflated update is due
+   if (nextConflationDeadline_ != 0)
+   {
+      RsslUInt64 now = utils::time::GetMicroCount();
+      if (nextConflationDeadline_ <= now)
+      {
+         return 0;
+      }
+
+      long conflationTimeout = (long)((nextConflationDeadline_ - now + 999) / 1000);
+      if (conflationTimeout < timeout)
+      {
+         timeout = conflationTimeout;
+      }
+   }
+
+   return timeout;
 }
 
 // Wait for UPAConsumer thread stop
@@ -582,12 +809,19 @@ RsslRet UPAConsumer::ReadFromChannel(RsslChannel* chnl)
    RsslRet    readret;
 
    int maxReadTime = (pingTimeoutClient_*1000)/2;
+
+   // assume we will drain the channel
+   readPending_ = false;
+
    if (chnl->socketId != -1 && chnl->state == RSSL_CH_STATE_ACTIVE)
    {
 
     int32_t start = utils::time::GetMilliCount();
       readret = 1;
 
+      // the items we look up from the stream ids are borrowed from the stream manager for the duration of the read
+      UPAStreamManager::ReadEpoch epoch(streamManager_);
+
       // keep reading 'til nothing left or we have used half the ping interval
       // we put int he second condition in order that when the input rate is high we still get the opportunity to send pings and other outgoing data
 
@@ -596,6 +830,11 @@ RsslRet UPAConsumer::ReadFromChannel(RsslChannel* chnl)
 
          if ((msgBuf = rsslRead(chnl,&readret,&error)) != 0)
          {
+            if (capture_)
+            {
+               capture_->WriteMessage(msgBuf);
+            }
+
             if (ProcessResponse(chnl, msgBuf) == RSSL_RET_SUCCESS)
             {
                /* set flag for server message received */
@@ -606,9 +845,13 @@ RsslRet UPAConsumer::ReadFromChannel(RsslChannel* chnl)
                // this will trigger a reconnection so process response needs to be circumspect about return value
                return RSSL_RET_FAILURE;
             }
+
+            // the channel is edge triggered, so unless rssl tells us it would block we have to come back for more
+            readPending_ = true;
          }
          else
          {
+            readPending_ = false;
             switch (readret)
             {
             case RSSL_RET_CONGESTION_DETECTED:
@@ -633,16 +876,15 @@ RsslRet UPAConsumer::ReadFromChannel(RsslChannel* chnl)
             case RSSL_RET_READ_FD_CHANGE:
                {
                   t42log_info("rsslRead() FD Change - Old FD: %d New FD: %d\n", chnl->oldSocketId, chnl->socketId);
-                  FD_CLR(chnl->oldSocketId, &readfds_);
-                  FD_CLR(chnl->oldSocketId, &exceptfds_);
-                  FD_SET(chnl->socketId, &readfds_);
-                  FD_SET(chnl->socketId, &exceptfds_);
+                  poller_.ChangeChannel(chnl->oldSocketId, chnl->socketId);
+                  readPending_ = true;
                }
                break;
             case RSSL_RET_READ_PING:
                {
                   //set flag for server message received
                   receivedServerMsg_ = RSSL_TRUE;
+                  readPending_ = true;
                }
                break;
             default:
@@ -713,19 +955,33 @@ void UPAConsumer::ProcessPings(RsslChannel* chnl)
 
 
 // Process a channel response
+RsslRet UPAConsumer::ProcessResponse(RsslChannel* chnl, RsslBuffer* buffer)
+{
+   // bump counter
+   //++incomingMessageCount_;
+   statsLogger_->IncIncomingMessageCount();
+   ++messageSequence_;
+   if (statsLogger_->Enabled())
+   {
+      messageStartTime_ = utils::time::GetMicroCount();
+   }
+
+   RsslRet ret = DecodeResponse(chnl, buffer);
+
+   // anything notified from here on (LVC recaps, conflation flushes, stale fan out) isn't timed from this message
+   messageStartTime_ = 0;
+   return ret;
+}
+
 // Decode the higher level message elements that when we have determined the message type
 // pass to the appropriate handler
-RsslRet UPAConsumer::ProcessResponse(RsslChannel* chnl, RsslBuffer* buffer)
+RsslRet UPAConsumer::DecodeResponse(RsslChannel* chnl, RsslBuffer* buffer)
 {
    RsslRet ret = 0;
    RsslMsg msg = RSSL_INIT_MSG;
    RsslDecodeIterator dIter;
    UPALogin::RsslLoginResponseInfo *loginRespInfo = NULL;
 
-   // bump counter
-   //++incomingMessageCount_;
-   statsLogger_->IncIncomingMessageCount();
-
    // reset the decode iterator
    rsslClearDecodeIterator(&dIter);
 
@@ -805,10 +1061,15 @@ RsslRet UPAConsumer::ProcessResponse(RsslChannel* chnl, RsslBuffer* buffer)
          if (streamId >= 16)
             // its either a regular mp update or an onstream ack
          {
-            UPAItem_ptr_t item = streamManager_.GetItem(streamId);
-            if (item.get() == 0)
+            UPAItem * item = streamManager_.GetItem(streamId);
+            if (item == 0)
             {
-               // the item has been released - just ignore the update
+               // the item has been released - just ignore the update. Or its the stream of a batch request, which the
+               // provider closes once it has opened the items
+               if (msg.msgBase.msgClass == RSSL_MC_STATUS)
+               {
+                  streamManager_.ReleaseBatchStream(streamId);
+               }
                return RSSL_RET_SUCCESS;
             }
 
@@ -836,12 +1097,16 @@ RsslRet UPAConsumer::ProcessResponse(RsslChannel* chnl, RsslBuffer* buffer)
          // lookup the subscription from the stream id
          RsslUInt32 streamId = msg.msgBase.streamId;
 
-         UPAItem_ptr_t item = streamManager_.GetItem(streamId);
+         UPAItem * item = streamManager_.GetItem(streamId);
 
 
-         if (item.get() == 0)
+         if (item == 0)
          {
-            // the item has been released - just ignore the update
+            // the item has been released - just ignore the update. Or its the stream of a batch request
+            if (msg.msgBase.msgClass == RSSL_MC_STATUS)
+            {
+               streamManager_.ReleaseBatchStream(streamId);
+            }
             return RSSL_RET_SUCCESS;
          }
 
@@ -855,12 +1120,16 @@ RsslRet UPAConsumer::ProcessResponse(RsslChannel* chnl, RsslBuffer* buffer)
          // lookup the subscription from the stream id
          RsslUInt32 streamId = msg.msgBase.streamId;
 
-         UPAItem_ptr_t item = streamManager_.GetItem(streamId);
+         UPAItem * item = streamManager_.GetItem(streamId);
 
 
-         if (item.get() == 0)
+         if (item == 0)
          {
-            // the item has been released - just ignore the update
+            // the item has been released - just ignore the update. Or its the stream of a batch request
+            if (msg.msgBase.msgClass == RSSL_MC_STATUS)
+            {
+               streamManager_.ReleaseBatchStream(streamId);
+            }
             return RSSL_RET_SUCCESS;
          }
 
@@ -931,6 +1200,18 @@ void MAMACALLTYPE UPAConsumer::DictionaryRequestCb(mamaQueue queue,void *closure
 
 }
 
+bool UPAConsumer::RequestDictionaryVersionCheck(mamaQueue requestQueue)
+{
+   return upaDictionary_->QueueVersionCheck(requestQueue);
+}
+
+void MAMACALLTYPE UPAConsumer::DictionaryVersionCheckCb(mamaQueue queue,void *closure)
+{
+   UPADictionary * pDictionary = (UPADictionary*)closure;
+
+   pDictionary->SendVersionCheck();
+}
+
 
 //client  dictionary request
 
@@ -1002,6 +1283,16 @@ RsslUInt32 UPAConsumer::LoginStreamId() const
    return login_->StreamId();
 }
 
+bool UPAConsumer::SendLogin()
+{
+   return login_->SendLoginRequest();
+}
+
+void UPAConsumer::AddLoginListener(LoginResponseListener * pListener)
+{
+   login_->AddListener(pListener);
+}
+
 RsslRet UPAConsumer::ProcessOffStreamResponse(RsslMsg* msg, RsslDecodeIterator* dIter)
 {
    // handle ACK / NAK for off-stream posts
@@ -1039,26 +1330,44 @@ RsslRet UPAConsumer::ProcessOffStreamResponse(RsslMsg* msg, RsslDecodeIterator*
 
 bool UPAConsumer::PumpQueueEvents()
 {
-    // before we do anything else, process any pending subscriptions
-   owner_->ProcessPendingSubcriptions();
+    // before we do anything else, process any pending subscriptions. This is done on the primary's thread, which routes
+    // each one to its shard
+   if (IsPrimary())
+   {
+      owner_->ProcessPendingSubcriptions();
+   }
+
+   // and the next slice of any source or item group state changes for the items on this consumer
+   bool transitionsPending = owner_->ProcessSourceTransitions(this);
+
+   // send the conflated updates that have been held for the max latency
+   SweepConflation();
 
    // Now dispatch any incoming events from the mama queue
    size_t numEvents = 0;
+   requestBacklog_ = false;
 
   mama_status status = mamaQueue_getEventCount(requestQueue_, &numEvents);
-   if ((status == MAMA_STATUS_OK) && (numEvents > 0))
+   if ((status == MAMA_STATUS_OK) && (numEvents > 0) && requestsEnabled_)
    {
       // although we only really want to throttle subscriptions, for simplicity throttle everything here.
       size_t eventsDispatched = 0;
 
+      // the open window - fixed at maxPending, or sized from the response times by the adaptive throttle
+      size_t openWindow = StreamManager().OpenWindow();
+
+      // collect the opens into batch requests, if the provider takes them
+      batchRequests_.Begin(rsslConsumerChannel_ != NULL && login_->LoginResponseInfo().SupportBatchRequests != 0);
+
       // so keep dispatching while there are events on the queue, we haven't hit the max per cycle
       //and we haven't hit the max pending limit
       while ((numEvents > eventsDispatched)
          && (eventsDispatched < maxDispatchesPerCycle_)
-         && (StreamManager().countPendingItems() < maxPendingOpens_))
+         && (StreamManager().countPendingItems() < openWindow))
       {
          if (!runThread_)
          {
+            batchRequests_.Clear();
             return false;
          }
 
@@ -1066,7 +1375,21 @@ bool UPAConsumer::PumpQueueEvents()
          ++eventsDispatched;
       }
 
+      batchRequests_.Send();
+
       t42log_debug("dispatched %d requests \n", eventsDispatched);
+
+      // if we stopped because of maxdisp then come straight back for more. If we stopped because of maxPending
+      // then we will be woken by the refreshes that bring the pending count down
+      requestBacklog_ = (numEvents > eventsDispatched) && (StreamManager().countPendingItems() < StreamManager().OpenWindow());
+   }
+
+   // come straight back for the rest of the transitions too
+   requestBacklog_ = requestBacklog_ || transitionsPending;
+
+   if (recoveryResubscribed_)
+   {
+      CheckRecovered();
    }
 
    // This MUST be outside the loop as there may be no further events when the final items
@@ -1078,6 +1401,70 @@ bool UPAConsumer::PumpQueueEvents()
    return true;
 }
 
+void UPAConsumer::SweepConflation()
+{
+   if (conflationWatch_.empty())
+   {
+      nextConflationDeadline_ = 0;
+      return;
+   }
+
+   RsslUInt64 now = utils::time::GetMicroCount();
+   if (nextConflationDeadline_ > now)
+   {
+      return;
+   }
+
+   // drop the subscriptions that are no longer holding anything, and find when the next is due
+   nextConflationDeadline_ = 0;
+   size_t kept = 0;
+   for (size_t i = 0; i < conflationWatch_.size(); ++i)
+   {
+      if (conflationWatch_[i]->FlushExpiredConflation(now, nextConflationDeadline_))
+      {
+         conflationWatch_[kept++] = conflationWatch_[i];
+      }
+   }
+   conflationWatch_.resize(kept);
+}
+
+void UPAConsumer::RecoveryStage(const char * stage)
+{
+   if (recoveryStart_ != 0)
+   {
+      t42log_info("Transport %s shard %u recovery: %s after %llu ms\n", getTransportName().c_str(), (unsigned int)shard_, stage,
+         (unsigned long long)((utils::time::GetMicroCount() - recoveryStart_) / 1000));
+   }
+}
+
+void UPAConsumer::ItemsResubscribed()
+{
+   if (recoveryStart_ != 0)
+   {
+      RecoveryStage("items re-requested");
+      recoveryResubscribed_ = true;
+   }
+}
+
+void UPAConsumer::CheckRecovered()
+{
+   // done when the re-requests have all gone out and had their responses
+   size_t queued = 0;
+   mamaQueue_getEventCount(requestQueue_, &queued);
+   if (queued > 0 || StreamManager().countPendingItems() > 0)
+   {
+      return;
+   }
+
+   RsslUInt64 millis = (utils::time::GetMicroCount() - recoveryStart_) / 1000;
+   t42log_info("Transport %s shard %u recovered %d items %llu ms after the connection was lost\n", getTransportName().c_str(),
+      (unsigned int)shard_, (int)StreamManager().OpenItems(), (unsigned long long)millis);
+   statsLogger_->SetLastRecoveryTime(millis);
+
+   recoveryStart_ = 0;
+   recoveryResubscribed_ = false;
+}
+
 void UPAConsumer::WaitReconnectionDelay()
 {
    // wait for the specified time in the reconnection delay sequence.
@@ -1109,3 +1496,205 @@ const std::string& UPAConsumer::getTransportName() const
 {
    return GetOwner()->GetTransportName();
 }
+
+bool UPAConsumer::ItemOpened(RsslUInt32 streamId, RsslUInt8 domainType, const std::string& source, const std::string& symbol)
+{
+   if (replay_)
+   {
+      replay_->ItemOpened(streamId, domainType, source, symbol);
+      return false;
+   }
+
+   if (capture_)
+   {
+      capture_->WriteItemOpen(streamId, domainType, source, symbol);
+   }
+   return true;
+}
+
+bool UPAConsumer::ItemClosed(RsslUInt32 streamId)
+{
+   if (replay_)
+   {
+      replay_->ItemClosed(streamId);
+      return false;
+   }
+   return true;
+}
+
+bool UPAConsumer::ViewsSupported() const
+{
+   return rsslConsumerChannel_ != NULL && login_->LoginResponseInfo().SupportViewRequests != 0;
+}
+
+// Replay a capture file in place of a connection
+//
+// The recorded login and source directory responses bring the subscriber up as they would on a connection, although
+// the dictionary has to come from the fieldfile and enumfile. The item messages are processed as the matching
+// subscriptions are opened, timing each call to ProcessResponse, and the file is replayed replay-passes times. After
+// that the consumer just dispatches requests until it is stopped
+void UPAConsumer::RunReplay()
+{
+   if (!replay_->Load(replayFile_))
+   {
+      NotifyListeners(false, "Unable to load the capture file to replay");
+      return;
+   }
+
+   if (!upaDictionary_->IsComplete())
+   {
+      t42log_error("Replaying %s needs the dictionary to be loaded from the fieldfile and enumfile\n", replayFile_.c_str());
+      NotifyListeners(false, "No dictionary to replay the capture file with");
+      return;
+   }
+
+   memset(&replayChannel_, 0, sizeof(replayChannel_));
+   replayChannel_.socketId = -1;
+   replayChannel_.state = RSSL_CH_STATE_ACTIVE;
+   replayChannel_.majorVersion = RSSL_RWF_MAJOR_VERSION;
+   replayChannel_.minorVersion = RSSL_RWF_MINOR_VERSION;
+
+   NotifyListeners(true, "Replaying capture file");
+   replayStart_ = utils::time::GetMicroCount();
+
+   for (int pass = 1; pass <= replayPasses_ && runThread_; ++pass)
+   {
+      replay_->BeginPass();
+      RsslUInt64 waited = 0;
+      RsslUInt64 start = utils::time::GetNanoCount();
+
+      size_t record = 0;
+      while (record < replay_->NumRecords() && runThread_)
+      {
+         // dispatch the requests between batches, as the message loop does between reads
+         if (!PumpQueueEvents())
+         {
+            break;
+         }
+
+         UPAStreamManager::ReadEpoch epoch(streamManager_);
+         size_t end = std::min(record + ReplayBatchSize, replay_->NumRecords());
+         for (; record < end && runThread_; ++record)
+         {
+            ReplayRecord(replay_->GetRecord(record), pass == 1, waited);
+         }
+      }
+
+      replay_->EndPass(pass, utils::time::GetNanoCount() - start - waited);
+   }
+
+   t42log_info("Finished replaying %s\n", replayFile_.c_str());
+
+   while (runThread_ && PumpQueueEvents())
+   {
+      ReplayIdle();
+   }
+}
+
+void UPAConsumer::ReplayRecord(UPACaptureReplay::Record & record, bool firstPass, RsslUInt64 & waited)
+{
+   switch (record.type_)
+   {
+   case UPACaptureReplay::RecordSession:
+      replayChannel_.majorVersion = record.majorVersion_;
+      replayChannel_.minorVersion = record.minorVersion_;
+      replay_->BeginSession();
+      break;
+
+   case UPACaptureReplay::RecordItemOpen:
+      replay_->RecordedOpen(record);
+      break;
+
+   case UPACaptureReplay::RecordMessage:
+      switch (record.domainType_)
+      {
+      case RSSL_DMT_LOGIN:
+      case RSSL_DMT_SOURCE:
+         // these bring the subscriber up, so are only needed the first time through
+         if (firstPass)
+         {
+            ProcessResponse(&replayChannel_, &record.buffer_);
+         }
+         break;
+
+      case RSSL_DMT_DICTIONARY:
+         // the dictionary is loaded from the files
+         break;
+
+      default:
+         {
+            RsslUInt32 streamId = replay_->LiveStream(record.streamId_);
+            if (streamId == 0 && firstPass)
+            {
+               RsslUInt64 waitStart = utils::time::GetNanoCount();
+               streamId = WaitForReplayStream(record.streamId_);
+               waited += utils::time::GetNanoCount() - waitStart;
+            }
+
+            if (streamId == 0)
+            {
+               replay_->Skipped();
+               break;
+            }
+
+            UPACaptureReplay::SetStreamId(&record.buffer_, streamId);
+
+            RsslUInt64 allocations = UPACaptureReplay::ThreadAllocations();
+            RsslUInt64 start = utils::time::GetNanoCount();
+            ProcessResponse(&replayChannel_, &record.buffer_);
+            RsslUInt64 elapsed = utils::time::GetNanoCount() - start;
+            replay_->Sample(record.domainType_, record.numFields_, elapsed, UPACaptureReplay::ThreadAllocations() - allocations);
+         }
+         break;
+      }
+      break;
+
+   default:
+      break;
+   }
+}
+
+// wait for the item on a recorded stream to be subscribed to. Once nothing has been opened for replay-settle the
+// application has subscribed to all it is going to, so from then on we dont wait
+RsslUInt32 UPAConsumer::WaitForReplayStream(RsslUInt32 recordedStreamId)
+{
+   RsslUInt32 streamId = 0;
+   while (runThread_ && (streamId = replay_->LiveStream(recordedStreamId)) == 0)
+   {
+      RsslUInt64 lastActivity = std::max(replay_->LastOpenTime(), replayStart_);
+      if (utils::time::GetMicroCount() - lastActivity >= replaySettle_)
+      {
+         break;
+      }
+
+      if (!PumpQueueEvents())
+      {
+         break;
+      }
+
+      if ((streamId = replay_->LiveStream(recordedStreamId)) != 0)
+      {
+         break;
+      }
+
+      ReplayIdle();
+   }
+   return streamId;
+}
+
+void UPAConsumer::ReplayIdle()
+{
+   if (blockingWait_)
+   {
+      // woken early if a request is queued
+      poller_.Wait(1);
+   }
+   else
+   {
+#ifdef _WIN32
+      Sleep(1);
+#else
+      usleep(1000);
+#endif
+   }
+}
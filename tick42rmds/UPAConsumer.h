@@ -42,6 +42,10 @@
 #include "RMDSConnectionConfig.h"
 #include "ConnectionListener.h"
 #include "StatisticsLogger.h"
+#include "UPAEventPoller.h"
+#include "UPAWriteBatch.h"
+#include "UPABatchRequests.h"
+#include "UPACaptureFile.h"
 
 
 extern "C"
@@ -62,11 +66,16 @@ class PublishMessageRequest;
 // The UPAConsumer is the class that runs the subscribing socket thread that connects to the ADS
 // It writes item requests and posted messages
 // it reads incoming data and status messages
+//
+// A transport may run several consumers, each with its own connection to the ADS. Shard 0 is the primary, it
+// requests the source directory and dictionary and drives the subscriber state. The other shards share the primary's
+// dictionary and just log in and carry the item streams that are hashed onto them, only taking the item groups from
+// their own source directory
 
 class UPAConsumer
 {
 public:
-    UPAConsumer(RMDSSubscriber * pOwner);
+    UPAConsumer(RMDSSubscriber * pOwner, size_t shard = 0);
     ~UPAConsumer(void);
 
     void Run();
@@ -81,6 +90,10 @@ public:
     static void MAMACALLTYPE DictionaryRequestCb(mamaQueue, void * closure);
     bool RequestDictionary( mamaQueue requestQueue);
 
+    // check the version of the dictionary downloaded on an earlier connection (see UPADictionary::SendVersionCheck)
+    static void MAMACALLTYPE DictionaryVersionCheckCb(mamaQueue, void * closure);
+    bool RequestDictionaryVersionCheck(mamaQueue requestQueue);
+
     // dispatch client request for dictionary subscription
     bool ClientRequestDictionary(mamaQueue requestQueue);
     static void MAMACALLTYPE ClientDictionaryRequestCb(mamaQueue queue, void * closure);
@@ -97,15 +110,27 @@ public:
 
     RsslUInt32 LoginStreamId() const;
 
+    // secondary shards send their login straight away on connection rather than through the request queue, as the
+    // queue is held until the login has succeeded
+    bool SendLogin();
+    void AddLoginListener(LoginResponseListener * pListener);
+
     // connection notifications
     void AddListener( ConnectionListener * pListener );
 
+    size_t Shard() const { return shard_; }
+    bool IsPrimary() const { return shard_ == 0; }
+
+    // while disabled the consumer thread leaves requests on the queue
+    void EnableRequests(bool enable) { requestsEnabled_ = enable; }
+
     // Accessors
     UPAStreamManager & StreamManager()  { return streamManager_; }
     UPAPostManager & PostManager()  { return postManager_; }
     RsslChannel * RsslConsumerChannel() const { return rsslConsumerChannel_; }
     UPASourceDirectory *SourceDirectory() { return sourceDirectory_; }
     UPADictionaryWrapper_ptr_t RsslDictionary()    {return upaDictionary_->RsslDictionary();}
+    const boost::shared_ptr<UPADictionary>& SharedUpaDictionary() const { return upaDictionary_; }
     const RMDSSubscriber* GetOwner() const { return owner_; }
     bool RequiresConnection() const    {return requiresConnection_;}
 
@@ -129,6 +154,32 @@ public:
         statsLogger_->IncSubscriptionsFailed();
     }
 
+    const StatisticsLogger_ptr_t& StatsLogger() const
+    {
+        return statsLogger_;
+    }
+
+    // when the consumer started processing the current message - only set while statistics logging is enabled, and
+    // 0 outside ProcessResponse, so notifications that aren't decoding a message don't record a decode time
+    RsslUInt64 MessageStartTime() const
+    {
+        return messageStartTime_;
+    }
+
+    // counts the messages the consumer has read. Subscriptions use it to order their resubscription by activity
+    RsslUInt64 MessageSequence() const
+    {
+        return messageSequence_;
+    }
+
+    // Recovery timing
+    //
+    // Times the recovery of a lost connection, logging how long after the loss each stage completed. The recovery is
+    // complete once the items resubscribed on the new connection have all had their responses. The total is
+    // reported as the last recovery time in the statistics log
+    void RecoveryStage(const char * stage);
+    void ItemsResubscribed();
+
     void WarnMissingFid(RsslFieldId fid);
 
     void JoinThread(wthread_t thread);
@@ -137,11 +188,56 @@ public:
 
     void SetQueueEventsCount(size_t count);
 
+    // wake the consumer thread if it is blocked waiting for the channel, e.g. when a subscription has been added
+    // to the pending list. May be called from any thread
+    void Wakeup();
+
+    // Capture and replay
+    //
+    // With capture-file set the consumer records what it reads from the channel, and the items it opens, so that the
+    // session can be replayed later. With replay-file set the consumer doesnt connect at all, but replays a capture
+    // through ProcessResponse and logs how long it took (see UPACaptureFile.h)
+    bool Replaying() const { return replay_ != 0; }
+
+    // the subscriptions tell the consumer about the item streams they open and close. These return false when the
+    // consumer is replaying, as there is no channel to send the request on
+    bool ItemOpened(RsslUInt32 streamId, RsslUInt8 domainType, const std::string& source, const std::string& symbol);
+    bool ItemClosed(RsslUInt32 streamId);
+
+    // Batch requests
+    //
+    // With batch-requests set, the item opens that PumpQueueEvents dispatches are sent as RDM batch requests (see
+    // UPABatchRequests.h). The channel generation counts the channels the consumer has had, so a subscription can tell
+    // whether its stream was requested on this one
+    bool BatchOpen(const UPASubscription_ptr_t& sub, bool isSnapshot) { return batchRequests_.Add(sub, isSnapshot); }
+    RsslUInt32 ChannelGeneration() const { return channelGeneration_; }
+
+    // true if the provider's login response said it takes RDM view requests (see RMDSSource::HasView)
+    bool ViewsSupported() const;
+
+    // Conflation
+    //
+    // The subscriptions holding conflated updates, so PumpQueueEvents can send the ones that reach
+    // conflation-max-latency when no later update arrives to do it, and the wait is cut short to be in time for the
+    // earliest (see UPASubscription.h)
+    void WatchConflation(const UPASubscription_ptr_t& sub) { conflationWatch_.push_back(sub); }
+    void ConflationDeadline(RsslUInt64 deadline)
+    {
+        if (nextConflationDeadline_ == 0 || deadline < nextConflationDeadline_)
+        {
+            nextConflationDeadline_ = deadline;
+        }
+    }
+
 private:
     // rssl connection
-    fd_set    readfds_;
-    fd_set    exceptfds_;
-    fd_set    wrtfds_;
+    UPAEventPoller poller_;
+
+    // true if the poller is woken by the request queue, otherwise we have to poll with waitTimeForSelect_
+    bool blockingWait_;
+
+    // how long to wait for the channel on this pass through the message loop
+    long WaitTimeout() const;
 
 
     RsslChannel* ConnectToRsslServer(const std::string &hostname, const std::string &port, char* interfaceName, RsslConnectionTypes connType, RsslError* error);
@@ -154,6 +250,13 @@ private:
     RsslChannel *rsslConsumerChannel_;
 
     RsslRet ReadFromChannel(RsslChannel* chnl);
+
+    // coalesces the flushes of what the queue events and reads write, which are flushed once before each wait
+    UPAWriteBatch writeBatch_;
+    void FlushWrites(RsslChannel* chnl);
+
+    // set when the last read didnt drain the channel, so we must read again without waiting for it to become readable
+    bool readPending_;
     void ProcessPings(RsslChannel* chnl);
 
     RsslBool shouldRecoverConnection_;
@@ -166,6 +269,7 @@ private:
 
 
     RsslRet ProcessResponse(RsslChannel* chnl, RsslBuffer* buffer);
+    RsslRet DecodeResponse(RsslChannel* chnl, RsslBuffer* buffer);
 
     RsslRet ProcessOffStreamResponse(RsslMsg* msg, RsslDecodeIterator* dIter);
 
@@ -177,8 +281,12 @@ private:
 
     RMDSSubscriber * owner_;
 
+    size_t shard_;
+
     mamaQueue requestQueue_;
 
+    volatile bool requestsEnabled_;
+
     UPALogin * login_;
 
     UPASourceDirectory * sourceDirectory_;
@@ -201,6 +309,13 @@ private:
     RsslUInt64 lastSubscriptionsFailed_;
 
     StatisticsLogger_ptr_t statsLogger_;
+    RsslUInt64 messageStartTime_;
+    RsslUInt64 messageSequence_;
+
+    // when the connection was lost, or 0 if it is not recovering
+    RsslUInt64 recoveryStart_;
+    bool recoveryResubscribed_;
+    void CheckRecovered();
 
     // Handle connection
     //
@@ -221,11 +336,38 @@ private:
     // pump incoming events from mama queue
     bool PumpQueueEvents();
 
+    // set when PumpQueueEvents left requests on the queue that it could have dispatched if not for maxdisp
+    bool requestBacklog_;
+
+    std::vector<UPASubscription_ptr_t> conflationWatch_;
+    RsslUInt64 nextConflationDeadline_;
+    void SweepConflation();
+
+    // coalesces the opens that PumpQueueEvents dispatches
+    UPABatchRequests batchRequests_;
+    RsslUInt32 channelGeneration_;
+
     // request throttling
     size_t maxDispatchesPerCycle_;
     size_t maxPendingOpens_;
     size_t waitTimeForSelect_;
 
+    // capture and replay
+    UPACaptureWriter * capture_;
+    UPACaptureReplay * replay_;
+    std::string replayFile_;
+    int replayPasses_;
+    RsslUInt64 replaySettle_;
+    RsslUInt64 replayStart_;
+
+    // stands in for the channel when replaying - ProcessResponse only needs the rwf version from it
+    RsslChannel replayChannel_;
+
+    void RunReplay();
+    void ReplayRecord(UPACaptureReplay::Record & record, bool firstPass, RsslUInt64 & waited);
+    RsslUInt32 WaitForReplayStream(RsslUInt32 recordedStreamId);
+    void ReplayIdle();
+
     // Re-usable message object
     // this is used by all the subscriptions on this thread. We can share this because currently
     // the message is send up to the client synchronously
@@ -35,11 +35,14 @@ using namespace std;
 
 const int FieldDictionaryStreamId = 3;
 const int EnumDictionaryStreamId = 4;
+const int VersionCheckStreamId = 5;
 
 UPADictionary::UPADictionary( const std::string &transport_name )
     : rsslDictionary_(new UPADictionaryWrapper)
     , transport_name_(transport_name)
     , maxMessageSize_(Default_maxMessageSize)
+    , fieldsDownloaded_(false)
+    , versionCheckPending_(false)
 {
     fieldDictionaryStreamId_ = 0;
     enumDictionaryStreamId_ = 0;
@@ -73,6 +76,18 @@ bool UPADictionary::QueueRequest( mamaQueue queue )
 }
 
 
+bool UPADictionary::QueueVersionCheck(mamaQueue queue)
+{
+    mama_status status;
+    if ((status = mamaQueue_enqueueEvent(queue,  UPAConsumer::DictionaryVersionCheckCb, (void*) this)) != MAMA_STATUS_OK)
+    {
+        t42log_error("Failed to enqueue dictionary version check, status code = %d", status);
+        return false;
+    }
+    return true;
+}
+
+
 bool UPADictionary::QueueMamaClientRequest(mamaQueue queue)
 {
     mama_status status;
@@ -151,13 +166,30 @@ bool UPADictionary::SendRequest()
 }
 
 
+bool UPADictionary::SendVersionCheck()
+{
+    RsslRet ret;
+
+    // only the summary is wanted, so this is a handful of bytes however large the dictionary
+    if ((ret = SendDictionaryRequest(DictionaryDownloadName, VersionCheckStreamId, RDM_DICTIONARY_INFO)) != RSSL_RET_SUCCESS)
+    {
+        mama_log(MAMA_LOG_LEVEL_ERROR, "failed to send version check for dictionary '%s' error code = %d", DictionaryDownloadName, ret);
+        return false;
+    }
+
+    versionCheckPending_ = true;
+    return true;
+}
+
+
 
  // Sends a dictionary request to the rmds
 
  // dictionaryName - The name of the dictionary to request
  // streamId - The stream id of the dictionary request
+ // verbosity - How much of the dictionary to request
 
-RsslRet UPADictionary::SendDictionaryRequest(const char *dictionaryName, RsslInt32 streamId)
+RsslRet UPADictionary::SendDictionaryRequest(const char *dictionaryName, RsslInt32 streamId, RsslUInt32 verbosity)
 {
     RsslError error;
     RsslBuffer* msgBuf = 0;
@@ -168,7 +200,7 @@ RsslRet UPADictionary::SendDictionaryRequest(const char *dictionaryName, RsslInt
     if (msgBuf != NULL)
     {
          // encode the dictionary request
-        if (EncodeDictionaryRequest(msgBuf, dictionaryName, streamId) != RSSL_RET_SUCCESS)
+        if (EncodeDictionaryRequest(msgBuf, dictionaryName, streamId, verbosity) != RSSL_RET_SUCCESS)
         {
             rsslReleaseBuffer(msgBuf, &error);
             t42log_error("encodeDictionaryRequest() failed\n");
@@ -199,8 +231,9 @@ RsslRet UPADictionary::SendDictionaryRequest(const char *dictionaryName, RsslInt
  // msgBuf - The message buffer to encode the dictionary request into
  // dictionaryName - The name of the dictionary to request
   // streamId - The stream id of the dictionary request
+ // verbosity - How much of the dictionary to request
 
-RsslRet UPADictionary::EncodeDictionaryRequest( RsslBuffer* msgBuf, const char *dictionaryName, RsslInt32 streamId)
+RsslRet UPADictionary::EncodeDictionaryRequest( RsslBuffer* msgBuf, const char *dictionaryName, RsslInt32 streamId, RsslUInt32 verbosity)
 {
     RsslRet ret = 0;
     RsslRequestMsg msg = RSSL_INIT_REQUEST_MSG;
@@ -222,7 +255,7 @@ RsslRet UPADictionary::EncodeDictionaryRequest( RsslBuffer* msgBuf, const char *
     msg.msgBase.msgKey.name.data = (char *)dictionaryName;
     msg.msgBase.msgKey.name.length = (RsslUInt32)strlen(dictionaryName);
 
-    msg.msgBase.msgKey.filter = RDM_DICTIONARY_VERBOSE;
+    msg.msgBase.msgKey.filter = verbosity;
 
 
     // encode message
@@ -267,6 +300,12 @@ RsslRet UPADictionary::ProcessDictionaryResponse( RsslMsg* msg, RsslDecodeIterat
 
     RDMDictionaryTypes dictionaryType = (RDMDictionaryTypes)0;
 
+    // the version check has its own stream and never touches the loaded dictionary
+    if (msg->msgBase.streamId == VersionCheckStreamId)
+    {
+        return ProcessVersionCheck(msg, dIter);
+    }
+
     switch(msg->msgBase.msgClass)
     {
     case RSSL_MC_REFRESH:
@@ -315,6 +354,7 @@ RsslRet UPADictionary::ProcessDictionaryResponse( RsslMsg* msg, RsslDecodeIterat
             if (msg->refreshMsg.flags & RSSL_RFMF_REFRESH_COMPLETE)
             {
                 rsslDictionary_->SetFieldsLoaded(true);
+                fieldsDownloaded_ = true;
                 fieldDictionaryStreamId_ = 0;
                 if (!rsslDictionary_->GetEnumTypesStatus().loaded)
                     t42log_info("Field Dictionary complete, waiting for Enum Table...\n");
@@ -375,6 +415,61 @@ RsslRet UPADictionary::ProcessDictionaryResponse( RsslMsg* msg, RsslDecodeIterat
 }
 
 
+ // Processes the response to a version check, which is just the summary of the field dictionary
+
+RsslRet UPADictionary::ProcessVersionCheck(RsslMsg* msg, RsslDecodeIterator* dIter)
+{
+    if (!versionCheckPending_)
+    {
+        // the rest of a multi part response
+        return RSSL_RET_SUCCESS;
+    }
+
+    if (msg->msgBase.msgClass != RSSL_MC_REFRESH)
+    {
+        if (msg->msgBase.msgClass == RSSL_MC_STATUS && (msg->statusMsg.flags & RSSL_STMF_HAS_STATE)
+            && msg->statusMsg.state.streamState != RSSL_STREAM_OPEN)
+        {
+            versionCheckPending_ = false;
+            t42log_warn("Dictionary version check on transport %s was refused, keeping the loaded dictionary\n", transport_name_.c_str());
+        }
+        return RSSL_RET_SUCCESS;
+    }
+
+    versionCheckPending_ = false;
+
+    char    errTxt[256];
+    RsslBuffer errorText = {255, (char*)errTxt};
+
+    RsslDataDictionary summary;
+    rsslClearDataDictionary(&summary);
+
+    if (rsslDecodeFieldDictionary(dIter, &summary, RDM_DICTIONARY_INFO, &errorText) != RSSL_RET_SUCCESS)
+    {
+        t42log_warn("Decoding dictionary version check failed: %.*s, keeping the loaded dictionary\n", errorText.length, errorText.data);
+    }
+    else
+    {
+        const RsslBuffer& loadedVersion = rsslDictionary_->GetRawDictionary().infoField_Version;
+        bool sameVersion = rsslBufferIsEqual(&loadedVersion, &summary.infoField_Version) == RSSL_TRUE;
+        if (sameVersion)
+        {
+            t42log_info("Field dictionary version %.*s on transport %s is unchanged, keeping the loaded dictionary\n",
+                loadedVersion.length, loadedVersion.data, transport_name_.c_str());
+        }
+        else
+        {
+            t42log_warn("Field dictionary version on transport %s has changed from %.*s to %.*s\n", transport_name_.c_str(),
+                loadedVersion.length, loadedVersion.data, summary.infoField_Version.length, summary.infoField_Version.data);
+        }
+        NotifyVersionChecked(sameVersion);
+    }
+
+    rsslDeleteDataDictionary(&summary);
+    return RSSL_RET_SUCCESS;
+}
+
+
  // Close the dictionary stream if there is one.
 
  // chnl - The channel to send a dictionary close to
@@ -497,6 +592,17 @@ void UPADictionary::NotifyListeners( bool dictionaryComplete )
 
 }
 
+void UPADictionary::NotifyVersionChecked(bool sameVersion)
+{
+    vector<DictionaryResponseListener*>::iterator it = listeners_.begin();
+
+    while(it != listeners_.end() )
+    {
+        (*it)->DictionaryVersionChecked(sameVersion);
+        it++;
+    }
+}
+
 bool UPADictionary::IsComplete()
 {
     return rsslDictionary_->isComplete();
@@ -71,6 +71,16 @@ public:
 
     UPADictionaryWrapper_ptr_t RsslDictionary() const { return rsslDictionary_; }
     UPADictionaryWrapper_ptr_t GetUnderlyingDictionary() {return rsslDictionary_;}
+
+    // Dictionary version check
+    //
+    // A fast reconnect keeps the dictionary downloaded on the first connection rather than downloading it again. It
+    // just requests the summary of the provider's field dictionary and the listeners are told whether its version
+    // matches the one loaded. A dictionary loaded from file is never checked
+    bool FieldsDownloaded() const { return fieldsDownloaded_; }
+    bool QueueVersionCheck(mamaQueue queue);
+    bool SendVersionCheck();
+
 private:
 
     void NotifyListeners( bool dictionaryComplete );
@@ -90,8 +100,16 @@ private:
     /* enum table file name */
 
     // send requests to channel
-    RsslRet SendDictionaryRequest(const char *dictionaryName, RsslInt32 streamId);
-    RsslRet EncodeDictionaryRequest( RsslBuffer* msgBuf, const char *dictionaryName, RsslInt32 streamId);
+    RsslRet SendDictionaryRequest(const char *dictionaryName, RsslInt32 streamId, RsslUInt32 verbosity = RDM_DICTIONARY_VERBOSE);
+    RsslRet EncodeDictionaryRequest( RsslBuffer* msgBuf, const char *dictionaryName, RsslInt32 streamId, RsslUInt32 verbosity);
+
+    // the field dictionary came from the rmds rather than a file
+    bool fieldsDownloaded_;
+
+    // the version check is outstanding
+    bool versionCheckPending_;
+    RsslRet ProcessVersionCheck(RsslMsg* msg, RsslDecodeIterator* dIter);
+    void NotifyVersionChecked(bool sameVersion);
 
 
     RsslInt32 fieldDictionaryStreamId_;
@@ -115,6 +133,7 @@ class DictionaryResponseListener
 {
 public:
     virtual void DictionaryUpdate(bool dictionaryComplete) = 0;
+    virtual void DictionaryVersionChecked(bool sameVersion) = 0;
 };
 
 #endif //__UPADICTIONARY_H__
@@ -0,0 +1,307 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "stdafx.h"
+#include "UPAEventPoller.h"
+
+#include <utils/t42log.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#endif
+
+UPAEventPoller::UPAEventPoller()
+    : socketId_(-1)
+    , wantWrite_(false)
+    , edgeTriggered_(false)
+    , readable_(false)
+    , writable_(false)
+    , woken_(false)
+#ifdef __linux__
+    , epollFd_(-1)
+    , eventFd_(-1)
+#endif
+{
+#ifndef __linux__
+    FD_ZERO(&readfds_);
+    FD_ZERO(&exceptfds_);
+    FD_ZERO(&wrtfds_);
+#endif
+}
+
+UPAEventPoller::~UPAEventPoller()
+{
+#ifdef __linux__
+    if (eventFd_ != -1)
+    {
+        ::close(eventFd_);
+    }
+
+    if (epollFd_ != -1)
+    {
+        ::close(epollFd_);
+    }
+#endif
+}
+
+bool UPAEventPoller::Initialize()
+{
+#ifdef __linux__
+    if ((epollFd_ = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    {
+        t42log_error("epoll_create1() failed with error %d\n", errno);
+        return false;
+    }
+
+    if ((eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+    {
+        t42log_error("eventfd() failed with error %d\n", errno);
+        return false;
+    }
+
+    // the wakeup fd is level triggered, it stays readable until we drain it in Wait()
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = eventFd_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, eventFd_, &ev) == -1)
+    {
+        t42log_error("epoll_ctl() failed to add wakeup fd with error %d\n", errno);
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+bool UPAEventPoller::CanWakeup() const
+{
+#ifdef __linux__
+    return eventFd_ != -1;
+#else
+    return false;
+#endif
+}
+
+void UPAEventPoller::SetChannel(RsslSocket socketId, bool wantWrite)
+{
+    if (socketId_ != -1)
+    {
+        ClearChannel();
+    }
+
+    socketId_ = socketId;
+    wantWrite_ = wantWrite;
+    edgeTriggered_ = false;
+
+#ifdef __linux__
+    UpdateChannel(EPOLL_CTL_ADD);
+#else
+    FD_SET(socketId_, &readfds_);
+    FD_SET(socketId_, &exceptfds_);
+    if (wantWrite_)
+    {
+        FD_SET(socketId_, &wrtfds_);
+    }
+#endif
+}
+
+void UPAEventPoller::ChangeChannel(RsslSocket oldSocketId, RsslSocket newSocketId)
+{
+#ifdef __linux__
+    // closed descriptors are removed from the epoll set automatically so a failure here is not an error
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, oldSocketId, NULL);
+    socketId_ = newSocketId;
+    UpdateChannel(EPOLL_CTL_ADD);
+#else
+    FD_CLR(oldSocketId, &readfds_);
+    FD_CLR(oldSocketId, &exceptfds_);
+    FD_CLR(oldSocketId, &wrtfds_);
+    SetChannel(newSocketId, wantWrite_);
+#endif
+}
+
+void UPAEventPoller::ClearChannel()
+{
+    if (socketId_ == -1)
+    {
+        return;
+    }
+
+#ifdef __linux__
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, socketId_, NULL);
+#else
+    FD_CLR(socketId_, &readfds_);
+    FD_CLR(socketId_, &exceptfds_);
+    FD_CLR(socketId_, &wrtfds_);
+#endif
+
+    socketId_ = -1;
+    wantWrite_ = false;
+    edgeTriggered_ = false;
+}
+
+void UPAEventPoller::EdgeTriggered(bool edgeTriggered)
+{
+    if (edgeTriggered == edgeTriggered_)
+    {
+        return;
+    }
+
+    edgeTriggered_ = edgeTriggered;
+
+#ifdef __linux__
+    if (socketId_ != -1)
+    {
+        UpdateChannel(EPOLL_CTL_MOD);
+    }
+#endif
+}
+
+void UPAEventPoller::WantWrite(bool wantWrite)
+{
+    if (wantWrite == wantWrite_)
+    {
+        return;
+    }
+
+    wantWrite_ = wantWrite;
+
+    if (socketId_ == -1)
+    {
+        return;
+    }
+
+#ifdef __linux__
+    UpdateChannel(EPOLL_CTL_MOD);
+#else
+    if (wantWrite_)
+    {
+        FD_SET(socketId_, &wrtfds_);
+    }
+    else
+    {
+        FD_CLR(socketId_, &wrtfds_);
+    }
+#endif
+}
+
+int UPAEventPoller::Wait(long timeoutMs)
+{
+    readable_ = false;
+    writable_ = false;
+    woken_ = false;
+
+#ifdef __linux__
+    struct epoll_event events[2];
+
+    int ret = epoll_wait(epollFd_, events, 2, (int)timeoutMs);
+    for (int i = 0; i < ret; ++i)
+    {
+        if (events[i].data.fd == eventFd_)
+        {
+            // reset the counter, the caller looks at the request queue itself
+            eventfd_t value;
+            eventfd_read(eventFd_, &value);
+            woken_ = true;
+        }
+        else
+        {
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                readable_ = true;
+            }
+
+            if (events[i].events & EPOLLOUT)
+            {
+                writable_ = true;
+            }
+        }
+    }
+
+    return ret;
+#else
+    fd_set useRead = readfds_;
+    fd_set useExcept = exceptfds_;
+    fd_set useWrt = wrtfds_;
+
+    struct timeval time_interval;
+    struct timeval *pTimeInterval = NULL;
+    if (timeoutMs >= 0)
+    {
+        time_interval.tv_sec = timeoutMs / 1000;
+        time_interval.tv_usec = (timeoutMs % 1000) * 1000;
+        pTimeInterval = &time_interval;
+    }
+
+    int ret = select(FD_SETSIZE, &useRead, &useWrt, &useExcept, pTimeInterval);
+    if (ret > 0 && socketId_ != -1)
+    {
+        readable_ = FD_ISSET(socketId_, &useRead) || FD_ISSET(socketId_, &useExcept);
+        writable_ = FD_ISSET(socketId_, &useWrt) != 0;
+    }
+
+    return ret;
+#endif
+}
+
+void UPAEventPoller::Wakeup()
+{
+#ifdef __linux__
+    if (eventFd_ != -1)
+    {
+        eventfd_write(eventFd_, 1);
+    }
+#endif
+}
+
+void MAMACALLTYPE UPAEventPoller::EnqueueCb(mamaQueue queue, void* closure)
+{
+    ((UPAEventPoller*)closure)->Wakeup();
+}
+
+#ifdef __linux__
+void UPAEventPoller::UpdateChannel(int op)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (edgeTriggered_)
+    {
+        ev.events |= EPOLLET;
+    }
+    if (wantWrite_)
+    {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.fd = socketId_;
+
+    if (epoll_ctl(epollFd_, op, socketId_, &ev) == -1)
+    {
+        t42log_error("epoll_ctl() failed for fd=%d with error %d\n", socketId_, errno);
+    }
+}
+#endif
@@ -0,0 +1,104 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __UPAEVENTPOLLER_H__
+#define __UPAEVENTPOLLER_H__
+
+#include <rtr/rsslTransport.h>
+
+// Waits for activity on the consumer's rssl channel and for requests being added to the consumer request queue.
+//
+// On linux this is an edge triggered epoll set plus an eventfd that is signalled whenever a request is enqueued, so
+// the consumer thread only wakes when there is something to do. On other platforms it falls back to select() and
+// cannot be woken, so the caller has to poll with a timeout.
+//
+// Once the channel is switched to edge triggered the caller must keep reading until rsslRead reports that it would block
+// before waiting again.
+
+class UPAEventPoller
+{
+public:
+    UPAEventPoller();
+    ~UPAEventPoller();
+
+    // create the underlying os objects. Returns false if the poller cant be used
+    bool Initialize();
+
+    // true if Wakeup() will interrupt a blocked Wait()
+    bool CanWakeup() const;
+
+    // channel registration
+    void SetChannel(RsslSocket socketId, bool wantWrite);
+    void ChangeChannel(RsslSocket oldSocketId, RsslSocket newSocketId);
+    void ClearChannel();
+
+    // the channel is level triggered while it is being initialised and edge triggered once it is active
+    void EdgeTriggered(bool edgeTriggered);
+
+    // enable / disable notification when the channel becomes writable
+    void WantWrite(bool wantWrite);
+    bool WantsWrite() const { return wantWrite_; }
+
+    // Wait for an event. timeoutMs < 0 waits until there is activity or Wakeup() is called
+    // returns the number of events (0 on timeout) or -1 on error
+    int Wait(long timeoutMs);
+
+    // results of the last Wait()
+    bool Readable() const { return readable_; }
+    bool Writable() const { return writable_; }
+    bool Woken() const { return woken_; }
+
+    // may be called from any thread
+    void Wakeup();
+
+    // mamaQueue enqueue callback, closure is the poller
+    static void MAMACALLTYPE EnqueueCb(mamaQueue queue, void* closure);
+
+private:
+    RsslSocket socketId_;
+    bool wantWrite_;
+    bool edgeTriggered_;
+
+    bool readable_;
+    bool writable_;
+    bool woken_;
+
+#ifdef __linux__
+    void UpdateChannel(int op);
+
+    int epollFd_;
+    int eventFd_;
+#else
+    fd_set readfds_;
+    fd_set exceptfds_;
+    fd_set wrtfds_;
+#endif
+
+    // not copyable
+    UPAEventPoller(const UPAEventPoller&);
+    UPAEventPoller& operator=(const UPAEventPoller&);
+};
+
+#endif //__UPAEVENTPOLLER_H__
@@ -0,0 +1,76 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "stdafx.h"
+#include "UPAFieldDecodePlan.h"
+#include "UPAFieldDecoder.h"
+
+UPAFieldDecodePlan::UPAFieldDecodePlan(const UPADictionaryWrapper_ptr_t& dictionary, const UpaMamaFieldMap_ptr_t& fieldmap, RsslUInt32 generation)
+    : generation_(generation)
+    , stepIndex_(RSSL_MAX_FID - RSSL_MIN_FID + 1, -1)
+{
+    const RsslDataDictionary* rsslDictionary = dictionary->RsslDictionary();
+    if (rsslDictionary->entriesArray == 0)
+    {
+        t42log_warn("Cant build decode plan - no dictionary");
+        return;
+    }
+
+    steps_.reserve(rsslDictionary->numberOfEntries);
+
+    for (RsslInt32 fid = rsslDictionary->minFid; fid <= rsslDictionary->maxFid; ++fid)
+    {
+        const RsslDictionaryEntry* dictionaryEntry = rsslDictionary->entriesArray[fid];
+        if (dictionaryEntry == 0)
+        {
+            continue;
+        }
+
+        // this also assigns the mama fids for the fields that are not in the field map, if they are being passed through
+        FindFieldResult findFieldResult = fieldmap->GetTranslatedField((RsslFieldId)fid);
+        if (!findFieldResult.first)
+        {
+            continue;
+        }
+
+        UPAFieldDecodeStep step;
+        step.fid = (RsslFieldId)fid;
+        step.rwfType = dictionaryEntry->rwfType;
+        step.fieldType = dictionaryEntry->fieldType;
+        step.mamaField = findFieldResult.second;
+        step.mamaName = 0;
+        step.handler = UPAFieldDecoder::SelectHandler(dictionaryEntry, step.mamaField);
+
+        stepIndex_[(RsslUInt16)(fid - RSSL_MIN_FID)] = (RsslInt32)steps_.size();
+        steps_.push_back(step);
+    }
+
+    // now the steps wont move we can point at the names
+    for (size_t i = 0; i < steps_.size(); ++i)
+    {
+        steps_[i].mamaName = steps_[i].mamaField.mama_field_name.c_str();
+    }
+
+    t42log_info("Built decode plan %d for %d fields\n", generation_, (int)steps_.size());
+}
@@ -0,0 +1,88 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __UPAFIELDDECODEPLAN_H__
+#define __UPAFIELDDECODEPLAN_H__
+
+#include "UPAMamaFieldMap.h"
+#include "UPADictionaryWrapper.h"
+#include "rmdsBridgeTypes.h"
+
+class UPAFieldDecoder;
+struct UPAFieldDecodeStep;
+
+// a handler decodes one field entry and adds it to the mama message
+typedef RsslRet (UPAFieldDecoder::*UPAFieldDecodeHandler)(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+
+// Everything the decoder needs to know about a fid, resolved up front from the rssl dictionary and the field map
+struct UPAFieldDecodeStep
+{
+    UPAFieldDecodeHandler handler;
+
+    // copied from the dictionary entry. The plan doesnt point into the dictionary as it is freed and downloaded again
+    // when the connection recovers
+    RsslFieldId fid;
+    RsslUInt8 rwfType;
+    RsslInt8 fieldType;
+
+    // the translated mama field. The name is held here so the handlers dont go back to the field map for it
+    MamaField_t mamaField;
+    const char* mamaName;
+};
+
+// The decode plan maps each rmds fid onto the step that decodes it. It replaces the per-field dictionary and field map
+// lookups, and the switches on the rwf type and mama type, with a single indexed load and an indirect call.
+//
+// The plan is built each time the rssl dictionary is complete and is then read only, so it can be shared by all the
+// subscriptions on the transport. Fids that are not in the dictionary, or that the field map doesnt pass through,
+// have no step and are skipped.
+
+class UPAFieldDecodePlan
+{
+public:
+    UPAFieldDecodePlan(const UPADictionaryWrapper_ptr_t& dictionary, const UpaMamaFieldMap_ptr_t& fieldmap, RsslUInt32 generation);
+
+    const UPAFieldDecodeStep* Find(RsslFieldId fid) const
+    {
+        RsslInt32 index = stepIndex_[(RsslUInt16)(fid - RSSL_MIN_FID)];
+        return (index < 0) ? 0 : &steps_[index];
+    }
+
+    RsslUInt32 Generation() const { return generation_; }
+    size_t Size() const { return steps_.size(); }
+
+private:
+    // incremented by the owner each time the plan is rebuilt
+    RsslUInt32 generation_;
+
+    std::vector<UPAFieldDecodeStep> steps_;
+
+    // one slot for every possible fid, -1 if there is no step
+    std::vector<RsslInt32> stepIndex_;
+};
+
+typedef boost::shared_ptr<UPAFieldDecodePlan> UPAFieldDecodePlan_ptr_t;
+
+#endif //__UPAFIELDDECODEPLAN_H__
@@ -33,7 +33,8 @@
 
 using namespace std;
 
-RsslRet UPAFieldDecoder::DecodeFieldEntry(RsslFieldEntry* fEntry, RsslDecodeIterator *dIter, mamaMsg msg)
+// decode a field without a plan, this is used until the dictionary is complete and the plan has been built
+RsslRet UPAFieldDecoder::DecodeFieldEntryUnplanned(RsslFieldEntry* fEntry, RsslDecodeIterator *dIter, mamaMsg msg)
 {
     RsslRet ret = 0;
     RsslDictionaryEntry* dictionaryEntry = NULL;
@@ -395,6 +396,572 @@ RsslRet UPAFieldDecoder::DecodeFieldEntry(RsslFieldEntry* fEntry, RsslDecodeIter
     return RSSL_RET_SUCCESS;
 }
 
+// Choose the handler for a fid when the decode plan is built
+//
+// This makes the same decisions that DecodeFieldEntryUnplanned makes for each field, but once per fid rather than
+// once per field per message. Where the mama type is the default one for the rwf type the handler adds the value
+// straight to the message, otherwise it goes through the AddRsslXXXToMsg functions as before
+UPAFieldDecodeHandler UPAFieldDecoder::SelectHandler(const RsslDictionaryEntry* dictionaryEntry, const MamaField_t& mamaField)
+{
+    const int mamaType = mamaField.mama_field_type;
+
+    switch (dictionaryEntry->rwfType)
+    {
+    case RSSL_DT_UINT:
+        return (mamaType == AS_MAMA_FIELD_TYPE_U64) ? &UPAFieldDecoder::DecodeUIntAsU64 : &UPAFieldDecoder::DecodeUInt;
+
+    case RSSL_DT_INT:
+        return (mamaType == AS_MAMA_FIELD_TYPE_I64) ? &UPAFieldDecoder::DecodeIntAsI64 : &UPAFieldDecoder::DecodeInt;
+
+    case RSSL_DT_FLOAT:
+        return (mamaType == AS_MAMA_FIELD_TYPE_F32) ? &UPAFieldDecoder::DecodeFloatAsF32 : &UPAFieldDecoder::DecodeFloat;
+
+    case RSSL_DT_DOUBLE:
+        return (mamaType == AS_MAMA_FIELD_TYPE_F64) ? &UPAFieldDecoder::DecodeDoubleAsF64 : &UPAFieldDecoder::DecodeDouble;
+
+    case RSSL_DT_REAL:
+        // as with the unplanned decode, the marketfeed type decides whether this is a price, an integer or something else
+        if (dictionaryEntry->fieldType == RSSL_MFEED_INTEGER)
+        {
+            return (mamaType == AS_MAMA_FIELD_TYPE_I64) ? &UPAFieldDecoder::DecodeRealIntegerAsI64 : &UPAFieldDecoder::DecodeRealInteger;
+        }
+        else if (dictionaryEntry->fieldType == RSSL_MFEED_PRICE)
+        {
+            if (mamaType == AS_MAMA_FIELD_TYPE_PRICE)
+            {
+                return &UPAFieldDecoder::DecodeRealPriceAsPrice;
+            }
+            return (mamaType == AS_MAMA_FIELD_TYPE_F64) ? &UPAFieldDecoder::DecodeRealPriceAsF64 : &UPAFieldDecoder::DecodeRealPrice;
+        }
+        return &UPAFieldDecoder::DecodeRealString;
+
+    case RSSL_DT_ENUM:
+        if (mamaType == AS_MAMA_FIELD_TYPE_STRING || mamaType == RSSL_DT_ENUM_AS_MAMA_FIELD_TYPE_STRING)
+        {
+            return &UPAFieldDecoder::DecodeEnumAsString;
+        }
+        return &UPAFieldDecoder::DecodeEnum;
+
+    case RSSL_DT_DATE:
+        return &UPAFieldDecoder::DecodeDate;
+
+    case RSSL_DT_TIME:
+        return &UPAFieldDecoder::DecodeTime;
+
+    case RSSL_DT_DATETIME:
+        return &UPAFieldDecoder::DecodeDateTime;
+
+        // Qos and state are not added to the message and we currently don't support array
+    case RSSL_DT_QOS:
+    case RSSL_DT_STATE:
+    case RSSL_DT_ARRAY:
+        return &UPAFieldDecoder::DecodeSkip;
+
+        // all other types treat as string
+    case RSSL_DT_BUFFER:
+    case RSSL_DT_ASCII_STRING:
+    case RSSL_DT_UTF8_STRING:
+    case RSSL_DT_RMTES_STRING:
+        return &UPAFieldDecoder::DecodeBuffer;
+
+    default:
+        return &UPAFieldDecoder::DecodeUnsupported;
+    }
+}
+
+// decode plan handlers
+//
+// Missing (blank) data is handled the same way as in DecodeFieldEntryUnplanned. The ...AsXXX handlers add the value
+// directly with the mama type named, so they skip the virtual AddRsslXXXToMsg functions
+
+RsslRet UPAFieldDecoder::DecodeUInt(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslUInt64 UIntVal = 0;
+    RsslRet ret = rsslDecodeUInt(dIter, &UIntVal);
+    if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeUInt() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    if (ret == RSSL_RET_BLANK_DATA)
+    {
+        // set to 0 for missing data
+        UIntVal = 0;
+    }
+
+    AddRsslUintToMsg(msg, step.mamaField, UIntVal, step.fid);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeUIntAsU64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslUInt64 UIntVal = 0;
+    RsslRet ret = rsslDecodeUInt(dIter, &UIntVal);
+    if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeUInt() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    if (ret == RSSL_RET_BLANK_DATA)
+    {
+        // set to 0 for missing data
+        UIntVal = 0;
+    }
+
+    mamaMsg_addU64(msg, step.mamaName, step.mamaField.mama_fid, UIntVal);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeInt(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslInt64 intVal = 0;
+    RsslRet ret = rsslDecodeInt(dIter, &intVal);
+    if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeInt() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    if (ret == RSSL_RET_BLANK_DATA)
+    {
+        // set to 0 for missing data
+        intVal = 0;
+    }
+
+    AddRsslIntToMsg(msg, step.mamaField, intVal, step.fid);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeIntAsI64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslInt64 intVal = 0;
+    RsslRet ret = rsslDecodeInt(dIter, &intVal);
+    if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeInt() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    if (ret == RSSL_RET_BLANK_DATA)
+    {
+        // set to 0 for missing data
+        intVal = 0;
+    }
+
+    mamaMsg_addI64(msg, step.mamaName, step.mamaField.mama_fid, intVal);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeFloat(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslFloat floatVal = 0;
+    RsslRet ret = rsslDecodeFloat(dIter, &floatVal);
+    if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeFloat() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    if (ret == RSSL_RET_BLANK_DATA)
+    {
+        // set to 0 for missing data
+        floatVal = 0;
+    }
+
+    AddRsslFloatToMsg(msg, step.mamaField, floatVal, step.fid);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeFloatAsF32(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslFloat floatVal = 0;
+    RsslRet ret = rsslDecodeFloat(dIter, &floatVal);
+    if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeFloat() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    if (ret == RSSL_RET_BLANK_DATA)
+    {
+        // set to 0 for missing data
+        floatVal = 0;
+    }
+
+    mamaMsg_addF32(msg, step.mamaName, step.mamaField.mama_fid, floatVal);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeDouble(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslDouble doubleVal = 0;
+    RsslRet ret = rsslDecodeDouble(dIter, &doubleVal);
+    if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeDouble() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    if (ret == RSSL_RET_BLANK_DATA)
+    {
+        // set to 0 for missing data
+        doubleVal = 0;
+    }
+
+    AddRsslDoubleToMsg(msg, step.mamaField, doubleVal, RSSL_RH_EXPONENT0, step.fid);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeDoubleAsF64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslDouble doubleVal = 0;
+    RsslRet ret = rsslDecodeDouble(dIter, &doubleVal);
+    if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeDouble() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    if (ret == RSSL_RET_BLANK_DATA)
+    {
+        // set to 0 for missing data
+        doubleVal = 0;
+    }
+
+    mamaMsg_addF64(msg, step.mamaName, step.mamaField.mama_fid, doubleVal);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeRealInteger(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslReal realVal = RSSL_INIT_REAL;
+    RsslRet ret = rsslDecodeReal(dIter, &realVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        RsslDouble dblVal;
+        rsslRealToDouble(&dblVal, &realVal);
+        AddRsslIntToMsg(msg, step.mamaField, RsslInt64(dblVal), step.fid);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeReal() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+    else
+    {
+        // missing value set to 0
+        AddRsslIntToMsg(msg, step.mamaField, 0, step.fid);
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeRealIntegerAsI64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslReal realVal = RSSL_INIT_REAL;
+    RsslInt64 intVal = 0;
+    RsslRet ret = rsslDecodeReal(dIter, &realVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        RsslDouble dblVal;
+        rsslRealToDouble(&dblVal, &realVal);
+        intVal = RsslInt64(dblVal);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeReal() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    mamaMsg_addI64(msg, step.mamaName, step.mamaField.mama_fid, intVal);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeRealPrice(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslReal realVal = RSSL_INIT_REAL;
+    RsslRet ret = rsslDecodeReal(dIter, &realVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        RsslDouble dblVal;
+        rsslRealToDouble(&dblVal, &realVal);
+        AddRsslDoubleToMsg(msg, step.mamaField, dblVal, realVal.hint, step.fid);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeReal() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+    else
+    {
+        // missing value set to 0 price
+        AddRsslDoubleToMsg(msg, step.mamaField, 0.0, RSSL_RH_EXPONENT0, step.fid);
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeRealPriceAsPrice(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslReal realVal = RSSL_INIT_REAL;
+    RsslDouble dblVal = 0.0;
+    RsslUInt8 hint = RSSL_RH_EXPONENT0;
+    RsslRet ret = rsslDecodeReal(dIter, &realVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        rsslRealToDouble(&dblVal, &realVal);
+        hint = realVal.hint;
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeReal() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    // the price is copied into the message so we can reuse the one we hold
+    mamaPrice_clear(price_);
+    mamaPrice_setValue(price_, dblVal);
+    mamaPrice_setPrecision(price_, RsslHintToMamaPrecisionTo((RsslRealHints) hint, step.mamaField.mama_fid));
+    mamaMsg_addPrice(msg, step.mamaName, step.mamaField.mama_fid, price_);
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeRealPriceAsF64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslReal realVal = RSSL_INIT_REAL;
+    RsslDouble dblVal = 0.0;
+    RsslRet ret = rsslDecodeReal(dIter, &realVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        rsslRealToDouble(&dblVal, &realVal);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeReal() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+
+    mamaMsg_addF64(msg, step.mamaName, step.mamaField.mama_fid, dblVal);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeRealString(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslReal realVal = RSSL_INIT_REAL;
+    RsslRet ret = rsslDecodeReal(dIter, &realVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        // render as a string
+        char realStr[35];
+        RsslBuffer realBuff;
+        realBuff.data = realStr;
+        realBuff.length = sizeof(realStr);
+        rsslRealToString(&realBuff, &realVal);
+        AddRsslStringToMsg(msg, step.mamaField, realBuff.data, step.fid);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeReal() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+    else
+    {
+        // missing value set as empty string
+        AddRsslStringToMsg(msg, step.mamaField, "", step.fid);
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeEnum(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslEnum enumVal;
+    RsslRet ret = rsslDecodeEnum(dIter, &enumVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        // look up the enum type for this fid and field value
+        RsslEnumType *pEnumType = getFieldEntryEnumType(dictionary_->entriesArray[step.fid], enumVal);
+        if (pEnumType != 0)
+        {
+            std::string strEnumVal(pEnumType->display.data, pEnumType->display.length);
+            AddRsslStringToMsg(msg, step.mamaField, strEnumVal.c_str(), step.fid);
+        }
+        else
+        {
+            // enum lookup failed, just put the number value into the message
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%d", enumVal);
+            AddRsslStringToMsg(msg, step.mamaField, buf, step.fid);
+        }
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeEnum() failed with return code: %d\n", ret);
+        return ret;
+    }
+    else
+    {
+        // missing data just set to 0
+        AddRsslStringToMsg(msg, step.mamaField, "0", step.fid);
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeEnumAsString(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslEnum enumVal;
+    RsslRet ret = rsslDecodeEnum(dIter, &enumVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        RsslEnumType *pEnumType = getFieldEntryEnumType(dictionary_->entriesArray[step.fid], enumVal);
+        if (pEnumType != 0)
+        {
+            AddRsslBufferAsString(msg, step, pEnumType->display.data, pEnumType->display.length);
+        }
+        else
+        {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%d", enumVal);
+            mamaMsg_addString(msg, step.mamaName, step.mamaField.mama_fid, buf);
+        }
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeEnum() failed with return code: %d\n", ret);
+        return ret;
+    }
+    else
+    {
+        mamaMsg_addString(msg, step.mamaName, step.mamaField.mama_fid, "0");
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeDate(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslDateTime dateTimeVal = RSSL_INIT_DATETIME;
+    RsslRet ret = rsslDecodeDate(dIter, &dateTimeVal.date);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        AddRsslDateToMsg(msg, step.mamaField, dateTimeVal, step.fid);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeDate() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+    else
+    {
+        // missing date, set blank
+        rsslClearDateTime(&dateTimeVal);
+        AddRsslDateToMsg(msg, step.mamaField, dateTimeVal, step.fid, true);
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeTime(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslDateTime dateTimeVal = RSSL_INIT_DATETIME;
+    RsslRet ret = rsslDecodeTime(dIter, &dateTimeVal.time);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        AddRsslTimeToMsg(msg, step.mamaField, dateTimeVal, step.fid);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeTime() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+    else
+    {
+        // missing time, set to midnight
+        rsslClearDateTime(&dateTimeVal);
+        AddRsslTimeToMsg(msg, step.mamaField, dateTimeVal, step.fid, true);
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeDateTime(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslDateTime dateTimeVal;
+    RsslRet ret = rsslDecodeDateTime(dIter, &dateTimeVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        AddRsslDateTimeToMsg(msg, step.mamaField, dateTimeVal, step.fid);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeDateTime() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+    else
+    {
+        // missing datetime , set to Jan 1 1970, midnight
+        rsslClearDateTime(&dateTimeVal);
+        dateTimeVal.date.day = 1;
+        dateTimeVal.date.month = 1;
+        dateTimeVal.date.year = 1970;
+        AddRsslDateTimeToMsg(msg, step.mamaField, dateTimeVal, step.fid, true);
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeBuffer(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    RsslBuffer bufferVal;
+    RsslRet ret = rsslDecodeBuffer(dIter, &bufferVal);
+    if (ret == RSSL_RET_SUCCESS)
+    {
+        AddRsslBufferAsString(msg, step, bufferVal.data, bufferVal.length);
+    }
+    else if (ret != RSSL_RET_BLANK_DATA)
+    {
+        t42log_error("rsslDecodeBuffer() %s.%s %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), step.mamaName, ret);
+        return ret;
+    }
+    else
+    {
+        // missing value set as  empty string
+        mamaMsg_addString(msg, step.mamaName, step.mamaField.mama_fid, "");
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeSkip(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet UPAFieldDecoder::DecodeUnsupported(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg)
+{
+    t42log_warn("Unsupported data type=%d %s.%s %s\n", step.rwfType, sourceName_.c_str(), symbol_.c_str(), step.mamaName);
+    return RSSL_RET_SUCCESS;
+}
+
+// the rssl buffer isnt null terminated. Short values (which is almost all of them) are terminated in a buffer on the stack
+mama_status UPAFieldDecoder::AddRsslBufferAsString(mamaMsg msg, const UPAFieldDecodeStep& step, const char* data, RsslUInt32 length)
+{
+    char shortBuf[256];
+    if (length < sizeof(shortBuf))
+    {
+        memcpy(shortBuf, data, length);
+        shortBuf[length] = '\0';
+        return mamaMsg_addString(msg, step.mamaName, step.mamaField.mama_fid, shortBuf);
+    }
+
+    string strVal(data, length);
+    return mamaMsg_addString(msg, step.mamaName, step.mamaField.mama_fid, strVal.c_str());
+}
+
 // decode a book field
 //
 // for this we are concerned with specific fields rather than a generic type based conversion
@@ -29,6 +29,7 @@
 #include "UPABookMessage.h"
 #include "UPASubscription.h"
 #include "RMDSSubscriber.h"
+#include "UPAFieldDecodePlan.h"
 
 // decodes a field from a rssl message and inserts it into a mama message
 
@@ -36,9 +37,12 @@ class UPAFieldDecoder
 {
 public:
     UPAFieldDecoder(const UPAConsumer_ptr_t& consumer, const UpaMamaFieldMap_ptr_t& fieldmap, const std::string& SourceName, const std::string& Symbol) :
-        consumer_(consumer), fieldmap_(fieldmap), sourceName_(SourceName), symbol_(Symbol)
+        consumer_(consumer), fieldmap_(fieldmap), sourceName_(SourceName), symbol_(Symbol), price_(0)
     {
         dictionary_ = consumer_->RsslDictionary()->RsslDictionary();
+        owner_ = consumer_->GetOwner();
+        RefreshPlan();
+        mamaPrice_create(&price_);
 
         const std::string& transportName = consumer->GetOwner()->GetTransportName();
         TransportConfig_ptr_t enhancedConfig(new TransportConfig_t(transportName));
@@ -49,11 +53,43 @@ public:
         returnAnsiAsOpaque_ = (ansiAsOpaque == "true");
     }
 
-    virtual ~UPAFieldDecoder() { }
+    virtual ~UPAFieldDecoder()
+    {
+        if (price_ != 0)
+        {
+            mamaPrice_destroy(price_);
+        }
+    }
+
+    RsslRet DecodeFieldEntry(RsslFieldEntry* fEntry, RsslDecodeIterator* dIter, mamaMsg msg)
+    {
+        // pick up a new plan if the dictionary has been reloaded
+        if (owner_->DecodePlanGeneration() != planGeneration_)
+        {
+            RefreshPlan();
+        }
+
+        if (plan_)
+        {
+            const UPAFieldDecodeStep* step = plan_->Find(fEntry->fieldId);
+            if (step == 0)
+            {
+                // not in the dictionary or not passed through the field map
+                return RSSL_RET_SUCCESS;
+            }
+
+            return (this->*(step->handler))(*step, dIter, msg);
+        }
+
+        return DecodeFieldEntryUnplanned(fEntry, dIter, msg);
+    }
 
-    RsslRet DecodeFieldEntry(RsslFieldEntry* fEntry, RsslDecodeIterator* dIter, mamaMsg msg);
     RsslRet DecodeBookFieldEntry(RsslFieldEntry* fEntry, RsslDecodeIterator* dIter, const UPABookEntry_ptr_t& entry);
 
+    // pick the decode plan handler for a field. The common rwf type / mama type pairs get a handler that adds straight
+    // to the message, the rest go through the Add functions below
+    static UPAFieldDecodeHandler SelectHandler(const RsslDictionaryEntry* dictionaryEntry, const MamaField_t& mamaField);
+
 protected:
     // set of functions to add rssl fields to mama messages using the mama type from the field map
     //
@@ -69,6 +105,53 @@ protected:
     virtual mama_status AddRsslStringToMsg(mamaMsg msg, const MamaField_t& mamaField, const char* strVal, RsslFieldId fid);
 
 private:
+    // take the current decode plan from the subscriber. Only use it if it was built from the field map we are using
+    void RefreshPlan()
+    {
+        plan_ = owner_->DecodePlan();
+        planGeneration_ = plan_ ? plan_->Generation() : 0;
+        if (plan_ && fieldmap_ != owner_->FieldMap())
+        {
+            plan_.reset();
+        }
+    }
+
+    // decode without a plan, looking up the dictionary and field map for each field
+    RsslRet DecodeFieldEntryUnplanned(RsslFieldEntry* fEntry, RsslDecodeIterator* dIter, mamaMsg msg);
+
+    // decode plan handlers
+    RsslRet DecodeUInt(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeUIntAsU64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeInt(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeIntAsI64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeFloat(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeFloatAsF32(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeDouble(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeDoubleAsF64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeRealInteger(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeRealIntegerAsI64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeRealPrice(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeRealPriceAsPrice(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeRealPriceAsF64(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeRealString(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeEnum(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeEnumAsString(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeDate(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeTime(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeDateTime(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeBuffer(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeSkip(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+    RsslRet DecodeUnsupported(const UPAFieldDecodeStep& step, RsslDecodeIterator* dIter, mamaMsg msg);
+
+    // add a decoded string without taking a copy of it on the heap
+    mama_status AddRsslBufferAsString(mamaMsg msg, const UPAFieldDecodeStep& step, const char* data, RsslUInt32 length);
+
+    const RMDSSubscriber* owner_;
+    UPAFieldDecodePlan_ptr_t plan_;
+    RsslUInt32 planGeneration_;
+
+    // reused for each price field
+    mamaPrice price_;
 
     // for lookup
     RsslDataDictionary* dictionary_;
@@ -26,11 +26,68 @@
 #include <utils/t42log.h>
 #include "UPAFieldEncoder.h"
 #include "utils/namespacedefines.h"
+#include "../tick42rmdsmsg/upapayload.h"
 
 using namespace std;
 
+extern "C"
+{
+    mama_status
+        mamaMsgImpl_getPayload (const mamaMsg msg, msgPayload* payload);
+};
+
 utils::collection::unordered_set<int> UPAFieldEncoder::suppressBadEnumWarnings_;
 
+namespace
+{
+    // the encoder reads fields through one of these. Either through the mama field api, or for messages that have
+    // our own payload, straight out of the payload's field storage
+
+    class MamaFieldReader
+    {
+    public:
+        explicit MamaFieldReader(mamaMsgField field) : field_(field) {}
+
+        mama_fid_t Fid() const { mama_fid_t fid = 0; mamaMsgField_getFid(field_, &fid); return fid; }
+        const char* Name() const { const char* name = ""; mamaMsgField_getName(field_, &name); return name; }
+        mamaFieldType Type() const { mamaFieldType type = MAMA_FIELD_TYPE_UNKNOWN; mamaMsgField_getType(field_, &type); return type; }
+
+        mama_status getI64(mama_i64_t* value) const { return mamaMsgField_getI64(field_, value); }
+        mama_status getU64(mama_u64_t* value) const { return mamaMsgField_getU64(field_, value); }
+        mama_status getU16(mama_u16_t* value) const { return mamaMsgField_getU16(field_, value); }
+        mama_status getF32(mama_f32_t* value) const { return mamaMsgField_getF32(field_, value); }
+        mama_status getF64(mama_f64_t* value) const { return mamaMsgField_getF64(field_, value); }
+        mama_status getString(const char** value) const { return mamaMsgField_getString(field_, value); }
+        mama_status getPrice(mamaPrice value) const { return mamaMsgField_getPrice(field_, value); }
+        mama_status getDateTime(mamaDateTime value) const { return mamaMsgField_getDateTime(field_, value); }
+
+    private:
+        mamaMsgField field_;
+    };
+
+    class UpaFieldReader
+    {
+    public:
+        explicit UpaFieldReader(const UpaFieldPayload& field) : field_(field) {}
+
+        mama_fid_t Fid() const { return field_.fid_; }
+        const char* Name() const { return (field_.name_ != 0) ? field_.name_ : ""; }
+        mamaFieldType Type() const { return field_.type_; }
+
+        mama_status getI64(mama_i64_t* value) const { return field_.get(*value); }
+        mama_status getU64(mama_u64_t* value) const { return field_.get(*value); }
+        mama_status getU16(mama_u16_t* value) const { return field_.get(*value); }
+        mama_status getF32(mama_f32_t* value) const { return field_.get(*value); }
+        mama_status getF64(mama_f64_t* value) const { return field_.get(*value); }
+        mama_status getString(const char** value) const { return field_.get(*value); }
+        mama_status getPrice(mamaPrice value) const { return field_.getPrice(value); }
+        mama_status getDateTime(mamaDateTime value) const { return field_.getDateTime(value); }
+
+    private:
+        const UpaFieldPayload& field_;
+    };
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 UPAFieldEncoder::UPAFieldEncoder(mamaDictionary dictionary, const UpaMamaFieldMap_ptr_t& upaFieldMap,
@@ -47,51 +104,68 @@ UPAFieldEncoder::UPAFieldEncoder(mamaDictionary dictionary, const UpaMamaFieldMa
 //
 bool UPAFieldEncoder::encode(mamaMsg msg, RsslChannel *chnl, RsslMsg *rsslMsg, RsslBuffer *buffer)
 {
-    encodeFail_ = false;
-    rsslMessageBuffer_ = buffer;
+    EncodeState state;
+    state.encoder_ = this;
+    state.encodeFail_ = false;
 
-    rsslClearEncodeIterator(&itEncode_);
+    RsslEncodeIterator &itEncode = state.itEncode_;
+    rsslClearEncodeIterator(&itEncode);
     RsslRet ret;
-    if ((ret = rsslSetEncodeIteratorBuffer(&itEncode_, rsslMessageBuffer_)) < RSSL_RET_SUCCESS)
+    if ((ret = rsslSetEncodeIteratorBuffer(&itEncode, buffer)) < RSSL_RET_SUCCESS)
     {
         t42log_warn("rsslEncodeIteratorBuffer()  for %s : %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), ret);
         return false;
     }
-    rsslSetEncodeIteratorRWFVersion(&itEncode_, chnl->majorVersion, chnl->minorVersion);
+    rsslSetEncodeIteratorRWFVersion(&itEncode, chnl->majorVersion, chnl->minorVersion);
 
     // encode the message header
-    if ((ret = rsslEncodeMsgInit(&itEncode_, rsslMsg, 0)) < RSSL_RET_SUCCESS)
+    if ((ret = rsslEncodeMsgInit(&itEncode, rsslMsg, 0)) < RSSL_RET_SUCCESS)
     {
         t42log_warn("rsslEncodeMsgInit() for %s : %s  failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), ret);
         return false;
     }
 
-    rsslClearFieldList(&fList_);
-    fList_.flags = RSSL_FLF_HAS_STANDARD_DATA;
-    if ((ret = rsslEncodeFieldListInit(&itEncode_, &fList_, 0, 0)) < RSSL_RET_SUCCESS)
+    rsslClearFieldList(&state.fList_);
+    state.fList_.flags = RSSL_FLF_HAS_STANDARD_DATA;
+    if ((ret = rsslEncodeFieldListInit(&itEncode, &state.fList_, 0, 0)) < RSSL_RET_SUCCESS)
     {
         t42log_warn("rsslEncodeFieldListInit() failed for %s : %s with return code: %d\n", sourceName_.c_str(), symbol_.c_str(), ret);
         return false;
     }
 
-    mamaMsg_iterateFields(msg, mamaMsgIteratorCb, dictionary_, this);
+    mamaPayloadType payloadType;
+    msgPayload payload = 0;
+    if (mamaMsg_getPayloadType(msg, &payloadType) == MAMA_STATUS_OK && payloadType == MAMA_PAYLOAD_TICK42RMDS
+        && mamaMsgImpl_getPayload(msg, &payload) == MAMA_STATUS_OK && payload != 0)
+    {
+        // walk our own payload's fields directly, rather than have the mama iterator look each one up in the dictionary
+        const UpaPayload* upaPayload = reinterpret_cast<const UpaPayload*>(payload);
+        for (UpaPayload::FieldIterator_t it = upaPayload->fieldsBegin(); it != upaPayload->fieldsEnd(); ++it)
+        {
+            encodeField(state, UpaFieldReader(*it));
+        }
+    }
+    else
+    {
+        mamaMsg_iterateFields(msg, mamaMsgIteratorCb, dictionary_, &state);
+    }
 
     // complete encode field list
-    if ((ret = rsslEncodeFieldListComplete(&itEncode_, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    if ((ret = rsslEncodeFieldListComplete(&itEncode, RSSL_TRUE)) < RSSL_RET_SUCCESS)
     {
         t42log_warn("rsslEncodeFieldListComplete()  %s : %s  failed with return code: %d\n",  sourceName_.c_str(), symbol_.c_str(), ret);
         return false;
     }
 
     /* complete encode message */
-    if ((ret = rsslEncodeMsgComplete(&itEncode_, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    if ((ret = rsslEncodeMsgComplete(&itEncode, RSSL_TRUE)) < RSSL_RET_SUCCESS)
     {
         t42log_warn("rsslEncodeMsgComplete()  %s : %s failed with return code: %d\n", sourceName_.c_str(), symbol_.c_str(),  ret);
         return false;
     }
-    rsslMessageBuffer_->length = rsslGetEncodedBufferLength(&itEncode_);
+    buffer->length = rsslGetEncodedBufferLength(&itEncode);
 
-    return !encodeFail_;
+    return !state.encodeFail_;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -99,37 +173,59 @@ bool UPAFieldEncoder::encode(mamaMsg msg, RsslChannel *chnl, RsslMsg *rsslMsg, R
 void MAMACALLTYPE UPAFieldEncoder::mamaMsgIteratorCb(const mamaMsg msg,
     const mamaMsgField field, void *closure)
 {
-    ((UPAFieldEncoder*)closure)->encodeField(field);
+    EncodeState *state = (EncodeState*)closure;
+    state->encoder_->encodeField(*state, MamaFieldReader(field));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+UPAFieldEncoder::FieldPlan UPAFieldEncoder::Plan(mama_fid_t fid)
+{
+    utils::thread::T42Lock lock(&planLock_);
+    FieldPlanMap_t::const_iterator it = plans_.find(fid);
+    if (it != plans_.end())
+    {
+        return it->second;
+    }
+
+    // first time we've seen this fid, so map it and look it up in the dictionary
+    FieldPlan plan;
+    plan.rmdsFid_ = upaFieldMap_->GetRMDSFidFromMAMAFid(fid);
+    plan.dictEntry_ = (plan.rmdsFid_ != 0) ? rmdsDictionary_->entriesArray[plan.rmdsFid_] : 0;
+
+    if (plan.rmdsFid_ != 0 && plan.dictEntry_ == 0)
+    {
+        t42log_warn("No RMDS dictionary entry for published fid %d (mama fid = %d)\n", plan.rmdsFid_, fid);
+    }
+
+    return plans_.insert(FieldPlanMap_t::value_type(fid, plan)).first->second;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
-void UPAFieldEncoder::encodeField(const mamaMsgField &field)
+template <typename FieldReader>
+void UPAFieldEncoder::encodeField(EncodeState &state, const FieldReader &field)
 {
-    uint16_t fid;
-    const char* fname;
-    mamaFieldType fldType;
     mama_status status;
 
     // get the fid and its type and value (cf mamalistenc displayField line 1470 or thereabouts)
-    mamaMsgField_getFid(field, &fid);
-    mamaMsgField_getName(field, &fname);
-    mamaMsgField_getType(field, &fldType);
+    uint16_t fid = field.Fid();
+    const char* fname = field.Name();
+    mamaFieldType fldType = field.Type();
 
-    // now need to map the fid then insert the typed data into the rssl message
-    RsslInt32 rmdsFid = upaFieldMap_->GetRMDSFidFromMAMAFid(fid);
+    // now need to map the fid then insert the typed data into the rssl message. The mapping and the dictionary entry
+    // are looked up the first time the fid is published
+    const FieldPlan fieldPlan = Plan(fid);
+    RsslInt32 rmdsFid = fieldPlan.rmdsFid_;
 
     if (rmdsFid != 0)
     {
-        t42log_info("RMDS fid %d from mama fid %d", rmdsFid, fid);
         //we can do something with it
-        RsslDictionaryEntry * dictEntry = rmdsDictionary_->entriesArray[rmdsFid];
+        RsslDictionaryEntry * dictEntry = fieldPlan.dictEntry_;
 
         if (dictEntry == 0)
         {
-            // todo add something that puts the fids in a bag and uses that to check we only log the message once
-            t42log_warn("No RMDS dictionary entry for published fid %d (mama fid = %d)\n", rmdsFid, fid);
-            // just bail out
+            // no dictionary entry, which was logged when the plan was made
             return;
         }
         RsslFieldEntry fieldEntry = RSSL_INIT_FIELD_ENTRY;
@@ -144,25 +240,25 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
         case RSSL_DT_INT:
             //            RsslInt64 intVal;
             mama_i64_t intVal;  // gcc seems happier with this
-            status = mamaMsgField_getI64(field, &intVal);
+            status = field.getI64(&intVal);
             if (status != MAMA_STATUS_OK)
             {
                 t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getI64\n",
                     mamaStatus_stringForStatus(status), status,
                     sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                     rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                encodeFail_ = true;
+                state.encodeFail_ = true;
             }
             else
             {
                 // and encode into the message
-                if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&intVal)) < RSSL_RET_SUCCESS)
+                if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&intVal)) < RSSL_RET_SUCCESS)
                 {
                     t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                         rsslRetCodeToString(ret), ret,
                         sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                         rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                    encodeFail_ = true;
+                    state.encodeFail_ = true;
                 }
             }
             break;
@@ -171,75 +267,75 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
             // RsslUInt64 uintVal;
             mama_u64_t uintVal; // gcc seems happier with this
-            status = mamaMsgField_getU64(field, &uintVal);
+            status = field.getU64(&uintVal);
             if (status != MAMA_STATUS_OK)
             {
                 t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getU64\n",
                     mamaStatus_stringForStatus(status), status,
                     sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                     rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                encodeFail_ = true;
+                state.encodeFail_ = true;
             }
             else
             {
                 // and encode into the message
-                if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&uintVal)) < RSSL_RET_SUCCESS)
+                if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&uintVal)) < RSSL_RET_SUCCESS)
                 {
                     t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                         rsslRetCodeToString(ret), ret,
                         sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                         rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                    encodeFail_ = true;
+                    state.encodeFail_ = true;
                 }
             }
             break;
 
         case RSSL_DT_FLOAT:
             RsslFloat fltVal;
-            status = mamaMsgField_getF32(field, &fltVal);
+            status = field.getF32(&fltVal);
             if (status != MAMA_STATUS_OK)
             {
                 t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getF32\n",
                     mamaStatus_stringForStatus(status), status,
                     sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                     rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                encodeFail_ = true;
+                state.encodeFail_ = true;
             }
             else
             {
                 // and encode into the message
-                if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&fltVal)) < RSSL_RET_SUCCESS)
+                if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&fltVal)) < RSSL_RET_SUCCESS)
                 {
                     t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                         rsslRetCodeToString(ret), ret,
                         sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                         rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                    encodeFail_ = true;
+                    state.encodeFail_ = true;
                 }
             }
             break;
 
         case RSSL_DT_DOUBLE:
             RsslDouble dblVal;
-            status = mamaMsgField_getF64(field, &dblVal);
+            status = field.getF64(&dblVal);
             if (status != MAMA_STATUS_OK)
             {
                 t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getF64\n",
                     mamaStatus_stringForStatus(status), status,
                     sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                     rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                encodeFail_ = true;
+                state.encodeFail_ = true;
             }
             else
             {
                 // and encode into the message
-                if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&dblVal)) < RSSL_RET_SUCCESS)
+                if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&dblVal)) < RSSL_RET_SUCCESS)
                 {
                     t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                         rsslRetCodeToString(ret), ret,
                         sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                         rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                    encodeFail_ = true;
+                    state.encodeFail_ = true;
                 }
             }
             break;
@@ -255,14 +351,14 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                 {
                     mamaPrice p;
                     mamaPrice_create(&p);
-                    status = mamaMsgField_getPrice(field, p);
+                    status = field.getPrice(p);
                     if (status != MAMA_STATUS_OK)
                     {
                         t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getPrice\n",
                             mamaStatus_stringForStatus(status), status,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                     else
                     {
@@ -290,13 +386,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                         RsslRet ret;
                         // and encode into the message
-                        if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&r)) < RSSL_RET_SUCCESS)
+                        if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&r)) < RSSL_RET_SUCCESS)
                         {
                             t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                                 rsslRetCodeToString(ret), ret,
                                 sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                                 rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                            encodeFail_ = true;
+                            state.encodeFail_ = true;
                         }
                     }
 
@@ -317,14 +413,14 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                     //    RsslInt64 intVal;
                     mama_i64_t intVal;  // gcc seems happier with this
-                    status = mamaMsgField_getI64(field, &intVal);
+                    status = field.getI64(&intVal);
                     if (status != MAMA_STATUS_OK)
                     {
                         t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getF64\n",
                             mamaStatus_stringForStatus(status), status,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                     else
                     {
@@ -335,13 +431,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                         RsslRet ret;
                         // and encode into the message
-                        if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&r)) < RSSL_RET_SUCCESS)
+                        if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&r)) < RSSL_RET_SUCCESS)
                         {
                             t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                                 rsslRetCodeToString(ret), ret,
                                 sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                                 rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                            encodeFail_ = true;
+                            state.encodeFail_ = true;
                         }
                     }
                 }
@@ -351,14 +447,14 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                 {
                     // It's a double
                     mama_f64_t dblVal;
-                    status = mamaMsgField_getF64(field, &dblVal);
+                    status = field.getF64(&dblVal);
                     if (status != MAMA_STATUS_OK)
                     {
                         t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getF64\n",
                             mamaStatus_stringForStatus(status), status,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                     else
                     {
@@ -373,13 +469,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                         RsslRet ret;
                         // and encode into the message
-                        if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&r)) < RSSL_RET_SUCCESS)
+                        if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&r)) < RSSL_RET_SUCCESS)
                         {
                             t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                                 rsslRetCodeToString(ret), ret,
                                 sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                                 rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                            encodeFail_ = true;
+                            state.encodeFail_ = true;
                         }
                     }
                 }
@@ -388,14 +484,14 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
             case MAMA_FIELD_TYPE_F32:
                 {
                     mama_f32_t floatVal;
-                    status = mamaMsgField_getF32(field, &floatVal);
+                    status = field.getF32(&floatVal);
                     if (status != MAMA_STATUS_OK)
                     {
                         t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getF32\n",
                             mamaStatus_stringForStatus(status), status,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                     else
                     {
@@ -410,13 +506,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                         RsslRet ret;
                         // and encode into the message
-                        if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&r)) < RSSL_RET_SUCCESS)
+                        if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&r)) < RSSL_RET_SUCCESS)
                         {
                             t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                                 rsslRetCodeToString(ret), ret,
                                 sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                                 rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                            encodeFail_ = true;
+                            state.encodeFail_ = true;
                         }
                     }
                 }
@@ -426,7 +522,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                 t42log_warn("Conversion error: %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed converting to RSSL_REAL\n",
                     sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                     rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                encodeFail_ = true;
+                state.encodeFail_ = true;
                 break;
 
             }
@@ -437,7 +533,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                 mama_status status;
                 mamaDateTime d;
                 mamaDateTime_create(&d);
-                status = mamaMsgField_getDateTime(field, d);
+                status = field.getDateTime(d);
                 if (status == MAMA_STATUS_OK )
                 {
                     // build an rssl date from the mama datetime
@@ -460,13 +556,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                     RsslRet ret;
                     // and encode into the message
-                    if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&dt)) < RSSL_RET_SUCCESS)
+                    if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&dt)) < RSSL_RET_SUCCESS)
                     {
                         t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                             rsslRetCodeToString(ret), ret,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                 }
                 else
@@ -475,7 +571,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                         mamaStatus_stringForStatus(status), status,
                         sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                         rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                    encodeFail_ = true;
+                    state.encodeFail_ = true;
                 }
 
                 mamaDateTime_destroy(d);
@@ -486,7 +582,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
             {
                 mamaDateTime d;
                 mamaDateTime_create(&d);
-                status = mamaMsgField_getDateTime(field, d);
+                status = field.getDateTime(d);
                 if (status == MAMA_STATUS_OK )
                 {
                     // build an rssl date from the mama datetime
@@ -521,13 +617,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                     RsslRet ret;
                     // and encode into the message
-                    if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&t)) < RSSL_RET_SUCCESS)
+                    if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&t)) < RSSL_RET_SUCCESS)
                     {
                         t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                             rsslRetCodeToString(ret), ret,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                 }
                 else
@@ -536,7 +632,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                         mamaStatus_stringForStatus(status), status,
                         sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                         rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                    encodeFail_ = true;
+                    state.encodeFail_ = true;
                 }
 
                 mamaDateTime_destroy(d);
@@ -547,7 +643,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
             {
                 mamaDateTime d;
                 mamaDateTime_create(&d);
-                status = mamaMsgField_getDateTime(field, d);
+                status = field.getDateTime(d);
                 if (status == MAMA_STATUS_OK)
                 {
                     // build an rssl date from the mama datetime
@@ -586,13 +682,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                     RsslRet ret;
                     // and encode into the message
-                    if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&dt)) < RSSL_RET_SUCCESS)
+                    if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&dt)) < RSSL_RET_SUCCESS)
                     {
                         t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                             rsslRetCodeToString(ret), ret,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                 }
                 else
@@ -601,7 +697,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                         mamaStatus_stringForStatus(status), status,
                         sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                         rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                    encodeFail_ = true;
+                    state.encodeFail_ = true;
                 }
 
                 mamaDateTime_destroy(d);
@@ -623,14 +719,14 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                     // first get the string value
                     const char * stringVal;
-                    status = mamaMsgField_getString(field, &stringVal);
+                    status = field.getString(&stringVal);
                     if (status == MAMA_STATUS_OK)
                     {
 
                         size_t stringLen = strlen(stringVal);
 
                         // now we need to walk the enum table to find a match
-                        RsslEnumTypeTable * enumTable = rmdsDictionary_->entriesArray[rmdsFid]->pEnumTypeTable;
+                        RsslEnumTypeTable * enumTable = dictEntry->pEnumTypeTable;
                         RsslEnum numEntries = enumTable->maxValue + 1;
 
                         // now we need to walk the set of strings in the enum table to try find a match
@@ -672,13 +768,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                             enumVal = atoi(stringVal);
                         }
 
-                        if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&enumVal)) < RSSL_RET_SUCCESS)
+                        if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&enumVal)) < RSSL_RET_SUCCESS)
                         {
                             t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                                 rsslRetCodeToString(ret), ret,
                                 sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                                 rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                            encodeFail_ = true;
+                            state.encodeFail_ = true;
                         }
 
                     }
@@ -688,7 +784,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                             mamaStatus_stringForStatus(status), status,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                 }
                 break;
@@ -704,21 +800,21 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                 // otherwise, if its an int type then encode with 0 exponent
                 {
                     RsslEnum enumVal;
-                    mama_status status = mamaMsgField_getU16(field, &enumVal);
+                    mama_status status = field.getU16(&enumVal);
                     if (status == MAMA_STATUS_OK)
                     {
                         // check the enum value is valid
-                        RsslEnumType *pEnumType = getFieldEntryEnumType( rmdsDictionary_->entriesArray[rmdsFid], enumVal);
+                        RsslEnumType *pEnumType = getFieldEntryEnumType(dictEntry, enumVal);
                         if (pEnumType != 0)
                         {
                             // and encode into the message
-                            if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&enumVal)) < RSSL_RET_SUCCESS)
+                            if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&enumVal)) < RSSL_RET_SUCCESS)
                             {
                                 t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                                     rsslRetCodeToString(ret), ret,
                                     sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                                     rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                                encodeFail_ = true;
+                                state.encodeFail_ = true;
                             }
                         }
                         else if (suppressBadEnumWarnings_.insert(fid).second) // Output message only once for each fid
@@ -732,7 +828,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                             mamaStatus_stringForStatus(status), status,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                 }
                 break;
@@ -741,7 +837,7 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
                 t42log_warn("Conversion error: %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed converting to enum\n",
                     sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                     rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                encodeFail_ = true;
+                state.encodeFail_ = true;
 
             }
 
@@ -753,14 +849,14 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
         case RSSL_DT_RMTES_STRING:
             {
                 const char * stringVal;
-                status = mamaMsgField_getString(field, &stringVal);
+                status = field.getString(&stringVal);
                 if (status != MAMA_STATUS_OK)
                 {
                     t42log_warn("Conversion error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling mamaMsgField_getString\n",
                         mamaStatus_stringForStatus(status), status,
                         sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                         rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                    encodeFail_ = true;
+                    state.encodeFail_ = true;
                 }
                 else
                 {
@@ -771,13 +867,13 @@ void UPAFieldEncoder::encodeField(const mamaMsgField &field)
 
                     RsslRet ret;
                     // and encode into the message
-                    if ((ret = rsslEncodeFieldEntry(&itEncode_, &fieldEntry, (void*)&buf)) < RSSL_RET_SUCCESS)
+                    if ((ret = rsslEncodeFieldEntry(&state.itEncode_, &fieldEntry, (void*)&buf)) < RSSL_RET_SUCCESS)
                     {
                         t42log_warn("Encoding error: %s/%d %s.%s field=%s mamaFid=%d mamaType=%s/%d rsslType=%s/%d failed calling rsslEncodeFieldEntry\n",
                             rsslRetCodeToString(ret), ret,
                             sourceName_.c_str(), symbol_.c_str(), fname, fid, mamaFieldTypeToString(fldType), fldType,
                             rsslDataTypeToString(fieldEntry.dataType), fieldEntry.dataType);
-                        encodeFail_ = true;
+                        state.encodeFail_ = true;
                     }
                 }
             }
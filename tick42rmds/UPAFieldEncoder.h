@@ -29,8 +29,14 @@
 
 #include "UPAMamaFieldMap.h"
 #include <utils/namespacedefines.h>
+#include <utils/thread/lock.h>
 
 // Encodes an entire mama message into an rssl field list
+//
+// A publisher item keeps its encoder for all the messages it publishes, so the encoder remembers how it publishes
+// each fid rather than mapping it and looking it up in the dictionary for every field of every message. Only the fid
+// plans live that long, and they are locked as the item can be published from the app thread and recapped from the
+// new item request at the same time. Everything else an encode needs is local to the call
 
 class UPAFieldEncoder
 {
@@ -40,20 +46,41 @@ public:
     bool encode(mamaMsg msg, RsslChannel *chnl, RsslMsg *rsslMsg, RsslBuffer *buffer);
 
 private:
+    // the state of one call to encode
+    struct EncodeState
+    {
+        UPAFieldEncoder *encoder_;
+        RsslEncodeIterator itEncode_;
+        RsslFieldList fList_;
+        bool encodeFail_;
+    };
+
     static void MAMACALLTYPE mamaMsgIteratorCb(const mamaMsg msg, const mamaMsgField  field, void* closure);
-    void encodeField(const mamaMsgField &field);
+
+    // the field reader gets the field's values either through the mama field api or straight from our own payload
+    template <typename FieldReader>
+    void encodeField(EncodeState &state, const FieldReader &field);
     RsslRealHints MamaPrecisionToRsslHint(mamaPricePrecision p, uint16_t fid);
 
 private:
     mamaDictionary dictionary_;
     const std::string &sourceName_;
     const std::string &symbol_;
-    RsslBuffer *rsslMessageBuffer_;
-    RsslEncodeIterator itEncode_;
-    RsslFieldList fList_;
     UpaMamaFieldMap_ptr_t upaFieldMap_;
     RsslDataDictionary * rmdsDictionary_;
-    bool encodeFail_;
+
+    // how each mama fid is published - the RMDS fid it maps to and its dictionary entry, which gives the RWF type.
+    // Worked out the first time the fid is published, a 0 rmds fid means the field isnt published
+    struct FieldPlan
+    {
+        RsslInt32 rmdsFid_;
+        RsslDictionaryEntry * dictEntry_;
+    };
+    typedef utils::collection::unordered_map<mama_fid_t, FieldPlan> FieldPlanMap_t;
+    FieldPlanMap_t plans_;
+    mutable utils::thread::lock_t planLock_;
+
+    FieldPlan Plan(mama_fid_t fid);
 
     static utils::collection::unordered_set<int> suppressBadEnumWarnings_;
 };
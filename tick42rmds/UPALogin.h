@@ -152,6 +152,12 @@ UPALogin::RsslLoginRequestInfo * LoginRequestInfo()
     return &loginRequestInfo_;
 }
 
+// what the provider said it supports in its last login response
+const UPALogin::RsslLoginResponseInfo & LoginResponseInfo() const
+{
+    return loginResponseInfo_;
+}
+
 private:
     std::string userName_;
     std::string appName_; // Identifies the application sending the Login request or    response message. When present, the application    name in the Login request identifies the OMM Consumer,
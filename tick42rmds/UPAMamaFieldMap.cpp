@@ -737,6 +737,26 @@ mama_fid_t UpaMamaFieldMapHandler_t::GetMamaFid(const std::string& mamaFieldName
     return (mama_fid_t) 0;
 }
 
+bool UpaMamaFieldMapHandler_t::GetTranslatedFids(std::vector<RsslFieldId>& fids) const
+{
+    fids.clear();
+    if (ShouldPassNonTranslated_)
+    {
+        return false;
+    }
+
+    // with non-translated fields off, the only entries in the map are the ones loaded from the field map file
+    size_t len = fieldsMap_.size();
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (fieldsMap_[i].mama_fid != 0)
+        {
+            fids.push_back((RsslFieldId)(i - offset_));
+        }
+    }
+    return true;
+}
+
 bool UpaMamaFieldMapHandler_t::AddReservedFields( mamaDictionaryWrapper dict )
 {
     // just add the reserved types ... it would be nice if there was an iterator
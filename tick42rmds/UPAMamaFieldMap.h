@@ -222,6 +222,14 @@ public:
 
     mama_fid_t GetMamaFid(const std::string& mamaFieldName);
 
+    /**
+     * @brief Lists the RMDS fids that are translated to mama fields, which are the only ones the subscriber passes on
+     * when non-translated fields are not passed.
+     * @param fids: filled with the translated fids in ascending order
+     * @return: false if non-translated fields are passed on, in which case every field is wanted
+     */
+    bool GetTranslatedFids(std::vector<RsslFieldId>& fids) const;
+
 private:
     /**
      * @brief create the whole fields map. calls later on the parser loadPredefinedUpaMamaFieldsMap
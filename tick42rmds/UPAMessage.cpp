@@ -27,11 +27,18 @@
 #include "stdafx.h"
 
 #include "UPAMessage.h"
+#include "UPAWriteBatch.h"
 #include <utils/t42log.h>
 
-extern "C"
+// rssl has data queued for the channel that it couldnt write yet. The thread that owns the channel flushes it when the
+// channel becomes writable
+static void WantWrite(RsslChannel* UPAChannel)
 {
-    extern    fd_set wrtfds; /* located in application */
+    UPAWriteBatch* batch = UPAWriteBatch::ForChannel(UPAChannel);
+    if (batch != 0)
+    {
+        batch->SetWantWrite();
+    }
 }
 
 RsslRet SendUPAMessage(RsslChannel* UPAChannel, RsslBuffer* msgBuffer)
@@ -52,11 +59,10 @@ RsslRet SendUPAMessageWithErrorText(RsslChannel* UPAChannel, RsslBuffer* msgBuff
     /* send the request */
     if ((retval = rsslWrite(UPAChannel, msgBuffer, RSSL_HIGH_PRIORITY, writeFlags, &bytesWritten, &uncompressedBytesWritten, &error)) > RSSL_RET_FAILURE)
     {
-        // set write fd if there's still data queued 
-        // flush is done by application 
+        // there's still data queued, it is flushed below or by the owning thread
         if (retval > RSSL_RET_SUCCESS)
         {
-            FD_SET(UPAChannel->socketId, &wrtfds);
+            WantWrite(UPAChannel);
         }
     }
     else
@@ -72,18 +78,16 @@ RsslRet SendUPAMessageWithErrorText(RsslChannel* UPAChannel, RsslBuffer* msgBuff
                 }
                 retval = rsslWrite(UPAChannel, msgBuffer, RSSL_HIGH_PRIORITY, writeFlags, &bytesWritten, &uncompressedBytesWritten, &error);
             }
-             //set write fd if there's still data queued 
-             //flush is done by application 
+            // there's still data queued, it is flushed below or by the owning thread
             if (retval > RSSL_RET_SUCCESS)
             {
-                FD_SET(UPAChannel->socketId, &wrtfds);
+                WantWrite(UPAChannel);
             }
         }
         else if (retval == RSSL_RET_WRITE_FLUSH_FAILED && UPAChannel->state != RSSL_CH_STATE_CLOSED)
         {
-            // set write fd if flush failed 
-            // flush is done by application 
-            FD_SET(UPAChannel->socketId, &wrtfds);
+            // the flush failed, leave it to the owning thread
+            WantWrite(UPAChannel);
         }
         else    // close the connection and return
         {
@@ -97,16 +101,22 @@ RsslRet SendUPAMessageWithErrorText(RsslChannel* UPAChannel, RsslBuffer* msgBuff
 
     t42log_debug("SendMessage - %lu bytes written, %lu bytes uncompressed \n", bytesWritten, uncompressedBytesWritten);
 
+    // when the owning thread is batching writes it flushes the channel itself once it has finished this pass
+    UPAWriteBatch* batch = UPAWriteBatch::ForChannel(UPAChannel);
+    if (batch != 0 && !batch->Defer(bytesWritten))
+    {
+        return RSSL_RET_SUCCESS;
+    }
+
     if ((retval = rsslFlush(UPAChannel, &error)) < RSSL_RET_SUCCESS)
     {
         //printf("rsslFlush() failed with return code %d - <%s>\n", retval, error.text);
         errorText.assign(error.text);
 
     }
-    else if (retval == RSSL_RET_SUCCESS)
+    else if (retval > RSSL_RET_SUCCESS)
     {
-         //clear write fd 
-        FD_CLR(UPAChannel->socketId, &wrtfds);
+        WantWrite(UPAChannel);
     }
 
 
@@ -130,9 +140,8 @@ RsslRet SendPing(RsslChannel* UPAChannel)
     }
     else if (ret > RSSL_RET_SUCCESS)
     {
-         //set write fd if there's still data queued 
-         //flush is done by application 
-        FD_SET(UPAChannel->socketId, &wrtfds);
+        // there's still data queued, the owning thread flushes it
+        WantWrite(UPAChannel);
     }
 
     //printf("sent ping\n");
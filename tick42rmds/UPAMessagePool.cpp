@@ -0,0 +1,90 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "stdafx.h"
+#include "UPAMessagePool.h"
+#include "utils/t42log.h"
+
+#include "../tick42rmdsmsg/upapayloadimpl.h"
+
+UPAMessagePool::UPAMessagePool(mamaBridge bridge, size_t maxFree)
+    : bridge_(bridge)
+    , payloadBridge_(mamaInternal_findPayload(MAMA_PAYLOAD_TICK42RMDS))
+    , maxFree_(maxFree)
+{
+    free_.reserve(maxFree_);
+}
+
+UPAMessagePool::~UPAMessagePool()
+{
+    utils::thread::T42Lock l(&lock_);
+    for (std::vector<mamaMsg>::iterator it = free_.begin(); it != free_.end(); ++it)
+    {
+        mamaMsg_destroy(*it);
+    }
+    free_.clear();
+}
+
+mamaMsg UPAMessagePool::Acquire()
+{
+    {
+        utils::thread::T42Lock l(&lock_);
+        if (!free_.empty())
+        {
+            mamaMsg msg = free_.back();
+            free_.pop_back();
+            return msg;
+        }
+    }
+
+    mamaMsg msg = NULL;
+    mama_status status = mamaMsg_createForPayloadBridge(&msg, payloadBridge_);
+    if (MAMA_STATUS_OK != status)
+    {
+        t42log_error("UPAMessagePool - failed to create message (%d)\n", status);
+        return NULL;
+    }
+
+    mamaMsgImpl_setBridgeImpl(msg, bridge_);
+    return msg;
+}
+
+void UPAMessagePool::Release(mamaMsg msg)
+{
+    if (NULL == msg)
+    {
+        return;
+    }
+
+    {
+        utils::thread::T42Lock l(&lock_);
+        if (free_.size() < maxFree_)
+        {
+            free_.push_back(msg);
+            return;
+        }
+    }
+
+    mamaMsg_destroy(msg);
+}
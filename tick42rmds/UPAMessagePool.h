@@ -0,0 +1,71 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __UPAMESSAGEPOOL_H__
+#define __UPAMESSAGEPOOL_H__
+
+#include "utils/thread/lock.h"
+
+// A free list of mama messages for the async delivery path.
+//
+// With async messaging on, each update is copied into a message of its own which is then shared by all the listener
+// queues. The message goes back to the pool when the last queue has dispatched it, and the next update is copied over
+// the top of it, so in the steady state the payload storage is reused rather than allocated for every update.
+//
+// Messages are taken on the consumer threads and given back on the mama queue threads, so the free list is locked.
+
+class UPAMessagePool
+{
+public:
+    UPAMessagePool(mamaBridge bridge, size_t maxFree);
+    ~UPAMessagePool();
+
+    // take a message from the pool, or create a new one if the pool is empty. Returns NULL if the message cant be created
+    mamaMsg Acquire();
+
+    // give back a message that no queue still references. If the pool is already holding maxFree messages it is destroyed
+    void Release(mamaMsg msg);
+
+    size_t FreeCount() const
+    {
+        utils::thread::T42Lock l(&lock_);
+        return free_.size();
+    }
+
+private:
+    mamaBridge bridge_;
+    mamaPayloadBridge payloadBridge_;
+    size_t maxFree_;
+
+    std::vector<mamaMsg> free_;
+    mutable utils::thread::lock_t lock_;
+
+    UPAMessagePool(const UPAMessagePool&);
+    UPAMessagePool& operator=(const UPAMessagePool&);
+};
+
+typedef boost::shared_ptr<UPAMessagePool> UPAMessagePool_ptr_t;
+
+#endif //__UPAMESSAGEPOOL_H__
@@ -0,0 +1,146 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "stdafx.h"
+#include "UPAOpenThrottle.h"
+#include "utils/t42log.h"
+
+namespace
+{
+    // the weight of each new sample in the smoothed rtt
+    const double RttGain = 0.125;
+
+    // the base rtt is the quickest response in the last two epochs of this many responses, so that it can recover if
+    // the ADS gets slower for good
+    const RsslUInt64 EpochResponses = 20000;
+
+    // the smoothed rtt is congested when it is this many times the base rtt
+    const double CongestionFactor = 2.0;
+
+    // how much of the window is kept when congested
+    const double DecreaseFactor = 0.5;
+}
+
+UPAOpenThrottle::UPAOpenThrottle()
+    : adaptive_(false)
+    , window_(1000)
+    , minimum_(1)
+    , maximum_(1000)
+    , slowStart_(true)
+    , smoothedRtt_(0)
+    , epochMinRtt_(0)
+    , lastEpochMinRtt_(0)
+    , epochResponses_(0)
+    , responsesSinceDecrease_(0)
+{
+}
+
+void UPAOpenThrottle::Configure(bool adaptive, size_t initial, size_t minimum, size_t maximum)
+{
+    adaptive_ = adaptive;
+    minimum_ = (double)((minimum > 0) ? minimum : 1);
+    maximum_ = (double)((maximum > minimum) ? maximum : minimum);
+    window_ = (double)initial;
+    if (window_ < minimum_)
+    {
+        window_ = minimum_;
+    }
+    if (adaptive_ && window_ > maximum_)
+    {
+        window_ = maximum_;
+    }
+
+    slowStart_ = true;
+    smoothedRtt_ = 0;
+    epochMinRtt_ = 0;
+    lastEpochMinRtt_ = 0;
+    epochResponses_ = 0;
+    responsesSinceDecrease_ = 0;
+}
+
+void UPAOpenThrottle::OnResponse(RsslUInt64 rtt)
+{
+    if (!adaptive_)
+    {
+        return;
+    }
+
+    double sample = (double)rtt;
+    if (smoothedRtt_ == 0)
+    {
+        smoothedRtt_ = sample;
+        epochMinRtt_ = sample;
+        lastEpochMinRtt_ = sample;
+    }
+    else
+    {
+        smoothedRtt_ += RttGain * (sample - smoothedRtt_);
+        if (sample < epochMinRtt_)
+        {
+            epochMinRtt_ = sample;
+        }
+    }
+
+    if (++epochResponses_ >= EpochResponses)
+    {
+        lastEpochMinRtt_ = epochMinRtt_;
+        epochMinRtt_ = sample;
+        epochResponses_ = 0;
+    }
+
+    double baseRtt = (epochMinRtt_ < lastEpochMinRtt_) ? epochMinRtt_ : lastEpochMinRtt_;
+
+    ++responsesSinceDecrease_;
+
+    if (smoothedRtt_ > baseRtt * CongestionFactor)
+    {
+        if (responsesSinceDecrease_ >= (RsslUInt64)window_)
+        {
+            window_ *= DecreaseFactor;
+            if (window_ < minimum_)
+            {
+                window_ = minimum_;
+            }
+            slowStart_ = false;
+            responsesSinceDecrease_ = 0;
+
+            t42log_debug("Open throttle - response time %.0fus against %.0fus, window cut to %d\n", smoothedRtt_, baseRtt, (int)window_);
+        }
+        return;
+    }
+
+    if (slowStart_)
+    {
+        window_ += 1.0;
+    }
+    else
+    {
+        window_ += 1.0 / window_;
+    }
+
+    if (window_ > maximum_)
+    {
+        window_ = maximum_;
+    }
+}
@@ -0,0 +1,78 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __UPAOPENTHROTTLE_H__
+#define __UPAOPENTHROTTLE_H__
+
+// Sizes the window of item opens a consumer may have outstanding at the ADS, from how quickly the ADS is responding.
+//
+// This is additive increase / multiplicative decrease, in the same way as TCP congestion control. The window starts
+// small and grows by one for every response until the first sign of congestion (slow start), then grows by one for
+// each window's worth of responses. The sign of congestion is the smoothed time from sending an open to getting its
+// response rising to twice the quickest time seen recently - the ADS is queueing the requests rather than serving
+// them. Then the window is halved, at most once per window of responses so that one slow batch doesnt collapse it.
+//
+// With adaptive throttling off the window is fixed at the configured maximum, as it always was.
+
+class UPAOpenThrottle
+{
+public:
+    UPAOpenThrottle();
+
+    // initial is the starting window, and the fixed window if not adaptive
+    void Configure(bool adaptive, size_t initial, size_t minimum, size_t maximum);
+
+    // the number of opens that may be outstanding
+    size_t Window() const
+    {
+        return (size_t)window_;
+    }
+
+    // an open got its response after rtt microseconds
+    void OnResponse(RsslUInt64 rtt);
+
+    bool Adaptive() const
+    {
+        return adaptive_;
+    }
+
+private:
+    bool adaptive_;
+    double window_;
+    double minimum_;
+    double maximum_;
+    bool slowStart_;
+
+    // exponentially weighted moving average of the round trip time, and the quickest in this epoch and the last
+    double smoothedRtt_;
+    double epochMinRtt_;
+    double lastEpochMinRtt_;
+    RsslUInt64 epochResponses_;
+
+    // responses since the window was last cut
+    RsslUInt64 responsesSinceDecrease_;
+};
+
+#endif //__UPAOPENTHROTTLE_H__
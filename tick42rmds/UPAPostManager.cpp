@@ -24,63 +24,158 @@
 */
 #include "stdafx.h"
 #include "UPAPostManager.h"
+#include "UPABridgePoster.h"
 
 #include <utils/t42log.h>
+#include <utils/time.h>
 
 
 // When we post to the RMDS we want a PostID that is inserted into the Rssl Message. This is returned in the response message as the Ack ID
 // we can use this identify the poster and route the ack message to it
 
-RsslUInt32 UPAPostManager::AddPost(const UPABridgePoster_ptr_t& poster, const PublisherPostMessageReply_ptr_t& reply)
+UPAPostManager::UPAPostManager()
+    : records_(0)
+    , capacity_(0)
+    , mask_(0)
+    , nextPostId_(0)
+    , inFlight_(0)
+    , timeout_(0)
+    , lastExpiryTime_(0)
+{
+    Configure(DefaultCapacity, 0);
+}
+
+UPAPostManager::~UPAPostManager()
+{
+    delete [] records_;
+}
+
+void UPAPostManager::Configure(size_t capacity, RsslUInt32 timeout)
 {
-    RsslUInt32 ret = GetNextPostId();
+    // the table is indexed by the low bits of the ID, which must also wrap cleanly at the top of the ID range
+    size_t size = 1;
+    while (size < capacity && size < ((size_t)1 << 31))
+    {
+        size <<= 1;
+    }
+
+    if (size != capacity_)
+    {
+        delete [] records_;
+        records_ = new UPAPostRecord[size];
+        capacity_ = size;
+        mask_ = (RsslUInt32)(size - 1);
+    }
 
-    // create a new post record and add it to the list
-    UPAPostRecord * record = new UPAPostRecord(ret, poster, reply);
+    // and the timeout is held in microseconds
+    timeout_ = (RsslUInt64)timeout * 1000;
+}
+
+RsslUInt32 UPAPostManager::AddPost(const UPABridgePoster_ptr_t& poster, const PublisherPostMessageReply_ptr_t& reply)
+{
+    // claim the next ID whose record is free. If we go all the way round the table every post is still in flight
+    for (size_t tries = 0; tries < capacity_; ++tries)
+    {
+        RsslUInt32 id = nextPostId_.fetch_add(1);
+        if (id == NoPostId)
+        {
+            continue;
+        }
+        UPAPostRecord& record = records_[id & mask_];
 
-    utils::thread::T42Lock l(&postListLock_);
-    postList_.push_back(record);
+        RsslUInt32 state = UPAPostRecord::Free;
+        if (record.state_.compare_exchange_strong(state, UPAPostRecord::Filling))
+        {
+            record.id_ = id;
+            record.postTime_ = utils::time::GetMicroCount();
+            record.poster_ = poster;
+            record.reply_ = reply;
+            ++inFlight_;
+            record.state_.store(UPAPostRecord::InFlight);
+            return id;
+        }
+    }
 
-    return ret;
+    // we wouldnt be able to route the ack, so the poster fails the post
+    t42log_warn("UPAPostManager has %d posts in flight, unable to track another post \n", (int)capacity_);
+    return NoPostId;
 }
 
 bool UPAPostManager::RemovePost(RsslUInt32 AckId, UPABridgePoster_ptr_t & poster, PublisherPostMessageReply_ptr_t& reply)
 {
-    bool ret = false;
-    // search the list for the post ID
+    UPAPostRecord& record = records_[AckId & mask_];
+
+    RsslUInt32 state = UPAPostRecord::InFlight;
+    if (!record.state_.compare_exchange_strong(state, UPAPostRecord::Taking))
+    {
+        return false;
+    }
+
+    // the record may now hold a later post that shares the slot, if the one for this ack has timed out
+    if (record.id_ != AckId)
+    {
+        record.state_.store(UPAPostRecord::InFlight);
+        return false;
+    }
+
+    TakeRecord(record, poster, reply);
+    return true;
+}
+
+void UPAPostManager::ExpirePosts()
+{
+    if (timeout_ == 0 || inFlight_.load() == 0)
+    {
+        return;
+    }
 
-    utils::thread::T42Lock l(&postListLock_);
-    // as we can expect the responses to arrive in more or less the same order as the posts it will normally be the head of the list
-    PostList_t::iterator it = postList_.begin();
+    // sweep the table at most a few times per timeout
+    RsslUInt64 now = utils::time::GetMicroCount();
+    if (now - lastExpiryTime_ < timeout_ / 4)
+    {
+        return;
+    }
+    lastExpiryTime_ = now;
 
-    int listItemsSearched = 0;
-    while (it != postList_.end())
+    for (size_t index = 0; index < capacity_; ++index)
     {
-        if ((*it)->Id() == AckId)
+        UPAPostRecord& record = records_[index];
+
+        RsslUInt32 state = UPAPostRecord::InFlight;
+        if (!record.state_.compare_exchange_strong(state, UPAPostRecord::Taking))
         {
-            // we've found what we are looking for so....
-            // grab the data
-            UPAPostRecord * record = *it;
-            poster = record->Poster();
-            reply = record->Reply();
-            // clean up
-            delete record;
-            postList_.erase(it);
-            ret = true;
-            // and drop out of the loop
-            break;
+            continue;
         }
 
-        ++listItemsSearched;
-        ++it;
+        if (now - record.postTime_ < timeout_)
+        {
+            record.state_.store(UPAPostRecord::InFlight);
+            continue;
+        }
 
-    }
+        RsslUInt32 id = record.id_;
+        UPABridgePoster_ptr_t poster;
+        PublisherPostMessageReply_ptr_t reply;
+        TakeRecord(record, poster, reply);
 
-    // log something to see if the assumption that reposnses will be in the same order as posts is actually valid
-    // if it is exactly the same order then the repsonse will all ways be on the list head. This will give us an idea if it isnt
-    if (listItemsSearched > 0)
-    {
-        t42log_debug("UPAPostManager searched %d items to match post ID %d \n", listItemsSearched, AckId);
+        t42log_warn("UPAPostManager timed out waiting for the ack for post ID %d \n", id);
+        try
+        {
+            poster->ProcessPostTimeout(id, reply.get());
+        }
+        catch (...)
+        {
+            t42log_warn("Caught exception processing post timeout");
+        }
     }
-    return ret;
+}
+
+void UPAPostManager::TakeRecord(UPAPostRecord& record, UPABridgePoster_ptr_t & poster, PublisherPostMessageReply_ptr_t& reply)
+{
+    poster.swap(record.poster_);
+    reply.swap(record.reply_);
+    record.poster_.reset();
+    record.reply_.reset();
+    --inFlight_;
+    record.state_.store(UPAPostRecord::Free);
 }
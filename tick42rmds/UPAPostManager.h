@@ -28,69 +28,76 @@
 
 #include "rmdsBridgeTypes.h"
 
-#include <utils/thread/lock.h>
+#include <utils/namespacedefines.h>
 
 class PublisherPostMessageReply;
 typedef boost::shared_ptr<PublisherPostMessageReply> PublisherPostMessageReply_ptr_t;
 
 // hold postID / AckID keys to correlate posts with Acks
+//
+// The posts in flight are held in a fixed table of preallocated records indexed by the low bits of the post ID, so
+// an ack finds its post directly however out of order the acks arrive. A posting thread claims an ID and its record
+// with atomic operations, without taking a lock. If the record for the next ID is still in use by an older post the
+// ID is skipped - the ADS only hands back the ID we gave it, so there is no need for the IDs to be contiguous.
+//
+// Posts are removed on the consumer thread, either by their ack or by ExpirePosts when no ack has arrived within the
+// timeout, in which case the poster is told the post got no response.
 class UPAPostManager
 {
 public:
-    UPAPostManager()
-    {
-        UPAPostManager::nextPostId_ = 0;
-        maxPostId_ = (std::numeric_limits<RsslUInt32>::max)();
-    }
+    UPAPostManager();
+    ~UPAPostManager();
+
+    // capacity is rounded up to a power of 2, and timeout (milliseconds) of 0 means posts never time out. Call before
+    // posting
+    void Configure(size_t capacity, RsslUInt32 timeout);
 
-    // add a post to the list and get the ID
+    // add a post to the table and get the ID, or NoPostId if every record is still in use by a post in flight
     RsslUInt32 AddPost(const UPABridgePoster_ptr_t& poster, const PublisherPostMessageReply_ptr_t& reply);
 
     // get the poster back from the AckId
-    //UPABridgePoster_ptr_t RemovePost(RsslUInt32 AckId);
     bool RemovePost(RsslUInt32 AckId, UPABridgePoster_ptr_t & poster, PublisherPostMessageReply_ptr_t& reply);
 
+    // consumer thread - give up on the posts that have waited longer than the timeout for their ack
+    void ExpirePosts();
+
+    static const size_t DefaultCapacity = 16384;
+
+    // never handed out as a post ID
+    static const RsslUInt32 NoPostId = 0;
+
 private:
     // hold information on key passed as to rmds as postID and returned as AckId
     // this will allow us to route acks to the poster that originated the post
-    class UPAPostRecord
+    struct UPAPostRecord
     {
+        enum State
+        {
+            Free,
+            Filling,    // a posting thread is setting it up
+            InFlight,
+            Taking      // the consumer thread is looking at it
+        };
 
-    public:
-        UPAPostRecord(RsslUInt32 postId, const UPABridgePoster_ptr_t& poster, const PublisherPostMessageReply_ptr_t& reply)
-            : poster_(poster), id_(postId), reply_(reply) {}
-
-        UPABridgePoster_ptr_t Poster() const { return poster_; }
-        RsslUInt32 Id() const { return id_; }
-        const PublisherPostMessageReply_ptr_t& Reply() const { return reply_; }
+        UPAPostRecord() : state_(Free), id_(0), postTime_(0) {}
 
-    private:
+        utils::thread::atomic<RsslUInt32> state_;
         RsslUInt32 id_;
+        RsslUInt64 postTime_;
         UPABridgePoster_ptr_t poster_;
         PublisherPostMessageReply_ptr_t reply_;
-
     };
 
+    // take the record from the table, which must be in the Taking state
+    void TakeRecord(UPAPostRecord& record, UPABridgePoster_ptr_t & poster, PublisherPostMessageReply_ptr_t& reply);
 
-    RsslUInt32 GetNextPostId()
-    {
-        if (nextPostId_ < maxPostId_ )
-        {
-            return nextPostId_ ++;
-        }
-
-        // otherwise need to restart at 0
-        nextPostId_ = 0;
+    UPAPostRecord* records_;
+    size_t capacity_;
+    RsslUInt32 mask_;
 
-        return nextPostId_++;
-    }
+    utils::thread::atomic<RsslUInt32> nextPostId_;
+    utils::thread::atomic<RsslUInt32> inFlight_;
 
-    typedef std::list<UPAPostRecord *> PostList_t;
-    PostList_t postList_;
-
-    mutable utils::thread::lock_t postListLock_;
-
-    RsslUInt32 maxPostId_;
-    RsslUInt32 nextPostId_;
+    RsslUInt64 timeout_;
+    RsslUInt64 lastExpiryTime_;
 };
-
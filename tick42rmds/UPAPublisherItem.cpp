@@ -75,6 +75,10 @@ bool UPAPublisherItem::Initialise( const UPAPublisherItem_ptr_t& ptr,  RMDSPubli
    mamaDictionary_ = upaFieldMap_->GetCombinedMamaDictionary().get();
    rmdsDictionary_ = publisher->Subscriber()->Consumer()->RsslDictionary()->RsslDictionary();
    maxMessageSize_ = publisher->MaxMessageSize();
+
+   // the item reuses its encoder for every message it publishes. Only the fid plans are kept between encodes, under the
+   // encoder's lock, so a publish on the app thread and a recap for a new item request can encode at the same time
+   encoder_ = boost::make_shared<UPAFieldEncoder>(mamaDictionary_, upaFieldMap_, rmdsDictionary_, source_, symbol_);
    return true;
 }
 
@@ -231,9 +235,7 @@ void UPAPublisherItem::ProcessRecapMessage( mamaMsg msg )
 
 mama_status UPAPublisherItem::PublishMessage( mamaMsg msg, std::string& errorText )
 {
-   ChannelMap_t::iterator it = channelMap_.begin();
-
-   if (it == channelMap_.end())
+   if (channelMap_.empty())
    {
       // if the last channel has been closed.
       // it looks like the client is still sending updates, just log and return
@@ -241,46 +243,143 @@ mama_status UPAPublisherItem::PublishMessage( mamaMsg msg, std::string& errorTex
       return MAMA_STATUS_NOT_INITIALISED;
    }
 
-
    t42log_debug("channel map for %s has %d entries\n ", symbol_.c_str(), channelMap_.size());
 
-   // todo iterate this over all the channels
-   UpaChannel_t *UpaChannel = it->second;
-   RsslChannel *chnl = channelMap_.begin()->second->channel_;
-   RsslError err;
-   RsslBuffer *rsslMessageBuffer = rsslGetBuffer(chnl, maxMessageSize_, RSSL_FALSE, &err );
+   // publish on every stream the item is open on, on every channel
+   PublishTargetList_t targets;
+   for (ChannelMap_t::const_iterator it = channelMap_.begin(); it != channelMap_.end(); ++it)
+   {
+      const StreamList_t& streams = it->second->refreshStreamList_;
+      for (StreamList_t::const_iterator streamIt = streams.begin(); streamIt != streams.end(); ++streamIt)
+      {
+         targets.push_back(PublishTarget_t(it->second->channel_, *streamIt));
+      }
+   }
+
+   // The message is encoded once into the buffer for the first stream and copied to the others with just the stream
+   // id replaced. The streams of a non-interactive provider carry the message key on their updates, and channels may
+   // differ in their RWF version, so each of those gets its own encoding
+   mama_status ret = MAMA_STATUS_OK;
+   while (!targets.empty())
+   {
+      PublishTarget_t first = targets.front();
+      targets.pop_front();
+
+      RsslChannel *chnl = first.first;
+      RsslError err;
+      RsslBuffer *encodedBuffer = rsslGetBuffer(chnl, maxMessageSize_, RSSL_FALSE, &err);
+      if (encodedBuffer == 0)
+      {
+         t42log_warn("Unable to obtain rssl buffer to post message for %s : %s - error code is %d (%s) \n",
+            source_.c_str(), symbol_.c_str(), err.rsslErrorId, err.text);
 
+         errorText.assign(err.text);
+         ret = MAMA_STATUS_NOMEM;
+         continue;
+      }
+
+      if (!BuildPublishMessage(chnl, first.second, encodedBuffer, msg))
+      {
+         // Release buffer since we a re not going to send the message
+         rsslReleaseBuffer(encodedBuffer, &err);
+
+         // it wont encode for the streams like this one either
+         RemoveMatchingTargets(targets, first);
+         ret = MAMA_STATUS_NOT_INITIALISED;
+         continue;
+      }
+
+      PublishTargetList_t::iterator it = targets.begin();
+      while (it != targets.end())
+      {
+         if (!SameEncoding(*it, first))
+         {
+            ++it;
+            continue;
+         }
+
+         mama_status status = SendCopy(*it, encodedBuffer, errorText);
+         if (status != MAMA_STATUS_OK)
+         {
+            ret = status;
+         }
+         it = targets.erase(it);
+      }
+
+      // and the original goes last, as sending it gives up the buffer
+      if (SendUPAMessageWithErrorText(chnl, encodedBuffer, errorText) < RSSL_RET_SUCCESS)
+      {
+         t42log_warn("Failed to publish message for %s : %s on stream %d - %s \n", source_.c_str(), symbol_.c_str(), first.second, errorText.c_str());
+         ret = MAMA_STATUS_PLATFORM;
+      }
+   }
+
+   return ret;
+}
+
+bool UPAPublisherItem::SameEncoding( const PublishTarget_t& lhs, const PublishTarget_t& rhs )
+{
+   return ((lhs.second < 0) == (rhs.second < 0))
+      && lhs.first->majorVersion == rhs.first->majorVersion
+      && lhs.first->minorVersion == rhs.first->minorVersion;
+}
+
+void UPAPublisherItem::RemoveMatchingTargets( PublishTargetList_t& targets, const PublishTarget_t& target )
+{
+   PublishTargetList_t::iterator it = targets.begin();
+   while (it != targets.end())
+   {
+      if (SameEncoding(*it, target))
+      {
+         it = targets.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+}
+
+mama_status UPAPublisherItem::SendCopy( const PublishTarget_t& target, const RsslBuffer* encodedBuffer, std::string& errorText )
+{
+   RsslChannel *chnl = target.first;
+   RsslError err;
+   RsslBuffer *rsslMessageBuffer = rsslGetBuffer(chnl, encodedBuffer->length, RSSL_FALSE, &err);
    if (rsslMessageBuffer == 0)
    {
       t42log_warn("Unable to obtain rssl buffer to post message for %s : %s - error code is %d (%s) \n",
          source_.c_str(), symbol_.c_str(), err.rsslErrorId, err.text);
 
       errorText.assign(err.text);
-
       return MAMA_STATUS_NOMEM;
    }
 
-   if(!BuildPublishMessage(UpaChannel, rsslMessageBuffer, msg))
-   {
-       // Release buffer since we a re not going to send the message
-       RsslError err;
-       rsslReleaseBuffer(rsslMessageBuffer, &err);
-
-       errorText.assign(err.text);
+   memcpy(rsslMessageBuffer->data, encodedBuffer->data, encodedBuffer->length);
+   rsslMessageBuffer->length = encodedBuffer->length;
 
-       return MAMA_STATUS_NOT_INITIALISED;
+   // the encoded message is the same apart from the stream id
+   RsslEncodeIterator itEncode;
+   rsslClearEncodeIterator(&itEncode);
+   rsslSetEncodeIteratorBuffer(&itEncode, rsslMessageBuffer);
+   rsslSetEncodeIteratorRWFVersion(&itEncode, chnl->majorVersion, chnl->minorVersion);
+   RsslRet rsslRet;
+   if ((rsslRet = rsslReplaceStreamId(&itEncode, target.second)) < RSSL_RET_SUCCESS)
+   {
+      t42log_warn("rsslReplaceStreamId() for %s : %s failed with return code: %d\n", source_.c_str(), symbol_.c_str(), rsslRet);
+      rsslReleaseBuffer(rsslMessageBuffer, &err);
+      return MAMA_STATUS_PLATFORM;
    }
 
-   RsslRet rsslRet = SendUPAMessageWithErrorText(chnl, rsslMessageBuffer, errorText);
-   if (rsslRet >= RSSL_RET_SUCCESS)
+   if (SendUPAMessageWithErrorText(chnl, rsslMessageBuffer, errorText) < RSSL_RET_SUCCESS)
    {
-       return MAMA_STATUS_OK;
+      t42log_warn("Failed to publish message for %s : %s on stream %d - %s \n", source_.c_str(), symbol_.c_str(), target.second, errorText.c_str());
+      return MAMA_STATUS_PLATFORM;
    }
 
-   return MAMA_STATUS_PLATFORM;
+   return MAMA_STATUS_OK;
 }
 
-bool UPAPublisherItem::BuildPublishMessage( UpaChannel_t * chnl, RsslBuffer* rsslMessageBuffer, mamaMsg msg )
+bool UPAPublisherItem::BuildPublishMessage( RsslChannel * chnl, RsslInt32 streamId, RsslBuffer* rsslMessageBuffer, mamaMsg msg )
 {
    RsslMsg * rsslMsg;
    RsslMsgBase* msgBase;
@@ -304,8 +403,6 @@ bool UPAPublisherItem::BuildPublishMessage( UpaChannel_t * chnl, RsslBuffer* rss
    RsslRefreshMsg refreshMsg = RSSL_INIT_REFRESH_MSG;
    RsslUpdateMsg updateMsg = RSSL_INIT_UPDATE_MSG;
 
-   RsslInt32 streamId = chnl->refreshStreamList_.front();
-
    if (isRefresh)
    {
       msgBase = &refreshMsg.msgBase;
@@ -365,9 +462,8 @@ bool UPAPublisherItem::BuildPublishMessage( UpaChannel_t * chnl, RsslBuffer* rss
    msgBase->containerType = RSSL_DT_FIELD_LIST;
 
     //StreamId
-   msgBase->streamId = chnl->refreshStreamList_.front();
+   msgBase->streamId = streamId;
 
    // encode the message
-   UPAFieldEncoder encoder(mamaDictionary_, upaFieldMap_, rmdsDictionary_, source_, symbol_);
-   return encoder.encode(msg, chnl->channel_, rsslMsg, rsslMessageBuffer);
+   return encoder_->encode(msg, chnl, rsslMsg, rsslMessageBuffer);
 }
@@ -3,6 +3,8 @@
 #include "rmdsBridgeTypes.h"
 #include "RMDSSubscriber.h"
 
+class UPAFieldEncoder;
+
 typedef struct PubFieldListClosure
 {
     UPAPublisherItem_ptr_t publisher;
@@ -85,12 +87,25 @@ private:
     RsslUInt32 serviceId_;
 
     // build the outgoing rssl message
-    bool BuildPublishMessage(UpaChannel_t * upaChnl, RsslBuffer* rsslMessageBuffer, mamaMsg msg);
+    bool BuildPublishMessage(RsslChannel * chnl, RsslInt32 streamId, RsslBuffer* rsslMessageBuffer, mamaMsg msg);
+
+    // a stream a message is published on
+    typedef std::pair<RsslChannel *, RsslInt32> PublishTarget_t;
+    typedef std::list<PublishTarget_t> PublishTargetList_t;
+
+    // whether a message encoded for one target can be copied to the other with just the stream id replaced
+    static bool SameEncoding(const PublishTarget_t& lhs, const PublishTarget_t& rhs);
+    static void RemoveMatchingTargets(PublishTargetList_t& targets, const PublishTarget_t& target);
+
+    // send a copy of the encoded message to another target
+    mama_status SendCopy(const PublishTarget_t& target, const RsslBuffer* encodedBuffer, std::string& errorText);
 
     mamaDictionary mamaDictionary_;
     UpaMamaFieldMap_ptr_t upaFieldMap_;
     RsslDataDictionary * rmdsDictionary_;
 
+    boost::shared_ptr<UPAFieldEncoder> encoder_;
+
     unsigned int maxMessageSize_;
 
     // flag used to set Rssl message flags. messages from interactive publisher are unsolicited
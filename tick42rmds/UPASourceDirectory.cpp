@@ -249,7 +249,6 @@ RsslRet UPASourceDirectory::DecodeSourceDirectoryResponse(RsslDecodeIterator *dI
         // clear down the struct
         ResetSourceDirRespInfo(&srcDirRespInfo);
 
-        bool hasStateInfo = false;
         if (ret == RSSL_RET_SUCCESS)
         {
             if (ret != RSSL_RET_SUCCESS && ret != RSSL_RET_BLANK_DATA)
@@ -294,15 +293,22 @@ RsslRet UPASourceDirectory::DecodeSourceDirectoryResponse(RsslDecodeIterator *dI
                             t42log_error("decodeServiceStateInfo() failed with return code: %d\n", ret);
                             return ret;
                         }
-                        hasStateInfo = true;
+                        srcDirRespInfo.HasStateInfo = RSSL_TRUE;
                         break;
 
                     case RDM_DIRECTORY_SERVICE_GROUP_ID:
-                        if ((ret = DecodeServiceGroupInfo(&srcDirRespInfo.ServiceGroupInfo, dIter)) != RSSL_RET_SUCCESS)
+                        // each group filter entry carries the state or merge of one item group
+                        if (srcDirRespInfo.ServiceGroupCount >= MaxGroups)
+                        {
+                            t42log_warn("Source directory update for service %d has more than %d item groups\n", (int)serviceIdTemp, (int)MaxGroups);
+                            break;
+                        }
+                        if ((ret = DecodeServiceGroupInfo(&srcDirRespInfo.ServiceGroupInfo[srcDirRespInfo.ServiceGroupCount], dIter)) != RSSL_RET_SUCCESS)
                         {
                             t42log_error("decodeServiceGroupInfo() failed with return code: %d\n", ret);
                             return ret;
                         }
+                        ++srcDirRespInfo.ServiceGroupCount;
                         break;
 
                     case RDM_DIRECTORY_SERVICE_LOAD_ID:
@@ -337,7 +343,7 @@ RsslRet UPASourceDirectory::DecodeSourceDirectoryResponse(RsslDecodeIterator *dI
             }
         }
 
-        if (hasStateInfo)
+        if (srcDirRespInfo.HasStateInfo || srcDirRespInfo.ServiceGroupCount > 0)
         {
             NotifyListenersUpdate(&srcDirRespInfo, isRefresh);
         }
@@ -740,10 +746,12 @@ RsslRet UPASourceDirectory::DecodeServiceGroupInfo(RsslServiceGroupInfo* service
                 if (elt.encData.length < MaxGroupInfoLength)
                 {
                     memcpy(serviceGroupInfo->Group, elt.encData.data, elt.encData.length);
+                    serviceGroupInfo->GroupLength = elt.encData.length;
                 }
                 else
                 {
                     memcpy(serviceGroupInfo->Group, elt.encData.data, MaxGroupInfoLength);
+                    serviceGroupInfo->GroupLength = MaxGroupInfoLength;
                 }
             }
 
@@ -753,10 +761,12 @@ RsslRet UPASourceDirectory::DecodeServiceGroupInfo(RsslServiceGroupInfo* service
                 if (elt.encData.length < MaxGroupInfoLength)
                 {
                     memcpy(serviceGroupInfo->MergedToGroup, elt.encData.data, elt.encData.length);
+                    serviceGroupInfo->MergedToGroupLength = elt.encData.length;
                 }
                 else
                 {
                     memcpy(serviceGroupInfo->MergedToGroup, elt.encData.data, MaxGroupInfoLength);
+                    serviceGroupInfo->MergedToGroupLength = MaxGroupInfoLength;
                 }
             }
 
@@ -769,6 +779,7 @@ RsslRet UPASourceDirectory::DecodeServiceGroupInfo(RsslServiceGroupInfo* service
                     t42log_error("rsslDecodeUInt() failed with return code: %d\n", ret);
                     return ret;
                 }
+                serviceGroupInfo->HasStatus = (ret == RSSL_RET_SUCCESS);
             }
         }
         else
@@ -1225,7 +1236,10 @@ void UPASourceDirectory::ResetServiceStateInfo(RsslServiceStateInfo* serviceStat
 void UPASourceDirectory::ResetServiceGroupInfo(RsslServiceGroupInfo* serviceGroupInfo)
 {
     memset(serviceGroupInfo->Group, 0, sizeof(serviceGroupInfo->Group));
+    serviceGroupInfo->GroupLength = 0;
     memset(serviceGroupInfo->MergedToGroup, 0, sizeof(serviceGroupInfo->MergedToGroup));
+    serviceGroupInfo->MergedToGroupLength = 0;
+    serviceGroupInfo->HasStatus = RSSL_FALSE;
     rsslClearState(&serviceGroupInfo->Status);
 }
 
@@ -1263,8 +1277,13 @@ void UPASourceDirectory::ResetSourceDirRespInfo(RsslSourceDirectoryResponseInfo*
     srcDirRespInfo->StreamId = 0;
     srcDirRespInfo->ServiceId = 0;
     UPASourceDirectory::ResetServiceGeneralInfo(&srcDirRespInfo->ServiceGeneralInfo);
+    srcDirRespInfo->HasStateInfo = RSSL_FALSE;
     UPASourceDirectory::ResetServiceStateInfo(&srcDirRespInfo->ServiceStateInfo);
-    UPASourceDirectory::ResetServiceGroupInfo(&srcDirRespInfo->ServiceGroupInfo);
+    srcDirRespInfo->ServiceGroupCount = 0;
+    for (size_t i = 0; i < MaxGroups; i++)
+    {
+        UPASourceDirectory::ResetServiceGroupInfo(&srcDirRespInfo->ServiceGroupInfo[i]);
+    }
     UPASourceDirectory::ResetServiceLoadInfo(&srcDirRespInfo->ServiceLoadInfo);
     UPASourceDirectory::ResetServiceDataInfo(&srcDirRespInfo->ServiceDataInfo);
     UPASourceDirectory::ResetServiceLinkInfo(&srcDirRespInfo->ServiceLinkInfo[0]);
@@ -27,20 +27,7 @@
 #include "UPASubscription.h"
 #include "UPABridgePoster.h"
 
-// for the moment just have a simple flat array of stream ids. later we can dynamically allocate in blocks if we want to
-const RsslUInt32 StartStreamID = 16;
-const unsigned int NumStreamIds = 0x40000; // 256k for the moment
-
-
-inline RsslUInt32 Index2StreamId(RsslUInt32 Index)
-{
-    return Index+StartStreamID;
-}
-
-inline RsslUInt32 StreamId2Index( RsslUInt32 streamId)
-{
-    return streamId - StartStreamID;
-}
+#include <new>
 
 void* UPAStreamManager::Track(void* p)
 {
@@ -61,7 +48,7 @@ void* UPAStreamManager::Track(void* p)
             pending_items_t::iterator it = s->pendingItems_.begin();
             while (s->pendingItems_.end() != it)
             {
-                UPASubscription* sub = *it++;
+                UPASubscription* sub = (it++)->first;
                 sum += (long) sub;
                 UPASubscription::UPASubscriptionState state = sub->GetSubscriptionState();
                 if (state == UPASubscription::SubscriptionStateSubscribing) ing++;
@@ -81,16 +68,30 @@ void* UPAStreamManager::Track(void* p)
     return NULL;
 }
 
+UPAStreamManager::Segment::Segment()
+{
+    for (RsslUInt32 i = 0; i < SegmentSize; ++i)
+    {
+        slots_[i].item_.store(0, utils::thread::memory_order_relaxed);
+        slots_[i].nextFree_.store(EmptyFreeList, utils::thread::memory_order_relaxed);
+    }
+}
+
 UPAStreamManager::UPAStreamManager()
     : pendingItems_(0)
    , openItems_(0)
    , pendingCloses_(0)
 {
-    ItemArray_ = new UPAItem_ptr_t [NumStreamIds];
-    ::memset(ItemArray_, 0, sizeof(UPAItem_ptr_t *)*NumStreamIds);
+    segments_ = new utils::thread::atomic<Segment *>[MaxSegments];
+    for (RsslUInt32 i = 0; i < MaxSegments; ++i)
+    {
+        segments_[i].store(0, utils::thread::memory_order_relaxed);
+    }
 
-    nextIndex_ = 0;
-    nextPubIndex_ = 1;
+    nextIndex_.store(0);
+    freeHead_.store(EmptyFreeList);
+    readerActive_.store(false);
+    retiredCount_.store(0);
 
     // wthread_t tid;
     // wthread_create(&tid, 0, &UPAStreamManager::Track, this);
@@ -99,66 +100,285 @@ UPAStreamManager::UPAStreamManager()
 
 UPAStreamManager::~UPAStreamManager(void)
 {
-    delete [] ItemArray_;
+    for (RsslUInt32 i = 0; i < MaxSegments; ++i)
+    {
+        Segment * segment = segments_[i].load();
+        if (segment == 0)
+        {
+            continue;
+        }
+
+        for (RsslUInt32 j = 0; j < SegmentSize; ++j)
+        {
+            delete segment->slots_[j].item_.load();
+        }
+        delete segment;
+    }
+    delete [] segments_;
+
+    for (size_t i = 0; i < retiredItems_.size(); ++i)
+    {
+        delete retiredItems_[i];
+    }
 }
 
 RsslUInt32 UPAStreamManager::AddItem(const UPASubscription_ptr_t& sub )
 {
-    utils::thread::T42Lock lock(&streamLock_);
-
-    RsslUInt32 index;
+    RsslUInt32 index = nextIndex_.load();
     static bool firstUseOfQueue = true;
 
-    if (nextIndex_ >= NumStreamIds)
+    // hand out fresh ids until we reach the recycle threshold, then prefer the free list and only grow the table when
+    // there is nothing out of quarantine to recycle
+    if (index < RecycleThreshold || !(PopFreeIndex(index) || (ReleaseQuarantined() && PopFreeIndex(index))))
     {
-        if (firstUseOfQueue)
+        index = nextIndex_++;
+        if (index >= SegmentSize * MaxSegments)
         {
-            firstUseOfQueue = false;
-            t42log_info("Begin using the StreamManager queue, MaxStreamIds=%d", NumStreamIds);
+            nextIndex_.store(SegmentSize * MaxSegments);
+            t42log_warn("!No more streamIDs\n");
+            return 0;
         }
 
-        // first check to see if there is a free slot in the free list
-        if (freeStreamIds_.size() > 0)
+        if (!EnsureSegment(index))
         {
-            // grab the front of the list
-            index = freeStreamIds_.front();
-            freeStreamIds_.pop();
+            t42log_warn("!Failed to allocate streamIDs\n");
+            return 0;
         }
-        else
+    }
+    else if (firstUseOfQueue)
+    {
+        firstUseOfQueue = false;
+        t42log_info("Begin recycling StreamManager stream ids, RecycleThreshold=%d", RecycleThreshold);
+    }
+
+    RsslUInt32 streamId = index + StartStreamID;
+    UPAItem * newItem = new UPAItem(streamId, sub);
+    SlotAt(index).item_.store(newItem, utils::thread::memory_order_release);
+    return streamId;
+}
+
+bool UPAStreamManager::ReleaseStreamId( RsslUInt32 streamId )
+{
+    RsslUInt32 index = streamId - StartStreamID;
+    if (streamId < StartStreamID || index >= nextIndex_.load())
+    {
+        return false;
+    }
+
+    UPAItem * item = SlotAt(index).item_.exchange(0);
+    if (item == 0)
+    {
+        // already released
+        return false;
+    }
+
+    // the reader may still be holding the item, so retire it and let the reclaim sort out when it can go
+    {
+        utils::thread::T42Lock lock(&streamLock_);
+        retiredItems_.push_back(item);
+        retiredCount_.store(retiredItems_.size());
+    }
+    Reclaim();
+
+    // the provider may still send on the stream until it has seen the close
+    QuarantineIndex(index);
+    return true;
+}
+
+RsslUInt32 UPAStreamManager::ReserveStreamRange(RsslUInt32 count)
+{
+    RsslUInt32 index = nextIndex_.fetch_add(count);
+    if (index >= SegmentSize * MaxSegments || count > SegmentSize * MaxSegments - index)
+    {
+        nextIndex_.store(SegmentSize * MaxSegments);
+        t42log_warn("!No more streamIDs\n");
+        return 0;
+    }
+
+    for (RsslUInt32 segment = index >> SegmentShift; segment <= (index + count - 1) >> SegmentShift; ++segment)
+    {
+        if (!EnsureSegment(segment << SegmentShift))
         {
-            t42log_warn("!No more streamIDs\n");
+            t42log_warn("!Failed to allocate streamIDs\n");
             return 0;
         }
     }
-    else
+
+    RsslUInt32 streamId = index + StartStreamID;
     {
-         index = nextIndex_++;
+        utils::thread::T42Lock lock(&streamLock_);
+        batchStreams_.insert(streamId);
     }
-
-    RsslUInt32 streamId = Index2StreamId(index);
-    UPAItem_ptr_t newItem = UPAItem_ptr_t(new UPAItem(streamId, sub));
-    ItemArray_[index] = newItem;
     return streamId;
 }
 
-UPAItem_ptr_t UPAStreamManager::GetItem( RsslUInt32 streamId )
+void UPAStreamManager::ReturnStreamRange(RsslUInt32 firstStreamId, RsslUInt32 count)
 {
-    RsslUInt32 index = StreamId2Index(streamId);
-    return ItemArray_[index];
+    {
+        utils::thread::T42Lock lock(&streamLock_);
+        batchStreams_.erase(firstStreamId);
+    }
+
+    for (RsslUInt32 i = 0; i < count; ++i)
+    {
+        QuarantineIndex(firstStreamId - StartStreamID + i);
+    }
 }
 
-bool UPAStreamManager::ReleaseStreamId( RsslUInt32 streamId )
+void UPAStreamManager::SetItem(RsslUInt32 streamId, const UPASubscription_ptr_t& sub)
 {
-    utils::thread::T42Lock lock(&streamLock_);
+    UPAItem * newItem = new UPAItem(streamId, sub);
+    SlotAt(streamId - StartStreamID).item_.store(newItem, utils::thread::memory_order_release);
+}
+
+bool UPAStreamManager::ReleaseBatchStream(RsslUInt32 streamId)
+{
+    {
+        utils::thread::T42Lock lock(&streamLock_);
+        if (batchStreams_.erase(streamId) == 0)
+        {
+            return false;
+        }
+    }
+
+    // the batch stream never had an item on it, but the provider may still answer on it
+    QuarantineIndex(streamId - StartStreamID);
+    return true;
+}
+
+void UPAStreamManager::ReleaseBatchStreams()
+{
+    std::set<RsslUInt32> released;
+    {
+        utils::thread::T42Lock lock(&streamLock_);
+        released.swap(batchStreams_);
+    }
+
+    for (std::set<RsslUInt32>::const_iterator it = released.begin(); it != released.end(); ++it)
+    {
+        QuarantineIndex(*it - StartStreamID);
+    }
+}
+
+void UPAStreamManager::EnterReadEpoch()
+{
+    readerActive_.store(true);
+}
+
+void UPAStreamManager::LeaveReadEpoch()
+{
+    readerActive_.store(false);
+
+    if (retiredCount_.load(utils::thread::memory_order_relaxed) != 0)
+    {
+        Reclaim();
+    }
+}
+
+void UPAStreamManager::Reclaim()
+{
+    std::vector<UPAItem *> reclaimed;
+    {
+        utils::thread::T42Lock lock(&streamLock_);
+
+        // the retired items were unlinked from the table before they were retired. So once the reader is out of its
+        // epoch nobody can be holding them
+        if (readerActive_.load())
+        {
+            return;
+        }
+
+        reclaimed.swap(retiredItems_);
+        retiredCount_.store(0);
+    }
+
+    // delete outside the lock, releasing the item may release the subscription
+    for (size_t i = 0; i < reclaimed.size(); ++i)
+    {
+        delete reclaimed[i];
+    }
+}
+
+bool UPAStreamManager::EnsureSegment(RsslUInt32 index)
+{
+    utils::thread::atomic<Segment *> & entry = segments_[index >> SegmentShift];
+    if (entry.load(utils::thread::memory_order_acquire) != 0)
+    {
+        return true;
+    }
 
-    RsslUInt32 index = StreamId2Index(streamId);
-    ItemArray_[index].reset();
+    Segment * segment = new (std::nothrow) Segment();
+    if (segment == 0)
+    {
+        return false;
+    }
+
+    Segment * expected = 0;
+    if (!entry.compare_exchange_strong(expected, segment))
+    {
+        // someone else got there first
+        delete segment;
+    }
 
-    // add the index to the free list
-    freeStreamIds_.push(index);
     return true;
 }
 
+bool UPAStreamManager::PopFreeIndex(RsslUInt32 & index)
+{
+    RsslUInt64 head = freeHead_.load(utils::thread::memory_order_acquire);
+    for (;;)
+    {
+        RsslUInt32 top = (RsslUInt32)(head & 0xffffffff);
+        if (top == EmptyFreeList)
+        {
+            return false;
+        }
+
+        RsslUInt32 next = SlotAt(top).nextFree_.load(utils::thread::memory_order_relaxed);
+        RsslUInt64 newHead = (((head >> 32) + 1) << 32) | next;
+        if (freeHead_.compare_exchange_weak(head, newHead, utils::thread::memory_order_acq_rel, utils::thread::memory_order_acquire))
+        {
+            index = top;
+            return true;
+        }
+    }
+}
+
+void UPAStreamManager::PushFreeIndex(RsslUInt32 index)
+{
+    Slot & slot = SlotAt(index);
+    RsslUInt64 head = freeHead_.load(utils::thread::memory_order_relaxed);
+    for (;;)
+    {
+        slot.nextFree_.store((RsslUInt32)(head & 0xffffffff), utils::thread::memory_order_relaxed);
+        RsslUInt64 newHead = (((head >> 32) + 1) << 32) | index;
+        if (freeHead_.compare_exchange_weak(head, newHead, utils::thread::memory_order_release, utils::thread::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+}
+
+void UPAStreamManager::QuarantineIndex(RsslUInt32 index)
+{
+    utils::thread::T42Lock lock(&streamLock_);
+    quarantine_.push_back(std::make_pair(index, utils::time::GetMicroCount()));
+}
+
+bool UPAStreamManager::ReleaseQuarantined()
+{
+    RsslUInt64 now = utils::time::GetMicroCount();
+    bool released = false;
+
+    utils::thread::T42Lock lock(&streamLock_);
+    while (!quarantine_.empty() && now - quarantine_.front().second >= RecycleGracePeriod)
+    {
+        PushFreeIndex(quarantine_.front().first);
+        quarantine_.pop_front();
+        released = true;
+    }
+    return released;
+}
 
 
 UPAItem::UPAItem(RsslUInt32 streamId, const UPASubscription_ptr_t& sub )
@@ -29,9 +29,13 @@
 #include "rtr/rsslState.h"
 #include "rmdsBridgeTypes.h"
 #include "StatisticsLogger.h"
+#include "UPAOpenThrottle.h"
 
 #include <utils/thread/lock.h>
 #include <utils/namespacedefines.h>
+#include <utils/time.h>
+
+#include <deque>
 
 // manage generation of stream IDs
 class UPAItem
@@ -52,6 +56,16 @@ private:
 } ;
 
 
+// The stream table maps the stream id on each incoming message to its item. It is read for every message so the read
+// side takes no locks and touches no reference counts.
+//
+// The table is a directory of fixed size segments that are allocated as the stream ids are handed out, so there is no
+// hard limit beyond the size of the directory. Released stream ids are held in quarantine, oldest first, until the
+// provider has had time to act on the close, and then go onto a lock-free free list threaded through the slots.
+//
+// GetItem returns a borrowed pointer that is only valid inside a read epoch (see ReadEpoch). An item that is released
+// while a reader is inside its epoch is retired rather than deleted, and is reclaimed when the reader leaves the epoch.
+// The consumer thread is the only reader so there is only the one reader epoch to track.
 
 class UPAStreamManager
 {
@@ -62,10 +76,68 @@ public:
    // subscriber items
    RsslUInt32 AddItem(const UPASubscription_ptr_t& sub);
 
-   UPAItem_ptr_t GetItem(RsslUInt32 streamId);
+   // the item is borrowed - don't hold onto it outside the current read epoch
+   UPAItem * GetItem(RsslUInt32 streamId) const
+   {
+      RsslUInt32 index = streamId - StartStreamID;
+      if (streamId < StartStreamID || index >= SegmentSize * MaxSegments)
+      {
+         return 0;
+      }
+
+      Segment * segment = segments_[index >> SegmentShift].load(utils::thread::memory_order_acquire);
+      if (segment == 0)
+      {
+         return 0;
+      }
+
+      // seq_cst so the load is ordered after the store that entered the read epoch
+      return segment->slots_[index & SegmentMask].item_.load();
+   }
 
    bool ReleaseStreamId(RsslUInt32 streamId);
 
+   // A batch request takes a range of consecutive stream ids. The first is the stream of the request itself, which the
+   // provider closes once it has opened the items on the streams that follow. The range always comes from fresh ids as
+   // the free list isnt contiguous. Returns the first id, or 0 if there is no room
+   RsslUInt32 ReserveStreamRange(RsslUInt32 count);
+
+   // give back a range that wasnt used
+   void ReturnStreamRange(RsslUInt32 firstStreamId, RsslUInt32 count);
+
+   // put an item on a stream id from a reserved range
+   void SetItem(RsslUInt32 streamId, const UPASubscription_ptr_t& sub);
+
+   // the provider has closed a batch request's stream. Returns false if it isnt one
+   bool ReleaseBatchStream(RsslUInt32 streamId);
+
+   // the streams of the batch requests on the last channel dont exist on a new one
+   void ReleaseBatchStreams();
+
+   // bracket the reads of the table, items released inside the epoch are not deleted until it ends
+   void EnterReadEpoch();
+   void LeaveReadEpoch();
+
+   class ReadEpoch
+   {
+   public:
+      ReadEpoch(UPAStreamManager & mgr)
+         : mgr_(mgr)
+      {
+         mgr_.EnterReadEpoch();
+      }
+
+      ~ReadEpoch()
+      {
+         mgr_.LeaveReadEpoch();
+      }
+
+   private:
+      UPAStreamManager & mgr_;
+      ReadEpoch(const ReadEpoch &);
+      ReadEpoch & operator=(const ReadEpoch &);
+   };
+
    // manage the pending items count
    // at the moment this all runs on the single upa thread so no need for serializing access
    RsslUInt64 countPendingItems() const
@@ -77,9 +149,10 @@ public:
    {
       utils::thread::T42Lock lock(&streamLock_);
 
-      pendingItems_.emplace(sub);
+      pendingItems_[sub] = utils::time::GetMicroCount();
    }
 
+   // the open was cancelled, or failed before it reached the ADS
    bool removePendingItem(UPASubscription *sub)
    {
       utils::thread::T42Lock lock(&streamLock_);
@@ -94,6 +167,35 @@ public:
       return found;
    }
 
+   // the ADS has responded to the open. The time it took goes to the open throttle
+   bool completePendingItem(UPASubscription *sub)
+   {
+      utils::thread::T42Lock lock(&streamLock_);
+
+      pending_items_t::iterator it = pendingItems_.find(sub);
+      if (pendingItems_.end() == it)
+      {
+          return false;
+      }
+
+      openThrottle_.OnResponse(utils::time::GetMicroCount() - it->second);
+      pendingItems_.erase(it);
+      return true;
+   }
+
+   // the number of opens that may be outstanding at once
+   size_t OpenWindow() const
+   {
+      utils::thread::T42Lock lock(&streamLock_);
+      return openThrottle_.Window();
+   }
+
+   void ConfigureOpenThrottle(bool adaptive, size_t initial, size_t minimum, size_t maximum)
+   {
+      utils::thread::T42Lock lock(&streamLock_);
+      openThrottle_.Configure(adaptive, initial, minimum, maximum);
+   }
+
    // The number of items that have been opened
    RsslUInt64 OpenItems() const
    {
@@ -135,19 +237,76 @@ public:
 private:
    static void* Track(void* p);
 
-   UPAItem_ptr_t * ItemArray_;
+   static const RsslUInt32 StartStreamID = 16;
+   static const RsslUInt32 SegmentShift = 12;
+   static const RsslUInt32 SegmentSize = 1 << SegmentShift;         // 4k streams per segment
+   static const RsslUInt32 SegmentMask = SegmentSize - 1;
+   static const RsslUInt32 MaxSegments = 0x8000;                    // up to 128M streams
+   static const RsslUInt32 EmptyFreeList = 0xffffffff;
+
+   // we dont recycle stream ids until we have handed out this many, to give any messages still in flight on a
+   // closed stream the chance to drain before the id gets reused
+   static const RsslUInt32 RecycleThreshold = 0x40000;
+
+   // and a released id stays in quarantine for this long, so that the provider's late refreshes and updates for the
+   // old item cant be taken for the new one
+   static const RsslUInt64 RecycleGracePeriod = 10 * 1000000;     // microseconds
 
-   RsslUInt32 nextIndex_;
-   RsslUInt32 nextPubIndex_;
-   typedef utils::collection::unordered_set<UPASubscription *> pending_items_t;
+   struct Slot
+   {
+      utils::thread::atomic<UPAItem *> item_;
+      utils::thread::atomic<RsslUInt32> nextFree_;
+   };
+
+   struct Segment
+   {
+      Segment();
+      Slot slots_[SegmentSize];
+   };
+
+   Slot & SlotAt(RsslUInt32 index) const
+   {
+      return segments_[index >> SegmentShift].load(utils::thread::memory_order_acquire)->slots_[index & SegmentMask];
+   }
+
+   bool EnsureSegment(RsslUInt32 index);
+
+   // the free list is a stack of slot indexes. The head carries a tag in the top 32 bits that is bumped on every
+   // change, so a pop that races with a pop / push of the same index fails its compare and swap. Only ids that have
+   // served their quarantine are pushed onto it
+   bool PopFreeIndex(RsslUInt32 & index);
+   void PushFreeIndex(RsslUInt32 index);
+
+   // released ids go into quarantine in the order they were released, with the time they were released
+   void QuarantineIndex(RsslUInt32 index);
+
+   // move the ids that have served their quarantine onto the free list, returning false if there were none
+   bool ReleaseQuarantined();
+
+   // reclaim the retired items, if the reader isn't in its epoch
+   void Reclaim();
+
+   utils::thread::atomic<Segment *> * segments_;
+
+   utils::thread::atomic<RsslUInt32> nextIndex_;
+   utils::thread::atomic<RsslUInt64> freeHead_;
+
+   typedef std::deque<std::pair<RsslUInt32, RsslUInt64> > quarantine_t;
+   quarantine_t quarantine_;
+
+   // epoch based reclamation for the single reader
+   utils::thread::atomic<bool> readerActive_;
+   utils::thread::atomic<size_t> retiredCount_;
+   std::vector<UPAItem *> retiredItems_;
+
+   // the pending items, with the time their open was sent
+   typedef utils::collection::unordered_map<UPASubscription *, RsslUInt64> pending_items_t;
    pending_items_t pendingItems_;
+   UPAOpenThrottle openThrottle_;
+   std::set<RsslUInt32> batchStreams_;
    RsslUInt64 openItems_;
    RsslUInt64 pendingCloses_;
 
-   // free list
-   typedef std::queue<RsslUInt32> streamIdList_t;
-   streamIdList_t freeStreamIds_;
-
    mutable utils::thread::lock_t streamLock_;
 };
 
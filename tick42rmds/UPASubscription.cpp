@@ -55,15 +55,27 @@ using namespace utils::thread;
 int MonthFromName(char * monthName);
 
 UPASubscription::UPASubscription(const std::string&  sourceName, const std::string& symbol, bool logRmdsValues )
-    :sourceName_(sourceName), symbol_(symbol),  msgTotal_(0), streamId_(0),    msgNum_(0), msgSeqNum_(0), state_(SubscriptionStateInactive), subscriptionType_(SubscriptionTypeUnknown), logRmdsValues_(logRmdsValues),
+    :sourceName_(sourceName), symbol_(symbol),  msgTotal_(0), streamId_(0), streamGeneration_(0), msgNum_(0), msgSeqNum_(0), state_(SubscriptionStateInactive), subscriptionType_(SubscriptionTypeUnknown), logRmdsValues_(logRmdsValues),
     numDecodeFailures_(0), numDecodeFailuresLast_(0), timeLastReport_(0),openCloseCount_(0), gotInitial_(false), isSnapshot_(false),isRefresh_(false),
-    reportedMFeedNotSupported_(false), reportedAnsiNotSupported_(false), sendRecap_(true), useCallbacks_(false), sendAckMessages_(true), asyncMessaging_(false)
+    reportedMFeedNotSupported_(false), reportedAnsiNotSupported_(false), sendRecap_(true), useCallbacks_(false), sendAckMessages_(true), asyncMessaging_(false), asyncMessageCount_(0),
+    conflate_(false), conflationMaxLatency_(0), conflationWatched_(false),
+    cacheImage_(false), cachedImage_(NULL), cacheValid_(false), lastActivity_(0)
 {
+    listeners_ = boost::make_shared<SubscriptionResponseListenersVector_t>();
     t42log_debug("created new subscription for %s on stream %d\n", symbol_.c_str(), streamId_);
 }
 
 UPASubscription::~UPASubscription()
 {
+    for (std::vector<AsyncQueueState_ptr_t>::const_iterator it = asyncQueueStates_.begin(); it != asyncQueueStates_.end(); ++it)
+    {
+        ReleasePendingUpdate(**it);
+    }
+
+    if (cachedImage_ != NULL)
+    {
+        mamaMsg_destroy(cachedImage_);
+    }
 }
 
 bool UPASubscription::Open(const UPAConsumer_ptr_t& consumer )
@@ -92,6 +104,21 @@ bool UPASubscription::Open(const UPAConsumer_ptr_t& consumer )
     useCallbacks_ = config_->getBool("use-callbacks", Default_useCallbacks);
     sendAckMessages_ = config_->getBool("send-ack-messages", Default_sendAckMessage);
     asyncMessaging_ = config_->getBool("async-messaging", Default_asyncMessaging);
+    if (asyncMessaging_)
+    {
+        messagePool_ = consumer->GetOwner()->MessagePool();
+
+        // conflation can be set for the transport and overridden for each source
+        bool conflate = config_->getBool("conflation", Default_conflation);
+        conflate_ = config_->getServicePropertyBool(sourceName_, "conflation", conflate);
+        int maxLatency = config_->getInt("conflation-max-latency", Default_conflationMaxLatency);
+        maxLatency = config_->getServicePropertyInt(sourceName_, "conflation-max-latency", maxLatency);
+        conflationMaxLatency_ = (maxLatency > 0) ? (RsslUInt64)maxLatency * 1000 : 0;
+    }
+
+    // the last value cache can be set for the transport and overridden for each source
+    bool cacheImage = config_->getBool("last-value-cache", Default_lastValueCache);
+    cacheImage_ = config_->getServicePropertyBool(sourceName_, "last-value-cache", cacheImage);
 
     t42log_debug("queue open request for %s on stream %d\n", symbol_.c_str(), streamId_);
     QueueOpenRequest();
@@ -198,7 +225,11 @@ void MAMACALLTYPE UPASubscription::SubscriptionSnapshotRequestCb(mamaQueue queue
 
     if (sub->GetSubscriptionState() == SubscriptionStateSubscribing)
     {
-        sub->SendOpenRequest(true);
+        // only go to the ADS if we cant answer from the cache of a live subscription on the item
+        if (!sub->SendCachedSnapshot())
+        {
+            sub->SendOpenRequest(true);
+        }
     }
     else
     {
@@ -217,7 +248,10 @@ void MAMACALLTYPE UPASubscription::SubscriptionRefreshRequestCb(mamaQueue queue,
 
     if (sub->GetSubscriptionState() == SubscriptionStateSubscribing || sub->GetSubscriptionState() == SubscriptionStateLive)
     {
-        sub->SendOpenRequest(false);
+        if (!sub->SendCachedImage())
+        {
+            sub->SendOpenRequest(false);
+        }
     }
     else
     {
@@ -232,6 +266,13 @@ bool UPASubscription::SendOpenRequest( bool isSnapshot )
     RsslError error;
     RsslBuffer* msgBuf = 0;
 
+    // an item that hasnt got a stream on this channel yet can go in a batch request, which the consumer sends once it
+    // has dispatched the queued requests
+    if ((streamId_ == 0 || streamGeneration_ != consumer_->ChannelGeneration()) && consumer_->BatchOpen(shared_from_this(), isSnapshot))
+    {
+        return true;
+    }
+
     // if we dont already have a stream id allocated;
     if (streamId_ == 0)
     {
@@ -246,6 +287,14 @@ bool UPASubscription::SendOpenRequest( bool isSnapshot )
         return false;
     }
 
+    // when the consumer is replaying a capture there is no channel, it just needs to know the stream has been opened
+    if (!consumer_->ItemOpened(streamId_, DomainType(), sourceName_, symbol_))
+    {
+        consumer_->StatsSubscribed();
+        consumer_->StreamManager().addPendingItem(this);
+        return true;
+    }
+
     RsslChannel * UPAChannel = consumer_->RsslConsumerChannel();
 
     // get a buffer for the item request
@@ -263,6 +312,7 @@ bool UPASubscription::SendOpenRequest( bool isSnapshot )
         }
 
         t42log_debug("Send Open for %s on stream %d\n", Symbol().c_str(), streamId_);
+        streamGeneration_ = consumer_->ChannelGeneration();
 
         consumer_->StatsSubscribed();
         // Update the pending opens count]
@@ -283,6 +333,41 @@ bool UPASubscription::SendOpenRequest( bool isSnapshot )
 }
 
 
+void UPASubscription::OpenInBatch(RsslUInt32 streamId)
+{
+    UPAStreamManager &mgr = consumer_->StreamManager();
+
+    // a stream from before a reconnect is no use on the new channel
+    if (streamId_ != 0)
+    {
+        mgr.ReleaseStreamId(streamId_);
+    }
+
+    streamId_ = streamId;
+    streamGeneration_ = consumer_->ChannelGeneration();
+    mgr.SetItem(streamId_, shared_from_this());
+
+    consumer_->ItemOpened(streamId_, DomainType(), sourceName_, symbol_);
+    consumer_->StatsSubscribed();
+
+    // restart the clock on the pending open now the request is going out
+    mgr.addPendingItem(this);
+}
+
+RsslUInt8 UPASubscription::DomainType() const
+{
+    switch (subscriptionType_)
+    {
+    case SubscriptionTypeMarketByOrder:
+        return RSSL_DMT_MARKET_BY_ORDER;
+    case SubscriptionTypeMarketByPrice:
+        return RSSL_DMT_MARKET_BY_PRICE;
+    case SubscriptionTypeMarketPrice:
+        return RSSL_DMT_MARKET_PRICE;
+    default:
+        return 0;
+    }
+}
 
 // Encode an item request
 // Set the DMT domain according to the subscription type
@@ -348,6 +433,14 @@ RsslRet UPASubscription::EncodeItemRequest(RsslChannel* UPAChannel, RsslBuffer*
 
     msg.msgBase.msgKey.serviceId = (RsslUInt16) source_->ServiceId();
 
+    // ask for just the fields we pass on, if the source has a view
+    bool view = consumer_->ViewsSupported() && source_->HasView();
+    if (view)
+    {
+        msg.flags |= RSSL_RQMF_HAS_VIEW;
+        msg.msgBase.containerType = RSSL_DT_ELEMENT_LIST;
+    }
+
     // encode the message
     if ((ret = rsslSetEncodeIteratorBuffer(&encodeIter, msgBuffer)) < RSSL_RET_SUCCESS)
     {
@@ -361,6 +454,28 @@ RsslRet UPASubscription::EncodeItemRequest(RsslChannel* UPAChannel, RsslBuffer*
         return ret;
     }
 
+    if (view)
+    {
+        RsslElementList elementList = RSSL_INIT_ELEMENT_LIST;
+        elementList.flags = RSSL_ELF_HAS_STANDARD_DATA;
+        if ((ret = rsslEncodeElementListInit(&encodeIter, &elementList, 0, 0)) < RSSL_RET_SUCCESS)
+        {
+            t42log_error("rsslEncodeElementListInit() failed with return code: %d\n", ret);
+            return ret;
+        }
+
+        if ((ret = source_->EncodeView(&encodeIter)) < RSSL_RET_SUCCESS)
+        {
+            return ret;
+        }
+
+        if ((ret = rsslEncodeElementListComplete(&encodeIter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+        {
+            t42log_error("rsslEncodeElementListComplete() failed with return code: %d\n", ret);
+            return ret;
+        }
+    }
+
     if ((ret = rsslEncodeMsgComplete(&encodeIter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
     {
         t42log_error("rsslEncodeMsgComplete() failed with return code: %d\n", ret);
@@ -387,7 +502,7 @@ RsslRet UPASubscription::InternalProcessMarketPriceResponse(RsslMsg* msg, RsslDe
         if (!gotInitial_)
         {
             t42log_debug("got response on closed item no initial - dec pending items count for %s on stream %d\n", symbol_.c_str(), streamId_);
-            mgr.removePendingItem(this);
+            mgr.completePendingItem(this);
         }
         return RSSL_RET_SUCCESS;
     }
@@ -396,7 +511,7 @@ RsslRet UPASubscription::InternalProcessMarketPriceResponse(RsslMsg* msg, RsslDe
     {
         // response to a subscribe message so decrement  the count
         t42log_debug("got response - dec pending items count for %s on stream %d\n", symbol_.c_str(), streamId_);
-        bool found = mgr.removePendingItem(this);
+        bool found = mgr.completePendingItem(this);
         gotInitial_ = true;
     }
 
@@ -429,7 +544,7 @@ RsslRet UPASubscription::InternalProcessMarketPriceResponse(RsslMsg* msg, RsslDe
         if (isRefresh_)
         {
             // Remove recap from pending items
-            mgr.removePendingItem(this);
+            mgr.completePendingItem(this);
         }
 
         if (!SetRsslState(&msg->refreshMsg.state))
@@ -543,6 +658,11 @@ RsslRet UPASubscription::InternalProcessMarketPriceResponse(RsslMsg* msg, RsslDe
                     // return RSSL_RET_SUCCESS otherwise it will shut down the thread
                     return RSSL_RET_SUCCESS;
                 }
+
+                if (cacheImage_ && !isSnapshot_)
+                {
+                    UpdateCachedImage(msg);
+                }
             }
 
             // bump the mama message num fields
@@ -775,6 +895,9 @@ bool UPASubscription::SetStale(const char* msg)
     {
         SetSubscriptionState(SubscriptionStateStale);
 
+        // the cached image cant be trusted until we get a new one
+        cacheValid_ = false;
+
         if (msg != NULL)
         {
             mamaMsg_addString(msg_, MamaFieldFeedName.mName, MamaFieldFeedName.mFid, msg);
@@ -833,7 +956,18 @@ bool UPASubscription::SetLive()
 
 bool UPASubscription::ReSubscribe()
 {
-    return Open(consumer_);
+    // on the same consumer with the same field map, the settings that Open reads from the config cant have changed.
+    // So when a recovery resubscribes every item, there is just the request to send again
+    if (isSnapshot_ || consumer_->GetOwner()->FieldMap() != fieldmap_)
+    {
+        return Open(consumer_);
+    }
+
+    SetSubscriptionState(SubscriptionStateSubscribing);
+    t42log_debug("queue reopen request for %s on stream %d\n", symbol_.c_str(), streamId_);
+    QueueOpenRequest();
+
+    return true;
 }
 
 void UPASubscription::LogRsslState(RsslState* state)
@@ -979,6 +1113,13 @@ RsslRet UPASubscription::CloseStream(RsslChannel* UPAChannel, RsslInt32 streamId
     RsslError error;
     RsslBuffer* msgBuff = 0;
 
+    if (!consumer_->ItemClosed(streamId))
+    {
+        // replaying, so there is nothing to send
+        consumer_->StreamManager().DecOpenItems();
+        return RSSL_RET_SUCCESS;
+    }
+
     // get a buffer for the item close
     msgBuff = rsslGetBuffer(UPAChannel, consumer_->MaxMessageSize(), RSSL_FALSE, &error);
 
@@ -1144,7 +1285,7 @@ RsslRet UPASubscription::InternalProcessMarketByOrderResponse(RsslMsg* msg, Rssl
         if (!gotInitial_)
         {
             t42log_debug("got response on closed item no initial - dec pending items count for %s on stream %d\n", symbol_.c_str(), streamId_);
-            mgr.removePendingItem(this);
+            mgr.completePendingItem(this);
         }
         return RSSL_RET_SUCCESS;
     }
@@ -1153,7 +1294,7 @@ RsslRet UPASubscription::InternalProcessMarketByOrderResponse(RsslMsg* msg, Rssl
     {
         // response to a subscribe message so decrement  the count
         t42log_debug("got response - dec pending items count for %s on stream %d\n", symbol_.c_str(), streamId_);
-        mgr.removePendingItem(this);
+        mgr.completePendingItem(this);
         gotInitial_ = true;
 
     }
@@ -1189,7 +1330,7 @@ RsslRet UPASubscription::InternalProcessMarketByOrderResponse(RsslMsg* msg, Rssl
         if (isRefresh_)
         {
             // Remove recap from pending items
-            mgr.removePendingItem(this);
+            mgr.completePendingItem(this);
         }
 
         // then just fall through
@@ -1324,8 +1465,13 @@ RsslRet UPASubscription::InternalProcessMarketByOrderResponse(RsslMsg* msg, Rssl
                     {
                         const char* actionString;
 
-                        UPABookEntry_ptr_t entry = UPABookEntry_ptr_t(new UPABookEntry);
-                        entry.use_count();
+                        // the book takes what it needs from the entry, so one entry is reused for the whole message
+                        if (!bookEntry_)
+                        {
+                            bookEntry_.reset(new UPABookEntry);
+                        }
+                        const UPABookEntry_ptr_t& entry = bookEntry_;
+                        entry->Clear();
 
                         /* convert the action to a string for display purposes */
                         switch(mapEntry.action)
@@ -1386,11 +1532,11 @@ RsslRet UPASubscription::InternalProcessMarketByOrderResponse(RsslMsg* msg, Rssl
 
                                 if (mapEntry.action == RSSL_MPEA_ADD_ENTRY )
                                 {
-                                    bookByOrderMessage_.AddEntry(entry);
+                                    bookByOrderMessage_.AddEntry(*entry);
                                 }
                                 else if (mapEntry.action == RSSL_MPEA_UPDATE_ENTRY)
                                 {
-                                    bookByOrderMessage_.UpdateEntry(entry);
+                                    bookByOrderMessage_.UpdateEntry(*entry);
                                 }
                             }
                             else
@@ -1403,7 +1549,7 @@ RsslRet UPASubscription::InternalProcessMarketByOrderResponse(RsslMsg* msg, Rssl
                         else
                         {
                             // do an entry delete
-                            bookByOrderMessage_.RemoveEntry(entry);
+                            bookByOrderMessage_.RemoveEntry(*entry);
                         }
                     }
                     else
@@ -1415,8 +1561,8 @@ RsslRet UPASubscription::InternalProcessMarketByOrderResponse(RsslMsg* msg, Rssl
                     }
                 }
 
-                // now render the OpenMama message
-                bookByOrderMessage_.BuildMamdaMessage(msg_);
+                // now render the OpenMama message. Images carry the whole book, updates just the levels they changed
+                bookByOrderMessage_.BuildMamdaMessage(msg_, isRefreshMsg || (msgType != MAMA_MSG_TYPE_BOOK_UPDATE));
 
                 // send the message
                 setMsgNum(false);
@@ -1505,7 +1651,7 @@ RsslRet UPASubscription::InternalProcessMarketByPriceResponse(RsslMsg* msg, Rssl
         if (!gotInitial_)
         {
             t42log_debug("got response on closed item no initial - dec pending items count for %s on stream %d\n", symbol_.c_str(), streamId_);
-            mgr.removePendingItem(this);
+            mgr.completePendingItem(this);
         }
         return RSSL_RET_SUCCESS;
     }
@@ -1515,7 +1661,7 @@ RsslRet UPASubscription::InternalProcessMarketByPriceResponse(RsslMsg* msg, Rssl
         // response to a subscribe message so decrement the count
 
         t42log_debug("got response - dec pending items count for %s on stream %d\n", symbol_.c_str(), streamId_);
-        mgr.removePendingItem(this);
+        mgr.completePendingItem(this);
         gotInitial_ = true;
 
     }
@@ -1546,7 +1692,7 @@ RsslRet UPASubscription::InternalProcessMarketByPriceResponse(RsslMsg* msg, Rssl
         if (isRefresh_)
         {
             // Remove recap from pending items
-            mgr.removePendingItem(this);
+            mgr.completePendingItem(this);
         }
 
         // then just fall thorugh
@@ -1946,8 +2092,8 @@ RsslRet UPASubscription::InternalProcessMarketByPriceResponse(RsslMsg* msg, Rssl
 
 void UPASubscription::setLineTime()
 {
-    return;
-
+    // the consumer's message count stands in for the time, so this doesnt have to read the clock for every message
+    lastActivity_ = consumer_->MessageSequence();
 }
 
 void UPASubscription::SendStatusMsg(mamaMsgStatus secStatus)
@@ -1958,6 +2104,15 @@ void UPASubscription::SendStatusMsg(mamaMsgStatus secStatus)
 
 void UPASubscription::NotifyListenersMessage( mamaMsg msg, mamaMsgType msgType )
 {
+    const StatisticsLogger_ptr_t& stats = consumer_->StatsLogger();
+    bool timed = stats->Enabled() && (consumer_->MessageStartTime() != 0);
+    RsslUInt64 decoded = 0;
+    if (timed)
+    {
+        decoded = utils::time::GetMicroCount();
+        stats->RecordDecodeTime(decoded - consumer_->MessageStartTime());
+    }
+
     if (asyncMessaging_)
     {
         NotifyListenersMessageAsync(msg, msgType);
@@ -1966,58 +2121,119 @@ void UPASubscription::NotifyListenersMessage( mamaMsg msg, mamaMsgType msgType )
     {
         NotifyListenersMessageSync(msg, msgType);
     }
+
+    if (timed)
+    {
+        stats->RecordFanoutTime(utils::time::GetMicroCount() - decoded);
+    }
 }
 
-void UPASubscription::NotifyListenersMessageAsync(mamaMsg msg, mamaMsgType msgType) const
+void UPASubscription::NotifyListenersMessageAsync(mamaMsg msg, mamaMsgType msgType)
 {
-    SubscriptionResponseListenersVector_t listenersSnap;
+    SubscriptionResponseListeners_ptr_t listenersSnap = Listeners();
+    if (listenersSnap->empty() || !messagePool_)
     {
-        T42Lock l(&subscriptionLock_);
-        // take a snap of the vector in case anything gets removed on the other thread
-        listenersSnap = listeners_;
+        return;
+    }
+
+    conflatedQueues_.clear();
+    if (conflate_)
+    {
+        if (msgType == MAMA_MSG_TYPE_UPDATE)
+        {
+            // hold the update back from the queues still working through the last one we sent them. If that is all of
+            // them there is nothing to send now
+            if (!ConflateUpdate(msg, listenersSnap))
+            {
+                return;
+            }
+        }
+        else
+        {
+            // dont let anything overtake the updates we are holding
+            FlushConflatedUpdates();
+        }
     }
 
-    msgPayload payload;
-    mamaMsgImpl_getPayload(msg, &payload);
+    // Copy the update once into a pooled message. All the listener queues share that one copy, each holding a
+    // reference, and the last queue to dispatch it gives it back to the pool. The copy reuses the payload storage of
+    // the pooled message, so in the steady state nothing is allocated here
+    mamaMsg newMsg = messagePool_->Acquire();
+    if (NULL == newMsg)
+    {
+        return;
+    }
 
-    mamaMsg newMsg;
-    mamaPayloadBridge bridge = mamaInternal_findPayload(MAMA_PAYLOAD_TICK42RMDS);
-    mamaMsg_createForPayloadBridge(&newMsg, bridge);
-//    mamaMsgImpl_useBridgePayload(newMsg, consumer_->GetOwner()->Bridge());
-    mamaMsgImpl_setBridgeImpl(newMsg, consumer_->GetOwner()->Bridge());
+    if (MAMA_STATUS_OK != mamaMsg_copy(msg, &newMsg))
+    {
+        t42log_warn("Failed to copy async message for %s\n", symbol_.c_str());
+        messagePool_->Release(newMsg);
+        return;
+    }
 
-    msgBridge newBridgeMessage;
-    mamaMsgImpl_getBridgeMsg(newMsg, &newBridgeMessage);
+    FanOutAsync(newMsg, msgType);
+}
 
-//    msgPayload emptyPayload;
-//    mamaMsgImpl_getPayload(newMsg, &emptyPayload);
+void UPASubscription::FanOutAsync(mamaMsg newMsg, mamaMsgType msgType, mamaQueue onlyQueue)
+{
+    SubscriptionResponseListeners_ptr_t listenersSnap = Listeners();
 
-//    mamaMsgImpl_setPayload(newMsg, payload, 1);
-//    mamaMsgImpl_setPayload(msg, emptyPayload, 1);
+    msgBridge newBridgeMessage;
+    mamaMsgImpl_getBridgeMsg(newMsg, &newBridgeMessage);
 
-    mamaMsg_copy(msg, &newMsg);
+    // hold our own reference while we fan out, otherwise a queue that dispatches quickly could give the message back
+    // to the pool before the later listeners have been handed it
+    tick42rmdsBridgeMamaMsgImpl_increaseReferences(newBridgeMessage);
 
-    typedef utils::collection::unordered_set<mamaQueue> QueuesMap;
-    QueuesMap queues;
+    asyncQueues_.clear();
 
-    SubscriptionResponseListenersVector_t::iterator it = listenersSnap.begin();
-    while(it != listenersSnap.end() )
+    SubscriptionResponseListenersVector_t::const_iterator it = listenersSnap->begin();
+    while(it != listenersSnap->end() )
     {
-        RMDSBridgeSubscription_ptr_t sub = *it;
+        const RMDSBridgeSubscription_ptr_t& sub = *it;
         it++;
 
-        tick42rmdsBridgeMamaMsgImpl_increaseReferences(newBridgeMessage);
+        mamaQueue queue = sub->Queue();
+        if (onlyQueue != NULL)
+        {
+            if (queue != onlyQueue)
+            {
+                continue;
+            }
+        }
+        else if (std::find(conflatedQueues_.begin(), conflatedQueues_.end(), queue) != conflatedQueues_.end())
+        {
+            continue;
+        }
 
+        // takes a reference if it queues the message
         sub->OnMessage(newMsg, msgType, true);
 
-        queues.insert(sub->Queue());
+        if (std::find(asyncQueues_.begin(), asyncQueues_.end(), queue) == asyncQueues_.end())
+        {
+            asyncQueues_.push_back(queue);
+        }
+    }
+
+    size_t references = 0;
+    tick42rmdsBridgeMamaMsgImpl_decreaseReferences(newBridgeMessage, references);
+    if (references == 0)
+    {
+        // nobody queued it
+        messagePool_->Release(newMsg);
+    }
+
+    // the queue depth is only reported in the statistics so dont sample it on every update
+    if ((++asyncMessageCount_ % QueueDepthSampleInterval) != 0)
+    {
+        return;
     }
 
     size_t queuesSize = 0;
-    for (const QueuesMap::value_type& queueValue : queues)
+    for (std::vector<mamaQueue>::const_iterator itQueue = asyncQueues_.begin(); itQueue != asyncQueues_.end(); ++itQueue)
     {
         size_t queueSize = 0;
-        mama_status status = mamaQueue_getEventCount(queueValue, &queueSize);
+        mama_status status = mamaQueue_getEventCount(*itQueue, &queueSize);
         if (status != MAMA_STATUS_OK)
         {
             queueSize = 0;
@@ -2029,17 +2245,270 @@ void UPASubscription::NotifyListenersMessageAsync(mamaMsg msg, mamaMsgType msgTy
     consumer_->SetQueueEventsCount(queuesSize);
 }
 
-void UPASubscription::NotifyListenersMessageSync(mamaMsg msg, mamaMsgType msgType) const
+UPASubscription::AsyncQueueState_ptr_t UPASubscription::QueueState(mamaQueue queue) const
+{
+    for (std::vector<AsyncQueueState_ptr_t>::const_iterator it = asyncQueueStates_.begin(); it != asyncQueueStates_.end(); ++it)
+    {
+        if ((*it)->queue == queue)
+        {
+            return *it;
+        }
+    }
+    return AsyncQueueState_ptr_t();
+}
+
+UPASubscription::AsyncQueueState_ptr_t UPASubscription::AsyncMessageQueued(mamaQueue queue)
+{
+    if (!conflate_)
+    {
+        return AsyncQueueState_ptr_t();
+    }
+
+    // the listeners only queue async messages from FanOutAsync, on the consumer thread
+    AsyncQueueState_ptr_t state = QueueState(queue);
+    if (!state)
+    {
+        state = boost::make_shared<AsyncQueueState>(queue);
+        asyncQueueStates_.push_back(state);
+    }
+
+    // count it in flight before the queue can dispatch it
+    state->inFlight.fetch_add(1, memory_order_seq_cst);
+    return state;
+}
+
+bool UPASubscription::ConflateUpdate(mamaMsg msg, const SubscriptionResponseListeners_ptr_t& listeners)
+{
+    RsslUInt64 now = 0;
+    for (std::vector<AsyncQueueState_ptr_t>::const_iterator it = asyncQueueStates_.begin(); it != asyncQueueStates_.end(); ++it)
+    {
+        AsyncQueueState& state = **it;
+        if (state.pendingMsg == NULL && state.inFlight.load(memory_order_seq_cst) == 0)
+        {
+            // this queue has caught up so is sent the update now
+            continue;
+        }
+
+        bool listening = false;
+        for (SubscriptionResponseListenersVector_t::const_iterator itSub = listeners->begin(); itSub != listeners->end(); ++itSub)
+        {
+            if ((*itSub)->Queue() == state.queue)
+            {
+                listening = true;
+                break;
+            }
+        }
+        if (!listening)
+        {
+            continue;
+        }
+
+        if (now == 0)
+        {
+            now = utils::time::GetMicroCount();
+        }
+
+        if (ConflateInto(state, msg, now))
+        {
+            conflatedQueues_.push_back(state.queue);
+        }
+    }
+
+    if (conflatedQueues_.empty())
+    {
+        return true;
+    }
+
+    // is any listener left to send it to now
+    for (SubscriptionResponseListenersVector_t::const_iterator itSub = listeners->begin(); itSub != listeners->end(); ++itSub)
+    {
+        if (std::find(conflatedQueues_.begin(), conflatedQueues_.end(), (*itSub)->Queue()) == conflatedQueues_.end())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool UPASubscription::ConflateInto(AsyncQueueState& state, mamaMsg msg, RsslUInt64 now)
+{
+    if (state.pendingMsg == NULL)
+    {
+        state.pendingMsg = messagePool_->Acquire();
+        if (NULL == state.pendingMsg)
+        {
+            return false;
+        }
+
+        if (MAMA_STATUS_OK != mamaMsg_copy(msg, &state.pendingMsg))
+        {
+            t42log_warn("Failed to copy conflated message for %s\n", symbol_.c_str());
+            ReleasePendingUpdate(state);
+            return false;
+        }
+
+        state.pendingCount = 1;
+        state.pendingSince = now;
+
+        // have the consumer thread send it at the max latency if no later update does
+        if (conflationMaxLatency_ != 0)
+        {
+            if (!conflationWatched_)
+            {
+                conflationWatched_ = true;
+                consumer_->WatchConflation(shared_from_this());
+            }
+            consumer_->ConflationDeadline(now + conflationMaxLatency_);
+        }
+    }
+    else
+    {
+        // the latest value of each field wins
+        if (MAMA_STATUS_OK != mamaMsg_applyMsg(state.pendingMsg, msg))
+        {
+            t42log_warn("Failed to conflate message for %s\n", symbol_.c_str());
+        }
+        ++state.pendingCount;
+    }
+
+    // Publish that we are holding an update before looking at the messages in flight. The queue thread that
+    // dispatches the last one clears the count before it looks at this, so at least one of us sees the other
+    state.hasPending.store(true, memory_order_seq_cst);
+    if (state.inFlight.load(memory_order_seq_cst) == 0)
+    {
+        FlushConflatedUpdate(state);
+    }
+    else if (conflationMaxLatency_ != 0 && now - state.pendingSince >= conflationMaxLatency_)
+    {
+        // the queue is too slow to wait for
+        FlushConflatedUpdate(state);
+    }
+    return true;
+}
+
+void UPASubscription::FlushConflatedUpdate(AsyncQueueState& state)
+{
+    if (state.pendingMsg == NULL)
+    {
+        return;
+    }
+
+    mamaMsg msg = state.pendingMsg;
+    state.pendingMsg = NULL;
+    state.hasPending.store(false, memory_order_seq_cst);
+
+    mamaMsg_updateI32(msg, MamaFieldConflateCount.mName, MamaFieldConflateCount.mFid, state.pendingCount);
+    state.pendingCount = 0;
+
+    FanOutAsync(msg, MAMA_MSG_TYPE_UPDATE, state.queue);
+}
+
+void UPASubscription::FlushConflatedUpdates()
+{
+    for (std::vector<AsyncQueueState_ptr_t>::const_iterator it = asyncQueueStates_.begin(); it != asyncQueueStates_.end(); ++it)
+    {
+        FlushConflatedUpdate(**it);
+    }
+}
+
+bool UPASubscription::FlushExpiredConflation(RsslUInt64 now, RsslUInt64& nextDeadline)
 {
-    SubscriptionResponseListenersVector_t listenersSnap;
+    bool holding = false;
+    for (std::vector<AsyncQueueState_ptr_t>::const_iterator it = asyncQueueStates_.begin(); it != asyncQueueStates_.end(); ++it)
+    {
+        AsyncQueueState& state = **it;
+        if (state.pendingMsg == NULL)
+        {
+            continue;
+        }
+
+        RsslUInt64 deadline = state.pendingSince + conflationMaxLatency_;
+        if (now >= deadline)
+        {
+            FlushConflatedUpdate(state);
+            continue;
+        }
+
+        holding = true;
+        if (nextDeadline == 0 || deadline < nextDeadline)
+        {
+            nextDeadline = deadline;
+        }
+    }
+
+    // the next update to be held puts us back on the consumer's list
+    if (!holding)
+    {
+        conflationWatched_ = false;
+    }
+    return holding;
+}
+
+void UPASubscription::ReleasePendingUpdate(AsyncQueueState& state)
+{
+    if (state.pendingMsg != NULL)
+    {
+        messagePool_->Release(state.pendingMsg);
+        state.pendingMsg = NULL;
+        state.pendingCount = 0;
+    }
+    state.hasPending.store(false, memory_order_seq_cst);
+}
+
+void UPASubscription::AsyncMessageDispatched(const AsyncQueueState_ptr_t& queueState)
+{
+    if (!queueState || queueState->inFlight.fetch_sub(1, memory_order_seq_cst) != 1)
+    {
+        return;
+    }
+
+    // the queue has caught up, so send the update we have been holding for it. The pending message belongs to the
+    // consumer thread so hand the flush over to it
+    if (queueState->hasPending.load(memory_order_seq_cst) && !queueState->flushQueued.exchange(true, memory_order_acq_rel))
+    {
+        ConflationFlushClosure * closure = new ConflationFlushClosure(shared_from_this(), queueState);
+        if (MAMA_STATUS_OK != mamaQueue_enqueueEvent(consumer_->RequestQueue(), UPASubscription::ConflationFlushCb, (void*) closure))
+        {
+            queueState->flushQueued.store(false, memory_order_release);
+            delete closure;
+        }
+    }
+}
+
+void MAMACALLTYPE UPASubscription::ConflationFlushCb(mamaQueue queue, void *closure)
+{
+    ConflationFlushClosure * cl = (ConflationFlushClosure *)closure;
+    AsyncQueueState& state = *cl->State();
+
+    state.flushQueued.store(false, memory_order_release);
+
+    // if an update has arrived since, it will have been sent already
+    if (state.inFlight.load(memory_order_seq_cst) == 0)
+    {
+        cl->GetPtr()->FlushConflatedUpdate(state);
+    }
+
+    delete cl;
+}
+
+void UPASubscription::ReleaseAsyncMessage(mamaMsg msg)
+{
+    if (messagePool_)
+    {
+        messagePool_->Release(msg);
+    }
+    else
     {
-        T42Lock l(&subscriptionLock_);
-        // take a snap of the vector in case anything gets removed on the other thread
-        listenersSnap = listeners_;
+        mamaMsg_destroy(msg);
     }
+}
+
+void UPASubscription::NotifyListenersMessageSync(mamaMsg msg, mamaMsgType msgType) const
+{
+    SubscriptionResponseListeners_ptr_t listenersSnap = Listeners();
 
-    SubscriptionResponseListenersVector_t::iterator it = listenersSnap.begin();
-    while(it != listenersSnap.end() )
+    SubscriptionResponseListenersVector_t::const_iterator it = listenersSnap->begin();
+    while(it != listenersSnap->end() )
     {
         RMDSBridgeSubscription_ptr_t sub = *it;
         it++;
@@ -2055,15 +2524,10 @@ void UPASubscription::NotifyListenersRefreshMessage(mamaMsg msg, const RMDSBridg
     // the rest get a message type recap.
 
     // We send a recap to all the other subscriptions on this stream in case the platform has conflated any updates into the snapshot.
-    SubscriptionResponseListenersVector_t listenersSnap;
-    {
-        T42Lock l(&subscriptionLock_);
-        // take a snap of the vector in case anything gets removed on the other thread
-        listenersSnap = listeners_;
-    }
+    SubscriptionResponseListeners_ptr_t listenersSnap = Listeners();
 
-    SubscriptionResponseListenersVector_t::const_iterator itListener = listenersSnap.begin();
-    while(itListener != listenersSnap.end() )
+    SubscriptionResponseListenersVector_t::const_iterator itListener = listenersSnap->begin();
+    while(itListener != listenersSnap->end() )
     {
         // have to update the message type in here as this is where we know whether we are sending it to an existing subscription or one we have added to the stream
         const RMDSBridgeSubscription_ptr_t& listener = *itListener;
@@ -2098,15 +2562,10 @@ void UPASubscription::NotifyListenersRefreshMessage(mamaMsg msg, const RMDSBridg
 
 void UPASubscription::NotifyListenersStatus( mamaMsgStatus statusCode )
 {
-    SubscriptionResponseListenersVector_t listenersSnap;
-    {
-        T42Lock l(&subscriptionLock_);
-        // take a snap of the vector in case anything gets removed on the other thread
-        listenersSnap = listeners_;
-    }
+    SubscriptionResponseListeners_ptr_t listenersSnap = Listeners();
 
-    SubscriptionResponseListenersVector_t::iterator it = listenersSnap.begin();
-    while(it != listenersSnap.end() )
+    SubscriptionResponseListenersVector_t::const_iterator it = listenersSnap->begin();
+    while(it != listenersSnap->end() )
     {
         RMDSBridgeSubscription_ptr_t sub = *it;
         it++;
@@ -2121,15 +2580,10 @@ void UPASubscription::NotifyListenersError( mama_status statusCode )
     /*    T42Lock l(&subscriptionLock_);
     SubscriptionResponseListenersVector_t::iterator it = listeners_.begin()*/;
 
-    SubscriptionResponseListenersVector_t listenersSnap;
-    {
-        T42Lock l(&subscriptionLock_);
-        // take a snap of the vector in case anything gets removed on the other thread
-        listenersSnap = listeners_;
-    }
+    SubscriptionResponseListeners_ptr_t listenersSnap = Listeners();
 
-    SubscriptionResponseListenersVector_t::iterator it = listenersSnap.begin();
-    while(it != listenersSnap.end() )
+    SubscriptionResponseListenersVector_t::const_iterator it = listenersSnap->begin();
+    while(it != listenersSnap->end() )
     {
         RMDSBridgeSubscription_ptr_t sub = *it;
         it++;
@@ -2139,15 +2593,10 @@ void UPASubscription::NotifyListenersError( mama_status statusCode )
 
 void UPASubscription::NotifyListenersQuality(mamaQuality quality, short cause)
 {
-    SubscriptionResponseListenersVector_t listenersSnap;
-    {
-        T42Lock l(&subscriptionLock_);
-        // take a snap of the vector in case anything gets removed on the other thread
-        listenersSnap = listeners_;
-    }
+    SubscriptionResponseListeners_ptr_t listenersSnap = Listeners();
 
-    SubscriptionResponseListenersVector_t::iterator it = listenersSnap.begin();
-    while (it != listenersSnap.end())
+    SubscriptionResponseListenersVector_t::const_iterator it = listenersSnap->begin();
+    while (it != listenersSnap->end())
     {
         RMDSBridgeSubscription_ptr_t sub = *it;
         it++;
@@ -2158,51 +2607,144 @@ void UPASubscription::NotifyListenersQuality(mamaQuality quality, short cause)
 void UPASubscription::AddListener(const RMDSBridgeSubscription_ptr_t& listener )
 {
     T42Lock l(&subscriptionLock_);
-    listeners_.push_back(listener);
+
+    // copy on write - the notify functions may be iterating the current vector on the consumer thread
+    boost::shared_ptr<SubscriptionResponseListenersVector_t> newListeners = boost::make_shared<SubscriptionResponseListenersVector_t>(*listeners_);
+    newListeners->push_back(listener);
+    boost::atomic_store(&listeners_, SubscriptionResponseListeners_ptr_t(newListeners));
 }
 
 void UPASubscription::RemoveListener( const RMDSBridgeSubscription_ptr_t& listener )
+{
+    RemoveListener(listener.get());
+}
+
+void UPASubscription::RemoveListener( RMDSBridgeSubscription * listener )
 {
     T42Lock l(&subscriptionLock_);
-    SubscriptionResponseListenersVector_t::iterator it;
+    SubscriptionResponseListenersVector_t::const_iterator it;
 
-    for(it = listeners_.begin(); it != listeners_.end(); it ++)
+    for(it = listeners_->begin(); it != listeners_->end(); it ++)
     {
 
-        if ((*it).get() == listener.get())
+        if ((*it).get() == listener)
         {
-            listeners_.erase(it);
+            boost::shared_ptr<SubscriptionResponseListenersVector_t> newListeners = boost::make_shared<SubscriptionResponseListenersVector_t>(*listeners_);
+            newListeners->erase(newListeners->begin() + (it - listeners_->begin()));
+            boost::atomic_store(&listeners_, SubscriptionResponseListeners_ptr_t(newListeners));
             break;
         }
     }
 }
 
-void UPASubscription::RemoveListener( RMDSBridgeSubscription * listener )
+
+// Request an image for this subscription
+void UPASubscription::RequestImage(const RMDSBridgeSubscription_ptr_t& sub)
 {
     T42Lock l(&subscriptionLock_);
-    SubscriptionResponseListenersVector_t::iterator it;
+    // We obtain a new image by making a refresh request to the rmds, unless it can be served from the last value cache
+    // when the request is dispatched
+    Refresh(consumer_, sub);
+}
+
 
-    for(it = listeners_.begin(); it != listeners_.end(); it ++)
+
+void UPASubscription::UpdateCachedImage(RsslMsg* msg)
+{
+    if (msg->msgBase.msgClass == RSSL_MC_REFRESH)
     {
+        if (msg->refreshMsg.flags & RSSL_RFMF_DO_NOT_CACHE)
+        {
+            return;
+        }
 
-        if ((*it).get() == listener)
+        // a solicited image replaces what we have. It may arrive in several parts so we only serve the cache once
+        // the last part is in
+        if ((msg->refreshMsg.flags & RSSL_RFMF_CLEAR_CACHE) && cachedImage_ != NULL)
         {
-            listeners_.erase(it);
-            break;
+            mamaMsg_clear(cachedImage_);
+            cacheValid_ = false;
         }
     }
+    else if ((msg->updateMsg.flags & RSSL_UPMF_DO_NOT_CACHE) || cachedImage_ == NULL)
+    {
+        // updates only count once we have had an image to apply them to
+        return;
+    }
+
+    mama_status status = (cachedImage_ == NULL) ? mamaMsg_copy(msg_, &cachedImage_) : mamaMsg_applyMsg(cachedImage_, msg_);
+    if (status != MAMA_STATUS_OK)
+    {
+        t42log_warn("Failed to update the cached image for %s\n", symbol_.c_str());
+        cacheValid_ = false;
+        return;
+    }
+
+    if (msg->msgBase.msgClass == RSSL_MC_REFRESH && (msg->refreshMsg.flags & RSSL_RFMF_REFRESH_COMPLETE))
+    {
+        cacheValid_ = true;
+    }
 }
 
+bool UPASubscription::CopyCachedImage(mamaMsg msg)
+{
+    if (!cacheValid_ || GetSubscriptionState() != SubscriptionStateLive)
+    {
+        return false;
+    }
 
-// Request an image for this subscription
-void UPASubscription::RequestImage(const RMDSBridgeSubscription_ptr_t& sub)
+    return mamaMsg_applyMsg(msg, cachedImage_) == MAMA_STATUS_OK;
+}
+
+bool UPASubscription::SendCachedImage()
 {
-    T42Lock l(&subscriptionLock_);
-    // We obtain a new image by making a refresh request to the rmds
-    Refresh(consumer_, sub);
+    if (!CopyCachedImage(msg_))
+    {
+        return false;
+    }
+
+    t42log_debug("sending cached image for %s on stream %d\n", symbol_.c_str(), streamId_);
+
+    // build it just as we would the refresh from the ADS
+    SetMessageType(RSSL_MC_REFRESH, 0, false);
+    setMsgNum(false);
+    mamaMsg_addI32(msg_, MamaFieldMsgStatus.mName, MamaFieldMsgStatus.mFid, MAMA_MSG_STATUS_OK);
+
+    NotifyListenersRefreshMessage(msg_, subscription_);
+    isRefresh_ = false;
+    subscription_.reset();
+
+    mamaMsg_clear(msg_);
+    return true;
 }
 
+bool UPASubscription::SendCachedSnapshot()
+{
+    UPASubscription_ptr_t source = imageSource_;
+    imageSource_.reset();
 
+    // the cache belongs to the streaming subscription's consumer thread, which is only this one if the item is on
+    // the same shard
+    if (source == 0 || source->Consumer() != consumer_ || !source->CopyCachedImage(msg_))
+    {
+        return false;
+    }
+
+    t42log_debug("sending cached snapshot for %s\n", symbol_.c_str());
+
+    SetMessageType(RSSL_MC_REFRESH, 0, false);
+    setMsgNum(false);
+    mamaMsg_addI32(msg_, MamaFieldMsgStatus.mName, MamaFieldMsgStatus.mFid, MAMA_MSG_STATUS_OK);
+
+    if (0 != snapShot_)
+    {
+        snapShot_->OnMessage(msg_);
+        snapShot_.reset();
+    }
+
+    mamaMsg_clear(msg_);
+    return true;
+}
 
 const RsslUInt32 DecodeFailureReportInterval = 60 * 1000;  // 1 minute
 
@@ -2210,6 +2752,10 @@ void UPASubscription::ReportDecodeFailure( const char * location, RsslRet errCod
 {
 
     RsslUInt32 now = utils::time::GetMilliCount();
+
+    // the cached image will be missing whatever we failed to decode
+    cacheValid_ = false;
+
     // first decide whether to log a report
     if (numDecodeFailuresLast_  != 0 )
     {
@@ -2316,6 +2862,7 @@ void UPASubscription::ProcessAnsiMessage(RsslMsg * msg)
 // wrappers for the rssl message processing functions
 RsslRet UPASubscription::ProcessMarketPriceResponse(RsslMsg* msg, RsslDecodeIterator* dIter)
 {
+    TrackItemGroup(msg);
     RsslRet ret = InternalProcessMarketPriceResponse(msg, dIter);
     mamaMsg_clear(msg_);
     return ret;
@@ -2323,6 +2870,7 @@ RsslRet UPASubscription::ProcessMarketPriceResponse(RsslMsg* msg, RsslDecodeIter
 
 RsslRet UPASubscription::ProcessMarketByOrderResponse(RsslMsg* msg, RsslDecodeIterator* dIter)
 {
+    TrackItemGroup(msg);
     RsslRet ret = InternalProcessMarketByOrderResponse(msg, dIter);
     mamaMsg_clear(msg_);
     return ret;
@@ -2330,11 +2878,36 @@ RsslRet UPASubscription::ProcessMarketByOrderResponse(RsslMsg* msg, RsslDecodeIt
 
 RsslRet UPASubscription::ProcessMarketByPriceResponse(RsslMsg* msg, RsslDecodeIterator* dIter)
 {
+    TrackItemGroup(msg);
     RsslRet ret = InternalProcessMarketByPriceResponse(msg, dIter);
     mamaMsg_clear(msg_);
     return ret;
 }
 
+// keep the source's item group index up to date from the group id in the refreshes and status messages
+void UPASubscription::TrackItemGroup(RsslMsg* msg)
+{
+    if (isSnapshot_ || source_ == 0)
+    {
+        return;
+    }
+
+    const RsslBuffer * groupId = 0;
+    if (msg->msgBase.msgClass == RSSL_MC_REFRESH)
+    {
+        groupId = &msg->refreshMsg.groupId;
+    }
+    else if (msg->msgBase.msgClass == RSSL_MC_STATUS && (msg->statusMsg.flags & RSSL_STMF_HAS_GROUP_ID))
+    {
+        groupId = &msg->statusMsg.groupId;
+    }
+
+    if (groupId != 0 && groupId->length > 0 && GetSubscriptionState() != SubscriptionStateInactive)
+    {
+        source_->SetItemGroup(shared_from_this(), *groupId);
+    }
+}
+
 char UPASubscription::ExtractSideCode(RsslBuffer &mapKey)
 {
     // key is price as a string appended with 'a' or 'b' for the side
@@ -2377,12 +2950,12 @@ char UPASubscription::ExtractSideCode(RsslBuffer &mapKey)
 bool UPASubscription::FindListener(RMDSBridgeSubscription * listener, RMDSBridgeSubscription_ptr_t & listenerPtr)
 {
     T42Lock l(&subscriptionLock_);
-    SubscriptionResponseListenersVector_t::iterator it;
+    SubscriptionResponseListenersVector_t::const_iterator it;
 
     RMDSBridgeSubscription_ptr_t ret;
 
 
-    for(it = listeners_.begin(); it != listeners_.end(); it ++)
+    for(it = listeners_->begin(); it != listeners_->end(); it ++)
     {
 
         if ((*it).get() == listener)
@@ -31,6 +31,7 @@
 #include "UPAConsumer.h"
 #include "UPAMamaFieldMap.h"
 #include "UPABookMessage.h"
+#include "UPAMessagePool.h"
 
 #include "RMDSBridgeSubscription.h"
 #include "transportconfig.h"
@@ -89,6 +90,10 @@ public:
 
     virtual bool ReSubscribe();
 
+    // when the item last had a message, as the consumer's message count at the time. A recovery resubscribes the
+    // items that were most recently active first
+    RsslUInt64 LastActivity() const { return lastActivity_; }
+
 
     // subscription type - which OMM domain to use
     enum UPASubscriptionType
@@ -102,9 +107,15 @@ public:
 
     void SetDomain(UPASubscriptionType domain);
 
+    // the rssl domain for the subscription type, 0 if it is unknown
+    RsslUInt8 DomainType() const;
+
     // obtain the rssl stream id for this subscription
     RsslUInt32 StreamId() const { return streamId_; }
 
+    // the consumer (connection) that carries the stream
+    const UPAConsumer_ptr_t& Consumer() const { return consumer_; }
+
     // manage listeners
     void AddListener(const RMDSBridgeSubscription_ptr_t& listener);
     void RemoveListener(const RMDSBridgeSubscription_ptr_t& listener);
@@ -113,14 +124,59 @@ public:
 
     size_t ListenerCount() const
     {
-        return listeners_.size();
+        return Listeners()->size();
     }
 
     // Request an image for this subscription
     void RequestImage(const RMDSBridgeSubscription_ptr_t& sub);
 
+    // true if this is a streaming subscription that keeps a last value cache of its image
+    bool CachesImage() const { return cacheImage_; }
+
+    // a snapshot can be taken from the cache of the streaming subscription on the same item, if that is live when the
+    // snapshot request is dispatched
+    void ImageSource(const UPASubscription_ptr_t& source) { imageSource_ = source; }
+
     void QueueSubscriptionDestroy(const RMDSBridgeSubscription_ptr_t& sub);
 
+    // send the item request, or add it to one of the consumer's batch requests if the stream isnt open on the current
+    // channel (see UPABatchRequests.h)
+    bool SendOpenRequest(bool isSnapshot = false);
+
+    // the batch request has been encoded, take the stream the provider will open the item on
+    void OpenInBatch(RsslUInt32 streamId);
+
+    // called from the mama queue when the last listener has dispatched an async message
+    void ReleaseAsyncMessage(mamaMsg msg);
+
+    // The conflation state of one listener queue. The pending message belongs to the consumer thread; the queue thread
+    // only counts down the messages in flight and asks the consumer to flush when the queue has caught up
+    struct AsyncQueueState
+    {
+        AsyncQueueState(mamaQueue q)
+            : queue(q), pendingMsg(NULL), pendingCount(0), pendingSince(0), inFlight(0), hasPending(false), flushQueued(false)
+        {}
+
+        mamaQueue queue;
+        mamaMsg pendingMsg;
+        int32_t pendingCount;
+        RsslUInt64 pendingSince;
+
+        utils::thread::atomic<size_t> inFlight;
+        utils::thread::atomic<bool> hasPending;
+        utils::thread::atomic<bool> flushQueued;
+    };
+    typedef boost::shared_ptr<AsyncQueueState> AsyncQueueState_ptr_t;
+
+    // called by a listener as it puts an async message on its queue - returns the state it counts against, or null if
+    // the subscription isnt conflating - and from the queue once the listener has dispatched it
+    AsyncQueueState_ptr_t AsyncMessageQueued(mamaQueue queue);
+    void AsyncMessageDispatched(const AsyncQueueState_ptr_t& queueState);
+
+    // called by the consumer thread to send the conflated updates that have been held for the max latency. Returns
+    // false once nothing is held, otherwise brings nextDeadline forward to when the next one is due
+    bool FlushExpiredConflation(RsslUInt64 now, RsslUInt64& nextDeadline);
+
 protected:
 
     // used by derived classes
@@ -131,7 +187,7 @@ protected:
     void NotifyListenersQuality(mamaQuality quality, short cause);
 
     void NotifyListenersMessageSync(mamaMsg msg, mamaMsgType msgType) const;
-    void NotifyListenersMessageAsync(mamaMsg msg, mamaMsgType msgType) const;
+    void NotifyListenersMessageAsync(mamaMsg msg, mamaMsgType msgType);
 
     // Protected so Marketfeed subclass can use them in diagnostics
     std::string sourceName_;
@@ -182,6 +238,9 @@ private:
         state_ = state;
     }
 
+    // the item group is held by the source (see RMDSSource::SetItemGroup)
+    void TrackItemGroup(RsslMsg* msg);
+
     // rssl state - this persists state data delivered by upa
     void LogRsslState(RsslState* state);
     bool SetRsslState(RsslState* state);
@@ -201,7 +260,9 @@ private:
 
     // make an open request
     void QueueOpenRequest();
-    bool SendOpenRequest(bool isSnapshot = false);
+
+    // the consumer channel the stream was last requested on, a stream from an earlier one is free to move to a batch
+    RsslUInt32 streamGeneration_;
 
     // make a close request
     void QueueCloseRequest();
@@ -241,13 +302,76 @@ private:
     int64_t msgSeqNum_;
 
     // notify listeners
+    // The listeners are copied on write. Adding or removing a listener builds a new vector under the subscription lock
+    // and swaps it in, so the notify functions only need to take a reference to the current vector
     typedef std::vector<RMDSBridgeSubscription_ptr_t> SubscriptionResponseListenersVector_t;
-    SubscriptionResponseListenersVector_t listeners_;
+    typedef boost::shared_ptr<const SubscriptionResponseListenersVector_t> SubscriptionResponseListeners_ptr_t;
+    SubscriptionResponseListeners_ptr_t listeners_;
+
+    SubscriptionResponseListeners_ptr_t Listeners() const
+    {
+        return boost::atomic_load(&listeners_);
+    }
+
+    // async delivery - the pool the fanned out messages come from, and the queues the last one went to
+    UPAMessagePool_ptr_t messagePool_;
+    std::vector<mamaQueue> asyncQueues_;
+    RsslUInt64 asyncMessageCount_;
+    static const RsslUInt64 QueueDepthSampleInterval = 64;
+
+    // hand a pooled message to the listener queues - all of them, less the ones that have just conflated it, or only
+    // onlyQueue when sending its conflated update
+    void FanOutAsync(mamaMsg newMsg, mamaMsgType msgType, mamaQueue onlyQueue = NULL);
+
+    // Conflation
+    //
+    // Each listener queue is conflated on its own, so a slow queue doesnt hold back the updates to the others. While
+    // a message from this subscription is still waiting on a queue, further updates for that queue are applied field
+    // by field onto one pending message rather than each being queued. The pending message is sent when the queue has
+    // dispatched everything ahead of it, or once it has been held for the max latency - checked as updates arrive and
+    // by the consumer thread's sweep, for when none do - with the number of updates merged into it in
+    // wConflateCount. Other message types send the pending updates first, so the order the listeners see is preserved.
+    //
+    // The queue states are only added to, and the pending messages only touched, on the consumer thread
+    bool conflate_;
+    RsslUInt64 conflationMaxLatency_;
+
+    std::vector<AsyncQueueState_ptr_t> asyncQueueStates_;
+    std::vector<mamaQueue> conflatedQueues_;
+    bool conflationWatched_;
+
+    AsyncQueueState_ptr_t QueueState(mamaQueue queue) const;
+    bool ConflateUpdate(mamaMsg msg, const SubscriptionResponseListeners_ptr_t& listeners);
+    bool ConflateInto(AsyncQueueState& state, mamaMsg msg, RsslUInt64 now);
+    void FlushConflatedUpdate(AsyncQueueState& state);
+    void FlushConflatedUpdates();
+    void ReleasePendingUpdate(AsyncQueueState& state);
+    static void MAMACALLTYPE ConflationFlushCb(mamaQueue queue, void *closure);
+
+    // Last value cache
+    //
+    // With last-value-cache set, a market price subscription merges the fields of each refresh and update into a
+    // cached image. A listener joining the live item, or a snapshot of it, then gets its image from the cache rather
+    // than with a new request to the ADS. The cache is only touched on the consumer thread. It is not served once the
+    // item goes stale, or after a decode failure, until the next complete refresh
+    bool cacheImage_;
+    mamaMsg cachedImage_;
+    bool cacheValid_;
+    UPASubscription_ptr_t imageSource_;
+
+    void UpdateCachedImage(RsslMsg* msg);
+    bool CopyCachedImage(mamaMsg msg);
+    bool SendCachedImage();
+    bool SendCachedSnapshot();
+
+    // set by setLineTime on the consumer thread
+    RsslUInt64 lastActivity_;
 
     mutable utils::thread::lock_t subscriptionLock_;
 
     // internal message cache for book handling
     UPABookByOrderMessage bookByOrderMessage_;
+    UPABookEntry_ptr_t bookEntry_;
     UPABookByPriceMessage bookByPriceMessage_;
 
     // price point map for book handling
@@ -293,6 +417,22 @@ private:
         UPASubscription_ptr_t sub_;
     };
 
+    // the subscription and the listener queue to flush, as a mama closure
+    class ConflationFlushClosure : public UPASubscriptionClosure
+    {
+    public:
+        ConflationFlushClosure(const UPASubscription_ptr_t& s, const AsyncQueueState_ptr_t& state)
+            : UPASubscriptionClosure(s), state_(state)
+        {}
+
+        const AsyncQueueState_ptr_t& State() const
+        {
+            return state_;
+        }
+    private:
+        AsyncQueueState_ptr_t state_;
+    };
+
     // wrap a rmds bridge subscription shared pointer for use as a mama void * closure;
     // If we use a pointer to one of these objects as a mama closure then shared pointer (and the underlying object
     // is guaranteed to stay alive while the object is on the queue
@@ -0,0 +1,112 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "stdafx.h"
+#include "UPAWriteBatch.h"
+#include <utils/time.h>
+
+UPAWriteBatch::UPAWriteBatch()
+    : enabled_(false)
+    , maxBytes_(0)
+    , maxDelay_(0)
+    , holding_(false)
+    , wantWrite_(false)
+    , heldBytes_(0)
+    , firstHeldTime_(0)
+    , anyHeld_(false)
+{
+}
+
+void UPAWriteBatch::Configure(bool enabled, RsslUInt32 maxBytes, RsslUInt32 maxDelay)
+{
+    enabled_ = enabled;
+    maxBytes_ = maxBytes;
+    maxDelay_ = maxDelay;
+}
+
+void UPAWriteBatch::Hold()
+{
+    if (enabled_)
+    {
+        holding_.store(true);
+    }
+}
+
+RsslRet UPAWriteBatch::Flush(RsslChannel* chnl, RsslError* error)
+{
+    // a writer that sees holding_ clear after its write flushes for itself, so anything written before this point is
+    // either in the flush below or already flushed
+    holding_.store(false);
+    if (!anyHeld_.exchange(false))
+    {
+        return RSSL_RET_SUCCESS;
+    }
+    Reset();
+
+    RsslRet ret = rsslFlush(chnl, error);
+    if (ret > RSSL_RET_SUCCESS)
+    {
+        SetWantWrite();
+    }
+    return ret;
+}
+
+bool UPAWriteBatch::Defer(RsslUInt32 bytesWritten)
+{
+    if (!enabled_)
+    {
+        return true;
+    }
+
+    // mark the write as held before looking at holding_, so that an owner that is flushing either sees it or has
+    // already stopped holding and this writer flushes it
+    bool alreadyHeld = anyHeld_.exchange(true);
+    if (!holding_.load())
+    {
+        return true;
+    }
+
+    RsslUInt64 now = utils::time::GetMicroCount();
+    if (!alreadyHeld)
+    {
+        firstHeldTime_.store(now);
+    }
+
+    RsslUInt32 held = heldBytes_.fetch_add(bytesWritten) + bytesWritten;
+    if (held >= maxBytes_ || now - firstHeldTime_.load() >= maxDelay_)
+    {
+        // over budget, the writer flushes everything held so far
+        anyHeld_.store(false);
+        Reset();
+        return true;
+    }
+
+    return false;
+}
+
+void UPAWriteBatch::Reset()
+{
+    heldBytes_.store(0);
+    firstHeldTime_.store(0);
+}
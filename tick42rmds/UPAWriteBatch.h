@@ -0,0 +1,96 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __UPAWRITEBATCH_H__
+#define __UPAWRITEBATCH_H__
+
+#include <utils/namespacedefines.h>
+
+// Coalesces the flushes of the messages written on a channel.
+//
+// Without batching every message is written and then flushed straight away, which is a system call per message. With
+// batching the thread that owns the channel holds the flushes while it works through its queue and reads, so that the
+// messages accumulate in rssl's output buffers, and then flushes them once before it waits on the channel again. So
+// that a long pass through the loop doesnt delay them unduly a writer still flushes once the bytes written or the age
+// of the oldest unflushed message passes its budget. Messages written by other threads while the owner is waiting
+// are flushed as they are written, as before.
+//
+// The batch is found from the channel's userSpecPtr, so a channel that has none is flushed after every message.
+
+class UPAWriteBatch
+{
+public:
+    UPAWriteBatch();
+
+    // maxBytes and maxDelay (microseconds) bound how much is held before a writer flushes
+    void Configure(bool enabled, RsslUInt32 maxBytes, RsslUInt32 maxDelay);
+
+    bool Enabled() const
+    {
+        return enabled_;
+    }
+
+    // owning thread - hold the flushes of the messages written from now on
+    void Hold();
+
+    // owning thread - stop holding and flush the channel. Returns the rsslFlush result, or success if nothing was held
+    RsslRet Flush(RsslChannel* chnl, RsslError* error);
+
+    // after a message has been written - returns true if the writer should flush now
+    bool Defer(RsslUInt32 bytesWritten);
+
+    // rssl still has data queued after a write or flush, so the owning thread should flush when the channel is writable
+    void SetWantWrite()
+    {
+        wantWrite_.store(true);
+    }
+
+    bool TakeWantWrite()
+    {
+        return wantWrite_.exchange(false);
+    }
+
+    static UPAWriteBatch* ForChannel(RsslChannel* chnl)
+    {
+        return static_cast<UPAWriteBatch*>(chnl->userSpecPtr);
+    }
+
+private:
+    void Reset();
+
+    bool enabled_;
+    RsslUInt32 maxBytes_;
+    RsslUInt64 maxDelay_;
+
+    utils::thread::atomic<bool> holding_;
+    utils::thread::atomic<bool> wantWrite_;
+
+    // what has been held since the last flush
+    utils::thread::atomic<RsslUInt32> heldBytes_;
+    utils::thread::atomic<RsslUInt64> firstHeldTime_;
+    utils::thread::atomic<bool> anyHeld_;
+};
+
+#endif //__UPAWRITEBATCH_H__
@@ -107,6 +107,9 @@ tick42rmdsBridge_open (mamaBridge bridgeImpl)
    wsocketstartup();
    mama_log (MAMA_LOG_LEVEL_FINEST, "tick42rmdsBridge_open(): Entering.");
 
+   // hand the formatting and writing of the bridge log lines to a background thread if configured
+   Tick42Logging::CTick42Logger::StartAsync();
+
    if (MAMA_STATUS_OK !=
       (status =  mamaQueue_create (&impl->mDefaultEventQueue, bridgeImpl)))
    {
@@ -175,6 +178,9 @@ mama_status tick42rmdsBridge_close(mamaBridge bridgeImpl)
          wthread_destroy(timerThread);
       }
    }
+   // write out any log lines still queued
+   Tick42Logging::CTick42Logger::StopAsync();
+
    mama_log (MAMA_LOG_LEVEL_FINEST, "tick42rmdsBridge_close(): finished");
    return status;
 }
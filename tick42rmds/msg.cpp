@@ -45,12 +45,52 @@ typedef struct
 
     RMDSBridgeMsgReplyHandle_t    replyHandle_;
 
-    mutable utils::thread::lock_t refSync_;
-    size_t references_;
-    bool detached_;
+    // the number of queues still to dispatch a message that was fanned out to several of them
+    utils::thread::atomic<size_t> references_;
+    utils::thread::atomic<bool> detached_;
 
 } RMDSBridgeMsgImpl_t;
 
+namespace
+{
+    // Destroyed bridge messages are kept on a free list and reused by the next create, so the strings keep their
+    // storage and creating a message doesnt allocate in the steady state. Messages are created and destroyed on
+    // the consumer and the mama queue threads, so the free list is locked
+    const size_t MaxFreeMsgImpls = 1024;
+
+    std::vector<RMDSBridgeMsgImpl_t*> freeMsgImpls_;
+    utils::thread::lock_t freeMsgImplsLock_;
+
+    RMDSBridgeMsgImpl_t* AcquireMsgImpl()
+    {
+        {
+            utils::thread::T42Lock lock(&freeMsgImplsLock_);
+            if (!freeMsgImpls_.empty())
+            {
+                RMDSBridgeMsgImpl_t* impl = freeMsgImpls_.back();
+                freeMsgImpls_.pop_back();
+                return impl;
+            }
+        }
+
+        return new (std::nothrow) RMDSBridgeMsgImpl_t();
+    }
+
+    void ReleaseMsgImpl(RMDSBridgeMsgImpl_t* impl)
+    {
+        {
+            utils::thread::T42Lock lock(&freeMsgImplsLock_);
+            if (freeMsgImpls_.size() < MaxFreeMsgImpls)
+            {
+                freeMsgImpls_.push_back(impl);
+                return;
+            }
+        }
+
+        delete impl;
+    }
+}
+
 
   /*=========================================================================
    =                        Recommended Functions                           =
@@ -70,7 +110,7 @@ typedef struct
      *msg = NULL;
 
      /* Allocate memory for the implementation struct */
-     impl = new RMDSBridgeMsgImpl_t();
+     impl = AcquireMsgImpl();
 
      if (NULL == impl)
      {
@@ -82,12 +122,15 @@ typedef struct
      impl->parent_       = parent;
      impl->isValid_      = 1;
 
-     impl->replyHandle_.source_="";
-     impl->replyHandle_.symbol_ = "";
-     impl->sendSubject_ = "";
+     impl->msgType_      = RMDS_MSG_PUB_SUB;
+
+     // a reused message keeps the storage of its strings
+     impl->replyHandle_.source_.clear();
+     impl->replyHandle_.symbol_.clear();
+     impl->sendSubject_.clear();
 
-     impl->references_ = 0;
-     impl->detached_ = false;
+     impl->references_.store(0, utils::thread::memory_order_relaxed);
+     impl->detached_.store(false, utils::thread::memory_order_relaxed);
 
      /* Populate the msgBridge pointer with the implementation */
      *msg = (msgBridge) impl;
@@ -103,8 +146,8 @@ typedef struct
      {
          return MAMA_STATUS_INVALID_ARG;
      }
-     /* Free the underlying implementation */
-     delete (RMDSBridgeMsgImpl_t*)msg;
+     /* Give the underlying implementation back to the free list */
+     ReleaseMsgImpl((RMDSBridgeMsgImpl_t*)msg);
 
      return MAMA_STATUS_OK;
  }
@@ -126,7 +169,7 @@ typedef struct
  tick42rmdsBridgeMamaMsg_detach (msgBridge msg)
  {
      RMDSBridgeMsgImpl_t* impl     = (RMDSBridgeMsgImpl_t*) msg;
-     impl->detached_ = true;
+     impl->detached_.store(true, utils::thread::memory_order_release);
 
       //The bridge message is never responsible for the memory associated with
       //the underlying middleware message (it's owned by publishers and
@@ -309,9 +352,7 @@ mama_status tick42rmdsBridgeMamaMsgImpl_increaseReferences(msgBridge msg)
         return MAMA_STATUS_NULL_ARG;
     }
 
-    utils::thread::T42Lock lock(&impl->refSync_);
-
-    ++ impl->references_;
+    impl->references_.fetch_add(1, utils::thread::memory_order_relaxed);
 
     return MAMA_STATUS_OK;
 }
@@ -325,9 +366,23 @@ mama_status tick42rmdsBridgeMamaMsgImpl_decreaseReferences(msgBridge msg)
         return MAMA_STATUS_NULL_ARG;
     }
 
-    utils::thread::T42Lock lock(&impl->refSync_);
+    // only used where the caller holds another reference, so this is never the last one
+    impl->references_.fetch_sub(1, utils::thread::memory_order_release);
 
-    -- impl->references_;
+    return MAMA_STATUS_OK;
+}
+
+mama_status tick42rmdsBridgeMamaMsgImpl_decreaseReferences(msgBridge msg, size_t& references)
+{
+    RMDSBridgeMsgImpl_t*  impl   = (RMDSBridgeMsgImpl_t*) msg;
+
+    if (NULL == impl)
+    {
+        return MAMA_STATUS_NULL_ARG;
+    }
+
+    // the acquire half makes the other holders' use of the message visible to whoever sees the last one go
+    references = impl->references_.fetch_sub(1, utils::thread::memory_order_acq_rel) - 1;
 
     return MAMA_STATUS_OK;
 }
@@ -341,9 +396,7 @@ mama_status tick42rmdsBridgeMamaMsgImpl_getReferences(msgBridge msg, size_t& ref
         return MAMA_STATUS_NULL_ARG;
     }
 
-    utils::thread::T42Lock lock(&impl->refSync_);
-
-    references = impl->references_;
+    references = impl->references_.load(utils::thread::memory_order_acquire);
 
     return MAMA_STATUS_OK;
 }
@@ -357,7 +410,7 @@ mama_status tick42rmdsBridgeMamaMsgImpl_isDetached(msgBridge msg, bool& detached
         return MAMA_STATUS_NULL_ARG;
     }
 
-    detached = impl->detached_;
+    detached = impl->detached_.load(utils::thread::memory_order_acquire);
 
     return MAMA_STATUS_OK;
 }
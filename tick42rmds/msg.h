@@ -51,6 +51,8 @@ typedef enum RMDSBridgeMsgType_t
 
  mama_status tick42rmdsBridgeMamaMsgImpl_increaseReferences(msgBridge msg);
  mama_status tick42rmdsBridgeMamaMsgImpl_decreaseReferences(msgBridge msg);
+ // decrease and return the number of references left, in one step so that only one caller sees the last one go
+ mama_status tick42rmdsBridgeMamaMsgImpl_decreaseReferences(msgBridge msg, size_t& references);
 
  mama_status tick42rmdsBridgeMamaMsgImpl_getReferences(msgBridge msg, size_t& references);
 
@@ -25,13 +25,41 @@
 #include "stdafx.h"
 #include "tick42rmdsbridgefunctions.h"
 #include "utils/t42log.h"
+#include "utils/properties.h"
+#include "utils/thread/lock.h"
 
 
+// closures are carved out of slabs of this many and recycled through a free list on the queue, rather than being
+// allocated and freed for every event
+static const size_t ClosureSlabSize = 256;
+
+struct upaQueueClosure_t;
+
 typedef struct upaQueueBridge_t
 {
     mamaQueue          parent_;
     wombatQueue        queue_;
     uint8_t            isNative_;
+
+    // optional callback made after each event is enqueued, used to wake a thread that
+    // dispatches the queue itself
+    mamaQueueEnqueueCB enqueueCb_;
+    void*              enqueueClosure_;
+
+    // guards the closure free list and the batch
+    utils::thread::lock_t lock_;
+
+    upaQueueClosure_t* freeClosures_;
+    std::vector<upaQueueClosure_t*> closureSlabs_;
+
+    // Batched dispatch. With a batch size above 1 the events are held in a list on the queue and only one wombat queue
+    // event is outstanding for the whole list. Each time it is dispatched it drains up to batchSize_ events and then
+    // re-queues itself if there are more. mamaQueue_dispatchEvent still runs one event at a time
+    size_t             batchSize_;
+    upaQueueClosure_t* batchHead_;
+    upaQueueClosure_t* batchTail_;
+    size_t             batchCount_;
+    bool               batchQueued_;
 } upaQueueBridge_t;
 
 typedef struct upaQueueClosure_t
@@ -39,6 +67,9 @@ typedef struct upaQueueClosure_t
     upaQueueBridge_t* impl_;
     mamaQueueEventCB cb_;
     void*            userClosure_;
+
+    // link in the free list or the batch
+    upaQueueClosure_t* next_;
 } upaQueueClosure_t;
 
 #define upaQueue(queue) ((upaQueueBridge_t*) queue)
@@ -49,6 +80,61 @@ typedef struct upaQueueClosure_t
     } while(0)
 
 
+// create the bridge queue and read the batch size from the properties
+static upaQueueBridge_t* newQueueBridge(mamaQueue parent)
+{
+    upaQueueBridge_t* upaQueue = new (std::nothrow) upaQueueBridge_t();
+    if (upaQueue == NULL)
+        return NULL;
+
+    upaQueue->parent_ = parent;
+
+    utils::properties config;
+    int batchSize = atoi(config.get("mama.tick42rmds.queue.dispatchbatch", "1").c_str());
+    upaQueue->batchSize_ = (batchSize > 1) ? (size_t)batchSize : 1;
+
+    return upaQueue;
+}
+
+static void deleteQueueBridge(upaQueueBridge_t* upaQueue)
+{
+    for (std::vector<upaQueueClosure_t*>::iterator it = upaQueue->closureSlabs_.begin(); it != upaQueue->closureSlabs_.end(); ++it)
+    {
+        delete [] *it;
+    }
+    delete upaQueue;
+}
+
+// take a closure from the free list, adding a new slab if it is empty. Called with the queue lock held
+static upaQueueClosure_t* allocateClosure(upaQueueBridge_t* upaQueue)
+{
+    if (NULL == upaQueue->freeClosures_)
+    {
+        upaQueueClosure_t* slab = new (std::nothrow) upaQueueClosure_t[ClosureSlabSize];
+        if (NULL == slab)
+            return NULL;
+
+        upaQueue->closureSlabs_.push_back(slab);
+        for (size_t i = 0; i < ClosureSlabSize; ++i)
+        {
+            slab[i].next_ = upaQueue->freeClosures_;
+            upaQueue->freeClosures_ = &slab[i];
+        }
+    }
+
+    upaQueueClosure_t* cl = upaQueue->freeClosures_;
+    upaQueue->freeClosures_ = cl->next_;
+    cl->next_ = NULL;
+    return cl;
+}
+
+// give back a chain of closures linked through next_. Called with the queue lock held
+static void releaseClosures(upaQueueBridge_t* upaQueue, upaQueueClosure_t* head, upaQueueClosure_t* tail)
+{
+    tail->next_ = upaQueue->freeClosures_;
+    upaQueue->freeClosures_ = head;
+}
+
   /*=========================================================================
    =                         Mandatory Functions                            =
    =========================================================================*/
@@ -63,12 +149,10 @@ typedef struct upaQueueClosure_t
          return MAMA_STATUS_NULL_ARG;
      *queue = NULL;
 
-     upaQueue = (upaQueueBridge_t*)calloc (1, sizeof (upaQueueBridge_t));
+     upaQueue = newQueueBridge(parent);
      if (upaQueue == NULL)
          return MAMA_STATUS_NOMEM;
 
-     upaQueue->parent_  = parent;
-
      wombatQueue_allocate (&upaQueue->queue_);
      wombatQueue_create (upaQueue->queue_, 0, 0, 0);
 
@@ -87,7 +171,7 @@ typedef struct upaQueueClosure_t
      CHECK_QUEUE(queue);
      if (upaQueue(queue)->isNative_)
          wombatQueue_destroy (upaQueue(queue)->queue_);
-     free(upaQueue(queue));
+     deleteQueueBridge(upaQueue(queue));
      return MAMA_STATUS_OK;
 
  }
@@ -155,6 +239,43 @@ typedef struct upaQueueClosure_t
  {
      wombatQueueStatus status;
      CHECK_QUEUE(queue);
+     upaQueueBridge_t* impl = upaQueue(queue);
+
+     // Dispatch exactly one event, even when the queue is batched. The consumers throttle their request queues by
+     // counting the events they dispatch, so running a whole batch here would get round maxdisp and the open window.
+     // Take the event straight off the front of the batch; the batch's wombat queue event will find whatever is left
+     if (impl->batchSize_ > 1)
+     {
+         upaQueueClosure_t* cl = NULL;
+         {
+             utils::thread::T42Lock lock(&impl->lock_);
+             cl = impl->batchHead_;
+             if (cl != NULL)
+             {
+                 impl->batchHead_ = cl->next_;
+                 if (impl->batchHead_ == NULL)
+                     impl->batchTail_ = NULL;
+                 cl->next_ = NULL;
+                 --impl->batchCount_;
+             }
+         }
+
+         if (cl != NULL)
+         {
+             try
+             {
+                 cl->cb_(impl->parent_, cl->userClosure_);
+             }
+             catch (...)
+             {
+                 t42log_warn("Caught exception in queue callback\n");
+             }
+
+             utils::thread::T42Lock lock(&impl->lock_);
+             releaseClosures(impl, cl, cl);
+             return MAMA_STATUS_OK;
+         }
+     }
 
      status = wombatQueue_dispatch (upaQueue(queue)->queue_,
          NULL, NULL);
@@ -178,16 +299,79 @@ typedef struct upaQueueClosure_t
  {
      upaQueueClosure_t* cl = (upaQueueClosure_t*)closure;
      if (NULL ==cl) return;
+     upaQueueBridge_t* impl = cl->impl_;
      try
      {
-         cl->cb_(cl->impl_->parent_, cl->userClosure_);
+         cl->cb_(impl->parent_, cl->userClosure_);
      }
      catch (...)
      {
          t42log_warn("Caught exception in queue callback\n");
      }
 
-     free (cl);
+     utils::thread::T42Lock lock(&impl->lock_);
+     releaseClosures(impl, cl, cl);
+ }
+
+
+ // call back for a batch of queued events
+ static void MAMACALLTYPE batchCb(void* ignored, void* closure)
+ {
+     upaQueueBridge_t* impl = (upaQueueBridge_t*)closure;
+     if (NULL == impl) return;
+
+     // take up to a batch of events off the front of the list
+     upaQueueClosure_t* head = NULL;
+     upaQueueClosure_t* tail = NULL;
+     {
+         utils::thread::T42Lock lock(&impl->lock_);
+         head = impl->batchHead_;
+         tail = head;
+         size_t count = (head != NULL) ? 1 : 0;
+         while (count < impl->batchSize_ && tail != NULL && tail->next_ != NULL)
+         {
+             tail = tail->next_;
+             ++count;
+         }
+
+         if (tail != NULL)
+         {
+             impl->batchHead_ = tail->next_;
+             if (impl->batchHead_ == NULL)
+                 impl->batchTail_ = NULL;
+             tail->next_ = NULL;
+         }
+         impl->batchCount_ -= count;
+     }
+
+     for (upaQueueClosure_t* cl = head; cl != NULL; cl = cl->next_)
+     {
+         try
+         {
+             cl->cb_(impl->parent_, cl->userClosure_);
+         }
+         catch (...)
+         {
+             t42log_warn("Caught exception in queue callback\n");
+         }
+     }
+
+     // give back the closures and queue the next batch. We re-queue after dispatching rather than before so the events
+     // stay in order even if more than one thread dispatches the queue
+     utils::thread::T42Lock lock(&impl->lock_);
+     if (head != NULL)
+         releaseClosures(impl, head, tail);
+
+     if (impl->batchHead_ == NULL)
+     {
+         impl->batchQueued_ = false;
+     }
+     else if (wombatQueue_enqueue(impl->queue_, batchCb, NULL, impl) != WOMBAT_QUEUE_OK)
+     {
+         // the next event enqueued will try again
+         t42log_warn("Failed to queue the next batch of events\n");
+         impl->batchQueued_ = false;
+     }
  }
 
 
@@ -199,27 +383,78 @@ typedef struct upaQueueClosure_t
      wombatQueueStatus status;
      upaQueueClosure_t* cl = NULL;
      CHECK_QUEUE(queue);
+     upaQueueBridge_t* impl = upaQueue(queue);
 
-     cl = (upaQueueClosure_t*)calloc(1, sizeof(upaQueueClosure_t));
-     if (NULL == cl)
-         return MAMA_STATUS_NOMEM;
-
-     cl->impl_ = upaQueue(queue);
-     cl->cb_ = callback;
-     cl->userClosure_ = closure;
-
-     status = wombatQueue_enqueue (upaQueue(queue)->queue_,
-                                   queueCb,
-                                   NULL,
-                                   cl);
-
-     if (status != WOMBAT_QUEUE_OK)
+     if (impl->batchSize_ > 1)
      {
-         //!!! DP Does this happen often - will it cause a memory leak?
-
-         free (cl);
+         utils::thread::T42Lock lock(&impl->lock_);
+
+         cl = allocateClosure(impl);
+         if (NULL == cl)
+             return MAMA_STATUS_NOMEM;
+
+         cl->impl_ = impl;
+         cl->cb_ = callback;
+         cl->userClosure_ = closure;
+
+         // add to the batch, and if there isnt already an event on the wombat queue for it then queue one
+         if (impl->batchTail_ != NULL)
+             impl->batchTail_->next_ = cl;
+         else
+             impl->batchHead_ = cl;
+         impl->batchTail_ = cl;
+         ++impl->batchCount_;
+
+         if (!impl->batchQueued_)
+         {
+             status = wombatQueue_enqueue (impl->queue_,
+                                           batchCb,
+                                           NULL,
+                                           impl);
+
+             if (status != WOMBAT_QUEUE_OK)
+             {
+                 // nothing else can have been added to the batch as we hold the lock
+                 impl->batchHead_ = impl->batchTail_ = NULL;
+                 --impl->batchCount_;
+                 releaseClosures(impl, cl, cl);
+
+                 return MAMA_STATUS_PLATFORM;
+             }
+
+             impl->batchQueued_ = true;
+         }
+     }
+     else
+     {
+         {
+             utils::thread::T42Lock lock(&impl->lock_);
+             cl = allocateClosure(impl);
+         }
+         if (NULL == cl)
+             return MAMA_STATUS_NOMEM;
+
+         cl->impl_ = impl;
+         cl->cb_ = callback;
+         cl->userClosure_ = closure;
+
+         status = wombatQueue_enqueue (impl->queue_,
+                                       queueCb,
+                                       NULL,
+                                       cl);
+
+         if (status != WOMBAT_QUEUE_OK)
+         {
+             utils::thread::T42Lock lock(&impl->lock_);
+             releaseClosures(impl, cl, cl);
+
+             return MAMA_STATUS_PLATFORM;
+         }
+     }
 
-         return MAMA_STATUS_PLATFORM;
+     if (NULL != upaQueue(queue)->enqueueCb_)
+     {
+         upaQueue(queue)->enqueueCb_(upaQueue(queue)->parent_, upaQueue(queue)->enqueueClosure_);
      }
 
      return MAMA_STATUS_OK;
@@ -263,11 +498,10 @@ typedef struct upaQueueClosure_t
          return MAMA_STATUS_NULL_ARG;
      *queue = NULL;
 
-     upaQueue = (upaQueueBridge_t*)calloc (1, sizeof (upaQueueBridge_t));
+     upaQueue = newQueueBridge(parent);
      if (upaQueue == NULL)
          return MAMA_STATUS_NOMEM;
 
-     upaQueue->parent_  = parent;
      upaQueue->queue_   = (wombatQueue)nativeQueue;
      upaQueue->isNative_ = 1;
 
@@ -284,7 +518,10 @@ typedef struct upaQueueClosure_t
                                         void*              closure)
  {
     CHECK_QUEUE(queue);
-    return MAMA_STATUS_NOT_IMPLEMENTED;
+
+    upaQueue(queue)->enqueueClosure_ = closure;
+    upaQueue(queue)->enqueueCb_ = callback;
+    return MAMA_STATUS_OK;
  }
 
 
@@ -292,7 +529,10 @@ typedef struct upaQueueClosure_t
  tick42rmdsBridgeMamaQueue_removeEnqueueCallback (queueBridge queue)
  {
      CHECK_QUEUE(queue);
-    return MAMA_STATUS_NOT_IMPLEMENTED;
+
+     upaQueue(queue)->enqueueCb_ = NULL;
+     upaQueue(queue)->enqueueClosure_ = NULL;
+     return MAMA_STATUS_OK;
  }
 
 
@@ -329,7 +569,13 @@ typedef struct upaQueueClosure_t
  tick42rmdsBridgeMamaQueue_getEventCount (queueBridge queue, size_t* count)
  {
      CHECK_QUEUE(queue);
-     *count = 0;
-     wombatQueue_getSize (upaQueue(queue)->queue_, (int*)count);
+     int size = 0;
+     wombatQueue_getSize (upaQueue(queue)->queue_, &size);
+
+     // a pending batch counts as the events in it rather than the one wombat queue event
+     utils::thread::T42Lock lock(&upaQueue(queue)->lock_);
+     if (upaQueue(queue)->batchQueued_ && size > 0)
+         --size;
+     *count = (size_t)size + upaQueue(queue)->batchCount_;
      return MAMA_STATUS_OK;
  }
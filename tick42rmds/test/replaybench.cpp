@@ -0,0 +1,262 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+
+// Replay benchmark
+//
+// Subscribes to the given symbols on a transport that has replay-file set, so that the bridge replays the capture
+// rather than connecting, and runs for a fixed time. The bridge logs the per domain figures at the end of each pass
+// through the file. This program replaces operator new and counts each allocation through
+// tick42rmds_countAllocation, so those figures include the allocations per message made on the consumer thread. At
+// the end it also prints the allocations per message delivered over the whole process.
+//
+// Only the allocations made through operator new are counted, not the mallocs made by MAMA and UPA, and the bridge
+// library has to pick up this operator new, which it does when it is loaded as a shared library on Linux.
+//
+//    replaybench -tport <transport> -S <source> [-m <middleware>] [-t <seconds>] [-f <symbol file>] [symbol ...]
+
+#include <mama/mama.h>
+#include <mama/subscription.h>
+#include <mama/timer.h>
+
+#include "tick42rmdsbridgefunctions.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <utils/namespacedefines.h>
+
+namespace
+{
+    utils::thread::atomic<unsigned long long> allocations(0);
+    unsigned long long messages = 0;
+
+    void* CountedAllocate(std::size_t size)
+    {
+        tick42rmds_countAllocation();
+        allocations.fetch_add(1, utils::thread::memory_order_relaxed);
+        return malloc((size == 0) ? 1 : size);
+    }
+
+    void MAMACALLTYPE OnCreate(mamaSubscription subscription, void* closure)
+    {
+    }
+
+    void MAMACALLTYPE OnError(mamaSubscription subscription, mama_status status, void* platformError, const char* subject, void* closure)
+    {
+        std::cerr << "Subscription error for " << ((subject != 0) ? subject : "") << ": " << mamaStatus_stringForStatus(status) << std::endl;
+    }
+
+    void MAMACALLTYPE OnMsg(mamaSubscription subscription, mamaMsg msg, void* closure, void* itemClosure)
+    {
+        ++messages;
+    }
+
+    void MAMACALLTYPE OnStopTimer(mamaTimer timer, void* closure)
+    {
+        mama_stop((mamaBridge)closure);
+    }
+
+    void Usage()
+    {
+        std::cerr << "replaybench -tport <transport> -S <source> [-m <middleware>] [-t <seconds>] [-f <symbol file>] [symbol ...]" << std::endl;
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    void* p = CountedAllocate(size);
+    if (p == 0)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw()
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw()
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* p) throw()
+{
+    free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+    free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+    free(p);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string middleware = "tick42rmds";
+    std::string transportName;
+    std::string sourceName;
+    double seconds = 60;
+    std::vector<std::string> symbols;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-tport" && hasValue)
+        {
+            transportName = argv[++i];
+        }
+        else if (arg == "-S" && hasValue)
+        {
+            sourceName = argv[++i];
+        }
+        else if (arg == "-m" && hasValue)
+        {
+            middleware = argv[++i];
+        }
+        else if (arg == "-t" && hasValue)
+        {
+            seconds = atof(argv[++i]);
+        }
+        else if (arg == "-f" && hasValue)
+        {
+            std::ifstream file(argv[++i]);
+            std::string symbol;
+            while (file >> symbol)
+            {
+                symbols.push_back(symbol);
+            }
+        }
+        else if (arg[0] != '-')
+        {
+            symbols.push_back(arg);
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (transportName.empty() || sourceName.empty() || symbols.empty() || seconds <= 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    mamaBridge bridge = 0;
+    mama_status status;
+    if ((status = mama_loadBridge(&bridge, middleware.c_str())) != MAMA_STATUS_OK
+        || (status = mama_open()) != MAMA_STATUS_OK)
+    {
+        std::cerr << "Unable to load and open the " << middleware << " bridge: " << mamaStatus_stringForStatus(status) << std::endl;
+        return 1;
+    }
+
+    mamaTransport transport = 0;
+    mamaTransport_allocate(&transport);
+    if ((status = mamaTransport_create(transport, transportName.c_str(), bridge)) != MAMA_STATUS_OK)
+    {
+        std::cerr << "Unable to create transport " << transportName << ": " << mamaStatus_stringForStatus(status) << std::endl;
+        mama_close();
+        return 1;
+    }
+
+    mamaSource source = 0;
+    mamaSource_create(&source);
+    mamaSource_setId(source, "Replay_Source");
+    mamaSource_setTransport(source, transport);
+    mamaSource_setSymbolNamespace(source, sourceName.c_str());
+
+    mamaQueue queue = 0;
+    mama_getDefaultEventQueue(bridge, &queue);
+
+    mamaMsgCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.onCreate = OnCreate;
+    callbacks.onError = OnError;
+    callbacks.onMsg = OnMsg;
+
+    std::vector<mamaSubscription> subscriptions;
+    for (size_t i = 0; i < symbols.size(); ++i)
+    {
+        mamaSubscription subscription = 0;
+        mamaSubscription_allocate(&subscription);
+        if ((status = mamaSubscription_create(subscription, queue, &callbacks, source, symbols[i].c_str(), 0)) != MAMA_STATUS_OK)
+        {
+            std::cerr << "Unable to subscribe to " << symbols[i] << ": " << mamaStatus_stringForStatus(status) << std::endl;
+            mamaSubscription_deallocate(subscription);
+            continue;
+        }
+        subscriptions.push_back(subscription);
+    }
+
+    // the bridge replays the capture as the subscriptions open, and logs its figures at the end of each pass
+    mamaTimer stopTimer = 0;
+    mamaTimer_create(&stopTimer, queue, OnStopTimer, seconds, bridge);
+    unsigned long long startAllocations = allocations.load(utils::thread::memory_order_relaxed);
+    mama_start(bridge);
+    unsigned long long replayAllocations = allocations.load(utils::thread::memory_order_relaxed) - startAllocations;
+    mamaTimer_destroy(stopTimer);
+
+    std::cout << messages << " messages delivered, " << replayAllocations << " allocations";
+    if (messages > 0)
+    {
+        std::cout << ", " << (double)replayAllocations / (double)messages << " allocs/msg";
+    }
+    std::cout << std::endl;
+
+    for (size_t i = 0; i < subscriptions.size(); ++i)
+    {
+        mamaSubscription_destroy(subscriptions[i]);
+        mamaSubscription_deallocate(subscriptions[i]);
+    }
+    mamaSource_destroy(source);
+    mamaTransport_destroy(transport);
+    mama_close();
+    return 0;
+}
@@ -556,6 +556,16 @@ MAMAExpBridgeDLL
 extern mama_status
 tick42rmdsBridgeMamaMsgImpl_setAttributesAndSecure (msgBridge msg, void* attributes, uint8_t secure);
  
+/*=========================================================================
+=                    Replay benchmark                                    =
+=========================================================================*/
+/* Called for each allocation by a program that replaces operator new, such
+*  as the replay benchmark, so that a replay can report the allocations per
+*  message made on the consumer thread                                   */
+MAMAExpBridgeDLL
+extern void
+tick42rmds_countAllocation ();
+ 
 #if defined(__cplusplus)
 } 
 #endif
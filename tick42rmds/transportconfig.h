@@ -46,11 +46,31 @@ static const bool Default_disabledataconversion = false;
 static const char * Default_retrysched = "0,3(3),10(3),30(6)";
 static const int Default_maxdisp = 1000;
 static const int Default_maxPending = 1000;
+static const bool Default_adaptiveThrottle = false;
+static const int Default_minPending = 16;
+static const int Default_maxPendingLimit = 0;       // 0 - the adaptive window doesn't grow past maxPending
 static const char * Default_useCallbacks = "0";
 static const char * Default_sendAckMessage = "1";
 static const bool Default_asyncMessaging = false;
 static const int Default_maxMessageSize = 4096;
 static const int Default_waitTimeForSelect = 100000;
+static const int Default_consumers = 1;
+static const int Default_asyncMessagePool = 256;
+static const bool Default_writeBatching = false;
+static const int Default_writeBatchBytes = 16384;
+static const int Default_writeBatchDelay = 1000;
+static const int Default_postTableSize = 16384;
+static const int Default_postTimeout = 60000;
+static const bool Default_conflation = false;
+static const int Default_conflationMaxLatency = 100;
+static const int Default_replayPasses = 1;
+static const int Default_replaySettle = 5000;
+static const bool Default_lastValueCache = false;
+static const bool Default_batchRequests = false;
+static const int Default_batchSize = 1000;
+static const bool Default_viewRequests = false;
+static const int Default_stateSliceSize = 10000;
+static const bool Default_fastReconnect = false;
 
 /* Thin wrapper class that reflects mama.properties in type safe way.
  * Calling any of the get_<field name> will result with the value of the related filed in mama.properties that ends with that name.
@@ -28,6 +28,7 @@
 #include <mama/msg.h>
 
 #include <vector>
+#include <boost/shared_ptr.hpp>
 #include "upapayloadimpl.h"
 
 //////////////////////////////////////////////////////////////////////////
@@ -114,6 +115,13 @@ public:
         payloadvector_.emplace_back(payload);
         ++length_;
     }
+
+    // add a payload that the vector owns, such as one read from a serialized message
+    void addOwnedMessage(const boost::shared_ptr<MamaMsgPayloadWrapper>& payload)
+    {
+        ownedPayloads_.push_back(payload);
+        addMessage(payload->getMamaMsgPayload());
+    }
     mama_size_t getVectorLength() const
     {
         return length_;
@@ -129,6 +137,7 @@ private:
     typedef std::vector<msgPayload> MsgPayloadVector_t;
 
     MsgPayloadVector_t payloadvector_;
+    std::vector<boost::shared_ptr<MamaMsgPayloadWrapper> > ownedPayloads_;
 
     //msgPayload * msgVector_;
     mama_size_t length_;
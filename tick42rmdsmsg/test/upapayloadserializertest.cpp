@@ -0,0 +1,437 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+
+// Round trip test for UpaPayloadSerializer
+//
+// Builds a payload with a field of every kind the serializer writes - each scalar at its limits, price, date time,
+// opaque, string, the byte and string vectors, and nested messages and message vectors - serializes it, reads it
+// back into a fresh payload and checks each field. Also checks that leaving the names out, and damaged buffers, are
+// handled. Exits non zero if any check fails.
+
+#include "stdafx.h"
+#include "upapayload.h"
+#include "upapayloadserializer.h"
+
+#include <cstring>
+#include <limits>
+#include <iostream>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool ok, const char* what, int line)
+    {
+        if (!ok)
+        {
+            std::cerr << "FAILED line " << line << ": " << what << std::endl;
+            ++failures;
+        }
+    }
+
+#define CHECK(expr) check((expr), #expr, __LINE__)
+
+    enum Fids
+    {
+        FidI8 = 1,
+        FidU8,
+        FidI16,
+        FidU16,
+        FidI32,
+        FidU32,
+        FidI64,
+        FidU64,
+        FidF32,
+        FidF64,
+        FidBool,
+        FidChar,
+        FidString,
+        FidEmptyString,
+        FidPrice,
+        FidNullPrice,
+        FidDateTime,
+        FidNullDateTime,
+        FidOpaque,
+        FidNullOpaque,
+        FidVectorI32,
+        FidVectorF64,
+        FidVectorString,
+        FidMsg,
+        FidVectorMsg,
+        FidNullMsg,
+
+        // a fid above the varint single byte range
+        FidLarge = 30000
+    };
+
+    const mama_u64_t DateTimeMicros = 1445000000123456ULL;
+
+    template <typename T>
+    T fieldValue(const UpaPayload& payload, mama_fid_t fid)
+    {
+        T value = T();
+        CHECK(payload.get(fid, 0, value) == MAMA_STATUS_OK);
+        return value;
+    }
+
+    template <typename T>
+    const T* variantValue(const UpaPayload& payload, mama_fid_t fid)
+    {
+        const UpaFieldPayload* field = payload.cfindField(fid, 0);
+        if (field == 0)
+        {
+            return 0;
+        }
+        return boost::get<T>(&field->data_);
+    }
+
+    // a small payload to nest, which has a nested message of its own
+    MamaMsgPayloadWrapper_ptr_t makeNested(int32_t id, bool withChild)
+    {
+        UpaPayload* nested = new UpaPayload();
+        MamaMsgPayloadWrapper_ptr_t wrapper(new MamaMsgPayloadWrapper((msgPayload)nested));
+
+        nested->set(FidI32, "ID", id);
+        nested->set(FidString, "NAME", std::string("nested"));
+        if (withChild)
+        {
+            nested->setMsg(FidMsg, "CHILD", makeNested(id * 10, false));
+        }
+        return wrapper;
+    }
+
+    void checkNested(const UpaPayload& nested, int32_t id, bool withChild)
+    {
+        CHECK(nested.numFields() == (withChild ? 3u : 2u));
+        CHECK(fieldValue<int32_t>(nested, FidI32) == id);
+        CHECK(fieldValue<std::string>(nested, FidString) == "nested");
+
+        if (withChild)
+        {
+            const MamaMsgPayloadWrapper_ptr_t* child = variantValue<MamaMsgPayloadWrapper_ptr_t>(nested, FidMsg);
+            CHECK(child != 0 && *child);
+            if (child != 0 && *child)
+            {
+                checkNested(*reinterpret_cast<const UpaPayload*>((*child)->getMamaMsgPayload()), id * 10, false);
+            }
+        }
+    }
+
+    void buildPayload(UpaPayload& payload, std::vector<MamaMsgPayloadWrapper_ptr_t>& vectorParts)
+    {
+        payload.set(FidI8, "I8", std::numeric_limits<int8_t>::min());
+        payload.set(FidU8, "U8", std::numeric_limits<uint8_t>::max());
+        payload.set(FidI16, "I16", std::numeric_limits<int16_t>::min());
+        payload.set(FidU16, "U16", std::numeric_limits<uint16_t>::max());
+        payload.set(FidI32, "I32", std::numeric_limits<int32_t>::min());
+        payload.set(FidU32, "U32", std::numeric_limits<uint32_t>::max());
+        payload.set(FidI64, "I64", std::numeric_limits<int64_t>::min());
+        payload.set(FidU64, "U64", std::numeric_limits<uint64_t>::max());
+        payload.set(FidF32, "F32", -1.25f);
+        payload.set(FidF64, "F64", 123456.789012);
+        payload.set(FidBool, "BOOL", true);
+        payload.set(FidChar, "CHAR", 'Z');
+        payload.set(FidString, "STRING", std::string("a string\0with a nul", 19));
+        payload.set(FidEmptyString, "EMPTY", std::string());
+
+        mamaPrice price;
+        mamaPrice_create(&price);
+        mamaPrice_setValue(price, 101.5);
+        mamaPrice_setHints(price, MAMA_PRICE_HINTS_DECIMAL_4);
+        payload.setPrice(FidPrice, "PRICE", MamaPriceWrapper_ptr_t(new MamaPriceWrapper(price)));
+        payload.setPrice(FidNullPrice, "NULL_PRICE", MamaPriceWrapper_ptr_t());
+
+        mamaDateTime dt;
+        mamaDateTime_create(&dt);
+        mamaDateTime_setEpochTimeMicroseconds(dt, DateTimeMicros);
+        mamaDateTime_setPrecision(dt, MAMA_DATE_TIME_PREC_MICROSECONDS);
+        payload.set(FidDateTime, "DATETIME", MamaDateTimeWrapper_ptr_t(new MamaDateTimeWrapper(dt)));
+        payload.set(FidNullDateTime, "NULL_DATETIME", MamaDateTimeWrapper_ptr_t());
+
+        const unsigned char opaque[] = { 0x00, 0x01, 0x80, 0xff, 0x00, 0x7f };
+        payload.setOpaque(FidOpaque, "OPAQUE", MamaOpaqueWrapper_ptr_t(new MamaOpaqueWrapper(opaque, sizeof(opaque))));
+        payload.setOpaque(FidNullOpaque, "NULL_OPAQUE", MamaOpaqueWrapper_ptr_t());
+
+        const int32_t ints[] = { 0, -1, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min() };
+        payload.setVector(FidVectorI32, "VECTOR_I32", ints, 4);
+        const double doubles[] = { 0.5, -2.25, 1e300 };
+        payload.setVector(FidVectorF64, "VECTOR_F64", doubles, 3);
+        const char* strings[] = { "one", "", "three" };
+        payload.setVectorString(FidVectorString, "VECTOR_STRING", strings, 3);
+
+        payload.setMsg(FidMsg, "MSG", makeNested(7, true));
+        payload.setMsg(FidNullMsg, "NULL_MSG", MamaMsgPayloadWrapper_ptr_t());
+
+        // the vector doesnt own the payloads it is given, so keep them alive for the test
+        MamaMsgVectorWrapper_ptr_t msgVector(new MamaMsgVectorWrapper());
+        for (int32_t i = 1; i <= 2; ++i)
+        {
+            vectorParts.push_back(makeNested(i, i == 2));
+            msgVector->addMessage(vectorParts.back()->getMamaMsgPayload());
+        }
+        payload.setVectorMsg(FidVectorMsg, "VECTOR_MSG", msgVector);
+
+        payload.set(FidLarge, "LARGE_FID", (int16_t)-1);
+    }
+
+    void checkPayload(const UpaPayload& payload, bool withNames)
+    {
+        CHECK(payload.numFields() == 27);
+
+        CHECK(fieldValue<int8_t>(payload, FidI8) == std::numeric_limits<int8_t>::min());
+        CHECK(fieldValue<uint8_t>(payload, FidU8) == std::numeric_limits<uint8_t>::max());
+        CHECK(fieldValue<int16_t>(payload, FidI16) == std::numeric_limits<int16_t>::min());
+        CHECK(fieldValue<uint16_t>(payload, FidU16) == std::numeric_limits<uint16_t>::max());
+        CHECK(fieldValue<int32_t>(payload, FidI32) == std::numeric_limits<int32_t>::min());
+        CHECK(fieldValue<uint32_t>(payload, FidU32) == std::numeric_limits<uint32_t>::max());
+        CHECK(fieldValue<int64_t>(payload, FidI64) == std::numeric_limits<int64_t>::min());
+        CHECK(fieldValue<uint64_t>(payload, FidU64) == std::numeric_limits<uint64_t>::max());
+        CHECK(fieldValue<float>(payload, FidF32) == -1.25f);
+        CHECK(fieldValue<double>(payload, FidF64) == 123456.789012);
+        CHECK(fieldValue<bool>(payload, FidBool) == true);
+        CHECK(fieldValue<char>(payload, FidChar) == 'Z');
+        CHECK(fieldValue<std::string>(payload, FidString) == std::string("a string\0with a nul", 19));
+        CHECK(fieldValue<std::string>(payload, FidEmptyString).empty());
+        CHECK(fieldValue<int16_t>(payload, FidLarge) == -1);
+
+        // the field types come through as they were, not as the kind of value they hold
+        CHECK(payload.cfindField(FidI8, 0)->type_ == MAMA_FIELD_TYPE_I8);
+        CHECK(payload.cfindField(FidString, 0)->type_ == MAMA_FIELD_TYPE_STRING);
+        CHECK(payload.cfindField(FidPrice, 0)->type_ == MAMA_FIELD_TYPE_PRICE);
+        CHECK(payload.cfindField(FidDateTime, 0)->type_ == MAMA_FIELD_TYPE_TIME);
+        CHECK(payload.cfindField(FidOpaque, 0)->type_ == MAMA_FIELD_TYPE_OPAQUE);
+        CHECK(payload.cfindField(FidVectorString, 0)->type_ == MAMA_FIELD_TYPE_VECTOR_STRING);
+        CHECK(payload.cfindField(FidMsg, 0)->type_ == MAMA_FIELD_TYPE_MSG);
+        CHECK(payload.cfindField(FidVectorMsg, 0)->type_ == MAMA_FIELD_TYPE_VECTOR_MSG);
+
+        // price
+        const MamaPriceWrapper_ptr_t* price = variantValue<MamaPriceWrapper_ptr_t>(payload, FidPrice);
+        CHECK(price != 0 && *price);
+        if (price != 0 && *price)
+        {
+            double value = 0;
+            mamaPriceHints hints = 0;
+            mamaPrice_getValue((*price)->getMamaPrice(), &value);
+            mamaPrice_getHints((*price)->getMamaPrice(), &hints);
+            CHECK(value == 101.5);
+            CHECK(hints == MAMA_PRICE_HINTS_DECIMAL_4);
+        }
+        const MamaPriceWrapper_ptr_t* nullPrice = variantValue<MamaPriceWrapper_ptr_t>(payload, FidNullPrice);
+        CHECK(nullPrice != 0 && !*nullPrice);
+
+        // date time
+        const MamaDateTimeWrapper_ptr_t* dt = variantValue<MamaDateTimeWrapper_ptr_t>(payload, FidDateTime);
+        CHECK(dt != 0 && *dt);
+        if (dt != 0 && *dt)
+        {
+            mama_u64_t micros = 0;
+            mamaDateTimePrecision precision = MAMA_DATE_TIME_PREC_UNKNOWN;
+            mamaDateTime_getEpochTimeMicroseconds((*dt)->getMamaDateTime(), &micros);
+            mamaDateTime_getPrecision((*dt)->getMamaDateTime(), &precision);
+            CHECK(micros == DateTimeMicros);
+            CHECK(precision == MAMA_DATE_TIME_PREC_MICROSECONDS);
+        }
+        const MamaDateTimeWrapper_ptr_t* nullDt = variantValue<MamaDateTimeWrapper_ptr_t>(payload, FidNullDateTime);
+        CHECK(nullDt != 0 && !*nullDt);
+
+        // opaque
+        const void* data = 0;
+        size_t length = 0;
+        CHECK(payload.cfindField(FidOpaque, 0)->getOpaque(&data, &length) == MAMA_STATUS_OK);
+        const unsigned char opaque[] = { 0x00, 0x01, 0x80, 0xff, 0x00, 0x7f };
+        CHECK(length == sizeof(opaque) && memcmp(data, opaque, sizeof(opaque)) == 0);
+        const MamaOpaqueWrapper_ptr_t* nullOpaque = variantValue<MamaOpaqueWrapper_ptr_t>(payload, FidNullOpaque);
+        CHECK(nullOpaque != 0 && !*nullOpaque);
+
+        // the vectors of fixed size elements
+        const int32_t ints[] = { 0, -1, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min() };
+        const UpaFieldPayload* vectorI32 = payload.cfindField(FidVectorI32, 0);
+        CHECK(vectorI32->type_ == MAMA_FIELD_TYPE_I32);
+        CHECK(vectorI32->dataVector1_ == std::string((const char*)ints, sizeof(ints)));
+        const double doubles[] = { 0.5, -2.25, 1e300 };
+        const UpaFieldPayload* vectorF64 = payload.cfindField(FidVectorF64, 0);
+        CHECK(vectorF64->type_ == MAMA_FIELD_TYPE_F64);
+        CHECK(vectorF64->dataVector1_ == std::string((const char*)doubles, sizeof(doubles)));
+
+        // the string vector, which has to give out c strings as well
+        const char** strings = 0;
+        size_t numStrings = 0;
+        CHECK(payload.get(FidVectorString, 0, &strings, &numStrings) == MAMA_STATUS_OK);
+        CHECK(numStrings == 3);
+        if (numStrings == 3)
+        {
+            CHECK(strcmp(strings[0], "one") == 0);
+            CHECK(strcmp(strings[1], "") == 0);
+            CHECK(strcmp(strings[2], "three") == 0);
+        }
+
+        // nested messages
+        const MamaMsgPayloadWrapper_ptr_t* msg = variantValue<MamaMsgPayloadWrapper_ptr_t>(payload, FidMsg);
+        CHECK(msg != 0 && *msg);
+        if (msg != 0 && *msg)
+        {
+            checkNested(*reinterpret_cast<const UpaPayload*>((*msg)->getMamaMsgPayload()), 7, true);
+        }
+        const MamaMsgPayloadWrapper_ptr_t* nullMsg = variantValue<MamaMsgPayloadWrapper_ptr_t>(payload, FidNullMsg);
+        CHECK(nullMsg != 0 && !*nullMsg);
+
+        const msgPayload* parts = 0;
+        size_t numParts = 0;
+        CHECK(payload.get(FidVectorMsg, 0, &parts, &numParts) == MAMA_STATUS_OK);
+        CHECK(numParts == 2);
+        if (numParts == 2)
+        {
+            checkNested(*reinterpret_cast<const UpaPayload*>(parts[0]), 1, false);
+            checkNested(*reinterpret_cast<const UpaPayload*>(parts[1]), 2, true);
+        }
+
+        // names
+        const UpaFieldPayload* named = payload.cfindField(FidPrice, 0);
+        if (withNames)
+        {
+            CHECK(strcmp(named->name_, "PRICE") == 0);
+            CHECK(payload.cfindField(0, "VECTOR_MSG") == payload.cfindField(FidVectorMsg, 0));
+        }
+        else
+        {
+            CHECK(named->name_ != 0 && named->name_[0] == '\0');
+        }
+    }
+
+    void testRoundTrip(bool withNames)
+    {
+        std::vector<MamaMsgPayloadWrapper_ptr_t> vectorParts;
+        UpaPayload payload;
+        buildPayload(payload, vectorParts);
+
+        std::vector<unsigned char> buffer;
+        UpaPayloadSerializer::serialize(payload, buffer, withNames);
+        CHECK(buffer.size() > 8);
+
+        UpaPayload decoded;
+        CHECK(UpaPayloadSerializer::unSerialize(decoded, buffer.data(), buffer.size()) == MAMA_STATUS_OK);
+        checkPayload(decoded, withNames);
+
+        // encoding the decoded payload gives the same bytes
+        std::vector<unsigned char> again;
+        UpaPayloadSerializer::serialize(decoded, again, withNames);
+        CHECK(again == buffer);
+
+        // decoding into a payload that already has fields replaces them
+        UpaPayload reused;
+        reused.set(FidLarge + 1, "STALE", (int32_t)1);
+        CHECK(UpaPayloadSerializer::unSerialize(reused, buffer.data(), buffer.size()) == MAMA_STATUS_OK);
+        CHECK(reused.cfindField(FidLarge + 1, 0) == 0);
+        checkPayload(reused, withNames);
+    }
+
+    void testDamagedBuffers()
+    {
+        std::vector<MamaMsgPayloadWrapper_ptr_t> vectorParts;
+        UpaPayload payload;
+        buildPayload(payload, vectorParts);
+
+        std::vector<unsigned char> buffer;
+        UpaPayloadSerializer::serialize(payload, buffer);
+
+        // every truncation fails cleanly and leaves the payload empty
+        for (size_t length = 0; length < buffer.size(); ++length)
+        {
+            UpaPayload decoded;
+            if (UpaPayloadSerializer::unSerialize(decoded, buffer.data(), length) != MAMA_STATUS_INVALID_ARG)
+            {
+                std::cerr << "truncated to " << length << " bytes was accepted" << std::endl;
+                CHECK(false);
+                break;
+            }
+            CHECK(decoded.numFields() == 0);
+        }
+
+        std::vector<unsigned char> badMagic(buffer);
+        badMagic[0] = 'X';
+        UpaPayload decoded;
+        CHECK(UpaPayloadSerializer::unSerialize(decoded, badMagic.data(), badMagic.size()) == MAMA_STATUS_INVALID_ARG);
+
+        std::vector<unsigned char> badVersion(buffer);
+        badVersion[2] = UpaPayloadSerializer::Version + 1;
+        CHECK(UpaPayloadSerializer::unSerialize(decoded, badVersion.data(), badVersion.size()) == MAMA_STATUS_INVALID_ARG);
+    }
+
+    void testEmptyPayload()
+    {
+        UpaPayload payload;
+        std::vector<unsigned char> buffer;
+        UpaPayloadSerializer::serialize(payload, buffer);
+
+        UpaPayload decoded;
+        CHECK(UpaPayloadSerializer::unSerialize(decoded, buffer.data(), buffer.size()) == MAMA_STATUS_OK);
+        CHECK(decoded.numFields() == 0);
+    }
+
+    // a decoded payload that is cleared for reuse doesnt keep the nested messages and wrappers of its last message
+    void testClearReleases()
+    {
+        mamaPrice price;
+        mamaPrice_create(&price);
+        MamaPriceWrapper_ptr_t priceWrapper(new MamaPriceWrapper(price));
+        MamaMsgPayloadWrapper_ptr_t nested = makeNested(1, false);
+
+        UpaPayload payload;
+        payload.setPrice(FidPrice, "PRICE", priceWrapper);
+        payload.setMsg(FidMsg, "MSG", nested);
+        const char* strings[] = { "one", "two" };
+        payload.setVectorString(FidVectorString, "VECTOR_STRING", strings, 2);
+        CHECK(priceWrapper.use_count() == 2);
+        CHECK(nested.use_count() == 2);
+
+        payload.clear();
+        CHECK(payload.numFields() == 0);
+        CHECK(priceWrapper.use_count() == 1);
+        CHECK(nested.use_count() == 1);
+
+        // and the slots still take new fields
+        payload.set(FidI32, "I32", (int32_t)5);
+        CHECK(fieldValue<int32_t>(payload, FidI32) == 5);
+        CHECK(payload.cfindField(FidPrice, 0) == 0);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    testRoundTrip(true);
+    testRoundTrip(false);
+    testDamagedBuffers();
+    testEmptyPayload();
+    testClearReleases();
+
+    if (failures != 0)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "UpaPayloadSerializer round trip tests passed" << std::endl;
+    return 0;
+}
@@ -308,6 +308,73 @@ struct UpaFieldPayload
    {
    }
 
+   // Overwrite the field in place. The payload reuses its field slots from message to message, so this keeps hold of
+   // any storage the slot already has (a string keeps its capacity) rather than building a new field
+   template <typename T>
+   void assign(const mama_fid_t fid, const char* name, const T& value)
+   {
+      reset(fid, name, MamaFieldType<T>::Value);
+      data_ = value;
+   }
+
+   void assign(const mama_fid_t fid, const char* name, const char* value)
+   {
+      reset(fid, name, MAMA_FIELD_TYPE_STRING);
+      std::string* str = boost::get<std::string>(&data_);
+      if (str != 0)
+      {
+         str->assign(value);
+      }
+      else
+      {
+         data_ = std::string(value);
+      }
+   }
+
+   void assign(const mama_fid_t fid, const char* name, const MamaMsgPayloadWrapper_ptr_t& value)
+   {
+      reset(fid, name, MAMA_FIELD_TYPE_MSG);
+      data_ = value;
+   }
+
+   void assign(const mama_fid_t fid, const char* name, const MamaMsgVectorWrapper_ptr_t& value)
+   {
+      reset(fid, name, MAMA_FIELD_TYPE_VECTOR_MSG);
+      data_ = value;
+   }
+
+   void reset(const mama_fid_t fid, const char* name, mamaFieldType type)
+   {
+      fid_ = fid;
+      name_ = name;
+      type_ = type;
+
+      dataVector1_.clear();
+      if (stringVector1_)
+      {
+         stringVector1_.reset();
+         stringVector2_.reset();
+      }
+   }
+
+   // Let go of what the field refers to when the payload clears its slot - the price, date time, opaque and nested
+   // message wrappers and the string vectors - so they dont live on until a later message reuses the slot. The string
+   // and byte vector storage are kept for the slot's next field
+   void releaseData()
+   {
+      if (boost::get<std::string>(&data_) == 0)
+      {
+         data_ = (int8_t)0;
+      }
+
+      dataVector1_.clear();
+      if (stringVector1_)
+      {
+         stringVector1_.reset();
+         stringVector2_.reset();
+      }
+   }
+
    //This macro is undef-ed later on
 #define CHECK_UPA_FIELD_PAYLOAD \
    do { \
@@ -28,6 +28,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <sstream>
 
 #include "upafieldpayload.h"
@@ -36,26 +37,46 @@
 #include <utils/namespacedefines.h>
 
 class UpaPayloadFieldIterator;
+class UpaPayloadSerializer;
+
+// The payload holds its fields in a flat array, in the order they were added, and finds them by fid through an open
+// addressed index into the array.
+//
+// The array slots are not released by clear(). Messages are reused for every update on a subscription so, once the
+// payload has seen its largest message, adding a field overwrites a slot left over from an earlier message and the
+// field keeps its string storage. clear() does drop the wrappers and nested messages the fields refer to.
 
 class UpaPayload
 {
 public:
     friend class UpaPayloadFieldIterator;
-    typedef utils::collection::unordered_map<mama_fid_t, UpaFieldPayload> FieldsMap_t;
-    typedef FieldsMap_t::const_iterator FieldIterator_t;
+    friend class UpaPayloadSerializer;
+    typedef std::vector<UpaFieldPayload> Fields_t;
+    typedef Fields_t::const_iterator FieldIterator_t;
 
     UpaPayload(mamaMsg parent) :
-        parent_ (parent)
+        parent_ (parent), numFields_(0), indexMask_(0)
     {}
 
     UpaPayload() :
-        parent_ (0), numDirtyFields_(0)
+        parent_ (0), numFields_(0), indexMask_(0)
     {}
 
     UpaPayload(const UpaPayload& payload) :
         parent_ (payload.parent_),
-        fields_ (payload.fields_)
-    {}
+        fields_ (payload.fieldsBegin(), payload.fieldsEnd()),
+        numFields_ (payload.numFields_),
+        index_ (payload.index_),
+        indexMask_ (payload.indexMask_)
+    {
+        if (!payload.names_.empty())
+        {
+            for (size_t i = 0; i < numFields_; ++i)
+            {
+                fields_[i].name_ = internName(fields_[i].name_);
+            }
+        }
+    }
 
     ~UpaPayload()
     {
@@ -63,8 +84,21 @@ public:
 
     UpaPayload& operator=(const UpaPayload& payload)
     {
-        parent_ = payload.parent_;
-        fields_ = payload.fields_;
+        if (this != &payload)
+        {
+            parent_ = payload.parent_;
+
+            clear();
+            for (size_t i = 0; i < payload.numFields_; ++i)
+            {
+                UpaFieldPayload& field = appendField(payload.fields_[i].fid_);
+                field = payload.fields_[i];
+                if (!payload.names_.empty())
+                {
+                    field.name_ = internName(field.name_);
+                }
+            }
+        }
 
         return *this;
     }
@@ -81,84 +115,32 @@ public:
 
     void set(mama_fid_t fid, const char* name, const std::string& value)
     {
-        fields_.emplace(fid, UpaFieldPayload(fid, name, value));
+        // doesnt replace an existing field
+        if (findIndex(fid) == NoField)
+        {
+            appendField(fid).assign(fid, name, value);
+        }
     }
 
     void setPrice(mama_fid_t fid, const char* name, const MamaPriceWrapper_ptr_t& value)
     {
-        FieldsMap_t::iterator it = fields_.empty() ? fields_.end() : fields_.find(fid);
-
-        if (it != fields_.end())
-        {
-            UpaFieldPayload fld = it->second;
-            if (fld.type_ == MAMA_FIELD_TYPE_PRICE)
-            {
-                //fields_[fid] = UpaFieldPayload(fid, name, value);
-                it->second =  std::move(UpaFieldPayload(fid, name, value));
-            }
-        }
-        else
-        {
-            fields_.emplace(fid, UpaFieldPayload(fid, name, value));
-        }
+        setIfSameType(fid, name, value, MAMA_FIELD_TYPE_PRICE);
     }
 
     void setMsg(mama_fid_t fid, const char* name, const MamaMsgPayloadWrapper_ptr_t& value)
     {
-        FieldsMap_t::iterator it = fields_.empty() ? fields_.end() : fields_.find(fid);
-
-        if (it != fields_.end())
-        {
-            UpaFieldPayload fld = it->second;
-            if (fld.type_ == MAMA_FIELD_TYPE_MSG)
-            {
-                //fields_[fid] = UpaFieldPayload(fid, name, value);
-                it->second =  std::move(UpaFieldPayload(fid, name, value));
-            }
-        }
-        else
-        {
-            fields_.emplace(fid, UpaFieldPayload(fid, name, value));
-        }
+        setIfSameType(fid, name, value, MAMA_FIELD_TYPE_MSG);
     }
 
 
     void setVectorMsg(mama_fid_t fid, const char* name, const MamaMsgVectorWrapper_ptr_t& value)
     {
-        FieldsMap_t::iterator it = fields_.empty() ? fields_.end() : fields_.find(fid);
-
-        if (it != fields_.end())
-        {
-            UpaFieldPayload fld = it->second;
-            if (fld.type_ == MAMA_FIELD_TYPE_VECTOR_MSG)
-            {
-                //fields_[fid] = UpaFieldPayload(fid, name, value);
-                it->second =  std::move(UpaFieldPayload(fid, name, value));
-            }
-        }
-        else
-        {
-            fields_.emplace(fid, UpaFieldPayload(fid, name, value));
-        }
+        setIfSameType(fid, name, value, MAMA_FIELD_TYPE_VECTOR_MSG);
     }
 
     void setOpaque(mama_fid_t fid, const char* name, const MamaOpaqueWrapper_ptr_t& value)
     {
-        FieldsMap_t::iterator it = fields_.empty() ? fields_.end() : fields_.find(fid);
-
-        if (it != fields_.end())
-        {
-            UpaFieldPayload fld = it->second;
-            if (fld.type_ == MAMA_FIELD_TYPE_OPAQUE)
-            {
-                //fields_[fid] = UpaFieldPayload(fid, name, value);
-                it->second =  std::move(UpaFieldPayload(fid, name, value));
-            }
-        }
-        else
-        {
-            fields_.emplace(fid, UpaFieldPayload(fid, name, value));
-        }
+        setIfSameType(fid, name, value, MAMA_FIELD_TYPE_OPAQUE);
     }
 
     //////////////////////////////////////////////////////////////////////////
@@ -166,7 +148,7 @@ public:
     void setVectorString(mama_fid_t fid, const char* name, const char *value[],
         size_t numElements)
     {
-        fields_[fid] = UpaFieldPayload(fid, name, value, numElements);
+        fieldFor(fid) = UpaFieldPayload(fid, name, value, numElements);
     }
 
     //////////////////////////////////////////////////////////////////////////
@@ -175,7 +157,7 @@ public:
     void setVector(mama_fid_t fid, const char* name, const T value[],
         size_t numElements)
     {
-        fields_[fid] = UpaFieldPayload(fid, name, value, numElements);
+        fieldFor(fid) = UpaFieldPayload(fid, name, value, numElements);
     }
 
     //////////////////////////////////////////////////////////////////////////
@@ -183,147 +165,132 @@ public:
     template <typename T>
     void set(mama_fid_t fid, const char* name, T value)
     {
-        FieldsMap_t::iterator it = fields_.empty() ? fields_.end() : fields_.find(fid);
-        if (it != fields_.end())
-        {
-            //fields_[fid] = UpaFieldPayload(fid, name, value);
-            it->second = std::move(UpaFieldPayload(fid, name, value));
-        }
-        else
-        {
-            fields_.emplace(fid, UpaFieldPayload(fid, name, value));
-        }
+        fieldFor(fid).assign(fid, name, value);
     }
 
     //////////////////////////////////////////////////////////////////////////
     //
-    UpaPayload::FieldsMap_t::const_iterator cfindField(mama_fid_t fid, const char *name) const
+    const UpaFieldPayload* cfindField(mama_fid_t fid, const char *name) const
     {
         // The non-const version of findField() doesn't modify the UpaPayload, so it's
         // safe to strip the const-ness here
         return const_cast<UpaPayload *>(this)->findField(fid, name);
     }
 
-    UpaPayload::FieldsMap_t::iterator findField(mama_fid_t fid, const char *name)
+    UpaFieldPayload* findField(mama_fid_t fid, const char *name)
     {
         // Prefer the fid, as that is much more efficient.
-        FieldsMap_t::iterator itField;
-        if (0 != fid && !fields_.empty())
+        if (0 != fid)
         {
-            itField = fields_.find(fid);
-            if (itField != fields_.end())
+            size_t pos = findIndex(fid);
+            if (pos != NoField)
             {
-                return itField;
+                return &fields_[pos];
             }
         }
-        if (name != 0 && !fields_.empty())
+        if (name != 0)
         {
             // Searching for the field by name requires O(n) time.
-            for (itField = fields_.begin(); itField != fields_.end(); ++itField)
+            for (size_t i = 0; i < numFields_; ++i)
             {
-                if (strcmp(itField->second.name_, name) == 0)
+                if (strcmp(fields_[i].name_, name) == 0)
                 {
-                    return itField;
+                    return &fields_[i];
                 }
             }
         }
-        return fields_.end();
+        return 0;
     }
 
     mama_status get(mama_fid_t fid, const char *name, const char** value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
         {
             return MAMA_STATUS_NOT_FOUND;
         }
 
-        mama_status ret = MAMA_STATUS_OK;
-        try
-        {
-            *value = boost::get<std::string>(itField->second.data_).c_str();
-        }
-        catch (boost::bad_get&)
+        const std::string* str = boost::get<std::string>(&field->data_);
+        if (str == 0)
         {
-            ret = MAMA_STATUS_WRONG_FIELD_TYPE;
+            return MAMA_STATUS_WRONG_FIELD_TYPE;
         }
 
-        return ret;
+        *value = str->c_str();
+        return MAMA_STATUS_OK;
     }
 
     mama_status get(mama_fid_t fid, const char *name, int8_t & value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
         {
             return MAMA_STATUS_NOT_FOUND;
         }
 
-        return itField->second.get(value);
+        return field->get(value);
     }
 
     mama_status get(mama_fid_t fid, const char *name, uint8_t & value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
             return MAMA_STATUS_NOT_FOUND;
 
-        return itField->second.get(value);
+        return field->get(value);
     }
 
     mama_status get(mama_fid_t fid, const char *name, int16_t & value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
             return MAMA_STATUS_NOT_FOUND;
 
-        return itField->second.get(value);
+        return field->get(value);
     }
 
     mama_status get(mama_fid_t fid, const char *name, uint16_t & value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
             return MAMA_STATUS_NOT_FOUND;
 
-        return itField->second.get(value);
+        return field->get(value);
     }
 
     mama_status get(mama_fid_t fid, const char *name, int32_t & value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
             return MAMA_STATUS_NOT_FOUND;
 
-        return itField->second.get(value);
+        return field->get(value);
     }
 
     mama_status get(mama_fid_t fid, const char *name, uint32_t & value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
             return MAMA_STATUS_NOT_FOUND;
 
-        return itField->second.get(value);
+        return field->get(value);
     }
 
     mama_status get(mama_fid_t fid, const char *name, const char*** value, size_t* resultLen) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
         {
             return MAMA_STATUS_NOT_FOUND;
         }
 
-        return (const_cast<UpaFieldPayload *>(&itField->second))->get(value, resultLen);
+        return (const_cast<UpaFieldPayload *>(field))->get(value, resultLen);
     }
 
     mama_status get(mama_fid_t fid, const char *name, const msgPayload** value, size_t* resultLen) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
         {
             return MAMA_STATUS_NOT_FOUND;
         }
@@ -332,7 +299,7 @@ public:
 
 
         // todo - need to change the vector wrapper so that it is a vector of msgPayLoad not the payload wrapper class
-        const MamaMsgVectorWrapper_ptr_t& msgVec = (MamaMsgVectorWrapper_ptr_t)boost::get<MamaMsgVectorWrapper_ptr_t>(itField->second.data_);
+        const MamaMsgVectorWrapper_ptr_t& msgVec = (MamaMsgVectorWrapper_ptr_t)boost::get<MamaMsgVectorWrapper_ptr_t>(field->data_);
         *value = msgVec->GetVector();
         *resultLen = msgVec->getVectorLength();
 
@@ -341,24 +308,24 @@ public:
 
     mama_status getPrice(mama_fid_t fid, const char *name, mamaPrice& value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
         {
             return MAMA_STATUS_NOT_FOUND;
         }
 
-        return itField->second.getPrice(value);
+        return field->getPrice(value);
     }
 
     mama_status getDateTime(mama_fid_t fid, const char *name, mamaDateTime& value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
         {
             return MAMA_STATUS_NOT_FOUND;
         }
 
-        return itField->second.getDateTime(value);
+        return field->getDateTime(value);
     }
 
     // for others
@@ -366,38 +333,38 @@ public:
     template <typename T>
     mama_status get(mama_fid_t fid, const char *name, T& value/*out*/) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
         {
             return MAMA_STATUS_NOT_FOUND;
         }
 
-        return itField->second.get(value);
+        return field->get(value);
     }
 
     mama_status getAsString(mama_fid_t fid, const char *name, std::string& value) const
     {
-        FieldsMap_t::const_iterator itField = cfindField(fid, name);
-        if (itField == fields_.end())
+        const UpaFieldPayload* field = cfindField(fid, name);
+        if (field == 0)
             return MAMA_STATUS_NOT_FOUND;
 
         mama_status ret = MAMA_STATUS_OK;
-        if (itField->second.type_ == MAMA_FIELD_TYPE_STRING)
+        if (field->type_ == MAMA_FIELD_TYPE_STRING)
         {
             try
             {
-                value = boost::get<std::string>(itField->second.data_);
+                value = boost::get<std::string>(field->data_);
             }
             catch (boost::bad_get&)
             {
                 ret = MAMA_STATUS_WRONG_FIELD_TYPE;
             }
         }
-        else if (itField->second.type_ == MAMA_FIELD_TYPE_TIME)
+        else if (field->type_ == MAMA_FIELD_TYPE_TIME)
         {
             try
             {
-                uint64_t ms = boost::get<uint64_t>(itField->second.data_);
+                uint64_t ms = boost::get<uint64_t>(field->data_);
                 value = epochTimeToString(ms);
             }
             catch (boost::bad_get&)
@@ -409,7 +376,7 @@ public:
         {
             std::ostringstream oss;
 
-            oss << itField->second.data_;
+            oss << field->data_;
             value = oss.str();
         }
 
@@ -418,14 +385,14 @@ public:
 
     inline mama_status getField(mama_fid_t fid, const char *name, msgFieldPayload* result) const
     {
-        FieldsMap_t::const_iterator found = cfindField(fid, name);
-        if (found == fields_.end())
+        const UpaFieldPayload* found = cfindField(fid, name);
+        if (found == 0)
         {
             *result = 0;
             return MAMA_STATUS_NOT_FOUND;
         }
 
-        *result = (msgFieldPayload)&found->second;
+        *result = (msgFieldPayload)found;
 
         return MAMA_STATUS_OK;
     }
@@ -433,28 +400,10 @@ public:
     mama_status iterateFields(mamaMsgField field,
         mamaMsgIteratorCb cb, void *closure) const
     {
-        // if its an image then want to send all the fields
-        // get the message type
-        //int32_t msgType;
-        //try {
-        //    get(1, 0, msgType);
-        //}
-        //catch (boost::bad_get&)
-        //{
-        //    msgType = MAMA_STATUS_WRONG_FIELD_TYPE;
-        //}
-
-
-        //bool allFields = msgType == (MAMA_MSG_TYPE_INITIAL);
-
-        for (FieldIterator_t fld = fields_.begin(); fld != fields_.end(); ++fld)
+        for (size_t i = 0; i < numFields_; ++i)
         {
-            //if (allFields || fld->second.dirty_)
-            //{
-                mamaMsgFieldImpl_setPayload (field, (msgFieldPayload)&fld->second);
-                (cb)(parent_, field, closure);
-            //}
-
+            mamaMsgFieldImpl_setPayload (field, (msgFieldPayload)&fields_[i]);
+            (cb)(parent_, field, closure);
         }
 
         return MAMA_STATUS_OK;
@@ -462,81 +411,182 @@ public:
 
     void clear()
     {
-        //FieldsMap_t::iterator fld;
-        //for ( fld = fields_.begin(); fld != fields_.end(); ++fld)
-        //{
-        //    fld->second.dirty_ = false;
-        //}
+        // empty the index by walking back through the fields, latest first, so each fid's probe sequence is still
+        // intact when we come to clear it. This keeps clear proportional to the number of fields rather than the
+        // size of the index
+        while (numFields_ > 0)
+        {
+            --numFields_;
+            fields_[numFields_].releaseData();
+
+            size_t pos = fields_[numFields_].fid_ & indexMask_;
+            while (index_[pos] != numFields_ + 1)
+            {
+                pos = (pos + 1) & indexMask_;
+            }
+            index_[pos] = 0;
+        }
+    }
+
+    size_t numFields() const
+    {
+        return numFields_;
+    }
 
-        //numDirtyFields_ = 0;
-        fields_.clear();
+    // somewhere for the payload's serialized form to live while the caller uses it
+    std::vector<unsigned char>& serializeBuffer() const
+    {
+        return serialized_;
     }
 
-    //void markAllDirty()
-    //{
-    //    // mark all the fields as dirty
-    //    // this will force the iterator to behave as if the message is an image
-    //    FieldsMap_t::iterator fld;
-    //    for ( fld = fields_.begin(); fld != fields_.end(); ++fld)
-    //    {
-    //        fld->second.dirty_ = false;
-    //    }
+    void apply(const UpaPayload* src)
+    {
+        // merge src into this
+        for (size_t i = 0; i < src->numFields_; ++i)
+        {
+            const UpaFieldPayload& srcField = src->fields_[i];
+
+            // just copy the field value
+            UpaFieldPayload& field = fieldFor(srcField.fid_);
+            field = srcField;
+            if (!src->names_.empty())
+            {
+                field.name_ = internName(field.name_);
+            }
+        }
+    }
 
-    //    numDirtyFields_ = fields_.size();
-    //}
+private:
+    static const size_t NoField = (size_t)-1;
+    static const size_t MinIndexSize = 64;
 
-    size_t numFields() const
+    // position of the field with this fid in the field array
+    size_t findIndex(mama_fid_t fid) const
     {
-        // with this implementation of the payload there is no way to track the number of dirty fields as a field value might me updated
-        // outside of the context of the payload - the best we can do is walk the collection and count the dirty fields
+        if (numFields_ == 0)
+        {
+            return NoField;
+        }
 
-        //size_t numDirty = 0;
+        // fids are mostly small and dense, so the fid itself spreads them well enough over the index
+        size_t pos = fid & indexMask_;
+        for (;;)
+        {
+            uint32_t entry = index_[pos];
+            if (entry == 0)
+            {
+                return NoField;
+            }
 
-        //FieldsMap_t::const_iterator it = fields_.begin();
-        //while(it != fields_.end())
-        //{
-        //    if (it->second.dirty_)
-        //    {
-        //        numDirty++;
-        //    }
-        //    ++it;
+            if (fields_[entry - 1].fid_ == fid)
+            {
+                return entry - 1;
+            }
 
-        //}
+            pos = (pos + 1) & indexMask_;
+        }
+    }
 
-        //return numDirty;
+    // add a field slot for a fid that isnt in the payload. The caller fills in the field
+    UpaFieldPayload& appendField(mama_fid_t fid)
+    {
+        // keep the index at most half full
+        if ((numFields_ + 1) * 2 > index_.size())
+        {
+            growIndex();
+        }
+
+        if (numFields_ == fields_.size())
+        {
+            fields_.push_back(UpaFieldPayload());
+        }
 
-              return fields_.size();
+        size_t pos = fid & indexMask_;
+        while (index_[pos] != 0)
+        {
+            pos = (pos + 1) & indexMask_;
+        }
+        index_[pos] = (uint32_t)(numFields_ + 1);
+
+        return fields_[numFields_++];
     }
 
-    void apply(const UpaPayload* src)
+    // the existing field for the fid, or a new one
+    UpaFieldPayload& fieldFor(mama_fid_t fid)
     {
-        // merge src into this
+        size_t pos = findIndex(fid);
+        return (pos != NoField) ? fields_[pos] : appendField(fid);
+    }
 
-        FieldsMap_t::const_iterator itSrcField = src->fields_.begin();
-        while (itSrcField != src->fields_.end())
+    // only replace an existing field if it is of the same type
+    template <typename T>
+    void setIfSameType(mama_fid_t fid, const char* name, const T& value, mamaFieldType type)
+    {
+        size_t pos = findIndex(fid);
+        if (pos == NoField)
+        {
+            appendField(fid).assign(fid, name, value);
+        }
+        else if (fields_[pos].type_ == type)
         {
-            const UpaFieldPayload& srcField = itSrcField->second;
+            fields_[pos].assign(fid, name, value);
+        }
+    }
 
-            FieldsMap_t::iterator itDestField = fields_.find(srcField.fid_);
-            if (itDestField != fields_.end())
-            {
-                // just copy the field value
-                itDestField->second = srcField;
-            }
-            else
+    void growIndex()
+    {
+        size_t size = index_.size() * 2;
+        if (size < MinIndexSize)
+        {
+            size = MinIndexSize;
+        }
+        index_.assign(size, 0);
+        indexMask_ = size - 1;
+
+        // the fields are re-indexed in the order they were added, which clear() depends on
+        for (size_t i = 0; i < numFields_; ++i)
+        {
+            size_t pos = fields_[i].fid_ & indexMask_;
+            while (index_[pos] != 0)
             {
-                fields_.emplace(srcField.fid_, UpaFieldPayload(srcField));
+                pos = (pos + 1) & indexMask_;
             }
-
-            ++itSrcField;
+            index_[pos] = (uint32_t)(i + 1);
         }
     }
 
-private:
+    // Field names normally point at names that outlive the payload (the field map or the caller's literals). Names
+    // that have been read from a serialized payload are kept here instead, and anything copying fields out of this
+    // payload takes its own copy of them
+    const char* internName(const char* name)
+    {
+        return names_.insert(std::string(name)).first->c_str();
+    }
+
+    FieldIterator_t fieldsBegin() const
+    {
+        return fields_.begin();
+    }
+
+    FieldIterator_t fieldsEnd() const
+    {
+        return fields_.begin() + numFields_;
+    }
+
     mamaMsg parent_;
 
-    size_t numDirtyFields_;
-    FieldsMap_t fields_;
+    // the field slots, only the first numFields_ are in use
+    Fields_t fields_;
+    size_t numFields_;
+
+    // power of 2 sized, each entry is the position of a field in fields_ plus 1, or 0 if the entry is empty
+    std::vector<uint32_t> index_;
+    size_t indexMask_;
+
+    std::set<std::string> names_;
+
+    // the result of the last serialize, which the caller can hold onto until the next one
+    mutable std::vector<unsigned char> serialized_;
 };
 
 
@@ -546,19 +596,19 @@ private:
 class UpaPayloadFieldIterator
 {
     const UpaPayload* payloadContext_;
-    UpaPayload::FieldsMap_t::const_iterator current_;
+    UpaPayload::FieldIterator_t current_;
 
     // hold state for mama's notion of begin (which is infront of the boost/stl begin)
     bool mamaBegin_;
 public:
-    typedef UpaPayload::FieldsMap_t::const_iterator const_iterator;
+    typedef UpaPayload::FieldIterator_t const_iterator;
     /**
     * @brief Associate the iterator with another payload and reset position
     * @param payload another payload
     */
     UpaPayloadFieldIterator(const UpaPayload & payload)
         : payloadContext_(&payload)
-        , current_ (payload.fields_.begin())
+        , current_ (payload.fieldsBegin())
         , mamaBegin_(true)
     {
     }
@@ -568,7 +618,7 @@ public:
     */
     UpaPayloadFieldIterator(const UpaPayloadFieldIterator& rhs)
         : payloadContext_(rhs.payloadContext_)
-        , current_ ((rhs.payloadContext_)->fields_.begin())
+        , current_ ((rhs.payloadContext_)->fieldsBegin())
     {
     }
     /**
@@ -592,7 +642,7 @@ public:
     {
         mamaBegin_ = true;
         payloadContext_ = &payload;
-        current_ = payload.fields_.begin();
+        current_ = payload.fieldsBegin();
     }
     /**
     * @brief next item on the payload
@@ -603,18 +653,13 @@ public:
         if (current_==end())
             return end();
 
-        //// mama iterator expects begin to point in front of the first item
-        //// so if we are at the "start" in mama terms then just return the first item for next, if its dirty
-        //// otherwise if its not dirty, fall through and find the first dirty item
-
+        // mama iterator expects begin to point in front of the first item
         if (mamaBegin_)
         {
             mamaBegin_ = false;
             return beginInternal();
         }
 
-        //const_iterator tmp = NextDirty();
-        //return tmp;
         return ++current_;
     }
     /**
@@ -623,8 +668,6 @@ public:
     */
     bool has_next() const
     {
-        //UpaPayload::FieldsMap_t::const_iterator tmp = current_;
-        //return ++tmp != payloadContext_->fields_.end();
         return InternalHasNext();
     }
     /**
@@ -637,12 +680,12 @@ public:
     {
 
         mamaBegin_ = true;
-        return payloadContext_->fields_.begin();
+        return payloadContext_->fieldsBegin();
     }
 
     const_iterator beginInternal()
     {
-        return payloadContext_->fields_.begin();
+        return payloadContext_->fieldsBegin();
     }
 
     /** THIS ONE IS MOST PROBABLY DEPRACATED AND SHOULD NOT BE USED
@@ -651,7 +694,7 @@ public:
     */
     const_iterator end() const
     {
-        return payloadContext_->fields_.end();
+        return payloadContext_->fieldsEnd();
     }
     /**
     * @brief current position on the payload
@@ -667,85 +710,14 @@ public:
     }
 private:
 
-    //const_iterator NextDirty()
-    //{
-    //    // if its an image then want to send all the fields
-    //    // get the message type
-    //    int32_t msgType;
-    //    try {
-    //        payloadContext_->get(1, 0, msgType);
-    //    }
-    //    catch (boost::bad_get&)
-    //    {
-    //        // if we fail the message type call then only return field with dirty set
-    //        msgType = MAMA_MSG_TYPE_UPDATE;
-    //    }
-
-
-    //    bool allFields = msgType == (MAMA_MSG_TYPE_INITIAL);
-
-    //    if (allFields)
-    //    {
-    //        current_++;
-    //    }
-    //    else
-    //    {
-    //        current_++;
-    //        while(current_ != payloadContext_->fields_.end() && current_->second.dirty_ == false)
-    //        {
-    //            current_++;
-    //        }
-    //    }
-
-
-    //    return current_;
-    //}
-
-
     bool InternalHasNext() const
     {
-        //// if its an image then want to send all the fields
-        //// get the message type
-        //int32_t msgType;
-        //try {
-        //    payloadContext_->get(1, 0, msgType);
-        //}
-        //catch (boost::bad_get&)
-        //{
-        //    // if we fail the message type call then only return field with dirty set
-        //    msgType = MAMA_MSG_TYPE_UPDATE;
-        //}
-
-
-        //bool allFields = msgType == (MAMA_MSG_TYPE_INITIAL);
-
-        //bool gotNext = false;
-
-        //if (allFields)
-        //{
-        //    //just check the next one
-        //    UpaPayload::FieldsMap_t::const_iterator tmp = current_;
-        //    gotNext = ( ++tmp != payloadContext_->fields_.end());
-        //}
-        //else
-        //{
-        //    //have to look for it
-        //    UpaPayload::FieldsMap_t::const_iterator tmp = current_;
-        //    while(++tmp != payloadContext_->fields_.end())
-        //    {
-        //        if (tmp->second.dirty_)
-        //        {
-        //            // found a dirty field
-        //            gotNext = true;
-        //            break;
-        //        }
-        //    }
-
-        //}
+        if (current_ == payloadContext_->fieldsEnd())
+            return false;
 
         //just check the next one
-        UpaPayload::FieldsMap_t::const_iterator tmp = current_;
-        bool gotNext = ( ++tmp != payloadContext_->fields_.end());
+        UpaPayload::FieldIterator_t tmp = current_;
+        bool gotNext = ( ++tmp != payloadContext_->fieldsEnd());
 
         return gotNext;
     }
@@ -32,6 +32,7 @@
 #include "upapayloadimpl.h"
 #include "upamsgimpl.h"
 #include "upapayload.h"
+#include "upapayloadserializer.h"
 #include "upavaluetype.h"
 
 #include "MamaPriceWrapper.h"
@@ -165,6 +166,17 @@ mama_status
     CHECK_BUFFER(buffer, bufferLength); //todo: CHECK_BUFFER should be rewrite
 
     UpaPayload* newPayload = new (std::nothrow) UpaPayload();
+    if (!newPayload)
+    {
+        return MAMA_STATUS_NOMEM;
+    }
+
+    mama_status status = UpaPayloadSerializer::unSerialize(*newPayload, buffer, bufferLength);
+    if (status != MAMA_STATUS_OK)
+    {
+        delete newPayload;
+        return status;
+    }
 
     *msg = (msgPayload)newPayload;
 
@@ -262,8 +274,17 @@ mama_status
     tick42rmdsmsgPayload_getByteSize       (const msgPayload    msg,
     mama_size_t*        size)
 {
-    //CHECK_PAYLOAD(msg);
-    return MAMA_STATUS_NOT_IMPLEMENTED;
+    CHECK_PAYLOAD(msg);
+    if (!size)
+        return MAMA_STATUS_NULL_ARG;
+
+    const UpaPayload* payload = reinterpret_cast<UpaPayload*>(msg);
+
+    std::vector<unsigned char>& serialized = payload->serializeBuffer();
+    UpaPayloadSerializer::serialize(*payload, serialized);
+    *size = serialized.size();
+
+    return MAMA_STATUS_OK;
 }
 
 mama_status
@@ -271,9 +292,12 @@ mama_status
     const void**        buffer,
     mama_size_t        bufferLength)
 {
-    //CHECK_PAYLOAD(msg);
-    //CHECK_BUFFER(buffer, bufferLength);
-    return MAMA_STATUS_NOT_IMPLEMENTED;
+    CHECK_PAYLOAD(msg);
+    CHECK_BUFFER(buffer, bufferLength);
+
+    // as with the other payload bridges, buffer is the serialized data itself
+    UpaPayload* payload = reinterpret_cast<UpaPayload*>(msg);
+    return UpaPayloadSerializer::unSerialize(*payload, (const void*)buffer, bufferLength);
 }
 
 
@@ -282,9 +306,18 @@ mama_status
     const void**        buffer,
     mama_size_t*        bufferLength)
 {
-    //CHECK_PAYLOAD(msg);
-    //CHECK_BUFFER(buffer, bufferLength);
-    return MAMA_STATUS_NOT_IMPLEMENTED;
+    CHECK_PAYLOAD(msg);
+    CHECK_BUFFER(buffer, bufferLength);
+
+    // the buffer belongs to the payload and is valid until it is next serialized or destroyed
+    const UpaPayload* payload = reinterpret_cast<UpaPayload*>(msg);
+
+    std::vector<unsigned char>& serialized = payload->serializeBuffer();
+    UpaPayloadSerializer::serialize(*payload, serialized);
+
+    *buffer = &serialized[0];
+    *bufferLength = serialized.size();
+    return MAMA_STATUS_OK;
 }
 
 mama_status
@@ -292,13 +325,7 @@ mama_status
     const void**        buffer,
     mama_size_t*        bufferLength)
 {
-    CHECK_PAYLOAD(msg);
-    CHECK_BUFFER(buffer, bufferLength);
-    const UpaPayload* payload = reinterpret_cast<UpaPayload*>(msg);
-
-    *buffer = payload;
-    *bufferLength = sizeof(UpaPayload);
-    return MAMA_STATUS_OK;
+    return tick42rmdsmsgPayload_serialize(msg, buffer, bufferLength);
 }
 
 mama_status
@@ -307,11 +334,11 @@ mama_status
     const void*         buffer,
     mama_size_t         bufferLength)
 {
-    //CHECK_PAYLOAD(msg);
-    //if (!bridge)
-    //    return MAMA_STATUS_NULL_ARG;
-    //CHECK_BUFFER(buffer, bufferLength);
-    return MAMA_STATUS_NOT_IMPLEMENTED;
+    CHECK_PAYLOAD(msg);
+    CHECK_BUFFER(buffer, bufferLength);
+
+    UpaPayload* payload = reinterpret_cast<UpaPayload*>(msg);
+    return UpaPayloadSerializer::unSerialize(*payload, buffer, bufferLength);
 }
 
 mama_status
@@ -1811,7 +1838,7 @@ msgFieldPayload
         return NULL;
 
     if (it->current() != it->end())
-        return (msgFieldPayload)&(it->current()->second);
+        return (msgFieldPayload)&(*it->current());
 
     return NULL;
 }
@@ -1829,7 +1856,7 @@ msgFieldPayload
     UpaPayloadFieldIterator::const_iterator itResult;
     itResult=it->next();
     if (itResult != it->end())
-        return (msgFieldPayload)&(itResult->second);
+        return (msgFieldPayload)&(*itResult);
 
     return NULL;
 }
@@ -1855,8 +1882,11 @@ msgFieldPayload
     const UpaPayload* payload = reinterpret_cast<UpaPayload*>(msg);
     UpaPayloadFieldIterator *it = reinterpret_cast<UpaPayloadFieldIterator *>(iter);
 
-    UpaFieldPayload temp = it->begin()->second;
-    return (msgFieldPayload)&(it->begin()->second);
+    UpaPayloadFieldIterator::const_iterator itBegin = it->begin();
+    if (itBegin == it->end())
+        return NULL;
+
+    return (msgFieldPayload)&(*itBegin);
 }
 
 msgFieldPayload
@@ -0,0 +1,747 @@
+/*
+* UPAMsgUtils: The Reuters UPA Bridge for OpenMama
+* Copyright (C) 2012 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+
+#include "stdafx.h"
+#include "upapayloadserializer.h"
+#include "upapayload.h"
+
+namespace
+{
+    const unsigned char Magic0 = 'T';
+    const unsigned char Magic1 = '4';
+
+    // a nested message can contain nested messages, but not without limit
+    const int MaxDepth = 32;
+
+    // the field value kinds. The scalars are the index of the type in ValueType_t; the vectors are held outside the
+    // variant
+    enum ValueKind
+    {
+        KindI8 = 0,
+        KindU8,
+        KindI16,
+        KindU16,
+        KindI32,
+        KindU32,
+        KindI64,
+        KindU64,
+        KindF32,
+        KindF64,
+        KindDateTime,
+        KindPrice,
+        KindMsg,
+        KindVectorMsg,
+        KindString,
+        KindBool,
+        KindChar,
+        KindOpaque,
+
+        KindVectorBytes = 0x80,         // fixed size elements in dataVector1_
+        KindVectorString = 0x81
+    };
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+class UpaPayloadSerializer::Writer
+{
+public:
+    Writer(std::vector<unsigned char>& out)
+        : out_(out)
+    {}
+
+    void byte(unsigned char b)
+    {
+        out_.push_back(b);
+    }
+
+    void varint(uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            out_.push_back((unsigned char)(v | 0x80));
+            v >>= 7;
+        }
+        out_.push_back((unsigned char)v);
+    }
+
+    void zigzag(int64_t v)
+    {
+        varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+    }
+
+    void fixed32(uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out_.push_back((unsigned char)(v >> (i * 8)));
+        }
+    }
+
+    void fixed64(uint64_t v)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            out_.push_back((unsigned char)(v >> (i * 8)));
+        }
+    }
+
+    void f32(float v)
+    {
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        fixed32(bits);
+    }
+
+    void f64(double v)
+    {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        fixed64(bits);
+    }
+
+    void bytes(const void* data, size_t length)
+    {
+        varint(length);
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        out_.insert(out_.end(), p, p + length);
+    }
+
+    void string(const std::string& s)
+    {
+        bytes(s.data(), s.size());
+    }
+
+    size_t position() const
+    {
+        return out_.size();
+    }
+
+    void patch32(size_t pos, uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out_[pos + i] = (unsigned char)(v >> (i * 8));
+        }
+    }
+
+private:
+    std::vector<unsigned char>& out_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//
+class UpaPayloadSerializer::Reader
+{
+public:
+    Reader(const unsigned char* data, size_t length)
+        : pos_(data), end_(data + length), ok_(true)
+    {}
+
+    bool ok() const
+    {
+        return ok_;
+    }
+
+    const unsigned char* position() const
+    {
+        return pos_;
+    }
+
+    size_t remaining() const
+    {
+        return end_ - pos_;
+    }
+
+    unsigned char byte()
+    {
+        if (!need(1))
+        {
+            return 0;
+        }
+        return *pos_++;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (!need(1))
+            {
+                return 0;
+            }
+            unsigned char b = *pos_++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+            {
+                return v;
+            }
+        }
+
+        ok_ = false;
+        return 0;
+    }
+
+    int64_t zigzag()
+    {
+        uint64_t v = varint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+    uint32_t fixed32()
+    {
+        if (!need(4))
+        {
+            return 0;
+        }
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            v |= (uint32_t)pos_[i] << (i * 8);
+        }
+        pos_ += 4;
+        return v;
+    }
+
+    uint64_t fixed64()
+    {
+        if (!need(8))
+        {
+            return 0;
+        }
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            v |= (uint64_t)pos_[i] << (i * 8);
+        }
+        pos_ += 8;
+        return v;
+    }
+
+    float f32()
+    {
+        uint32_t bits = fixed32();
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+
+    double f64()
+    {
+        uint64_t bits = fixed64();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+
+    // a length prefixed run of bytes, left in the buffer
+    const unsigned char* bytes(size_t& length)
+    {
+        uint64_t len = varint();
+        if (!ok_ || len > remaining())
+        {
+            ok_ = false;
+            length = 0;
+            return pos_;
+        }
+
+        const unsigned char* p = pos_;
+        length = (size_t)len;
+        pos_ += length;
+        return p;
+    }
+
+    void string(std::string& s)
+    {
+        size_t length;
+        const unsigned char* p = bytes(length);
+        s.assign((const char*)p, length);
+    }
+
+    void skip(size_t length)
+    {
+        if (need(length))
+        {
+            pos_ += length;
+        }
+    }
+
+private:
+    bool need(size_t n)
+    {
+        if (!ok_ || (size_t)(end_ - pos_) < n)
+        {
+            ok_ = false;
+            return false;
+        }
+        return true;
+    }
+
+    const unsigned char* pos_;
+    const unsigned char* end_;
+    bool ok_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//
+// write the value held in the variant. The kind has already been written
+class UpaPayloadSerializer::ValueWriter : public boost::static_visitor<void>
+{
+public:
+    ValueWriter(Writer& w, bool includeNames)
+        : w_(w), includeNames_(includeNames)
+    {}
+
+    void operator()(int8_t v) const { w_.byte((unsigned char)v); }
+    void operator()(uint8_t v) const { w_.byte(v); }
+    void operator()(int16_t v) const { w_.zigzag(v); }
+    void operator()(uint16_t v) const { w_.varint(v); }
+    void operator()(int32_t v) const { w_.zigzag(v); }
+    void operator()(uint32_t v) const { w_.varint(v); }
+    void operator()(int64_t v) const { w_.zigzag(v); }
+    void operator()(uint64_t v) const { w_.varint(v); }
+    void operator()(float v) const { w_.f32(v); }
+    void operator()(double v) const { w_.f64(v); }
+    void operator()(bool v) const { w_.byte(v ? 1 : 0); }
+    void operator()(char v) const { w_.byte((unsigned char)v); }
+    void operator()(const std::string& v) const { w_.string(v); }
+
+    // the wrapped types are written with a leading byte to say whether there is anything there
+
+    void operator()(const MamaDateTimeWrapper_ptr_t& v) const
+    {
+        if (!present(v))
+        {
+            return;
+        }
+
+        mamaDateTime dt = v->getMamaDateTime();
+        mama_i64_t micros = 0;
+        mamaDateTimeHints hints = 0;
+        mamaDateTimePrecision precision = MAMA_DATE_TIME_PREC_UNKNOWN;
+        mamaDateTime_getEpochTimeMicroseconds(dt, (mama_u64_t*)&micros);
+        mamaDateTime_getHints(dt, &hints);
+        mamaDateTime_getPrecision(dt, &precision);
+
+        w_.zigzag(micros);
+        w_.byte((unsigned char)hints);
+        w_.byte((unsigned char)precision);
+    }
+
+    void operator()(const MamaPriceWrapper_ptr_t& v) const
+    {
+        if (!present(v))
+        {
+            return;
+        }
+
+        mamaPrice price = v->getMamaPrice();
+        double value = 0.0;
+        mamaPriceHints hints = 0;
+        mamaPrice_getValue(price, &value);
+        mamaPrice_getHints(price, &hints);
+
+        w_.f64(value);
+        w_.byte((unsigned char)hints);
+    }
+
+    void operator()(const MamaMsgPayloadWrapper_ptr_t& v) const
+    {
+        if (!present(v))
+        {
+            return;
+        }
+
+        writePayload(w_, *reinterpret_cast<const UpaPayload*>(v->getMamaMsgPayload()), includeNames_);
+    }
+
+    void operator()(const MamaMsgVectorWrapper_ptr_t& v) const
+    {
+        if (!present(v))
+        {
+            return;
+        }
+
+        size_t count = v->getVectorLength();
+        w_.varint(count);
+        const msgPayload* payloads = v->GetVector();
+        for (size_t i = 0; i < count; ++i)
+        {
+            writePayload(w_, *reinterpret_cast<const UpaPayload*>(payloads[i]), includeNames_);
+        }
+    }
+
+    void operator()(const MamaOpaqueWrapper_ptr_t& v) const
+    {
+        if (!present(v))
+        {
+            return;
+        }
+
+        w_.bytes(v->Data(), v->Length());
+    }
+
+private:
+    template <typename T>
+    bool present(const boost::shared_ptr<T>& v) const
+    {
+        w_.byte(v ? 1 : 0);
+        return v ? true : false;
+    }
+
+    Writer& w_;
+    bool includeNames_;
+};
+
+void UpaPayloadSerializer::writeField(Writer& w, const UpaFieldPayload& field, bool includeNames)
+{
+    w.varint(field.fid_);
+    w.byte((unsigned char)field.type_);
+
+    unsigned char kind;
+    if (field.type_ == MAMA_FIELD_TYPE_VECTOR_STRING && field.stringVector1_)
+    {
+        kind = KindVectorString;
+    }
+    else if (!field.dataVector1_.empty())
+    {
+        kind = KindVectorBytes;
+    }
+    else
+    {
+        kind = (unsigned char)field.data_.which();
+    }
+    w.byte(kind);
+
+    if (includeNames)
+    {
+        const char* name = field.name_ ? field.name_ : "";
+        w.bytes(name, strlen(name));
+    }
+
+    switch (kind)
+    {
+    case KindVectorString:
+        {
+            const std::vector<std::string>& strings = *field.stringVector1_;
+            w.varint(strings.size());
+            for (size_t i = 0; i < strings.size(); ++i)
+            {
+                w.string(strings[i]);
+            }
+            break;
+        }
+
+    case KindVectorBytes:
+        w.string(field.dataVector1_);
+        break;
+
+    default:
+        boost::apply_visitor(ValueWriter(w, includeNames), field.data_);
+        break;
+    }
+}
+
+void UpaPayloadSerializer::writePayload(Writer& w, const UpaPayload& payload, bool includeNames)
+{
+    w.byte(Magic0);
+    w.byte(Magic1);
+    w.byte(UpaPayloadSerializer::Version);
+    w.byte(includeNames ? 0 : UpaPayloadSerializer::FlagNoNames);
+
+    // fill in the length once we know it
+    size_t lengthPos = w.position();
+    w.fixed32(0);
+
+    size_t numFields = payload.numFields();
+    w.varint(numFields);
+
+    for (UpaPayload::FieldIterator_t field = payload.fieldsBegin(); field != payload.fieldsEnd(); ++field)
+    {
+        writeField(w, *field, includeNames);
+    }
+
+    w.patch32(lengthPos, (uint32_t)(w.position() - lengthPos - 4));
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// nested messages are created as new payloads that the field owns through the usual wrapper
+MamaMsgPayloadWrapper_ptr_t UpaPayloadSerializer::readNestedPayload(Reader& r, int depth)
+{
+    UpaPayload* nested = new UpaPayload();
+    MamaMsgPayloadWrapper_ptr_t wrapper(new MamaMsgPayloadWrapper((msgPayload)nested));
+    if (!readPayload(r, *nested, depth + 1))
+    {
+        return MamaMsgPayloadWrapper_ptr_t();
+    }
+
+    return wrapper;
+}
+
+bool UpaPayloadSerializer::readValue(Reader& r, UpaFieldPayload& field, unsigned char kind, int depth)
+{
+    switch (kind)
+    {
+    case KindI8: field.data_ = (int8_t)r.byte(); break;
+    case KindU8: field.data_ = (uint8_t)r.byte(); break;
+    case KindI16: field.data_ = (int16_t)r.zigzag(); break;
+    case KindU16: field.data_ = (uint16_t)r.varint(); break;
+    case KindI32: field.data_ = (int32_t)r.zigzag(); break;
+    case KindU32: field.data_ = (uint32_t)r.varint(); break;
+    case KindI64: field.data_ = (int64_t)r.zigzag(); break;
+    case KindU64: field.data_ = (uint64_t)r.varint(); break;
+    case KindF32: field.data_ = r.f32(); break;
+    case KindF64: field.data_ = r.f64(); break;
+    case KindBool: field.data_ = (r.byte() != 0); break;
+    case KindChar: field.data_ = (char)r.byte(); break;
+
+    case KindString:
+        {
+            std::string* str = boost::get<std::string>(&field.data_);
+            if (str == 0)
+            {
+                field.data_ = std::string();
+                str = boost::get<std::string>(&field.data_);
+            }
+            r.string(*str);
+            break;
+        }
+
+    case KindDateTime:
+        {
+            MamaDateTimeWrapper_ptr_t value;
+            if (r.byte() != 0)
+            {
+                mama_i64_t micros = r.zigzag();
+                mamaDateTimeHints hints = r.byte();
+                mamaDateTimePrecision precision = (mamaDateTimePrecision)r.byte();
+
+                mamaDateTime dt;
+                mamaDateTime_create(&dt);
+                mamaDateTime_setEpochTimeMicroseconds(dt, (mama_u64_t)micros);
+                mamaDateTime_setHints(dt, hints);
+                mamaDateTime_setPrecision(dt, precision);
+                value.reset(new MamaDateTimeWrapper(dt));
+            }
+            field.data_ = value;
+            break;
+        }
+
+    case KindPrice:
+        {
+            MamaPriceWrapper_ptr_t value;
+            if (r.byte() != 0)
+            {
+                double priceValue = r.f64();
+                mamaPriceHints hints = r.byte();
+
+                mamaPrice price;
+                mamaPrice_create(&price);
+                mamaPrice_setValue(price, priceValue);
+                mamaPrice_setHints(price, hints);
+                value.reset(new MamaPriceWrapper(price));
+            }
+            field.data_ = value;
+            break;
+        }
+
+    case KindMsg:
+        {
+            MamaMsgPayloadWrapper_ptr_t value;
+            if (r.byte() != 0)
+            {
+                value = readNestedPayload(r, depth);
+                if (!value)
+                {
+                    return false;
+                }
+            }
+            field.data_ = value;
+            break;
+        }
+
+    case KindVectorMsg:
+        {
+            MamaMsgVectorWrapper_ptr_t value;
+            if (r.byte() != 0)
+            {
+                value.reset(new MamaMsgVectorWrapper());
+                uint64_t count = r.varint();
+                for (uint64_t i = 0; r.ok() && i < count; ++i)
+                {
+                    MamaMsgPayloadWrapper_ptr_t nested = readNestedPayload(r, depth);
+                    if (!nested)
+                    {
+                        return false;
+                    }
+                    value->addOwnedMessage(nested);
+                }
+            }
+            field.data_ = value;
+            break;
+        }
+
+    case KindOpaque:
+        {
+            MamaOpaqueWrapper_ptr_t value;
+            if (r.byte() != 0)
+            {
+                size_t length;
+                const unsigned char* data = r.bytes(length);
+                if (r.ok())
+                {
+                    value.reset(new MamaOpaqueWrapper(data, length));
+                }
+            }
+            field.data_ = value;
+            break;
+        }
+
+    case KindVectorBytes:
+        r.string(field.dataVector1_);
+        break;
+
+    case KindVectorString:
+        {
+            uint64_t count = r.varint();
+            if (count > r.remaining())
+            {
+                // every string takes at least a byte
+                return false;
+            }
+
+            field.stringVector1_.reset(new std::vector<std::string>((size_t)count));
+            field.stringVector2_.reset(new std::vector<const char*>());
+            field.stringVector2_->reserve((size_t)count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                r.string((*field.stringVector1_)[i]);
+                field.stringVector2_->push_back((*field.stringVector1_)[i].c_str());
+            }
+            break;
+        }
+
+    default:
+        t42log_warn("Unknown field value kind %d in serialized payload\n", kind);
+        return false;
+    }
+
+    return r.ok();
+}
+
+bool UpaPayloadSerializer::readPayload(Reader& r, UpaPayload& payload, int depth)
+{
+    if (depth > MaxDepth)
+    {
+        t42log_warn("Serialized payload nested too deeply\n");
+        return false;
+    }
+
+    if (r.byte() != Magic0 || r.byte() != Magic1)
+    {
+        t42log_warn("Serialized payload has a bad header\n");
+        return false;
+    }
+
+    unsigned char version = r.byte();
+    if (version == 0 || version > UpaPayloadSerializer::Version)
+    {
+        t42log_warn("Serialized payload version %d is not supported\n", version);
+        return false;
+    }
+
+    bool includeNames = (r.byte() & UpaPayloadSerializer::FlagNoNames) == 0;
+    uint32_t length = r.fixed32();
+    if (!r.ok() || length > r.remaining())
+    {
+        t42log_warn("Serialized payload is truncated\n");
+        return false;
+    }
+
+    // only read the fields inside the stated length, then step over them in the outer reader
+    Reader body(r.position(), length);
+    r.skip(length);
+
+    payload.clear();
+    payload.names_.clear();
+
+    uint64_t numFields = body.varint();
+    std::string name;
+    for (uint64_t i = 0; body.ok() && i < numFields; ++i)
+    {
+        mama_fid_t fid = (mama_fid_t)body.varint();
+        mamaFieldType type = (mamaFieldType)body.byte();
+        unsigned char kind = body.byte();
+
+        const char* fieldName = "";
+        if (includeNames)
+        {
+            body.string(name);
+            fieldName = payload.internName(name.c_str());
+        }
+
+        if (!body.ok())
+        {
+            break;
+        }
+
+        UpaFieldPayload& field = payload.fieldFor(fid);
+        field.reset(fid, fieldName, type);
+        if (!readValue(body, field, kind, depth))
+        {
+            t42log_warn("Failed to read field %d from serialized payload\n", fid);
+            return false;
+        }
+    }
+
+    if (!body.ok())
+    {
+        t42log_warn("Serialized payload is truncated\n");
+        return false;
+    }
+
+    return true;
+}
+
+void UpaPayloadSerializer::serialize(const UpaPayload& payload, std::vector<unsigned char>& out, bool includeNames)
+{
+    out.clear();
+    Writer w(out);
+    writePayload(w, payload, includeNames);
+}
+
+mama_status UpaPayloadSerializer::unSerialize(UpaPayload& payload, const void* buffer, size_t length)
+{
+    Reader r(static_cast<const unsigned char*>(buffer), length);
+    if (!readPayload(r, payload, 0))
+    {
+        payload.clear();
+        return MAMA_STATUS_INVALID_ARG;
+    }
+
+    return MAMA_STATUS_OK;
+}
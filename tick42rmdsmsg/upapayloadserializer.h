@@ -0,0 +1,89 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#ifndef UPA_PAYLOAD_SERIALIZER_H__
+#define UPA_PAYLOAD_SERIALIZER_H__
+
+#include <vector>
+#include <mama/status.h>
+
+#include "rmdsBridgeTypes.h"
+
+class UpaPayload;
+struct UpaFieldPayload;
+
+// Binary encoding of a UpaPayload, so payloads can be stored, replayed or passed to another process without going
+// back through mamaMsg iteration.
+//
+// A payload is encoded as
+//
+//   magic      2 bytes   'T' '4'
+//   version    1 byte
+//   flags      1 byte    FlagNoNames if the field names have been left out
+//   length     4 bytes   little endian, the number of bytes that follow the header
+//   numFields  varint
+//   fields
+//
+// and each field as
+//
+//   fid        varint
+//   type       1 byte    the mamaFieldType of the field
+//   kind       1 byte    which value the field holds (see upapayloadserializer.cpp)
+//   name       varint length and bytes - unless FlagNoNames is set
+//   value
+//
+// Integers are varints (zigzag for the signed types), floats are little endian IEEE, strings and opaques are a varint
+// length and the bytes, and nested messages are complete encodings of their own.
+
+class UpaPayloadSerializer
+{
+public:
+    static const unsigned char Version = 1;
+
+    enum Flags
+    {
+        FlagNoNames = 0x01
+    };
+
+    // encode the payload into out, replacing what was there. Names are only worth leaving out if the receiver can
+    // get them from the dictionary
+    static void serialize(const UpaPayload& payload, std::vector<unsigned char>& out, bool includeNames = true);
+
+    // replace the contents of the payload with the decoded buffer
+    static mama_status unSerialize(UpaPayload& payload, const void* buffer, size_t length);
+
+private:
+    class Reader;
+    class Writer;
+    class ValueWriter;
+
+    static void writePayload(Writer& w, const UpaPayload& payload, bool includeNames);
+    static void writeField(Writer& w, const UpaFieldPayload& field, bool includeNames);
+
+    static bool readPayload(Reader& r, UpaPayload& payload, int depth);
+    static bool readValue(Reader& r, UpaFieldPayload& field, unsigned char kind, int depth);
+    static MamaMsgPayloadWrapper_ptr_t readNestedPayload(Reader& r, int depth);
+};
+
+#endif
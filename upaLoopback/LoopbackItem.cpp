@@ -0,0 +1,482 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "LoopbackItem.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace
+{
+    // RDMFieldDictionary fids
+    const RsslFieldId DSPLY_NAME = 3;
+    const RsslFieldId TRDPRC_1 = 6;
+    const RsslFieldId BID = 22;
+    const RsslFieldId ASK = 25;
+    const RsslFieldId BIDSIZE = 30;
+    const RsslFieldId ASKSIZE = 31;
+    const RsslFieldId ACVOL_1 = 32;
+    const RsslFieldId TRDVOL_1 = 178;
+    const RsslFieldId ORDER_PRC = 3427;
+    const RsslFieldId ORDER_SIDE = 3428;
+    const RsslFieldId ORDER_SIZE = 3429;
+    const RsslFieldId NO_ORD = 3430;
+    const RsslFieldId QUOTIM_MS = 3855;
+    const RsslFieldId ACC_SIZE = 4356;
+
+    // ORDER_SIDE enum values
+    const RsslEnum SideBid = 1;
+    const RsslEnum SideAsk = 2;
+
+    RsslRet EncodeReal(RsslEncodeIterator * iter, RsslFieldId fid, RsslInt64 value, RsslUInt8 hint)
+    {
+        RsslFieldEntry fieldEntry = RSSL_INIT_FIELD_ENTRY;
+        fieldEntry.fieldId = fid;
+        fieldEntry.dataType = RSSL_DT_REAL;
+
+        RsslReal real = RSSL_INIT_REAL;
+        real.hint = hint;
+        real.value = value;
+        return rsslEncodeFieldEntry(iter, &fieldEntry, &real);
+    }
+
+    RsslRet EncodeUInt(RsslEncodeIterator * iter, RsslFieldId fid, RsslUInt64 value)
+    {
+        RsslFieldEntry fieldEntry = RSSL_INIT_FIELD_ENTRY;
+        fieldEntry.fieldId = fid;
+        fieldEntry.dataType = RSSL_DT_UINT;
+        return rsslEncodeFieldEntry(iter, &fieldEntry, &value);
+    }
+
+    RsslRet EncodeEnum(RsslEncodeIterator * iter, RsslFieldId fid, RsslEnum value)
+    {
+        RsslFieldEntry fieldEntry = RSSL_INIT_FIELD_ENTRY;
+        fieldEntry.fieldId = fid;
+        fieldEntry.dataType = RSSL_DT_ENUM;
+        return rsslEncodeFieldEntry(iter, &fieldEntry, &value);
+    }
+
+    RsslRet EncodeString(RsslEncodeIterator * iter, RsslFieldId fid, const std::string & value)
+    {
+        RsslFieldEntry fieldEntry = RSSL_INIT_FIELD_ENTRY;
+        fieldEntry.fieldId = fid;
+        fieldEntry.dataType = RSSL_DT_RMTES_STRING;
+
+        RsslBuffer buffer;
+        buffer.data = const_cast<char *>(value.c_str());
+        buffer.length = (RsslUInt32)value.length();
+        return rsslEncodeFieldEntry(iter, &fieldEntry, &buffer);
+    }
+
+    // milliseconds since midnight, which is what QUOTIM_MS carries
+    RsslUInt64 MillisecondsToday()
+    {
+#ifdef _WIN32
+        SYSTEMTIME st;
+        GetSystemTime(&st);
+        return ((st.wHour * 60 + st.wMinute) * 60 + st.wSecond) * 1000 + st.wMilliseconds;
+#else
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return (RsslUInt64)(tv.tv_sec % 86400) * 1000 + tv.tv_usec / 1000;
+#endif
+    }
+}
+
+LoopbackItem::LoopbackItem(RsslChannel * chnl, RsslInt32 streamId, RsslUInt8 domainType, const std::string & name,
+    RsslUInt16 serviceId, bool privateStream, size_t depth, unsigned int seed)
+    : rotationIndex_(NotRotating)
+    , chnl_(chnl)
+    , streamId_(streamId)
+    , domainType_(domainType)
+    , name_(name)
+    , serviceId_(serviceId)
+    , privateStream_(privateStream)
+    , seed_(seed == 0 ? 2463534242u : seed)
+    , nextOrderId_(1)
+{
+    // start somewhere between 10.00 and 109.99 with a one tick spread
+    bid_ = 1000 + Next() % 10000;
+    ask_ = bid_ + 1;
+    bidSize_ = 100 * (1 + Next() % 50);
+    askSize_ = 100 * (1 + Next() % 50);
+    last_ = bid_;
+    volume_ = 0;
+
+    if (domainType_ == RSSL_DMT_MARKET_BY_ORDER || domainType_ == RSSL_DMT_MARKET_BY_PRICE)
+    {
+        InitBook(depth);
+    }
+}
+
+unsigned int LoopbackItem::Next()
+{
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+    return seed_;
+}
+
+void LoopbackItem::InitBook(size_t depth)
+{
+    book_.reserve(depth * 2 + 1);
+    for (size_t level = 0; level < depth; ++level)
+    {
+        BookEntry bid;
+        bid.side = SideBid;
+        bid.price = bid_ - (RsslInt64)level;
+        bid.size = 100 * (1 + Next() % 50);
+        bid.orders = domainType_ == RSSL_DMT_MARKET_BY_PRICE ? 1 + Next() % 10 : 1;
+        MakeKey(bid);
+        book_.push_back(bid);
+
+        BookEntry ask;
+        ask.side = SideAsk;
+        ask.price = ask_ + (RsslInt64)level;
+        ask.size = 100 * (1 + Next() % 50);
+        ask.orders = domainType_ == RSSL_DMT_MARKET_BY_PRICE ? 1 + Next() % 10 : 1;
+        MakeKey(ask);
+        book_.push_back(ask);
+    }
+}
+
+void LoopbackItem::MakeKey(BookEntry & entry)
+{
+    char key[32];
+    if (domainType_ == RSSL_DMT_MARKET_BY_ORDER)
+    {
+        // orders are keyed by order id
+        snprintf(key, sizeof(key), "%llu", (unsigned long long)nextOrderId_++);
+    }
+    else
+    {
+        // price levels by price and side, as an ADS would
+        snprintf(key, sizeof(key), "%lld.%02lld%c", (long long)(entry.price / 100), (long long)(entry.price % 100),
+            entry.side == SideBid ? 'B' : 'A');
+    }
+    entry.key = key;
+}
+
+bool LoopbackItem::PriceInBook(RsslEnum side, RsslInt64 price) const
+{
+    for (std::vector<BookEntry>::const_iterator it = book_.begin(); it != book_.end(); ++it)
+    {
+        if (it->side == side && it->price == price)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+RsslRet LoopbackItem::EncodeRefresh(RsslEncodeIterator * iter, bool streaming)
+{
+    RsslRet ret;
+    RsslRefreshMsg refreshMsg = RSSL_INIT_REFRESH_MSG;
+
+    refreshMsg.msgBase.msgClass = RSSL_MC_REFRESH;
+    refreshMsg.msgBase.domainType = domainType_;
+    refreshMsg.msgBase.streamId = streamId_;
+    refreshMsg.msgBase.containerType = domainType_ == RSSL_DMT_MARKET_PRICE ? RSSL_DT_FIELD_LIST : RSSL_DT_MAP;
+    refreshMsg.flags = RSSL_RFMF_HAS_MSG_KEY | RSSL_RFMF_SOLICITED | RSSL_RFMF_REFRESH_COMPLETE | RSSL_RFMF_CLEAR_CACHE | RSSL_RFMF_HAS_QOS;
+    if (privateStream_)
+    {
+        refreshMsg.flags |= RSSL_RFMF_PRIVATE_STREAM;
+    }
+
+    refreshMsg.state.streamState = streaming ? RSSL_STREAM_OPEN : RSSL_STREAM_NON_STREAMING;
+    refreshMsg.state.dataState = RSSL_DATA_OK;
+    refreshMsg.state.code = RSSL_SC_NONE;
+    refreshMsg.state.text.data = (char *)"Item Refresh Completed";
+    refreshMsg.state.text.length = (RsslUInt32)strlen(refreshMsg.state.text.data);
+
+    refreshMsg.qos.dynamic = RSSL_FALSE;
+    refreshMsg.qos.rate = RSSL_QOS_RATE_TICK_BY_TICK;
+    refreshMsg.qos.timeliness = RSSL_QOS_TIME_REALTIME;
+
+    refreshMsg.msgBase.msgKey.flags = RSSL_MKF_HAS_NAME | RSSL_MKF_HAS_SERVICE_ID | RSSL_MKF_HAS_NAME_TYPE;
+    refreshMsg.msgBase.msgKey.name.data = const_cast<char *>(name_.c_str());
+    refreshMsg.msgBase.msgKey.name.length = (RsslUInt32)name_.length();
+    refreshMsg.msgBase.msgKey.nameType = RDM_INSTRUMENT_NAME_TYPE_RIC;
+    refreshMsg.msgBase.msgKey.serviceId = serviceId_;
+
+    if ((ret = rsslEncodeMsgInit(iter, (RsslMsg *)&refreshMsg, 0)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    ret = domainType_ == RSSL_DMT_MARKET_PRICE ? EncodeMarketPrice(iter, true) : EncodeBookRefresh(iter);
+    if (ret < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    return rsslEncodeMsgComplete(iter, RSSL_TRUE);
+}
+
+RsslRet LoopbackItem::EncodeUpdate(RsslEncodeIterator * iter)
+{
+    RsslRet ret;
+    RsslUpdateMsg updateMsg = RSSL_INIT_UPDATE_MSG;
+
+    updateMsg.msgBase.msgClass = RSSL_MC_UPDATE;
+    updateMsg.msgBase.domainType = domainType_;
+    updateMsg.msgBase.streamId = streamId_;
+    updateMsg.msgBase.containerType = domainType_ == RSSL_DMT_MARKET_PRICE ? RSSL_DT_FIELD_LIST : RSSL_DT_MAP;
+    updateMsg.updateType = RDM_UPD_EVENT_TYPE_QUOTE;
+
+    // work out what changes before we encode the header, so the update type is right
+    bool trade = false;
+    if (domainType_ == RSSL_DMT_MARKET_PRICE)
+    {
+        trade = Next() % 4 == 0;
+        if (trade)
+        {
+            updateMsg.updateType = RDM_UPD_EVENT_TYPE_TRADE;
+        }
+    }
+
+    if ((ret = rsslEncodeMsgInit(iter, (RsslMsg *)&updateMsg, 0)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    if (domainType_ == RSSL_DMT_MARKET_PRICE)
+    {
+        if (trade)
+        {
+            // trade at the bid or the ask
+            last_ = (Next() & 1) ? bid_ : ask_;
+            RsslInt64 tradeSize = 100 * (1 + Next() % 10);
+            volume_ += tradeSize;
+
+            RsslFieldList fieldList = RSSL_INIT_FIELD_LIST;
+            fieldList.flags = RSSL_FLF_HAS_STANDARD_DATA;
+            if ((ret = rsslEncodeFieldListInit(iter, &fieldList, 0, 0)) < RSSL_RET_SUCCESS
+                || (ret = EncodeReal(iter, TRDPRC_1, last_, RSSL_RH_EXPONENT_2)) < RSSL_RET_SUCCESS
+                || (ret = EncodeReal(iter, TRDVOL_1, tradeSize, RSSL_RH_EXPONENT0)) < RSSL_RET_SUCCESS
+                || (ret = EncodeReal(iter, ACVOL_1, volume_, RSSL_RH_EXPONENT0)) < RSSL_RET_SUCCESS
+                || (ret = rsslEncodeFieldListComplete(iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+            {
+                return ret;
+            }
+        }
+        else
+        {
+            // walk the quote a tick either way, keeping it above zero
+            RsslInt64 move = (RsslInt64)(Next() % 3) - 1;
+            if (bid_ + move > 0)
+            {
+                bid_ += move;
+                ask_ += move;
+            }
+            bidSize_ = 100 * (1 + Next() % 50);
+            askSize_ = 100 * (1 + Next() % 50);
+
+            if ((ret = EncodeMarketPrice(iter, false)) < RSSL_RET_SUCCESS)
+            {
+                return ret;
+            }
+        }
+    }
+    else if ((ret = EncodeBookUpdate(iter)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    return rsslEncodeMsgComplete(iter, RSSL_TRUE);
+}
+
+RsslRet LoopbackItem::EncodeMarketPrice(RsslEncodeIterator * iter, bool refresh)
+{
+    RsslRet ret;
+    RsslFieldList fieldList = RSSL_INIT_FIELD_LIST;
+    fieldList.flags = RSSL_FLF_HAS_STANDARD_DATA;
+
+    if ((ret = rsslEncodeFieldListInit(iter, &fieldList, 0, 0)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    if (refresh)
+    {
+        if ((ret = EncodeString(iter, DSPLY_NAME, name_)) < RSSL_RET_SUCCESS
+            || (ret = EncodeReal(iter, TRDPRC_1, last_, RSSL_RH_EXPONENT_2)) < RSSL_RET_SUCCESS
+            || (ret = EncodeReal(iter, ACVOL_1, volume_, RSSL_RH_EXPONENT0)) < RSSL_RET_SUCCESS)
+        {
+            return ret;
+        }
+    }
+
+    if ((ret = EncodeReal(iter, BID, bid_, RSSL_RH_EXPONENT_2)) < RSSL_RET_SUCCESS
+        || (ret = EncodeReal(iter, ASK, ask_, RSSL_RH_EXPONENT_2)) < RSSL_RET_SUCCESS
+        || (ret = EncodeReal(iter, BIDSIZE, bidSize_, RSSL_RH_EXPONENT0)) < RSSL_RET_SUCCESS
+        || (ret = EncodeReal(iter, ASKSIZE, askSize_, RSSL_RH_EXPONENT0)) < RSSL_RET_SUCCESS
+        || (ret = EncodeUInt(iter, QUOTIM_MS, MillisecondsToday())) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    return rsslEncodeFieldListComplete(iter, RSSL_TRUE);
+}
+
+RsslRet LoopbackItem::EncodeBookRefresh(RsslEncodeIterator * iter)
+{
+    RsslRet ret;
+    RsslMap map = RSSL_INIT_MAP;
+    map.keyPrimitiveType = RSSL_DT_BUFFER;
+    map.containerType = RSSL_DT_FIELD_LIST;
+
+    if ((ret = rsslEncodeMapInit(iter, &map, 0, 0)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    for (std::vector<BookEntry>::const_iterator it = book_.begin(); it != book_.end(); ++it)
+    {
+        if ((ret = EncodeBookEntry(iter, RSSL_MPEA_ADD_ENTRY, *it)) < RSSL_RET_SUCCESS)
+        {
+            return ret;
+        }
+    }
+
+    return rsslEncodeMapComplete(iter, RSSL_TRUE);
+}
+
+RsslRet LoopbackItem::EncodeBookUpdate(RsslEncodeIterator * iter)
+{
+    RsslRet ret;
+    RsslMap map = RSSL_INIT_MAP;
+    map.keyPrimitiveType = RSSL_DT_BUFFER;
+    map.containerType = RSSL_DT_FIELD_LIST;
+
+    if ((ret = rsslEncodeMapInit(iter, &map, 0, 0)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    if (!book_.empty())
+    {
+        BookEntry & entry = book_[Next() % book_.size()];
+
+        if (Next() % 4 == 0)
+        {
+            // replace the entry, moving it to a price that isnt in the book yet on its side
+            if ((ret = EncodeBookEntry(iter, RSSL_MPEA_DELETE_ENTRY, entry)) < RSSL_RET_SUCCESS)
+            {
+                return ret;
+            }
+
+            RsslInt64 price = entry.price;
+            do
+            {
+                price += (entry.side == SideBid ? -1 : 1) * (RsslInt64)(1 + Next() % 4);
+                if (price <= 0)
+                {
+                    price = entry.side == SideBid ? bid_ : ask_;
+                    entry.side = entry.side == SideBid ? SideAsk : SideBid;
+                }
+            } while (domainType_ == RSSL_DMT_MARKET_BY_PRICE && PriceInBook(entry.side, price));
+
+            entry.price = price;
+            entry.size = 100 * (1 + Next() % 50);
+            entry.orders = domainType_ == RSSL_DMT_MARKET_BY_PRICE ? 1 + Next() % 10 : 1;
+            MakeKey(entry);
+
+            if ((ret = EncodeBookEntry(iter, RSSL_MPEA_ADD_ENTRY, entry)) < RSSL_RET_SUCCESS)
+            {
+                return ret;
+            }
+        }
+        else
+        {
+            entry.size = 100 * (1 + Next() % 50);
+            if (domainType_ == RSSL_DMT_MARKET_BY_PRICE)
+            {
+                entry.orders = 1 + Next() % 10;
+            }
+
+            if ((ret = EncodeBookEntry(iter, RSSL_MPEA_UPDATE_ENTRY, entry)) < RSSL_RET_SUCCESS)
+            {
+                return ret;
+            }
+        }
+    }
+
+    return rsslEncodeMapComplete(iter, RSSL_TRUE);
+}
+
+RsslRet LoopbackItem::EncodeBookEntry(RsslEncodeIterator * iter, RsslMapEntryActions action, const BookEntry & entry)
+{
+    RsslRet ret;
+    RsslMapEntry mapEntry = RSSL_INIT_MAP_ENTRY;
+    mapEntry.action = action;
+
+    RsslBuffer key;
+    key.data = const_cast<char *>(entry.key.c_str());
+    key.length = (RsslUInt32)entry.key.length();
+
+    if (action == RSSL_MPEA_DELETE_ENTRY)
+    {
+        return rsslEncodeMapEntry(iter, &mapEntry, &key);
+    }
+
+    if ((ret = rsslEncodeMapEntryInit(iter, &mapEntry, &key, 0)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    RsslFieldList fieldList = RSSL_INIT_FIELD_LIST;
+    fieldList.flags = RSSL_FLF_HAS_STANDARD_DATA;
+
+    if ((ret = rsslEncodeFieldListInit(iter, &fieldList, 0, 0)) < RSSL_RET_SUCCESS
+        || (ret = EncodeReal(iter, ORDER_PRC, entry.price, RSSL_RH_EXPONENT_2)) < RSSL_RET_SUCCESS
+        || (ret = EncodeEnum(iter, ORDER_SIDE, entry.side)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    if (domainType_ == RSSL_DMT_MARKET_BY_ORDER)
+    {
+        ret = EncodeReal(iter, ORDER_SIZE, entry.size, RSSL_RH_EXPONENT0);
+    }
+    else if ((ret = EncodeReal(iter, ACC_SIZE, entry.size, RSSL_RH_EXPONENT0)) >= RSSL_RET_SUCCESS)
+    {
+        ret = EncodeUInt(iter, NO_ORD, entry.orders);
+    }
+
+    if (ret < RSSL_RET_SUCCESS
+        || (ret = EncodeUInt(iter, QUOTIM_MS, MillisecondsToday())) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeFieldListComplete(iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    return rsslEncodeMapEntryComplete(iter, RSSL_TRUE);
+}
@@ -0,0 +1,105 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __LOOPBACKITEM_H__
+#define __LOOPBACKITEM_H__
+
+#include <string>
+#include <vector>
+
+#include <rtr/rsslTransport.h>
+#include <rtr/rsslMessagePackage.h>
+#include <rtr/rsslDataPackage.h>
+#include <rtr/rsslRDM.h>
+
+// A synthetic item served by the loopback provider.
+//
+// Each open stream has its own item, which holds just enough state to make its updates look like a real feed. A
+// market price item has a quote and a last trade that random walk. A book item has a set of orders (market by order)
+// or price levels (market by price) on each side, and each update modifies one of them or replaces it with a new one
+// so the map sees the mix of update, delete and add actions that a real book does.
+class LoopbackItem
+{
+public:
+    LoopbackItem(RsslChannel * chnl, RsslInt32 streamId, RsslUInt8 domainType, const std::string & name,
+        RsslUInt16 serviceId, bool privateStream, size_t depth, unsigned int seed);
+
+    RsslChannel * Channel() const { return chnl_; }
+    RsslInt32 StreamId() const { return streamId_; }
+    RsslUInt8 DomainType() const { return domainType_; }
+    const std::string & Name() const { return name_; }
+
+    // encode a complete refresh or update message for the item, between rsslEncodeMsgInit and rsslEncodeMsgComplete
+    RsslRet EncodeRefresh(RsslEncodeIterator * iter, bool streaming);
+    RsslRet EncodeUpdate(RsslEncodeIterator * iter);
+
+    // position of the item in the provider's update rotation, or NotRotating if it is a snapshot
+    static const size_t NotRotating = (size_t)-1;
+    size_t rotationIndex_;
+
+private:
+    RsslChannel * chnl_;
+    RsslInt32 streamId_;
+    RsslUInt8 domainType_;
+    std::string name_;
+    RsslUInt16 serviceId_;
+    bool privateStream_;
+
+    // xorshift, we just want cheap numbers that differ between items
+    unsigned int seed_;
+    unsigned int Next();
+
+    // prices are held in ticks with an RSSL_RH_EXPONENT_2 hint
+    RsslInt64 bid_;
+    RsslInt64 ask_;
+    RsslInt64 bidSize_;
+    RsslInt64 askSize_;
+    RsslInt64 last_;
+    RsslInt64 volume_;
+
+    // an order or price level in a book
+    struct BookEntry
+    {
+        std::string key;
+        RsslEnum side;
+        RsslInt64 price;
+        RsslInt64 size;
+        RsslUInt64 orders;
+    };
+
+    std::vector<BookEntry> book_;
+    RsslUInt64 nextOrderId_;
+
+    void InitBook(size_t depth);
+    void MakeKey(BookEntry & entry);
+    bool PriceInBook(RsslEnum side, RsslInt64 price) const;
+
+    RsslRet EncodeMarketPrice(RsslEncodeIterator * iter, bool refresh);
+    RsslRet EncodeBookRefresh(RsslEncodeIterator * iter);
+    RsslRet EncodeBookUpdate(RsslEncodeIterator * iter);
+    RsslRet EncodeBookEntry(RsslEncodeIterator * iter, RsslMapEntryActions action, const BookEntry & entry);
+};
+
+#endif //__LOOPBACKITEM_H__
@@ -0,0 +1,1633 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#include "LoopbackProvider.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <algorithm>
+
+#include <utils/time.h>
+
+namespace
+{
+    // the field dictionary goes out in parts of this size, the enum dictionary in one message
+    const RsslUInt32 FieldDictionaryPartSize = 8192;
+    const RsslUInt32 EnumDictionarySize = 128000;
+
+    // how many times to flush and retry when a response cant get an output buffer
+    const int BufferRetries = 1000;
+
+    // select timeouts in microseconds, while streaming and while idle
+    const long StreamingWait = 1000;
+    const long IdleWait = 100000;
+
+    const char * DomainNames[3] = { "mp", "mbo", "mbp" };
+
+    int DomainIndex(RsslUInt8 domainType)
+    {
+        switch (domainType)
+        {
+        case RSSL_DMT_MARKET_BY_ORDER:
+            return 1;
+        case RSSL_DMT_MARKET_BY_PRICE:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    void SetState(RsslState & state, RsslUInt8 streamState, RsslUInt8 dataState, RsslUInt8 code, const char * text)
+    {
+        state.streamState = streamState;
+        state.dataState = dataState;
+        state.code = code;
+        state.text.data = const_cast<char *>(text);
+        state.text.length = (RsslUInt32)strlen(text);
+    }
+
+    RsslRet EncodeElementUInt(RsslEncodeIterator * iter, const RsslBuffer & name, RsslUInt64 value)
+    {
+        RsslElementEntry element = RSSL_INIT_ELEMENT_ENTRY;
+        element.name = name;
+        element.dataType = RSSL_DT_UINT;
+        return rsslEncodeElementEntry(iter, &element, &value);
+    }
+
+    RsslRet EncodeElementAscii(RsslEncodeIterator * iter, const RsslBuffer & name, const char * value)
+    {
+        RsslElementEntry element = RSSL_INIT_ELEMENT_ENTRY;
+        element.name = name;
+        element.dataType = RSSL_DT_ASCII_STRING;
+
+        RsslBuffer buffer;
+        buffer.data = const_cast<char *>(value);
+        buffer.length = (RsslUInt32)strlen(value);
+        return rsslEncodeElementEntry(iter, &element, &buffer);
+    }
+
+    // an element holding an array of ascii strings or uints, as the directory uses for its lists
+    RsslRet EncodeElementArray(RsslEncodeIterator * iter, const RsslBuffer & name, RsslDataType primitiveType,
+        const void * const * values, size_t count)
+    {
+        RsslRet ret;
+        RsslElementEntry element = RSSL_INIT_ELEMENT_ENTRY;
+        element.name = name;
+        element.dataType = RSSL_DT_ARRAY;
+        if ((ret = rsslEncodeElementEntryInit(iter, &element, 0)) < RSSL_RET_SUCCESS)
+        {
+            return ret;
+        }
+
+        RsslArray array = RSSL_INIT_ARRAY;
+        array.primitiveType = primitiveType;
+        array.itemLength = 0;
+        if ((ret = rsslEncodeArrayInit(iter, &array)) < RSSL_RET_SUCCESS)
+        {
+            return ret;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if ((ret = rsslEncodeArrayEntry(iter, 0, values[i])) < RSSL_RET_SUCCESS)
+            {
+                return ret;
+            }
+        }
+
+        if ((ret = rsslEncodeArrayComplete(iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+        {
+            return ret;
+        }
+
+        return rsslEncodeElementEntryComplete(iter, RSSL_TRUE);
+    }
+
+    // count the field entries in a payload, including those in the entries of a map. This is enough to check the
+    // framing of everything a provider publishes without needing to know the field types
+    RsslRet CountFields(RsslDecodeIterator * dIter, RsslContainerType containerType, RsslUInt64 & fields)
+    {
+        RsslRet ret;
+
+        if (containerType == RSSL_DT_FIELD_LIST)
+        {
+            RsslFieldList fieldList;
+            RsslFieldEntry fieldEntry;
+            if ((ret = rsslDecodeFieldList(dIter, &fieldList, 0)) < RSSL_RET_SUCCESS)
+            {
+                return ret;
+            }
+
+            while ((ret = rsslDecodeFieldEntry(dIter, &fieldEntry)) != RSSL_RET_END_OF_CONTAINER)
+            {
+                if (ret < RSSL_RET_SUCCESS)
+                {
+                    return ret;
+                }
+                ++fields;
+            }
+        }
+        else if (containerType == RSSL_DT_MAP)
+        {
+            RsslMap map;
+            RsslMapEntry mapEntry;
+            if ((ret = rsslDecodeMap(dIter, &map)) < RSSL_RET_SUCCESS)
+            {
+                return ret;
+            }
+
+            while ((ret = rsslDecodeMapEntry(dIter, &mapEntry, 0)) != RSSL_RET_END_OF_CONTAINER)
+            {
+                if (ret < RSSL_RET_SUCCESS)
+                {
+                    return ret;
+                }
+
+                if (mapEntry.action != RSSL_MPEA_DELETE_ENTRY && map.containerType == RSSL_DT_FIELD_LIST)
+                {
+                    if ((ret = CountFields(dIter, RSSL_DT_FIELD_LIST, fields)) < RSSL_RET_SUCCESS)
+                    {
+                        return ret;
+                    }
+                }
+            }
+        }
+
+        return RSSL_RET_SUCCESS;
+    }
+}
+
+LoopbackProvider::LoopbackProvider(const LoopbackConfig & config)
+    : config_(config)
+    , runThread_(true)
+    , rsslServer_(0)
+    , fieldsLoaded_(false)
+    , enumsLoaded_(false)
+    , rotationCursor_(0)
+    , nextSeed_(1)
+    , rateStart_(0)
+    , rateSent_(0)
+    , lastStatsTime_(0)
+{
+    FD_ZERO(&readfds_);
+    FD_ZERO(&exceptfds_);
+    FD_ZERO(&wrtfds_);
+    rsslClearDataDictionary(&dictionary_);
+}
+
+LoopbackProvider::~LoopbackProvider()
+{
+    while (!connections_.empty())
+    {
+        RemoveConnection(connections_.back());
+    }
+
+    if (rsslServer_ != 0)
+    {
+        RsslError error;
+        rsslCloseServer(rsslServer_, &error);
+    }
+
+    rsslDeleteDataDictionary(&dictionary_);
+    rsslUninitialize();
+}
+
+bool LoopbackProvider::Init()
+{
+    RsslError error;
+    if (rsslInitialize(RSSL_LOCK_NONE, &error) != RSSL_RET_SUCCESS)
+    {
+        fprintf(stderr, "rsslInitialize() failed <%s>\n", error.text);
+        return false;
+    }
+
+    // the dictionary is only needed to serve it, a consumer with its own dictionary files can do without
+    char errorText[256];
+    RsslBuffer errorBuffer;
+    errorBuffer.data = errorText;
+    errorBuffer.length = sizeof(errorText);
+    if (rsslLoadFieldDictionary(config_.fieldFile.c_str(), &dictionary_, &errorBuffer) < RSSL_RET_SUCCESS)
+    {
+        printf("Unable to load field dictionary '%s', dictionary requests will be refused <%.*s>\n",
+            config_.fieldFile.c_str(), errorBuffer.length, errorBuffer.data);
+    }
+    else
+    {
+        fieldsLoaded_ = true;
+    }
+
+    errorBuffer.length = sizeof(errorText);
+    if (rsslLoadEnumTypeDictionary(config_.enumFile.c_str(), &dictionary_, &errorBuffer) < RSSL_RET_SUCCESS)
+    {
+        printf("Unable to load enum dictionary '%s', dictionary requests will be refused <%.*s>\n",
+            config_.enumFile.c_str(), errorBuffer.length, errorBuffer.data);
+    }
+    else
+    {
+        enumsLoaded_ = true;
+    }
+
+    // bind the same way as UPAProvider::Bind
+    RsslBindOptions sopts = RSSL_INIT_BIND_OPTS;
+    sopts.guaranteedOutputBuffers = config_.outputBuffers;
+    sopts.serviceName = const_cast<char *>(config_.port.c_str());
+    sopts.majorVersion = RSSL_RWF_MAJOR_VERSION;
+    sopts.minorVersion = RSSL_RWF_MINOR_VERSION;
+    sopts.protocolType = RSSL_RWF_PROTOCOL_TYPE;
+
+    if ((rsslServer_ = rsslBind(&sopts, &error)) == 0)
+    {
+        fprintf(stderr, "Unable to bind to port %s <%s>\n", config_.port.c_str(), error.text);
+        return false;
+    }
+
+    printf("Loopback provider bound on port %d serving '%s' (id %d)\n", rsslServer_->portNumber,
+        config_.serviceName.c_str(), config_.serviceId);
+    FD_SET(rsslServer_->socketId, &readfds_);
+    FD_SET(rsslServer_->socketId, &exceptfds_);
+
+    return true;
+}
+
+void LoopbackProvider::Run()
+{
+    bool behind = false;
+    lastStatsTime_ = utils::time::GetMicroCount();
+
+    while (runThread_)
+    {
+        fd_set useRead = readfds_;
+        fd_set useExcept = exceptfds_;
+        fd_set useWrt = wrtfds_;
+
+        // dont wait at all if there are updates due, and only briefly while anything is streaming
+        struct timeval timeout;
+        long wait = behind ? 0 : (rotation_.empty() ? IdleWait : StreamingWait);
+        timeout.tv_sec = wait / 1000000;
+        timeout.tv_usec = wait % 1000000;
+
+        int selRet = select(FD_SETSIZE, &useRead, &useWrt, &useExcept, &timeout);
+        if (selRet > 0)
+        {
+            if (FD_ISSET(rsslServer_->socketId, &useRead))
+            {
+                AcceptConnection();
+            }
+
+            for (size_t index = 0; index < connections_.size(); ++index)
+            {
+                Connection * conn = connections_[index];
+                if (conn->failed || conn->chnl->socketId == -1)
+                {
+                    continue;
+                }
+
+                if (FD_ISSET(conn->chnl->socketId, &useRead) || FD_ISSET(conn->chnl->socketId, &useExcept))
+                {
+                    ReadFromChannel(conn);
+                }
+
+                if (!conn->failed && conn->chnl->state == RSSL_CH_STATE_ACTIVE && FD_ISSET(conn->chnl->socketId, &useWrt))
+                {
+                    RsslError error;
+                    RsslRet ret = rsslFlush(conn->chnl, &error);
+                    if (ret < RSSL_RET_SUCCESS)
+                    {
+                        printf("rsslFlush() failed on fd=%d with return code %d <%s>\n", conn->chnl->socketId, ret, error.text);
+                        FailConnection(conn);
+                    }
+                    else if (ret == RSSL_RET_SUCCESS)
+                    {
+                        FD_CLR(conn->chnl->socketId, &wrtfds_);
+                    }
+                }
+            }
+        }
+        else if (selRet < 0)
+        {
+#ifdef _WIN32
+            if (WSAGetLastError() != WSAEINTR)
+            {
+                fprintf(stderr, "select() failed with error code %d\n", WSAGetLastError());
+                break;
+            }
+#else
+            if (errno != EINTR)
+            {
+                fprintf(stderr, "select() failed with error code %d\n", errno);
+                break;
+            }
+#endif
+        }
+
+        RemoveFailedConnections();
+
+        behind = SendUpdates();
+        RemoveFailedConnections();
+
+        HandlePings(time(0));
+        RemoveFailedConnections();
+
+        RsslUInt64 now = utils::time::GetMicroCount();
+        if (config_.statsInterval > 0 && now - lastStatsTime_ >= (RsslUInt64)config_.statsInterval * 1000000)
+        {
+            LogStats(now);
+        }
+    }
+}
+
+void LoopbackProvider::AcceptConnection()
+{
+    RsslAcceptOptions acceptOpts = RSSL_INIT_ACCEPT_OPTS;
+    RsslError error;
+    RsslChannel * chnl = rsslAccept(rsslServer_, &acceptOpts, &error);
+    if (chnl == 0)
+    {
+        printf("rsslAccept() failed <%s>\n", error.text);
+        return;
+    }
+
+    Connection * conn = new Connection;
+    conn->chnl = chnl;
+    conn->nextSendPingTime = 0;
+    conn->nextReceivePingTime = 0;
+    conn->receivedMsg = false;
+    conn->pingsInitialized = false;
+    conn->failed = false;
+    connections_.push_back(conn);
+
+    printf("New client on fd=%d\n", chnl->socketId);
+    FD_SET(chnl->socketId, &readfds_);
+    FD_SET(chnl->socketId, &exceptfds_);
+}
+
+LoopbackProvider::Connection * LoopbackProvider::FindConnection(RsslChannel * chnl)
+{
+    for (std::vector<Connection *>::iterator it = connections_.begin(); it != connections_.end(); ++it)
+    {
+        if ((*it)->chnl == chnl)
+        {
+            return *it;
+        }
+    }
+    return 0;
+}
+
+void LoopbackProvider::InitChannel(Connection * conn)
+{
+    RsslChannel * chnl = conn->chnl;
+    RsslInProgInfo inProg = RSSL_INIT_IN_PROG_INFO;
+    RsslError error;
+
+    RsslRet ret = rsslInitChannel(chnl, &inProg, &error);
+    if (ret == RSSL_RET_CHAN_INIT_IN_PROGRESS)
+    {
+        if (inProg.flags & RSSL_IP_FD_CHANGE)
+        {
+            FD_CLR(inProg.oldSocket, &readfds_);
+            FD_CLR(inProg.oldSocket, &exceptfds_);
+            FD_SET(chnl->socketId, &readfds_);
+            FD_SET(chnl->socketId, &exceptfds_);
+        }
+    }
+    else if (ret == RSSL_RET_SUCCESS)
+    {
+        printf("Client channel fd=%d is now active\n", chnl->socketId);
+
+        // the ping timeout is negotiated on the channel, send at a third of it as UPAProvider does
+        time_t now = time(0);
+        conn->nextSendPingTime = now + (time_t)(chnl->pingTimeout / 3);
+        conn->nextReceivePingTime = now + (time_t)chnl->pingTimeout;
+        conn->pingsInitialized = true;
+    }
+    else
+    {
+        printf("Channel initialization failed on fd=%d <%s>\n", chnl->socketId, error.text);
+        FailConnection(conn);
+    }
+}
+
+void LoopbackProvider::ReadFromChannel(Connection * conn)
+{
+    RsslChannel * chnl = conn->chnl;
+    if (chnl->state == RSSL_CH_STATE_INITIALIZING)
+    {
+        InitChannel(conn);
+        return;
+    }
+
+    if (chnl->state != RSSL_CH_STATE_ACTIVE)
+    {
+        printf("Channel fd=%d closed\n", chnl->socketId);
+        FailConnection(conn);
+        return;
+    }
+
+    RsslRet readret = 1;
+    RsslError error;
+    while (readret > 0 && !conn->failed)
+    {
+        RsslBuffer * msgBuf = rsslRead(chnl, &readret, &error);
+        if (msgBuf != 0)
+        {
+            conn->receivedMsg = true;
+            if (ProcessRequest(conn, msgBuf) != RSSL_RET_SUCCESS)
+            {
+                FailConnection(conn);
+            }
+            continue;
+        }
+
+        switch (readret)
+        {
+        case RSSL_RET_READ_PING:
+            conn->receivedMsg = true;
+            break;
+
+        case RSSL_RET_READ_FD_CHANGE:
+            FD_CLR(chnl->oldSocketId, &readfds_);
+            FD_CLR(chnl->oldSocketId, &exceptfds_);
+            FD_SET(chnl->socketId, &readfds_);
+            FD_SET(chnl->socketId, &exceptfds_);
+            break;
+
+        case RSSL_RET_FAILURE:
+            printf("Channel fd=%d inactive <%s>\n", chnl->socketId, error.text);
+            FailConnection(conn);
+            break;
+
+        default:
+            if (readret < 0 && readret != RSSL_RET_READ_WOULD_BLOCK)
+            {
+                printf("Read error on fd=%d: %s <%d>\n", chnl->socketId, error.text, readret);
+            }
+            break;
+        }
+    }
+}
+
+void LoopbackProvider::FailConnection(Connection * conn)
+{
+    if (!conn->failed)
+    {
+        conn->failed = true;
+        failed_.push_back(conn);
+    }
+}
+
+void LoopbackProvider::RemoveFailedConnections()
+{
+    for (std::vector<Connection *>::iterator it = failed_.begin(); it != failed_.end(); ++it)
+    {
+        RemoveConnection(*it);
+    }
+    failed_.clear();
+}
+
+void LoopbackProvider::RemoveConnection(Connection * conn)
+{
+    for (Connection::ItemMap_t::iterator it = conn->items.begin(); it != conn->items.end(); ++it)
+    {
+        RemoveFromRotation(it->second);
+        delete it->second;
+    }
+    conn->items.clear();
+
+    RsslChannel * chnl = conn->chnl;
+    if (chnl->socketId != -1)
+    {
+        FD_CLR(chnl->socketId, &readfds_);
+        FD_CLR(chnl->socketId, &exceptfds_);
+        FD_CLR(chnl->socketId, &wrtfds_);
+    }
+
+    RsslError error;
+    rsslCloseChannel(chnl, &error);
+
+    connections_.erase(std::remove(connections_.begin(), connections_.end(), conn), connections_.end());
+    delete conn;
+}
+
+void LoopbackProvider::HandlePings(time_t now)
+{
+    for (std::vector<Connection *>::iterator it = connections_.begin(); it != connections_.end(); ++it)
+    {
+        Connection * conn = *it;
+        if (conn->failed || !conn->pingsInitialized)
+        {
+            continue;
+        }
+
+        if (now >= conn->nextSendPingTime)
+        {
+            RsslError error;
+            RsslRet ret = rsslPing(conn->chnl, &error);
+            if (ret < RSSL_RET_SUCCESS)
+            {
+                printf("rsslPing() failed on fd=%d with return code %d\n", conn->chnl->socketId, ret);
+            }
+            else
+            {
+                if (ret > RSSL_RET_SUCCESS)
+                {
+                    FD_SET(conn->chnl->socketId, &wrtfds_);
+                }
+                conn->nextSendPingTime = now + (time_t)(conn->chnl->pingTimeout / 3);
+            }
+        }
+
+        if (now >= conn->nextReceivePingTime)
+        {
+            if (conn->receivedMsg)
+            {
+                conn->receivedMsg = false;
+                conn->nextReceivePingTime = now + (time_t)conn->chnl->pingTimeout;
+            }
+            else
+            {
+                printf("Lost contact with client fd=%d\n", conn->chnl->socketId);
+                FailConnection(conn);
+            }
+        }
+    }
+}
+
+RsslRet LoopbackProvider::ProcessRequest(Connection * conn, RsslBuffer * buffer)
+{
+    RsslMsg msg = RSSL_INIT_MSG;
+    RsslDecodeIterator dIter;
+
+    rsslClearDecodeIterator(&dIter);
+    rsslSetDecodeIteratorRWFVersion(&dIter, conn->chnl->majorVersion, conn->chnl->minorVersion);
+    rsslSetDecodeIteratorBuffer(&dIter, buffer);
+
+    RsslRet ret = rsslDecodeMsg(&dIter, &msg);
+    if (ret != RSSL_RET_SUCCESS)
+    {
+        printf("rsslDecodeMsg() failed with %d on fd=%d size %d\n", ret, conn->chnl->socketId, buffer->length);
+        ++counters_.decodeErrors;
+        return RSSL_RET_SUCCESS;
+    }
+
+    // posts can come on the login stream as well as on item streams
+    if (msg.msgBase.msgClass == RSSL_MC_POST)
+    {
+        return ProcessPost(conn, &msg);
+    }
+
+    // anything other than a request or a close is being published to us by a non-interactive provider
+    bool isRequest = msg.msgBase.msgClass == RSSL_MC_REQUEST || msg.msgBase.msgClass == RSSL_MC_CLOSE;
+
+    switch (msg.msgBase.domainType)
+    {
+    case RSSL_DMT_LOGIN:
+        return ProcessLoginRequest(conn, &msg);
+
+    case RSSL_DMT_SOURCE:
+        return isRequest ? ProcessSourceDirectoryRequest(conn, &msg) : ProcessPublished(conn, &msg, &dIter);
+
+    case RSSL_DMT_DICTIONARY:
+        return isRequest ? ProcessDictionaryRequest(conn, &msg) : RSSL_RET_SUCCESS;
+
+    default:
+        return isRequest ? ProcessItemRequest(conn, &msg, &dIter) : ProcessPublished(conn, &msg, &dIter);
+    }
+}
+
+RsslRet LoopbackProvider::ProcessLoginRequest(Connection * conn, RsslMsg * msg)
+{
+    switch (msg->msgBase.msgClass)
+    {
+    case RSSL_MC_REQUEST:
+        {
+            RsslMsgKey * key = (RsslMsgKey *)rsslGetMsgKey(msg);
+            if (key != 0 && (key->flags & RSSL_MKF_HAS_NAME))
+            {
+                printf("Login from '%.*s' on fd=%d\n", key->name.length, key->name.data, conn->chnl->socketId);
+            }
+            return SendLoginRefresh(conn, msg);
+        }
+
+    case RSSL_MC_CLOSE:
+        printf("Login closed on fd=%d\n", conn->chnl->socketId);
+        break;
+
+    default:
+        break;
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet LoopbackProvider::ProcessSourceDirectoryRequest(Connection * conn, RsslMsg * msg)
+{
+    if (msg->msgBase.msgClass != RSSL_MC_REQUEST)
+    {
+        return RSSL_RET_SUCCESS;
+    }
+
+    RsslMsgKey * key = (RsslMsgKey *)rsslGetMsgKey(msg);
+    RsslUInt32 filter = RDM_DIRECTORY_SERVICE_INFO_FILTER | RDM_DIRECTORY_SERVICE_STATE_FILTER;
+    if (key != 0 && (key->flags & RSSL_MKF_HAS_FILTER))
+    {
+        filter = key->filter;
+    }
+
+    return SendSourceDirectoryRefresh(conn, msg->msgBase.streamId, filter);
+}
+
+RsslRet LoopbackProvider::ProcessDictionaryRequest(Connection * conn, RsslMsg * msg)
+{
+    if (msg->msgBase.msgClass != RSSL_MC_REQUEST)
+    {
+        return RSSL_RET_SUCCESS;
+    }
+
+    RsslInt32 streamId = msg->msgBase.streamId;
+    RsslMsgKey * key = (RsslMsgKey *)rsslGetMsgKey(msg);
+    if (key == 0 || !(key->flags & RSSL_MKF_HAS_NAME))
+    {
+        return SendStatus(conn, streamId, RSSL_DMT_DICTIONARY, RSSL_STREAM_CLOSED, RSSL_DATA_SUSPECT, RSSL_SC_USAGE_ERROR,
+            "Dictionary request has no name", false);
+    }
+
+    RsslUInt32 verbosity = (key->flags & RSSL_MKF_HAS_FILTER) ? key->filter : (RsslUInt32)RDM_DICTIONARY_NORMAL;
+
+    static const char fieldName[] = "RWFFld";
+    static const char enumName[] = "RWFEnum";
+    if (key->name.length == strlen(fieldName) && memcmp(key->name.data, fieldName, key->name.length) == 0 && fieldsLoaded_)
+    {
+        return SendFieldDictionary(conn, streamId, key->name, verbosity);
+    }
+    if (key->name.length == strlen(enumName) && memcmp(key->name.data, enumName, key->name.length) == 0 && enumsLoaded_)
+    {
+        return SendEnumDictionary(conn, streamId, key->name, verbosity);
+    }
+
+    return SendStatus(conn, streamId, RSSL_DMT_DICTIONARY, RSSL_STREAM_CLOSED, RSSL_DATA_SUSPECT, RSSL_SC_NOT_FOUND,
+        "Dictionary not available", false);
+}
+
+bool LoopbackProvider::IsServed(const RsslBuffer & name) const
+{
+    if (config_.symbols == 0)
+    {
+        return true;
+    }
+
+    // <prefix><n> with n < symbols and no leading zeros
+    const std::string & prefix = config_.symbolPrefix;
+    if (name.length <= prefix.length() || memcmp(name.data, prefix.c_str(), prefix.length()) != 0)
+    {
+        return false;
+    }
+
+    const char * digits = name.data + prefix.length();
+    size_t count = name.length - prefix.length();
+    if (count > 1 && digits[0] == '0')
+    {
+        return false;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (digits[i] < '0' || digits[i] > '9')
+        {
+            return false;
+        }
+        n = n * 10 + (digits[i] - '0');
+        if (n >= config_.symbols)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+RsslRet LoopbackProvider::ProcessItemRequest(Connection * conn, RsslMsg * msg, RsslDecodeIterator * dIter)
+{
+    RsslInt32 streamId = msg->msgBase.streamId;
+    RsslUInt8 domainType = msg->msgBase.domainType;
+
+    if (msg->msgBase.msgClass == RSSL_MC_CLOSE)
+    {
+        Connection::ItemMap_t::iterator it = conn->items.find(streamId);
+        if (it != conn->items.end())
+        {
+            RemoveFromRotation(it->second);
+            delete it->second;
+            conn->items.erase(it);
+        }
+        return RSSL_RET_SUCCESS;
+    }
+
+    RsslRequestMsg & requestMsg = msg->requestMsg;
+    bool privateStream = (requestMsg.flags & RSSL_RQMF_PRIVATE_STREAM) != 0;
+    bool streaming = (requestMsg.flags & RSSL_RQMF_STREAMING) != 0;
+
+    // a reissue on an open stream just gets a fresh image, unless it asked not to
+    Connection::ItemMap_t::iterator it = conn->items.find(streamId);
+    if (it != conn->items.end())
+    {
+        if (requestMsg.flags & RSSL_RQMF_NO_REFRESH)
+        {
+            return RSSL_RET_SUCCESS;
+        }
+        return SendItemRefresh(conn, it->second, true);
+    }
+
+    if (domainType != RSSL_DMT_MARKET_PRICE && domainType != RSSL_DMT_MARKET_BY_ORDER && domainType != RSSL_DMT_MARKET_BY_PRICE)
+    {
+        return SendStatus(conn, streamId, domainType, RSSL_STREAM_CLOSED, RSSL_DATA_SUSPECT, RSSL_SC_USAGE_ERROR,
+            "Domain not supported", privateStream);
+    }
+
+    RsslMsgKey * key = &requestMsg.msgBase.msgKey;
+    if ((key->flags & RSSL_MKF_HAS_SERVICE_ID) && key->serviceId != config_.serviceId)
+    {
+        return SendStatus(conn, streamId, domainType, RSSL_STREAM_CLOSED, RSSL_DATA_SUSPECT, RSSL_SC_USAGE_ERROR,
+            "Unknown service id", privateStream);
+    }
+
+    if (requestMsg.flags & RSSL_RQMF_HAS_BATCH)
+    {
+        return ProcessBatchRequest(conn, msg, dIter);
+    }
+
+    if (!(key->flags & RSSL_MKF_HAS_NAME))
+    {
+        return SendStatus(conn, streamId, domainType, RSSL_STREAM_CLOSED, RSSL_DATA_SUSPECT, RSSL_SC_USAGE_ERROR,
+            "Request has no item name", privateStream);
+    }
+
+    return OpenItem(conn, streamId, domainType, key->name, streaming, privateStream);
+}
+
+RsslRet LoopbackProvider::ProcessBatchRequest(Connection * conn, RsslMsg * msg, RsslDecodeIterator * dIter)
+{
+    RsslInt32 streamId = msg->msgBase.streamId;
+    RsslUInt8 domainType = msg->msgBase.domainType;
+    bool privateStream = (msg->requestMsg.flags & RSSL_RQMF_PRIVATE_STREAM) != 0;
+    bool streaming = (msg->requestMsg.flags & RSSL_RQMF_STREAMING) != 0;
+
+    // the items go on the streams that follow the batch stream, in the order of the :ItemList
+    RsslInt32 count = 0;
+    bool foundList = false;
+
+    RsslElementList elementList = RSSL_INIT_ELEMENT_LIST;
+    RsslElementEntry element = RSSL_INIT_ELEMENT_ENTRY;
+    RsslRet ret;
+    if (msg->msgBase.containerType == RSSL_DT_ELEMENT_LIST && rsslDecodeElementList(dIter, &elementList, 0) == RSSL_RET_SUCCESS)
+    {
+        while ((ret = rsslDecodeElementEntry(dIter, &element)) != RSSL_RET_END_OF_CONTAINER)
+        {
+            if (ret < RSSL_RET_SUCCESS)
+            {
+                break;
+            }
+
+            if (element.dataType != RSSL_DT_ARRAY || element.name.length != RSSL_ENAME_BATCH_ITEM_LIST.length
+                || memcmp(element.name.data, RSSL_ENAME_BATCH_ITEM_LIST.data, element.name.length) != 0)
+            {
+                continue;
+            }
+
+            RsslArray itemList = RSSL_INIT_ARRAY;
+            RsslBuffer entry;
+            if (rsslDecodeArray(dIter, &itemList) < RSSL_RET_SUCCESS)
+            {
+                break;
+            }
+
+            foundList = true;
+            while ((ret = rsslDecodeArrayEntry(dIter, &entry)) != RSSL_RET_END_OF_CONTAINER)
+            {
+                if (ret < RSSL_RET_SUCCESS)
+                {
+                    break;
+                }
+
+                RsslBuffer name;
+                if (rsslDecodeBuffer(dIter, &name) == RSSL_RET_SUCCESS)
+                {
+                    ++count;
+                    OpenItem(conn, streamId + count, domainType, name, streaming, privateStream);
+                }
+            }
+        }
+    }
+
+    if (!foundList)
+    {
+        return SendStatus(conn, streamId, domainType, RSSL_STREAM_CLOSED, RSSL_DATA_SUSPECT, RSSL_SC_USAGE_ERROR,
+            "Batch request has no item list", privateStream);
+    }
+
+    ++counters_.batchRequests;
+
+    // and the batch stream is done with
+    char text[64];
+    snprintf(text, sizeof(text), "Processed %d items from batch request", count);
+    return SendStatus(conn, streamId, domainType, RSSL_STREAM_CLOSED, RSSL_DATA_OK, RSSL_SC_NONE, text, privateStream);
+}
+
+RsslRet LoopbackProvider::OpenItem(Connection * conn, RsslInt32 streamId, RsslUInt8 domainType, const RsslBuffer & name,
+    bool streaming, bool privateStream)
+{
+    if (!IsServed(name))
+    {
+        return SendStatus(conn, streamId, domainType, RSSL_STREAM_CLOSED, RSSL_DATA_SUSPECT, RSSL_SC_NOT_FOUND,
+            "Item not found", privateStream);
+    }
+
+    // a batch may land on a stream thats still open, in which case the old item makes way
+    Connection::ItemMap_t::iterator it = conn->items.find(streamId);
+    if (it != conn->items.end())
+    {
+        RemoveFromRotation(it->second);
+        delete it->second;
+        conn->items.erase(it);
+    }
+
+    LoopbackItem * item = new LoopbackItem(conn->chnl, streamId, domainType, std::string(name.data, name.length),
+        config_.serviceId, privateStream, config_.depth, nextSeed_++);
+
+    RsslRet ret = SendItemRefresh(conn, item, streaming);
+    if (streaming && ret == RSSL_RET_SUCCESS)
+    {
+        conn->items[streamId] = item;
+        AddToRotation(conn, item);
+    }
+    else
+    {
+        // snapshots are done with as soon as the refresh is sent
+        delete item;
+    }
+
+    return ret;
+}
+
+RsslRet LoopbackProvider::ProcessPost(Connection * conn, RsslMsg * msg)
+{
+    RsslPostMsg * postMsg = &msg->postMsg;
+    if (postMsg->flags & RSSL_PSMF_ACK)
+    {
+        ++counters_.postsAcked;
+        return SendAck(conn, postMsg);
+    }
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet LoopbackProvider::ProcessPublished(Connection * conn, RsslMsg * msg, RsslDecodeIterator * dIter)
+{
+    switch (msg->msgBase.msgClass)
+    {
+    case RSSL_MC_REFRESH:
+        if (msg->msgBase.domainType == RSSL_DMT_SOURCE)
+        {
+            printf("Source directory published on fd=%d\n", conn->chnl->socketId);
+            return RSSL_RET_SUCCESS;
+        }
+        ++counters_.publishedRefreshes;
+        break;
+
+    case RSSL_MC_UPDATE:
+        if (msg->msgBase.domainType == RSSL_DMT_SOURCE)
+        {
+            return RSSL_RET_SUCCESS;
+        }
+        ++counters_.publishedUpdates;
+        break;
+
+    default:
+        return RSSL_RET_SUCCESS;
+    }
+
+    if (CountFields(dIter, msg->msgBase.containerType, counters_.publishedFields) < RSSL_RET_SUCCESS)
+    {
+        ++counters_.decodeErrors;
+    }
+
+    return RSSL_RET_SUCCESS;
+}
+
+RsslBuffer * LoopbackProvider::GetBuffer(Connection * conn, RsslUInt32 size, bool wait)
+{
+    RsslError error;
+    for (int attempt = 0; attempt < BufferRetries; ++attempt)
+    {
+        RsslBuffer * buffer = rsslGetBuffer(conn->chnl, size, RSSL_FALSE, &error);
+        if (buffer != 0)
+        {
+            return buffer;
+        }
+
+        if (error.rsslErrorId != RSSL_RET_BUFFER_NO_BUFFERS)
+        {
+            printf("rsslGetBuffer() failed on fd=%d <%s>\n", conn->chnl->socketId, error.text);
+            FailConnection(conn);
+            return 0;
+        }
+
+        // out of buffers, so the channel is backed up. Flushing is the only way to get some back
+        ++counters_.noBuffers;
+        if (rsslFlush(conn->chnl, &error) < RSSL_RET_SUCCESS)
+        {
+            FailConnection(conn);
+            return 0;
+        }
+
+        if (!wait)
+        {
+            break;
+        }
+    }
+
+    FD_SET(conn->chnl->socketId, &wrtfds_);
+    return 0;
+}
+
+void LoopbackProvider::InitEncodeIterator(Connection * conn, RsslEncodeIterator * iter, RsslBuffer * buffer)
+{
+    rsslClearEncodeIterator(iter);
+    rsslSetEncodeIteratorBuffer(iter, buffer);
+    rsslSetEncodeIteratorRWFVersion(iter, conn->chnl->majorVersion, conn->chnl->minorVersion);
+}
+
+bool LoopbackProvider::Write(Connection * conn, RsslBuffer * buffer)
+{
+    RsslError error;
+    RsslUInt32 bytes;
+    RsslUInt32 uncompressedBytes;
+
+    RsslRet ret = rsslWrite(conn->chnl, buffer, RSSL_HIGH_PRIORITY, 0, &bytes, &uncompressedBytes, &error);
+    while (ret == RSSL_RET_WRITE_CALL_AGAIN)
+    {
+        // the buffer is being fragmented and the channel is full, flush and carry on with the same buffer
+        if (rsslFlush(conn->chnl, &error) < RSSL_RET_SUCCESS)
+        {
+            break;
+        }
+        ret = rsslWrite(conn->chnl, buffer, RSSL_HIGH_PRIORITY, 0, &bytes, &uncompressedBytes, &error);
+    }
+
+    if (ret > RSSL_RET_SUCCESS || (ret == RSSL_RET_WRITE_FLUSH_FAILED && conn->chnl->state != RSSL_CH_STATE_CLOSED))
+    {
+        // written but there is more to flush
+        FD_SET(conn->chnl->socketId, &wrtfds_);
+        return true;
+    }
+
+    if (ret == RSSL_RET_WRITE_FLUSH_FAILED)
+    {
+        // the buffer was taken but the channel has gone
+        printf("rsslWrite() flush failed on fd=%d, channel closed\n", conn->chnl->socketId);
+        FailConnection(conn);
+        return false;
+    }
+
+    if (ret < RSSL_RET_SUCCESS)
+    {
+        printf("rsslWrite() failed on fd=%d with return code %d <%s>\n", conn->chnl->socketId, ret, error.text);
+        rsslReleaseBuffer(buffer, &error);
+        FailConnection(conn);
+        return false;
+    }
+
+    return true;
+}
+
+RsslRet LoopbackProvider::SendLoginRefresh(Connection * conn, RsslMsg * msg)
+{
+    RsslBuffer * buffer = GetBuffer(conn, config_.maxMessageSize, true);
+    if (buffer == 0)
+    {
+        return RSSL_RET_FAILURE;
+    }
+
+    RsslRefreshMsg refreshMsg = RSSL_INIT_REFRESH_MSG;
+    refreshMsg.msgBase.msgClass = RSSL_MC_REFRESH;
+    refreshMsg.msgBase.domainType = RSSL_DMT_LOGIN;
+    refreshMsg.msgBase.streamId = msg->msgBase.streamId;
+    refreshMsg.msgBase.containerType = RSSL_DT_NO_DATA;
+    refreshMsg.flags = RSSL_RFMF_HAS_MSG_KEY | RSSL_RFMF_SOLICITED | RSSL_RFMF_REFRESH_COMPLETE | RSSL_RFMF_CLEAR_CACHE;
+    SetState(refreshMsg.state, RSSL_STREAM_OPEN, RSSL_DATA_OK, RSSL_SC_NONE, "Login accepted by loopback provider");
+
+    // echo the user name, and tell the client what we support
+    RsslMsgKey * requestKey = (RsslMsgKey *)rsslGetMsgKey(msg);
+    refreshMsg.msgBase.msgKey.flags = RSSL_MKF_HAS_NAME_TYPE | RSSL_MKF_HAS_ATTRIB;
+    refreshMsg.msgBase.msgKey.nameType = RDM_LOGIN_USER_NAME;
+    refreshMsg.msgBase.msgKey.attribContainerType = RSSL_DT_ELEMENT_LIST;
+    if (requestKey != 0 && (requestKey->flags & RSSL_MKF_HAS_NAME))
+    {
+        refreshMsg.msgBase.msgKey.flags |= RSSL_MKF_HAS_NAME;
+        refreshMsg.msgBase.msgKey.name = requestKey->name;
+    }
+
+    RsslEncodeIterator iter;
+    InitEncodeIterator(conn, &iter, buffer);
+
+    RsslRet ret;
+    RsslElementList elementList = RSSL_INIT_ELEMENT_LIST;
+    elementList.flags = RSSL_ELF_HAS_STANDARD_DATA;
+
+    if ((ret = rsslEncodeMsgInit(&iter, (RsslMsg *)&refreshMsg, 0)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeElementListInit(&iter, &elementList, 0, 0)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementAscii(&iter, RSSL_ENAME_APPID, "256")) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementAscii(&iter, RSSL_ENAME_APPNAME, "upaloopback")) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(&iter, RSSL_ENAME_SINGLE_OPEN, 0)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(&iter, RSSL_ENAME_ALLOW_SUSPECT_DATA, 1)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(&iter, RSSL_ENAME_SUPPORT_POST, 1)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(&iter, RSSL_ENAME_SUPPORT_BATCH, 1)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeElementListComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeMsgKeyAttribComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeMsgComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        printf("Encoding the login refresh failed with return code %d\n", ret);
+        RsslError error;
+        rsslReleaseBuffer(buffer, &error);
+        return RSSL_RET_FAILURE;
+    }
+
+    buffer->length = rsslGetEncodedBufferLength(&iter);
+    return Write(conn, buffer) ? RSSL_RET_SUCCESS : RSSL_RET_FAILURE;
+}
+
+RsslRet LoopbackProvider::EncodeServiceInfo(RsslEncodeIterator * iter)
+{
+    RsslRet ret;
+    RsslElementList elementList = RSSL_INIT_ELEMENT_LIST;
+    elementList.flags = RSSL_ELF_HAS_STANDARD_DATA;
+
+    RsslUInt64 capabilities[] = { RSSL_DMT_DICTIONARY, RSSL_DMT_MARKET_PRICE, RSSL_DMT_MARKET_BY_ORDER, RSSL_DMT_MARKET_BY_PRICE };
+    const void * capabilityValues[] = { &capabilities[0], &capabilities[1], &capabilities[2], &capabilities[3] };
+
+    RsslBuffer dictionaries[2];
+    dictionaries[0].data = (char *)"RWFFld";
+    dictionaries[0].length = 6;
+    dictionaries[1].data = (char *)"RWFEnum";
+    dictionaries[1].length = 7;
+    const void * dictionaryValues[] = { &dictionaries[0], &dictionaries[1] };
+
+    RsslQos qos = RSSL_INIT_QOS;
+    qos.rate = RSSL_QOS_RATE_TICK_BY_TICK;
+    qos.timeliness = RSSL_QOS_TIME_REALTIME;
+    const void * qosValues[] = { &qos };
+
+    if ((ret = rsslEncodeElementListInit(iter, &elementList, 0, 0)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementAscii(iter, RSSL_ENAME_NAME, config_.serviceName.c_str())) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementAscii(iter, RSSL_ENAME_VENDOR, "Tick42")) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(iter, RSSL_ENAME_IS_SOURCE, 1)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementArray(iter, RSSL_ENAME_CAPABILITIES, RSSL_DT_UINT, capabilityValues, 4)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementArray(iter, RSSL_ENAME_DICTIONARYS_PROVIDED, RSSL_DT_ASCII_STRING, dictionaryValues, 2)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementArray(iter, RSSL_ENAME_DICTIONARYS_USED, RSSL_DT_ASCII_STRING, dictionaryValues, 2)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementArray(iter, RSSL_ENAME_QOS, RSSL_DT_QOS, qosValues, 1)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(iter, RSSL_ENAME_SUPPS_QOS_RANGE, 0)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    return rsslEncodeElementListComplete(iter, RSSL_TRUE);
+}
+
+RsslRet LoopbackProvider::EncodeServiceState(RsslEncodeIterator * iter)
+{
+    RsslRet ret;
+    RsslElementList elementList = RSSL_INIT_ELEMENT_LIST;
+    elementList.flags = RSSL_ELF_HAS_STANDARD_DATA;
+
+    if ((ret = rsslEncodeElementListInit(iter, &elementList, 0, 0)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(iter, RSSL_ENAME_SVC_STATE, 1)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(iter, RSSL_ENAME_ACCEPTING_REQS, 1)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    return rsslEncodeElementListComplete(iter, RSSL_TRUE);
+}
+
+RsslRet LoopbackProvider::EncodeServiceLoad(RsslEncodeIterator * iter)
+{
+    RsslRet ret;
+    RsslElementList elementList = RSSL_INIT_ELEMENT_LIST;
+    elementList.flags = RSSL_ELF_HAS_STANDARD_DATA;
+
+    // with a symbol universe the open limit is its size, otherwise there isnt one
+    RsslUInt64 openLimit = config_.symbols > 0 ? config_.symbols * 3 : 0xFFFFFFFF;
+
+    if ((ret = rsslEncodeElementListInit(iter, &elementList, 0, 0)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(iter, RSSL_ENAME_OPEN_LIMIT, openLimit)) < RSSL_RET_SUCCESS
+        || (ret = EncodeElementUInt(iter, RSSL_ENAME_LOAD_FACT, 1)) < RSSL_RET_SUCCESS)
+    {
+        return ret;
+    }
+
+    return rsslEncodeElementListComplete(iter, RSSL_TRUE);
+}
+
+RsslRet LoopbackProvider::SendSourceDirectoryRefresh(Connection * conn, RsslInt32 streamId, RsslUInt32 filter)
+{
+    RsslBuffer * buffer = GetBuffer(conn, config_.maxMessageSize, true);
+    if (buffer == 0)
+    {
+        return RSSL_RET_FAILURE;
+    }
+
+    RsslRefreshMsg refreshMsg = RSSL_INIT_REFRESH_MSG;
+    refreshMsg.msgBase.msgClass = RSSL_MC_REFRESH;
+    refreshMsg.msgBase.domainType = RSSL_DMT_SOURCE;
+    refreshMsg.msgBase.streamId = streamId;
+    refreshMsg.msgBase.containerType = RSSL_DT_MAP;
+    refreshMsg.flags = RSSL_RFMF_HAS_MSG_KEY | RSSL_RFMF_SOLICITED | RSSL_RFMF_REFRESH_COMPLETE | RSSL_RFMF_CLEAR_CACHE;
+    refreshMsg.msgBase.msgKey.flags = RSSL_MKF_HAS_FILTER;
+    refreshMsg.msgBase.msgKey.filter = filter;
+    SetState(refreshMsg.state, RSSL_STREAM_OPEN, RSSL_DATA_OK, RSSL_SC_NONE, "Source directory refresh completed");
+
+    RsslEncodeIterator iter;
+    InitEncodeIterator(conn, &iter, buffer);
+
+    RsslRet ret;
+    RsslMap map = RSSL_INIT_MAP;
+    map.keyPrimitiveType = RSSL_DT_UINT;
+    map.containerType = RSSL_DT_FILTER_LIST;
+
+    RsslMapEntry mapEntry = RSSL_INIT_MAP_ENTRY;
+    mapEntry.action = RSSL_MPEA_ADD_ENTRY;
+    RsslUInt64 serviceId = config_.serviceId;
+
+    RsslFilterList filterList = RSSL_INIT_FILTER_LIST;
+    filterList.containerType = RSSL_DT_ELEMENT_LIST;
+
+    if ((ret = rsslEncodeMsgInit(&iter, (RsslMsg *)&refreshMsg, 0)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeMapInit(&iter, &map, 0, 0)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeMapEntryInit(&iter, &mapEntry, &serviceId, 0)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeFilterListInit(&iter, &filterList)) < RSSL_RET_SUCCESS)
+    {
+        printf("Encoding the source directory failed with return code %d\n", ret);
+        RsslError error;
+        rsslReleaseBuffer(buffer, &error);
+        return RSSL_RET_FAILURE;
+    }
+
+    struct
+    {
+        RsslUInt32 flag;
+        RsslUInt8 id;
+        RsslRet (LoopbackProvider::*encode)(RsslEncodeIterator *);
+    } filters[] =
+    {
+        { RDM_DIRECTORY_SERVICE_INFO_FILTER, RDM_DIRECTORY_SERVICE_INFO_ID, &LoopbackProvider::EncodeServiceInfo },
+        { RDM_DIRECTORY_SERVICE_STATE_FILTER, RDM_DIRECTORY_SERVICE_STATE_ID, &LoopbackProvider::EncodeServiceState },
+        { RDM_DIRECTORY_SERVICE_LOAD_FILTER, RDM_DIRECTORY_SERVICE_LOAD_ID, &LoopbackProvider::EncodeServiceLoad }
+    };
+
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]) && ret >= RSSL_RET_SUCCESS; ++i)
+    {
+        if (!(filter & filters[i].flag))
+        {
+            continue;
+        }
+
+        RsslFilterEntry filterEntry = RSSL_INIT_FILTER_ENTRY;
+        filterEntry.id = filters[i].id;
+        filterEntry.action = RSSL_FTEA_SET_ENTRY;
+        if ((ret = rsslEncodeFilterEntryInit(&iter, &filterEntry, 0)) >= RSSL_RET_SUCCESS
+            && (ret = (this->*filters[i].encode)(&iter)) >= RSSL_RET_SUCCESS)
+        {
+            ret = rsslEncodeFilterEntryComplete(&iter, RSSL_TRUE);
+        }
+    }
+
+    if (ret < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeFilterListComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeMapEntryComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeMapComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeMsgComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        printf("Encoding the source directory failed with return code %d\n", ret);
+        RsslError error;
+        rsslReleaseBuffer(buffer, &error);
+        return RSSL_RET_FAILURE;
+    }
+
+    buffer->length = rsslGetEncodedBufferLength(&iter);
+    return Write(conn, buffer) ? RSSL_RET_SUCCESS : RSSL_RET_FAILURE;
+}
+
+RsslRet LoopbackProvider::SendFieldDictionary(Connection * conn, RsslInt32 streamId, const RsslBuffer & name, RsslUInt32 verbosity)
+{
+    char errorText[256];
+    RsslBuffer errorBuffer;
+
+    // the field dictionary is too big for one message so it goes in parts, the encoder tells us where it got up to
+    int currentFid = dictionary_.minFid;
+    RsslRet dictRet = RSSL_RET_DICT_PART_ENCODED;
+    bool first = true;
+
+    while (dictRet == RSSL_RET_DICT_PART_ENCODED)
+    {
+        RsslBuffer * buffer = GetBuffer(conn, FieldDictionaryPartSize, true);
+        if (buffer == 0)
+        {
+            return RSSL_RET_FAILURE;
+        }
+
+        RsslRefreshMsg refreshMsg = RSSL_INIT_REFRESH_MSG;
+        refreshMsg.msgBase.msgClass = RSSL_MC_REFRESH;
+        refreshMsg.msgBase.domainType = RSSL_DMT_DICTIONARY;
+        refreshMsg.msgBase.streamId = streamId;
+        refreshMsg.msgBase.containerType = RSSL_DT_SERIES;
+        refreshMsg.flags = RSSL_RFMF_HAS_MSG_KEY | RSSL_RFMF_SOLICITED | (first ? RSSL_RFMF_CLEAR_CACHE : 0);
+        refreshMsg.msgBase.msgKey.flags = RSSL_MKF_HAS_NAME | RSSL_MKF_HAS_FILTER | RSSL_MKF_HAS_SERVICE_ID;
+        refreshMsg.msgBase.msgKey.name = name;
+        refreshMsg.msgBase.msgKey.filter = verbosity;
+        refreshMsg.msgBase.msgKey.serviceId = config_.serviceId;
+        SetState(refreshMsg.state, RSSL_STREAM_OPEN, RSSL_DATA_OK, RSSL_SC_NONE, "Field dictionary refresh");
+
+        RsslEncodeIterator iter;
+        InitEncodeIterator(conn, &iter, buffer);
+
+        RsslRet ret = rsslEncodeMsgInit(&iter, (RsslMsg *)&refreshMsg, 0);
+        if (ret >= RSSL_RET_SUCCESS)
+        {
+            errorBuffer.data = errorText;
+            errorBuffer.length = sizeof(errorText);
+            dictRet = rsslEncodeFieldDictionary(&iter, &dictionary_, &currentFid, (RDMDictionaryVerbosityValues)verbosity, &errorBuffer);
+            if (dictRet == RSSL_RET_SUCCESS)
+            {
+                rsslSetRefreshCompleteFlag(&iter);
+            }
+            else if (dictRet != RSSL_RET_DICT_PART_ENCODED)
+            {
+                printf("rsslEncodeFieldDictionary() failed <%.*s>\n", errorBuffer.length, errorBuffer.data);
+                ret = dictRet;
+            }
+        }
+
+        if (ret < RSSL_RET_SUCCESS || (ret = rsslEncodeMsgComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+        {
+            RsslError error;
+            rsslReleaseBuffer(buffer, &error);
+            return RSSL_RET_FAILURE;
+        }
+
+        buffer->length = rsslGetEncodedBufferLength(&iter);
+        if (!Write(conn, buffer))
+        {
+            return RSSL_RET_FAILURE;
+        }
+        first = false;
+    }
+
+    printf("Sent field dictionary on fd=%d\n", conn->chnl->socketId);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet LoopbackProvider::SendEnumDictionary(Connection * conn, RsslInt32 streamId, const RsslBuffer & name, RsslUInt32 verbosity)
+{
+    RsslBuffer * buffer = GetBuffer(conn, EnumDictionarySize, true);
+    if (buffer == 0)
+    {
+        return RSSL_RET_FAILURE;
+    }
+
+    RsslRefreshMsg refreshMsg = RSSL_INIT_REFRESH_MSG;
+    refreshMsg.msgBase.msgClass = RSSL_MC_REFRESH;
+    refreshMsg.msgBase.domainType = RSSL_DMT_DICTIONARY;
+    refreshMsg.msgBase.streamId = streamId;
+    refreshMsg.msgBase.containerType = RSSL_DT_SERIES;
+    refreshMsg.flags = RSSL_RFMF_HAS_MSG_KEY | RSSL_RFMF_SOLICITED | RSSL_RFMF_CLEAR_CACHE | RSSL_RFMF_REFRESH_COMPLETE;
+    refreshMsg.msgBase.msgKey.flags = RSSL_MKF_HAS_NAME | RSSL_MKF_HAS_FILTER | RSSL_MKF_HAS_SERVICE_ID;
+    refreshMsg.msgBase.msgKey.name = name;
+    refreshMsg.msgBase.msgKey.filter = verbosity;
+    refreshMsg.msgBase.msgKey.serviceId = config_.serviceId;
+    SetState(refreshMsg.state, RSSL_STREAM_OPEN, RSSL_DATA_OK, RSSL_SC_NONE, "Enum dictionary refresh");
+
+    RsslEncodeIterator iter;
+    InitEncodeIterator(conn, &iter, buffer);
+
+    char errorText[256];
+    RsslBuffer errorBuffer;
+    errorBuffer.data = errorText;
+    errorBuffer.length = sizeof(errorText);
+
+    RsslRet ret;
+    if ((ret = rsslEncodeMsgInit(&iter, (RsslMsg *)&refreshMsg, 0)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeEnumTypeDictionary(&iter, &dictionary_, (RDMDictionaryVerbosityValues)verbosity, &errorBuffer)) < RSSL_RET_SUCCESS
+        || (ret = rsslEncodeMsgComplete(&iter, RSSL_TRUE)) < RSSL_RET_SUCCESS)
+    {
+        printf("Encoding the enum dictionary failed with return code %d\n", ret);
+        RsslError error;
+        rsslReleaseBuffer(buffer, &error);
+        return RSSL_RET_FAILURE;
+    }
+
+    buffer->length = rsslGetEncodedBufferLength(&iter);
+    if (!Write(conn, buffer))
+    {
+        return RSSL_RET_FAILURE;
+    }
+
+    printf("Sent enum dictionary on fd=%d\n", conn->chnl->socketId);
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet LoopbackProvider::SendItemRefresh(Connection * conn, LoopbackItem * item, bool streaming)
+{
+    RsslBuffer * buffer = GetBuffer(conn, config_.maxMessageSize, true);
+    if (buffer == 0)
+    {
+        return RSSL_RET_FAILURE;
+    }
+
+    RsslEncodeIterator iter;
+    InitEncodeIterator(conn, &iter, buffer);
+
+    RsslRet ret = item->EncodeRefresh(&iter, streaming);
+    if (ret < RSSL_RET_SUCCESS)
+    {
+        printf("Encoding the refresh for %s failed with return code %d\n", item->Name().c_str(), ret);
+        RsslError error;
+        rsslReleaseBuffer(buffer, &error);
+        return RSSL_RET_FAILURE;
+    }
+
+    buffer->length = rsslGetEncodedBufferLength(&iter);
+    if (!Write(conn, buffer))
+    {
+        return RSSL_RET_FAILURE;
+    }
+
+    ++counters_.refreshesSent;
+    return RSSL_RET_SUCCESS;
+}
+
+RsslRet LoopbackProvider::SendStatus(Connection * conn, RsslInt32 streamId, RsslUInt8 domainType, RsslUInt8 streamState,
+    RsslUInt8 dataState, RsslUInt8 code, const char * text, bool privateStream)
+{
+    RsslBuffer * buffer = GetBuffer(conn, config_.maxMessageSize, true);
+    if (buffer == 0)
+    {
+        return RSSL_RET_FAILURE;
+    }
+
+    RsslStatusMsg statusMsg = RSSL_INIT_STATUS_MSG;
+    statusMsg.msgBase.msgClass = RSSL_MC_STATUS;
+    statusMsg.msgBase.domainType = domainType;
+    statusMsg.msgBase.streamId = streamId;
+    statusMsg.msgBase.containerType = RSSL_DT_NO_DATA;
+    statusMsg.flags = RSSL_STMF_HAS_STATE | (privateStream ? RSSL_STMF_PRIVATE_STREAM : 0);
+    SetState(statusMsg.state, streamState, dataState, code, text);
+
+    RsslEncodeIterator iter;
+    InitEncodeIterator(conn, &iter, buffer);
+
+    RsslRet ret = rsslEncodeMsg(&iter, (RsslMsg *)&statusMsg);
+    if (ret < RSSL_RET_SUCCESS)
+    {
+        RsslError error;
+        rsslReleaseBuffer(buffer, &error);
+        return RSSL_RET_FAILURE;
+    }
+
+    buffer->length = rsslGetEncodedBufferLength(&iter);
+    return Write(conn, buffer) ? RSSL_RET_SUCCESS : RSSL_RET_FAILURE;
+}
+
+RsslRet LoopbackProvider::SendAck(Connection * conn, RsslPostMsg * postMsg)
+{
+    RsslBuffer * buffer = GetBuffer(conn, config_.maxMessageSize, true);
+    if (buffer == 0)
+    {
+        return RSSL_RET_FAILURE;
+    }
+
+    RsslAckMsg ackMsg = RSSL_INIT_ACK_MSG;
+    ackMsg.msgBase.msgClass = RSSL_MC_ACK;
+    ackMsg.msgBase.streamId = postMsg->msgBase.streamId;
+    ackMsg.msgBase.domainType = postMsg->msgBase.domainType;
+    ackMsg.msgBase.containerType = RSSL_DT_NO_DATA;
+    ackMsg.ackId = postMsg->postId;
+    ackMsg.seqNum = postMsg->seqNum;
+    if (postMsg->flags & RSSL_PSMF_HAS_SEQ_NUM)
+    {
+        ackMsg.flags |= RSSL_AKMF_HAS_SEQ_NUM;
+    }
+
+    RsslEncodeIterator iter;
+    InitEncodeIterator(conn, &iter, buffer);
+
+    RsslRet ret = rsslEncodeMsg(&iter, (RsslMsg *)&ackMsg);
+    if (ret < RSSL_RET_SUCCESS)
+    {
+        RsslError error;
+        rsslReleaseBuffer(buffer, &error);
+        return RSSL_RET_FAILURE;
+    }
+
+    buffer->length = rsslGetEncodedBufferLength(&iter);
+    return Write(conn, buffer) ? RSSL_RET_SUCCESS : RSSL_RET_FAILURE;
+}
+
+void LoopbackProvider::AddToRotation(Connection * conn, LoopbackItem * item)
+{
+    if (rotation_.empty())
+    {
+        // start metering from the first stream, rather than owing updates for the time we were idle
+        rateStart_ = utils::time::GetMicroCount();
+        rateSent_ = 0;
+    }
+
+    Rotating rotating;
+    rotating.conn = conn;
+    rotating.item = item;
+    item->rotationIndex_ = rotation_.size();
+    rotation_.push_back(rotating);
+}
+
+void LoopbackProvider::RemoveFromRotation(LoopbackItem * item)
+{
+    size_t index = item->rotationIndex_;
+    if (index == LoopbackItem::NotRotating)
+    {
+        return;
+    }
+
+    // swap the last one into its place
+    rotation_[index] = rotation_.back();
+    rotation_[index].item->rotationIndex_ = index;
+    rotation_.pop_back();
+    item->rotationIndex_ = LoopbackItem::NotRotating;
+}
+
+bool LoopbackProvider::SendUpdates()
+{
+    if (rotation_.empty())
+    {
+        return false;
+    }
+
+    // work out how many updates are due. Anything over the burst is written off and counted as lagged, so a slow
+    // consumer sees the configured rate for as long as it can keep up and doesnt get a flood afterwards
+    RsslInt64 due = config_.burst;
+    if (config_.rate > 0)
+    {
+        RsslUInt64 now = utils::time::GetMicroCount();
+        if (now - rateStart_ >= 1000000)
+        {
+            // rebase once a second to keep the arithmetic small
+            rateStart_ += 1000000;
+            rateSent_ -= config_.rate;
+        }
+
+        RsslInt64 target = (RsslInt64)((now - rateStart_) * config_.rate / 1000000);
+        due = target - rateSent_;
+        if (due <= 0)
+        {
+            return false;
+        }
+
+        if (due > (RsslInt64)config_.burst)
+        {
+            counters_.lagged += due - config_.burst;
+            rateSent_ += due - config_.burst;
+            due = config_.burst;
+        }
+    }
+
+    RsslInt64 sent = 0;
+    bool blocked = false;
+    while (sent < due && !rotation_.empty())
+    {
+        if (rotationCursor_ >= rotation_.size())
+        {
+            rotationCursor_ = 0;
+        }
+
+        Rotating & rotating = rotation_[rotationCursor_++];
+        Connection * conn = rotating.conn;
+        LoopbackItem * item = rotating.item;
+        if (conn->failed)
+        {
+            blocked = true;
+            break;
+        }
+
+        RsslBuffer * buffer = GetBuffer(conn, config_.maxMessageSize, false);
+        if (buffer == 0)
+        {
+            blocked = true;
+            break;
+        }
+
+        RsslEncodeIterator iter;
+        InitEncodeIterator(conn, &iter, buffer);
+
+        RsslRet ret = item->EncodeUpdate(&iter);
+        if (ret < RSSL_RET_SUCCESS)
+        {
+            printf("Encoding an update for %s failed with return code %d\n", item->Name().c_str(), ret);
+            RsslError error;
+            rsslReleaseBuffer(buffer, &error);
+            continue;
+        }
+
+        buffer->length = rsslGetEncodedBufferLength(&iter);
+        if (!Write(conn, buffer))
+        {
+            blocked = true;
+            break;
+        }
+
+        ++counters_.updatesSent[DomainIndex(item->DomainType())];
+        ++sent;
+    }
+
+    if (config_.rate > 0)
+    {
+        rateSent_ += sent;
+        if (blocked)
+        {
+            // write off what couldnt be sent
+            counters_.lagged += due - sent;
+            rateSent_ += due - sent;
+        }
+    }
+
+    // if there was a full burst, there may be more due straight away
+    return !blocked && sent == due;
+}
+
+size_t LoopbackProvider::StreamCount(RsslUInt8 domainType) const
+{
+    size_t count = 0;
+    for (std::vector<Rotating>::const_iterator it = rotation_.begin(); it != rotation_.end(); ++it)
+    {
+        if (it->item->DomainType() == domainType)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void LoopbackProvider::LogStats(RsslUInt64 now)
+{
+    double seconds = (double)(now - lastStatsTime_) / 1000000.0;
+    lastStatsTime_ = now;
+
+    RsslUInt64 updates = 0;
+    char byDomain[128];
+    size_t length = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        RsslUInt64 domainUpdates = counters_.updatesSent[i] - lastCounters_.updatesSent[i];
+        updates += domainUpdates;
+        length += snprintf(byDomain + length, sizeof(byDomain) - length, "%s%s %.0f", i == 0 ? "" : " ",
+            DomainNames[i], domainUpdates / seconds);
+    }
+
+    printf("streams %u (mp %u mbo %u mbp %u) connections %u | sent %.0f upd/s (%s) %llu refreshes, lagged %llu, "
+        "no buffers %llu, posts acked %llu, batches %llu | published %.0f refresh/s %.0f upd/s %.0f fields/s, decode errors %llu\n",
+        (unsigned int)rotation_.size(),
+        (unsigned int)StreamCount(RSSL_DMT_MARKET_PRICE),
+        (unsigned int)StreamCount(RSSL_DMT_MARKET_BY_ORDER),
+        (unsigned int)StreamCount(RSSL_DMT_MARKET_BY_PRICE),
+        (unsigned int)connections_.size(),
+        updates / seconds, byDomain,
+        (unsigned long long)(counters_.refreshesSent - lastCounters_.refreshesSent),
+        (unsigned long long)(counters_.lagged - lastCounters_.lagged),
+        (unsigned long long)(counters_.noBuffers - lastCounters_.noBuffers),
+        (unsigned long long)(counters_.postsAcked - lastCounters_.postsAcked),
+        (unsigned long long)(counters_.batchRequests - lastCounters_.batchRequests),
+        (counters_.publishedRefreshes - lastCounters_.publishedRefreshes) / seconds,
+        (counters_.publishedUpdates - lastCounters_.publishedUpdates) / seconds,
+        (counters_.publishedFields - lastCounters_.publishedFields) / seconds,
+        (unsigned long long)counters_.decodeErrors);
+
+    lastCounters_ = counters_;
+}
@@ -0,0 +1,224 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+#pragma once
+#ifndef __LOOPBACKPROVIDER_H__
+#define __LOOPBACKPROVIDER_H__
+
+#include <map>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <rtr/rsslTransport.h>
+#include <rtr/rsslMessagePackage.h>
+#include <rtr/rsslDataPackage.h>
+#include <rtr/rsslRDM.h>
+
+#include "LoopbackItem.h"
+
+struct LoopbackConfig
+{
+    LoopbackConfig()
+        : port("14002")
+        , serviceName("LOOPBACK")
+        , serviceId(1)
+        , rate(1000)
+        , burst(1000)
+        , symbols(0)
+        , symbolPrefix("SYN")
+        , depth(10)
+        , fieldFile("RDMFieldDictionary")
+        , enumFile("enumtype.def")
+        , statsInterval(5)
+        , maxMessageSize(16384)
+        , outputBuffers(2000)
+    {
+    }
+
+    std::string port;
+    std::string serviceName;
+    RsslUInt16 serviceId;
+
+    // total updates per second across all the open streams, 0 means as fast as the channels will take them
+    unsigned int rate;
+    // the most updates sent per pass through the loop, so a consumer that falls behind doesnt starve the reads
+    unsigned int burst;
+
+    // when non-zero only <prefix>0 .. <prefix><symbols - 1> are served and anything else is not found
+    size_t symbols;
+    std::string symbolPrefix;
+
+    // orders or price levels on each side of a book
+    size_t depth;
+
+    std::string fieldFile;
+    std::string enumFile;
+
+    // seconds between statistics lines
+    unsigned int statsInterval;
+
+    unsigned int maxMessageSize;
+    unsigned int outputBuffers;
+};
+
+// A stand-in for an ADS or ADH, so that the consumer and the providers can be driven end to end without a TREP
+// installation.
+//
+// It binds a listening rssl socket the same way as UPAProvider::Bind and accepts any number of channels on it.
+//
+// For consumers it serves a login, a source directory with a single service, the field and enum dictionaries from
+// the dictionary files, and synthetic market price, market by order and market by price items at a configured
+// overall update rate. Posts are acked.
+//
+// For non-interactive providers it accepts the login and then consumes the directory and the item refreshes and
+// updates that are published to it, decoding each payload so that malformed messages are counted.
+//
+// A line of statistics is written every few seconds with the rates in each direction.
+class LoopbackProvider
+{
+public:
+    explicit LoopbackProvider(const LoopbackConfig & config);
+    ~LoopbackProvider();
+
+    bool Init();
+    void Run();
+    void Stop() { runThread_ = false; }
+
+private:
+    LoopbackConfig config_;
+    volatile bool runThread_;
+
+    RsslServer * rsslServer_;
+    fd_set readfds_;
+    fd_set exceptfds_;
+    fd_set wrtfds_;
+
+    RsslDataDictionary dictionary_;
+    bool fieldsLoaded_;
+    bool enumsLoaded_;
+
+    struct Connection
+    {
+        RsslChannel * chnl;
+        time_t nextSendPingTime;
+        time_t nextReceivePingTime;
+        bool receivedMsg;
+        bool pingsInitialized;
+        bool failed;
+
+        typedef std::map<RsslInt32, LoopbackItem *> ItemMap_t;
+        ItemMap_t items;
+    };
+
+    std::vector<Connection *> connections_;
+    Connection * FindConnection(RsslChannel * chnl);
+
+    // the streaming items, which updates are sent to in turn
+    struct Rotating
+    {
+        Connection * conn;
+        LoopbackItem * item;
+    };
+
+    std::vector<Rotating> rotation_;
+    size_t rotationCursor_;
+    void AddToRotation(Connection * conn, LoopbackItem * item);
+    void RemoveFromRotation(LoopbackItem * item);
+
+    unsigned int nextSeed_;
+
+    void AcceptConnection();
+    void ReadFromChannel(Connection * conn);
+    void InitChannel(Connection * conn);
+    void RemoveConnection(Connection * conn);
+    void HandlePings(time_t now);
+
+    // the connections that failed during a pass through the loop are removed at the end of it
+    std::vector<Connection *> failed_;
+    void FailConnection(Connection * conn);
+    void RemoveFailedConnections();
+
+    RsslRet ProcessRequest(Connection * conn, RsslBuffer * buffer);
+    RsslRet ProcessLoginRequest(Connection * conn, RsslMsg * msg);
+    RsslRet ProcessSourceDirectoryRequest(Connection * conn, RsslMsg * msg);
+    RsslRet ProcessDictionaryRequest(Connection * conn, RsslMsg * msg);
+    RsslRet ProcessItemRequest(Connection * conn, RsslMsg * msg, RsslDecodeIterator * dIter);
+    RsslRet ProcessBatchRequest(Connection * conn, RsslMsg * msg, RsslDecodeIterator * dIter);
+    RsslRet OpenItem(Connection * conn, RsslInt32 streamId, RsslUInt8 domainType, const RsslBuffer & name, bool streaming,
+        bool privateStream);
+    RsslRet ProcessPost(Connection * conn, RsslMsg * msg);
+    RsslRet ProcessPublished(Connection * conn, RsslMsg * msg, RsslDecodeIterator * dIter);
+
+    bool IsServed(const RsslBuffer & name) const;
+
+    // encode and write. GetBuffer returns 0 when the channel is out of output buffers, unless asked to wait for one,
+    // which the responses to requests do as they cant be dropped
+    RsslBuffer * GetBuffer(Connection * conn, RsslUInt32 size, bool wait);
+    bool Write(Connection * conn, RsslBuffer * buffer);
+    void InitEncodeIterator(Connection * conn, RsslEncodeIterator * iter, RsslBuffer * buffer);
+
+    RsslRet SendLoginRefresh(Connection * conn, RsslMsg * msg);
+    RsslRet SendSourceDirectoryRefresh(Connection * conn, RsslInt32 streamId, RsslUInt32 filter);
+    RsslRet SendFieldDictionary(Connection * conn, RsslInt32 streamId, const RsslBuffer & name, RsslUInt32 verbosity);
+    RsslRet SendEnumDictionary(Connection * conn, RsslInt32 streamId, const RsslBuffer & name, RsslUInt32 verbosity);
+    RsslRet SendItemRefresh(Connection * conn, LoopbackItem * item, bool streaming);
+    RsslRet SendStatus(Connection * conn, RsslInt32 streamId, RsslUInt8 domainType, RsslUInt8 streamState,
+        RsslUInt8 dataState, RsslUInt8 code, const char * text, bool privateStream);
+    RsslRet SendAck(Connection * conn, RsslPostMsg * postMsg);
+
+    RsslRet EncodeServiceInfo(RsslEncodeIterator * iter);
+    RsslRet EncodeServiceState(RsslEncodeIterator * iter);
+    RsslRet EncodeServiceLoad(RsslEncodeIterator * iter);
+
+    // send the updates that are due at the configured rate. Returns true if it stopped short of what was due
+    bool SendUpdates();
+    RsslUInt64 rateStart_;
+    RsslInt64 rateSent_;
+
+    // statistics
+    struct Counters
+    {
+        Counters() { memset(this, 0, sizeof(Counters)); }
+
+        RsslUInt64 updatesSent[3];
+        RsslUInt64 refreshesSent;
+        RsslUInt64 lagged;
+        RsslUInt64 noBuffers;
+        RsslUInt64 postsAcked;
+        RsslUInt64 batchRequests;
+        RsslUInt64 publishedRefreshes;
+        RsslUInt64 publishedUpdates;
+        RsslUInt64 publishedFields;
+        RsslUInt64 decodeErrors;
+    };
+
+    Counters counters_;
+    Counters lastCounters_;
+    RsslUInt64 lastStatsTime_;
+    void LogStats(RsslUInt64 now);
+    size_t StreamCount(RsslUInt8 domainType) const;
+};
+
+#endif //__LOOPBACKPROVIDER_H__
@@ -0,0 +1,229 @@
+/*
+* Tick42RMDS: The Reuters RMDS Bridge for OpenMama
+* Copyright (C) 2013-2015 Tick42 Ltd.
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+* 02110-1301 USA
+*
+*Distributed under the Boost Software License, Version 1.0.
+*    (See accompanying file LICENSE_1_0.txt or copy at
+*         http://www.boost.org/LICENSE_1_0.txt)
+*
+*/
+
+/*
+ * upaloopback - a stand-in for an ADS or ADH
+ *
+ * Serves a login, a source directory and the dictionary to consumers, with synthetic market price, market by order
+ * and market by price items at a set overall update rate, and consumes what non-interactive providers publish. Point
+ * a bridge transport at it to soak or measure the bridge without any TREP infrastructure, e.g.
+ *
+ *    upaloopback -p 14002 -S LOOPBACK -n 10000 -rate 200000 -symbolfile syms.txt
+ *    mamalistencpp -m tick42rmds -tport rmds_sub -S LOOPBACK -f syms.txt -q -q
+ *
+ * and for the providers set the publisher transport's host and port to the same place.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "LoopbackProvider.h"
+
+static const char * gUsageString[] =
+{
+    "upaloopback - a local stand-in for an ADS or ADH",
+    "",
+    "Usage: upaloopback [options]",
+    "",
+    "  -p <port>            Port to listen on (default 14002)",
+    "  -S <service>         Name of the service in the source directory (default LOOPBACK)",
+    "  -id <serviceid>      Id of the service (default 1)",
+    "  -rate <n>            Updates per second across all the open streams, 0 for as fast",
+    "                       as the channels take them (default 1000)",
+    "  -burst <n>           Most updates written per pass through the loop (default 1000)",
+    "  -n <symbols>         Only serve <prefix>0 .. <prefix><n-1>, other names are not found.",
+    "                       0 serves any name (default 0)",
+    "  -prefix <prefix>     Symbol prefix (default SYN)",
+    "  -symbolfile <file>   Write the served symbols to a file, e.g. for mamalistencpp -f",
+    "  -depth <n>           Orders or price levels on each side of a book (default 10)",
+    "  -fieldfile <file>    Field dictionary to serve (default RDMFieldDictionary)",
+    "  -enumfile <file>     Enum dictionary to serve (default enumtype.def)",
+    "  -stats <seconds>     Interval between statistics lines, 0 for none (default 5)",
+    "  -msgsize <bytes>     Output buffer size for refreshes and updates (default 16384)",
+    "  -buffers <n>         Guaranteed output buffers per channel (default 2000)",
+    "  -h                   This help",
+    NULL
+};
+
+static LoopbackProvider * gProvider = NULL;
+
+static void usage(int exitStatus)
+{
+    for (int i = 0; gUsageString[i] != NULL; ++i)
+    {
+        printf("%s\n", gUsageString[i]);
+    }
+    exit(exitStatus);
+}
+
+static void signalHandler(int)
+{
+    if (gProvider != NULL)
+    {
+        gProvider->Stop();
+    }
+}
+
+static void parseCommandLine(int argc, const char * argv[], LoopbackConfig & config, std::string & symbolFile)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char * arg = argv[i];
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "-?") == 0)
+        {
+            usage(0);
+        }
+
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            usage(1);
+        }
+        const char * value = argv[++i];
+
+        if (strcmp(arg, "-p") == 0)
+        {
+            config.port = value;
+        }
+        else if (strcmp(arg, "-S") == 0)
+        {
+            config.serviceName = value;
+        }
+        else if (strcmp(arg, "-id") == 0)
+        {
+            config.serviceId = (RsslUInt16)atoi(value);
+        }
+        else if (strcmp(arg, "-rate") == 0)
+        {
+            config.rate = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(arg, "-burst") == 0)
+        {
+            config.burst = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(arg, "-n") == 0)
+        {
+            config.symbols = (size_t)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(arg, "-prefix") == 0)
+        {
+            config.symbolPrefix = value;
+        }
+        else if (strcmp(arg, "-symbolfile") == 0)
+        {
+            symbolFile = value;
+        }
+        else if (strcmp(arg, "-depth") == 0)
+        {
+            config.depth = (size_t)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(arg, "-fieldfile") == 0)
+        {
+            config.fieldFile = value;
+        }
+        else if (strcmp(arg, "-enumfile") == 0)
+        {
+            config.enumFile = value;
+        }
+        else if (strcmp(arg, "-stats") == 0)
+        {
+            config.statsInterval = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(arg, "-msgsize") == 0)
+        {
+            config.maxMessageSize = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(arg, "-buffers") == 0)
+        {
+            config.outputBuffers = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            usage(1);
+        }
+    }
+
+    if (config.burst == 0)
+    {
+        config.burst = 1;
+    }
+}
+
+static bool writeSymbolFile(const LoopbackConfig & config, const std::string & symbolFile)
+{
+    if (config.symbols == 0)
+    {
+        fprintf(stderr, "-symbolfile needs -n\n");
+        return false;
+    }
+
+    FILE * f = fopen(symbolFile.c_str(), "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", symbolFile.c_str());
+        return false;
+    }
+
+    for (size_t i = 0; i < config.symbols; ++i)
+    {
+        fprintf(f, "%s%u\n", config.symbolPrefix.c_str(), (unsigned int)i);
+    }
+
+    fclose(f);
+    return true;
+}
+
+int main(int argc, const char * argv[])
+{
+    LoopbackConfig config;
+    std::string symbolFile;
+    parseCommandLine(argc, argv, config, symbolFile);
+
+    if (!symbolFile.empty() && !writeSymbolFile(config, symbolFile))
+    {
+        return 1;
+    }
+
+    LoopbackProvider provider(config);
+    if (!provider.Init())
+    {
+        return 1;
+    }
+
+    gProvider = &provider;
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    provider.Run();
+
+    gProvider = NULL;
+    return 0;
+}
@@ -6,10 +6,12 @@
 #if defined(STD_NAMESPACES) || !defined(BOOST_NAMESPACES)
 #include <unordered_map>
 #include <unordered_set>
+#include <atomic>
 
 #elif defined(BOOST_NAMESPACES)
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
+#include <boost/atomic.hpp>
 
 #endif
 
@@ -31,6 +33,31 @@ using boost::unordered_set;
 
 #endif
 
+}
+
+namespace thread
+{
+
+#if defined(STD_NAMESPACES) || !defined(BOOST_NAMESPACES)
+
+using std::atomic;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::memory_order_acq_rel;
+using std::memory_order_seq_cst;
+
+#elif defined(BOOST_NAMESPACES)
+
+using boost::atomic;
+using boost::memory_order_relaxed;
+using boost::memory_order_acquire;
+using boost::memory_order_release;
+using boost::memory_order_acq_rel;
+using boost::memory_order_seq_cst;
+
+#endif
+
 }
 }
 
@@ -27,6 +27,594 @@
 
 #ifndef DISABLE_DEBUG_FILELINE
 
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define T42LOG_THREAD_LOCAL __declspec(thread)
+#else
+#define T42LOG_THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+   using utils::thread::atomic;
+   using utils::thread::memory_order_relaxed;
+   using utils::thread::memory_order_acquire;
+   using utils::thread::memory_order_release;
+
+   // Asynchronous logging
+   //
+   // Each logging thread gets a single producer / single consumer ring. A record in the ring is a header, the
+   // format string, rewritten so that each conversion takes a fixed size argument, and then the arguments in 8 byte
+   // slots. Strings are copied as a length and the characters. The background thread formats the records one
+   // conversion at a time with snprintf. A thread whose ring is full drains its own ring before it writes the line
+   // itself, so the ring can have a second reader and records are only taken out of a ring under drainLock_
+
+   struct LogRecord
+   {
+      uint32_t size_;         // 0 marks the unused end of the ring, the next record is at the start
+      uint32_t formatLength_; // including the terminator
+      MamaLogLevel logLevel_;
+      uint32_t lineNumber_;
+      const char *filename_;
+   };
+
+   const size_t RingSize = 64 * 1024;
+   const size_t MaxRings = 64;
+   const size_t SlotSize = 8;
+
+   inline size_t Align(size_t n)
+   {
+      return (n + SlotSize - 1) & ~(SlotSize - 1);
+   }
+
+   const size_t HeaderSize = Align(sizeof(LogRecord));
+
+   struct LogRing
+   {
+      LogRing() : head_(0), tail_(0) {}
+
+      atomic<size_t> head_;   // written by the logging thread
+      atomic<size_t> tail_;   // written by whoever drains the ring, under drainLock_
+      char buffer_[RingSize];
+
+      // copy a record that has already been built in the staging buffer, false if the ring is full
+      bool Push(const char *record, size_t size)
+      {
+         size_t head = head_.load(memory_order_relaxed);
+         size_t tail = tail_.load(memory_order_acquire);
+         size_t pos = head & (RingSize - 1);
+         size_t skip = (pos + size > RingSize) ? RingSize - pos : 0;
+
+         if (RingSize - (head - tail) < skip + size)
+         {
+            return false;
+         }
+
+         if (skip != 0)
+         {
+            reinterpret_cast<LogRecord *>(buffer_ + pos)->size_ = 0;
+            pos = 0;
+         }
+
+         memcpy(buffer_ + pos, record, size);
+         head_.store(head + skip + size, memory_order_release);
+         return true;
+      }
+   };
+
+   LogRing *rings_[MaxRings];
+   atomic<size_t> ringCount_(0);
+
+   T42LOG_THREAD_LOCAL LogRing *threadRing_ = 0;
+   T42LOG_THREAD_LOCAL bool threadHasNoRing_ = false;
+
+   utils::thread::lock_t drainLock_;
+
+   atomic<bool> logAsync_(false);
+   atomic<bool> runLogThread_(false);
+   wthread_t logThread_;
+
+   LogRing *ThreadRing()
+   {
+      if (threadRing_ == 0 && !threadHasNoRing_)
+      {
+         utils::thread::T42Lock sync(&Tick42Logging::CTick42Logger::lock_);
+         size_t count = ringCount_.load(memory_order_relaxed);
+         if (count < MaxRings)
+         {
+            // the rings are never freed, the background thread may still be reading one after its thread has gone
+            threadRing_ = new LogRing;
+            rings_[count] = threadRing_;
+            ringCount_.store(count + 1, memory_order_release);
+         }
+         else
+         {
+            // further threads log synchronously
+            threadHasNoRing_ = true;
+         }
+      }
+      return threadRing_;
+   }
+
+   enum ArgType { IntArg, LongLongArg, DoubleArg, LongDoubleArg, StringArg, PointerArg };
+
+   // appends to a fixed buffer, remembering if it ran out of room
+   struct FormatWriter
+   {
+      FormatWriter(char *buffer, size_t capacity) : buffer_(buffer), capacity_(capacity), size_(0), full_(false) {}
+
+      void Append(const char *text, size_t length)
+      {
+         if (size_ + length >= capacity_)
+         {
+            full_ = true;
+            return;
+         }
+         memcpy(buffer_ + size_, text, length);
+         size_ += length;
+      }
+      void Append(char c) { Append(&c, 1); }
+      void AppendInt(int value)
+      {
+         char number[16];
+         int length = snprintf(number, sizeof(number), "%d", value);
+         Append(number, length);
+      }
+
+      char *buffer_;
+      size_t capacity_;
+      size_t size_;
+      bool full_;
+   };
+
+   // Scan the conversion that starts at the % in format and copy it to out. Widths and precisions given as * are
+   // read from ap and written out as numbers, and integer conversions are written with an ll length modifier so that
+   // the background thread can read every integer argument the same way. Returns false for anything we dont capture
+   bool ScanConversion(const char *&format, va_list *ap, FormatWriter &out, ArgType &type, char &lengthModifier, bool &isSigned, int &precision)
+   {
+      const char *p = format + 1;
+      out.Append('%');
+
+      while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'')
+      {
+         out.Append(*p++);
+      }
+
+      if (*p == '*')
+      {
+         out.AppendInt(va_arg(*ap, int));
+         ++p;
+      }
+      else
+      {
+         while (*p >= '0' && *p <= '9')
+         {
+            out.Append(*p++);
+         }
+      }
+
+      precision = -1;
+      if (*p == '.')
+      {
+         out.Append(*p++);
+         if (*p == '*')
+         {
+            precision = va_arg(*ap, int);
+            out.AppendInt(precision);
+            ++p;
+         }
+         else
+         {
+            precision = 0;
+            while (*p >= '0' && *p <= '9')
+            {
+               precision = precision * 10 + (*p - '0');
+               out.Append(*p++);
+            }
+         }
+      }
+
+      // 'H' for hh and 'q' for ll, I64 and I32 are the MSVC spellings of ll and no modifier, I is size_t
+      lengthModifier = 0;
+      switch (*p)
+      {
+      case 'h':
+         lengthModifier = (p[1] == 'h') ? 'H' : 'h';
+         p += (p[1] == 'h') ? 2 : 1;
+         break;
+      case 'l':
+         lengthModifier = (p[1] == 'l') ? 'q' : 'l';
+         p += (p[1] == 'l') ? 2 : 1;
+         break;
+      case 'q': case 'j': case 'z': case 't': case 'L':
+         lengthModifier = *p++;
+         break;
+      case 'I':
+         if (p[1] == '6' && p[2] == '4')
+         {
+            lengthModifier = 'q';
+            p += 3;
+         }
+         else if (p[1] == '3' && p[2] == '2')
+         {
+            p += 3;
+         }
+         else
+         {
+            lengthModifier = 'z';
+            ++p;
+         }
+         break;
+      default:
+         break;
+      }
+
+      char conversion = *p;
+      switch (conversion)
+      {
+      case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+         type = LongLongArg;
+         isSigned = (conversion == 'd' || conversion == 'i');
+         out.Append("ll", 2);
+         break;
+      case 'c':
+         type = IntArg;
+         break;
+      case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+         type = (lengthModifier == 'L') ? LongDoubleArg : DoubleArg;
+         if (type == LongDoubleArg)
+         {
+            out.Append('L');
+         }
+         break;
+      case 's':
+         type = StringArg;
+         break;
+      case 'p':
+         type = PointerArg;
+         break;
+      default:
+         // %n and anything we dont recognise
+         return false;
+      }
+
+      // wide characters and strings are left to the synchronous path
+      if ((type == IntArg || type == StringArg) && lengthModifier == 'l')
+      {
+         return false;
+      }
+
+      out.Append(conversion);
+      format = p + 1;
+      return true;
+   }
+
+   long long ReadInteger(va_list *ap, char lengthModifier, bool isSigned)
+   {
+      switch (lengthModifier)
+      {
+      case 'H': return isSigned ? (long long)(signed char)va_arg(*ap, int) : (long long)(unsigned char)va_arg(*ap, int);
+      case 'h': return isSigned ? (long long)(short)va_arg(*ap, int) : (long long)(unsigned short)va_arg(*ap, int);
+      case 'l': return isSigned ? (long long)va_arg(*ap, long) : (long long)va_arg(*ap, unsigned long);
+      case 'q': return va_arg(*ap, long long);
+      case 'j': return (long long)va_arg(*ap, intmax_t);
+      case 'z': return (long long)va_arg(*ap, size_t);
+      case 't': return (long long)va_arg(*ap, ptrdiff_t);
+      default: return isSigned ? (long long)va_arg(*ap, int) : (long long)va_arg(*ap, unsigned int);
+      }
+   }
+
+   // Build the record for a call in staging. Returns the size of the record, or 0 if it cant be captured. The
+   // format is written straight after the header and the arguments are collected in the second half of staging,
+   // then moved down behind the format once we know its length
+   size_t CaptureRecord(char *staging, size_t stagingSize, MamaLogLevel logLevel, const char *filename, size_t lineNumber, const char *format, va_list *ap)
+   {
+      size_t half = Align(stagingSize / 2);
+      FormatWriter out(staging + HeaderSize, half - HeaderSize);
+
+      char *args = staging + half;
+      size_t argsCapacity = stagingSize - half;
+      size_t argsSize = 0;
+
+      const char *p = format;
+      while (*p != '\0' && !out.full_)
+      {
+         if (*p != '%')
+         {
+            const char *text = p;
+            while (*p != '\0' && *p != '%')
+            {
+               ++p;
+            }
+            out.Append(text, p - text);
+            continue;
+         }
+         if (p[1] == '%')
+         {
+            out.Append("%%", 2);
+            p += 2;
+            continue;
+         }
+
+         ArgType type;
+         char lengthModifier;
+         bool isSigned = false;
+         int precision;
+         if (!ScanConversion(p, ap, out, type, lengthModifier, isSigned, precision))
+         {
+            return 0;
+         }
+
+         if (argsSize + 2 * SlotSize > argsCapacity)
+         {
+            return 0;
+         }
+
+         char *slot = args + argsSize;
+         switch (type)
+         {
+         case IntArg:
+         {
+            int value = va_arg(*ap, int);
+            memcpy(slot, &value, sizeof(value));
+            argsSize += SlotSize;
+            break;
+         }
+         case LongLongArg:
+         {
+            long long value = ReadInteger(ap, lengthModifier, isSigned);
+            memcpy(slot, &value, sizeof(value));
+            argsSize += SlotSize;
+            break;
+         }
+         case DoubleArg:
+         {
+            double value = va_arg(*ap, double);
+            memcpy(slot, &value, sizeof(value));
+            argsSize += SlotSize;
+            break;
+         }
+         case LongDoubleArg:
+         {
+            long double value = va_arg(*ap, long double);
+            memcpy(slot, &value, sizeof(value));
+            argsSize += Align(sizeof(value));
+            break;
+         }
+         case PointerArg:
+         {
+            void *value = va_arg(*ap, void *);
+            memcpy(slot, &value, sizeof(value));
+            argsSize += SlotSize;
+            break;
+         }
+         case StringArg:
+         {
+            const char *value = va_arg(*ap, const char *);
+            if (value == 0)
+            {
+               value = "(null)";
+            }
+
+            // with a precision the string neednt be terminated
+            uint32_t stringLength = 0;
+            while ((precision < 0 || stringLength < (uint32_t)precision) && value[stringLength] != '\0')
+            {
+               if (argsSize + SlotSize + stringLength + 1 > argsCapacity)
+               {
+                  return 0;
+               }
+               ++stringLength;
+            }
+
+            memcpy(slot, &stringLength, sizeof(stringLength));
+            memcpy(slot + SlotSize, value, stringLength);
+            slot[SlotSize + stringLength] = '\0';
+            argsSize += SlotSize + Align(stringLength + 1);
+            break;
+         }
+         }
+      }
+
+      if (out.full_ || argsSize > argsCapacity)
+      {
+         return 0;
+      }
+      out.buffer_[out.size_] = '\0';
+
+      size_t formatSize = Align(out.size_ + 1);
+      size_t size = HeaderSize + formatSize + argsSize;
+
+      LogRecord *record = reinterpret_cast<LogRecord *>(staging);
+      record->size_ = static_cast<uint32_t>(size);
+      record->formatLength_ = static_cast<uint32_t>(out.size_ + 1);
+      record->logLevel_ = logLevel;
+      record->lineNumber_ = static_cast<uint32_t>(lineNumber);
+      record->filename_ = filename;
+
+      memmove(staging + HeaderSize + formatSize, args, argsSize);
+      return size;
+   }
+
+   // format a record from the ring into buf, returns the length of the line
+   int FormatRecord(const LogRecord *record, char *buf, size_t bufSize)
+   {
+      const char *format = reinterpret_cast<const char *>(record) + HeaderSize;
+      const char *args = format + Align(record->formatLength_);
+
+      int off = snprintf(buf, bufSize - 1, "%s(%u): ", record->filename_, record->lineNumber_);
+      std::string spec;
+
+      const char *p = format;
+      while (*p != '\0' && off >= 0 && (size_t)off < bufSize - 1)
+      {
+         if (*p != '%')
+         {
+            buf[off++] = *p++;
+            continue;
+         }
+         if (p[1] == '%')
+         {
+            buf[off++] = '%';
+            p += 2;
+            continue;
+         }
+
+         // the normalised format only has fixed width and precision and the ll and L modifiers
+         const char *begin = p++;
+         while (*p != '\0' && strchr("-+ #0'.0123456789lL", *p) != 0)
+         {
+            ++p;
+         }
+         char conversion = *p++;
+         spec.assign(begin, p);
+
+         int written = 0;
+         switch (conversion)
+         {
+         case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+         {
+            long long value;
+            memcpy(&value, args, sizeof(value));
+            written = snprintf(buf + off, bufSize - off, spec.c_str(), value);
+            args += SlotSize;
+            break;
+         }
+         case 'c':
+         {
+            int value;
+            memcpy(&value, args, sizeof(value));
+            written = snprintf(buf + off, bufSize - off, spec.c_str(), value);
+            args += SlotSize;
+            break;
+         }
+         case 'p':
+         {
+            void *value;
+            memcpy(&value, args, sizeof(value));
+            written = snprintf(buf + off, bufSize - off, spec.c_str(), value);
+            args += SlotSize;
+            break;
+         }
+         case 's':
+         {
+            uint32_t stringLength;
+            memcpy(&stringLength, args, sizeof(stringLength));
+            written = snprintf(buf + off, bufSize - off, spec.c_str(), args + SlotSize);
+            args += SlotSize + Align(stringLength + 1);
+            break;
+         }
+         default:
+            if (spec[spec.size() - 2] == 'L')
+            {
+               long double value;
+               memcpy(&value, args, sizeof(value));
+               written = snprintf(buf + off, bufSize - off, spec.c_str(), value);
+               args += Align(sizeof(value));
+            }
+            else
+            {
+               double value;
+               memcpy(&value, args, sizeof(value));
+               written = snprintf(buf + off, bufSize - off, spec.c_str(), value);
+               args += SlotSize;
+            }
+            break;
+         }
+
+         if (written < 0)
+         {
+            break;
+         }
+         off += written;
+      }
+
+      if (off < 0)
+      {
+         off = 0;
+      }
+      if ((size_t)off > bufSize - 1)
+      {
+         off = static_cast<int>(bufSize - 1);
+      }
+      buf[off] = '\0';
+      return off;
+   }
+
+   // write out everything in one ring, the caller holds drainLock_. Returns false if it was empty
+   bool DrainRing(LogRing *ring, char *buf, size_t bufSize)
+   {
+      bool any = false;
+      size_t tail = ring->tail_.load(memory_order_relaxed);
+      size_t head = ring->head_.load(memory_order_acquire);
+      while (tail != head)
+      {
+         size_t pos = tail & (RingSize - 1);
+         const LogRecord *record = reinterpret_cast<const LogRecord *>(ring->buffer_ + pos);
+         if (record->size_ == 0)
+         {
+            tail += RingSize - pos;
+            continue;
+         }
+
+         int off = FormatRecord(record, buf, bufSize - 2);
+         MamaLogLevel logLevel = record->logLevel_;
+         tail += record->size_;
+         ring->tail_.store(tail, memory_order_release);
+
+         // Strip one trailing '\n', as for the synchronous lines
+         if ((0 < off) && (buf[off - 1] == '\n'))
+         {
+            buf[--off]  = '\0';
+         }
+         Tick42Logging::CTick42Logger::Output(logLevel, buf, off, false);
+         any = true;
+      }
+      ring->tail_.store(tail, memory_order_release);
+      return any;
+   }
+
+   // write out everything in the rings, returns false if they were all empty
+   bool DrainRings(char *buf, size_t bufSize)
+   {
+      bool any = false;
+      size_t count = ringCount_.load(memory_order_acquire);
+      for (size_t index = 0; index < count; ++index)
+      {
+         utils::thread::T42Lock drain(&drainLock_);
+         any = DrainRing(rings_[index], buf, bufSize) || any;
+      }
+
+      if (any && Tick42Logging::CTick42Logger::logConsole_)
+      {
+         utils::thread::T42Lock sync(&Tick42Logging::CTick42Logger::lock_);
+         fflush(stdout);
+      }
+      return any;
+   }
+
+   void* LogThreadFunc(void *)
+   {
+      char *buf = new char[Tick42Logging::CTick42Logger::logBufferSize_];
+      size_t bufSize = Tick42Logging::CTick42Logger::logBufferSize_;
+      while (runLogThread_.load(memory_order_acquire))
+      {
+         if (!DrainRings(buf, bufSize))
+         {
+            Sleep(1);
+         }
+      }
+
+      // pick up anything logged while we were stopping
+      DrainRings(buf, bufSize);
+      delete [] buf;
+      return 0;
+   }
+}
+
 namespace Tick42Logging
 {
    //////////////////////////////////////////////////////////////////////////
@@ -46,6 +634,13 @@ namespace Tick42Logging
       : filename_(filename)
       , lineNumber_(lineNumber)
       , logLevel_(logLevel)
+   {
+      enabled_ = Enabled(logLevel);
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+   //
+   void CTick42Logger::Initialise()
    {
       // Initialize the statics, if we haven't already done so
       if (!once_)
@@ -66,8 +661,6 @@ namespace Tick42Logging
          logODS_ = (0 != val) ? (0 != properties_GetPropertyValueAsBoolean(val)) : false;
 #endif
       }
-
-      enabled_ = (MAMA_LOG_LEVEL_OFF != maxLogLevel_) && (logLevel <= maxLogLevel_);
    }
 
    //////////////////////////////////////////////////////////////////////////
@@ -80,40 +673,125 @@ namespace Tick42Logging
       // Only process if this logging level is enabled
       if (enabled_)
       {
-         char *buf = static_cast<char *>(alloca(logBufferSize_ * sizeof(*buf)));
-         int off = snprintf(buf, logBufferSize_ - 1, "%s(%u): ", filename_, lineNumber_);
-         off += vsnprintf(buf + off, logBufferSize_ - off, format, ap);
-
-         // Strip one trailing '\n', if there is one
-         // If you want a blank line in the debug log file, then include
-         // two '\n' sequences at the end of your format string
-         if ((0 < off) && (buf[off - 1] == '\n'))
+         LogRing *ring = logAsync_.load(memory_order_relaxed) ? ThreadRing() : 0;
+         bool written = false;
+         char *staging = 0;
+         if (ring != 0)
          {
-            buf[--off]  = '\0';
+            staging = static_cast<char *>(alloca(logBufferSize_ * sizeof(*staging)));
+            va_list capture;
+            va_copy(capture, ap);
+            size_t size = CaptureRecord(staging, logBufferSize_, logLevel_, filename_, lineNumber_, format, &capture);
+            va_end(capture);
+
+            written = (size != 0) && ring->Push(staging, size);
          }
 
-#ifdef _WIN32
-         if (logODS_)
+         if (!written && ring != 0)
          {
-            buf[off++] = '\r';
-            buf[off++] = '\n';
-            buf[off] = '\0';
-            OutputDebugStringA(buf);
+            // write out what this thread has already queued first, so that its lines stay in order
+            utils::thread::T42Lock drain(&drainLock_);
+            DrainRing(ring, staging, logBufferSize_);
+            Write(logLevel_, filename_, lineNumber_, format, ap);
          }
-         else
-#endif // _WIN32
+         else if (!written)
          {
-            mama_log(logLevel_, "%s", buf);
+            Write(logLevel_, filename_, lineNumber_, format, ap);
          }
+      }
+      va_end(ap);
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+   //
+   void CTick42Logger::Write(MamaLogLevel logLevel, const char *filename, size_t lineNumber, const char *format, va_list ap)
+   {
+      char *buf = static_cast<char *>(alloca(logBufferSize_ * sizeof(*buf)));
+      int off = snprintf(buf, logBufferSize_ - 1, "%s(%u): ", filename, (unsigned int)lineNumber);
+      off += vsnprintf(buf + off, logBufferSize_ - off, format, ap);
+
+      // Strip one trailing '\n', if there is one
+      // If you want a blank line in the debug log file, then include
+      // two '\n' sequences at the end of your format string
+      if ((0 < off) && (buf[off - 1] == '\n'))
+      {
+         buf[--off]  = '\0';
+      }
+
+      Output(logLevel, buf, off, true);
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+   //
+   void CTick42Logger::Output(MamaLogLevel logLevel, char *buf, int off, bool flush)
+   {
+#ifdef _WIN32
+      if (logODS_)
+      {
+         buf[off++] = '\r';
+         buf[off++] = '\n';
+         buf[off] = '\0';
+         OutputDebugStringA(buf);
+      }
+      else
+#endif // _WIN32
+      {
+         mama_log(logLevel, "%s", buf);
+      }
 
-         if (logConsole_)
+      if (logConsole_)
+      {
+         utils::thread::T42Lock sync(&lock_);
+         fprintf(stdout, "%s\n", buf);
+         if (flush)
          {
-            utils::thread::T42Lock sync(&lock_);
-            fprintf(stdout, "%s\n", buf);
             fflush(stdout);
          }
       }
-      va_end(ap);
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+   //
+   bool CTick42Logger::StartAsync()
+   {
+      Initialise();
+
+      const char *val = properties_Get(mamaInternal_getProperties(), "mama.tick42rmds.asynclogging");
+      bool async = (0 != val) ? (0 != properties_GetPropertyValueAsBoolean(val)) : false;
+      if (!async || runLogThread_.load(memory_order_relaxed) || MAMA_LOG_LEVEL_OFF == maxLogLevel_)
+      {
+         return false;
+      }
+
+      runLogThread_.store(true, memory_order_release);
+      if (0 != wthread_create(&logThread_, 0, LogThreadFunc, 0))
+      {
+         runLogThread_.store(false, memory_order_release);
+         return false;
+      }
+
+      logAsync_.store(true, memory_order_release);
+      return true;
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+   //
+   void CTick42Logger::StopAsync()
+   {
+      if (!runLogThread_.load(memory_order_relaxed))
+      {
+         return;
+      }
+
+      // new lines go straight out again, the thread writes out what was left in the rings before it exits
+      logAsync_.store(false, memory_order_release);
+      runLogThread_.store(false, memory_order_release);
+      wthread_join(logThread_, 0);
+
+      // a thread that saw async logging still on can have pushed its line after the background thread's last drain
+      char *buf = new char[logBufferSize_];
+      DrainRings(buf, logBufferSize_);
+      delete [] buf;
    }
 } // namespace
 
@@ -67,13 +67,44 @@ namespace Tick42Logging
       //
       CTick42Logger(const char *filename, size_t lineNumber, MamaLogLevel logLevel);
       void operator()(const char *format, ...);
+
+      static void Initialise();
+
+      static bool Enabled(MamaLogLevel logLevel)
+      {
+         if (!once_)
+         {
+            Initialise();
+         }
+         return (MAMA_LOG_LEVEL_OFF != maxLogLevel_) && (logLevel <= maxLogLevel_);
+      }
+
+      // With mama.tick42rmds.asynclogging set, the calling thread just copies the format and its arguments into a
+      // ring of its own and a background thread formats and writes the lines. A line that doesnt fit in the ring is
+      // written on the calling thread, after the lines already in its ring. Lines from different threads may be
+      // written slightly out of order
+      static bool StartAsync();
+      // write out what is left in the rings and stop the background thread
+      static void StopAsync();
+
+      // format and write one line on the calling thread
+      static void Write(MamaLogLevel logLevel, const char *filename, size_t lineNumber, const char *format, va_list ap);
+      static void Output(MamaLogLevel logLevel, char *buf, int len, bool flush);
    };
 }
 
-#define t42log_debug Tick42Logging::CTick42Logger(__FILE__, __LINE__, MAMA_LOG_LEVEL_FINEST)
-#define t42log_info  Tick42Logging::CTick42Logger(__FILE__, __LINE__, MAMA_LOG_LEVEL_NORMAL)
-#define t42log_warn  Tick42Logging::CTick42Logger(__FILE__, __LINE__, MAMA_LOG_LEVEL_WARN)
-#define t42log_error Tick42Logging::CTick42Logger(__FILE__, __LINE__, MAMA_LOG_LEVEL_ERROR)
+// The arguments of a call are only evaluated if its level is enabled. Defining T42LOG_NO_DEBUG compiles the
+// t42log_debug calls out altogether
+#define T42LOG_AT_LEVEL(level) if (!Tick42Logging::CTick42Logger::Enabled(level)) {} else Tick42Logging::CTick42Logger(__FILE__, __LINE__, level)
+
+#ifdef T42LOG_NO_DEBUG
+#define t42log_debug if (true) {} else Tick42Logging::CTick42Logger(__FILE__, __LINE__, MAMA_LOG_LEVEL_FINEST)
+#else
+#define t42log_debug T42LOG_AT_LEVEL(MAMA_LOG_LEVEL_FINEST)
+#endif
+#define t42log_info  T42LOG_AT_LEVEL(MAMA_LOG_LEVEL_NORMAL)
+#define t42log_warn  T42LOG_AT_LEVEL(MAMA_LOG_LEVEL_WARN)
+#define t42log_error T42LOG_AT_LEVEL(MAMA_LOG_LEVEL_ERROR)
 
 #else   // DISABLE_DEBUG_FILELINE
 
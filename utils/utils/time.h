@@ -32,6 +32,7 @@
 #include <Windows.h>
 #else
 #include <sys/timeb.h>
+#include <time.h>
 #endif
 
 
@@ -90,6 +91,52 @@ inline int32_t GetMilliSpan( int32_t now, int32_t start)
     return span;
 }
 
+/**
+ *  @brief A monotonic clock for timing short intervals
+ *  @return microseconds since an arbitrary starting point
+ */
+inline uint64_t GetMicroCount()
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((counter.QuadPart / frequency.QuadPart) * 1000000
+        + ((counter.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+/**
+ *  @brief A monotonic clock for timing very short intervals, such as the processing of a single message
+ *  @return nanoseconds since an arbitrary starting point
+ */
+inline uint64_t GetNanoCount()
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((counter.QuadPart / frequency.QuadPart) * 1000000000
+        + ((counter.QuadPart % frequency.QuadPart) * 1000000000) / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
 time_t GetSeconds(uint32_t year, uint32_t month, uint32_t day);
 
 } /*namespace utils*/ } /*namespace time*/